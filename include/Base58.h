@@ -36,4 +36,28 @@ uint32_t decodeBase58(const char *string,		// The base58 encoded string
 					   uint32_t maxOutputLength, // The maximum output length of the binary buffer.
 					   bool outputIsBigEndian);		// Whether or not the output is considered big endian and therefore needs to be byte reverse; true for bitcoin addresses
 
+// A fixed width codec for 25 byte payloads; the version byte, 20 byte hash and 4 byte checksum of a bitcoin address.
+// The payload is held as seven 32 bit limbs and converted 58^5 at a time with 64 bit arithmetic, with a fixed
+// number of steps, rather than a byte and a digit at a time like the general routines above.  Each leading zero
+// byte is a leading '1', as in the general encoding, so the strings are identical.
+#define BASE58_ADDRESS_SIZE 36	// The longest encoding of 25 bytes (35 characters) and the terminating zero
+
+// Encodes the 25 bytes, most significant first; returns the length of the string
+uint32_t encodeBase58Address(const uint8_t address[25],char output[BASE58_ADDRESS_SIZE]);
+
+// Decodes a string which is exactly 25 bytes long; returns false if it is not, or holds a character outside the
+// base58 alphabet.  The checksum is not checked.
+bool decodeBase58Address(const char *string,uint8_t address[25]);
+
+// As decodeBase58Address, and also returns false if the last 4 bytes are not the checksum of the first 21; the first
+// four bytes of the double SHA256 of them.  The decoded bytes are stored either way.
+bool decodeBase58Check(const char *string,uint8_t address[25]);
+
+// Encodes many addresses at once; outputs[i] receives the string of addresses[i]
+void encodeBase58AddressBatch(uint32_t count,const uint8_t (*addresses)[25],char (*outputs)[BASE58_ADDRESS_SIZE]);
+
+// Decodes many strings at once, with their checksums computed by computeDoubleSHA256Batch; valid[i] is set as
+// decodeBase58Check would return for strings[i].  Returns the number of valid strings.
+uint32_t decodeBase58CheckBatch(uint32_t count,const char *const *strings,uint8_t (*addresses)[25],bool *valid);
+
 #endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Measures encoding and decoding bitcoin addresses with the general base58 routines against the fixed width codec,
+// one address at a time and in batches, and checks every form produces the same strings, bytes and checksum results.
+namespace base58bench
+{
+
+class Base58Bench
+{
+public:
+	static Base58Bench *create(void);
+
+	// Encode and decode 'count' random addresses in each test; returns false if any codec disagreed with the general one
+	virtual bool run(uint32_t count) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~Base58Bench(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,37 @@
+#ifndef BECH32_H
+
+#define BECH32_H
+
+#include <stdint.h>
+
+// Encodes and decodes segregated witness addresses; the human readable part ('bc' on the main network), a
+// separator, the witness version and program as 5 bit characters and a six character checksum.
+//
+// https://github.com/bitcoin/bips/blob/master/bip-0173.mediawiki (Bech32; witness version 0)
+// https://github.com/bitcoin/bips/blob/master/bip-0350.mediawiki (Bech32m; witness versions 1 to 16)
+//
+// The checksum is a BCH code computed five bits at a time; the generator terms for the five bits shifted out at each
+// step are looked up in a 32 entry table rather than tested bit by bit, and the characters are decoded with a
+// 128 entry table.
+
+#define BECH32_ADDRESS_SIZE 91		// The longest address allowed (90 characters) and the terminating zero
+#define BECH32_MAX_PROGRAM 40		// The longest witness program
+
+// Encodes a witness program; version 0 is Bech32 and every later version Bech32m.  Returns the length of the
+// address, or zero if the version is above 16, the program is not 2 to 40 bytes long (exactly 20 or 32 for
+// version 0) or the human readable part is not lower case ASCII.
+uint32_t encodeSegwitAddress(const char *hrp,uint32_t witnessVersion,const uint8_t *program,uint32_t programLength,char output[BECH32_ADDRESS_SIZE]);
+
+// Decodes an address with this human readable part, in either case but not mixed; returns false if it is not a valid
+// address or its checksum is not the one its witness version requires
+bool decodeSegwitAddress(const char *hrp,const char *address,uint32_t &witnessVersion,uint8_t program[BECH32_MAX_PROGRAM],uint32_t &programLength);
+
+// Encodes many witness programs at once into the caller's buffers; lengths[i] receives the length of outputs[i],
+// zero if it could not be encoded
+void encodeSegwitAddressBatch(const char *hrp,uint32_t count,const uint8_t *witnessVersions,const uint8_t *const *programs,const uint32_t *programLengths,char (*outputs)[BECH32_ADDRESS_SIZE],uint32_t *lengths);
+
+// Decodes many addresses at once into the caller's buffers; valid[i] is set as decodeSegwitAddress would return for
+// addresses[i].  Returns the number of valid addresses.
+uint32_t decodeSegwitAddressBatch(const char *hrp,uint32_t count,const char *const *addresses,uint8_t *witnessVersions,uint8_t (*programs)[BECH32_MAX_PROGRAM],uint32_t *programLengths,bool *valid);
+
+#endif
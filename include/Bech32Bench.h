@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Checks the Bech32/Bech32m codec against the BIP173 and BIP350 test vectors, round trips random witness programs
+// through it one at a time and in batches, and measures its throughput next to the base58 address codec.
+namespace bech32bench
+{
+
+class Bech32Bench
+{
+public:
+	static Bech32Bench *create(void);
+
+	// Encode and decode 'count' random witness programs in each test; returns false if any check failed
+	virtual bool run(uint32_t count) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~Bech32Bench(void)
+	{
+	}
+};
+
+}
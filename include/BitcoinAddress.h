@@ -49,11 +49,11 @@
 // integer numbers.
 // 
 //
-// Converting bitcoin addresses from binary to ASCII and ASCII to binary is generally considered as utility function and not
-// subject to full performance considerations.
+// Converting bitcoin addresses from binary to ASCII and ASCII to binary goes through the fixed width base58 codec in Base58.h,
+// since exports render millions of addresses.
 #include <stdint.h>
 
-// Converts an ASCII bitcoin address into the 25 byte version.
+// Converts an ASCII bitcoin address into the 25 byte version; returns false if it is not 25 bytes or the checksum does not match
 bool bitcoinAsciiToAddress(const char *input,uint8_t output[25]); // convert an ASCII bitcoin address into binary.
 
 // Converts a 25 byte bitcoin address into the ASCII versions
@@ -77,10 +77,31 @@ bool bitcoinPublicKeyToAddress(const uint8_t input[65], // The 65 bytes long ECD
 bool bitcoinCompressedPublicKeyToAddress(const uint8_t input[33], // The 65 bytes long ECDSA public key; first byte will always be 0x4 followed by two 32 byte components
 							   uint8_t output[25]);		// A bitcoin address (in binary( is always 25 bytes long.
 
+// Computes the hash160 (the RIPEMD160 hash of the SHA256 hash) of many public keys at once; what an address encodes.
+// keyLengths[i] is 33 for a compressed key and 65 for a full key.  The SHA256 hashes are computed by computeSHA256Batch
+// and the RIPEMD160 hashes by computeRIPEMD160Batch, so with AVX2 or AVX-512 many keys are hashed at once.
+void bitcoinPublicKeysToHash160(uint32_t count,const uint8_t *const *keys,const uint32_t *keyLengths,uint8_t (*hashes)[20]);
+
+// Converts many public keys into 25 byte addresses at once; the same as bitcoinPublicKeyToAddress for each key 65 bytes
+// long and bitcoinCompressedPublicKeyToAddress for each key 33 bytes long.  The address of a key whose first byte
+// does not match its length is zeroed.  Returns the number of addresses produced.
+uint32_t bitcoinPublicKeysToAddresses(uint32_t count,const uint8_t *const *keys,const uint32_t *keyLengths,uint8_t (*addresses)[25]);
+
 // If someone gives you a bitcoin address as the already encoded 20 byte RIPEMD, then this will produce the 25 byte 'address' which has the padding and checksum added to it.
 // This puts the one byte header and the 4 byte checksum to conver a 20 byte RIPEMD public key into the padded 25 byte address version
 void bitcoinRIPEMD160ToAddress(const uint8_t ripeMD160[20],uint8_t address[25]);
 
 void bitcoinRIPEMD160ToScriptAddress(const uint8_t ripeMD160[20],uint8_t address[25]);
 
+// Converts a segregated witness program into its ASCII address on the main network ('bc1...'); Bech32 for witness
+// version 0 and Bech32m for later versions (see Bech32.h).  Returns false if the program has no address.
+bool bitcoinWitnessProgramToAscii(uint32_t witnessVersion,const uint8_t *program,uint32_t programLength,char *output,uint32_t maxOutputLen);
+
+// Converts an ASCII main network witness address back into its version and program (2 to 40 bytes)
+bool bitcoinAsciiToWitnessProgram(const char *input,uint32_t &witnessVersion,uint8_t program[40],uint32_t &programLength);
+
+// Converts an ASCII main network address (pay to public key hash, pay to script hash or witness) into the output
+// script which pays to it; at most 42 bytes.  Returns false if the address is not valid.
+bool bitcoinAsciiToOutputScript(const char *input,uint8_t script[42],uint32_t &scriptLength);
+
 #endif
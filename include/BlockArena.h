@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// A bump allocator for the memory needed while parsing a block (the transaction, input and output
+// arrays and the raw block data itself).  Allocation is a pointer increment; 'reset' makes all of the
+// memory available again in constant time so the next block reuses it.  The arena grows to the size of
+// the largest block parsed so far rather than being sized for the worst possible block up front.
+namespace blockarena
+{
+
+class BlockArena
+{
+public:
+	BlockArena(void)
+	{
+	}
+
+	~BlockArena(void)
+	{
+		freeChunks();
+	}
+
+	// Allocate uninitialized memory with this alignment (which must be a power of two).
+	// The memory remains valid until the next call to 'reset'.
+	inline void *alloc(size_t size,size_t alignment=16)
+	{
+		size_t offset = (mChunkUsed + (alignment-1)) & ~(alignment-1);
+		if ( (offset+size) > mChunkSize )
+		{
+			return allocSlow(size,alignment);
+		}
+		mChunkUsed = offset + size;
+		return mChunk + offset;
+	}
+
+	// Allocate and default construct an array of 'count' objects.  Destructors are never run, so this
+	// is only used for the simple block chain data structures.
+	template <typename T>
+	T *allocArray(size_t count)
+	{
+		T *ret = static_cast< T *>(alloc(sizeof(T)*count,alignof(T)));
+		for (size_t i=0; i<count; i++)
+		{
+			new (&ret[i]) T;
+		}
+		return ret;
+	}
+
+	// Release everything allocated since the last reset.  If the previous block needed more than one chunk
+	// they are merged into a single chunk large enough to hold it, so the arena settles at one chunk.
+	void reset(void);
+
+	// When enabled, chunks are requested from the operating system backed by huge (large) pages where
+	// available; this reduces TLB pressure when decoding very large blocks.  Takes effect on the next chunk.
+	void setHugePages(bool state)
+	{
+		mHugePages = state;
+	}
+
+	// Total memory reserved by the arena
+	size_t getCapacity(void) const
+	{
+		return mCapacity;
+	}
+
+private:
+	class Chunk
+	{
+	public:
+		uint8_t	*mData;
+		size_t	mSize;
+	};
+
+	void *allocSlow(size_t size,size_t alignment);
+	void addChunk(size_t size);
+	void freeChunks(void);
+
+	uint8_t					*mChunk{nullptr};		// The chunk currently being allocated from
+	size_t					mChunkSize{0};
+	size_t					mChunkUsed{0};
+	size_t					mChunkIndex{0};			// Index of the current chunk in mChunks
+	size_t					mCapacity{0};
+	bool					mHugePages{false};
+	std::vector< Chunk >	mChunks;				// Every chunk reserved so far; in order of allocation
+};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include "BlockChain.h"
+
+// A memory budgeted cache of parsed blocks keyed by block height.
+// Repeated and adjacent interactive queries are answered from memory rather than re-reading and
+// re-parsing the block from disk.  Blocks which fall out of the parsed set can optionally be kept
+// snappy compressed, and neighbouring heights are loaded ahead of time by a background thread.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace blockcache
+{
+
+class BlockCacheStats
+{
+public:
+	uint64_t	mHits{0};			// Lookups answered from a parsed block already in memory
+	uint64_t	mColdHits{0};		// Lookups answered by decompressing and re-parsing a cold block
+	uint64_t	mMisses{0};			// Lookups which had to read the block from disk
+	uint64_t	mPrefetched{0};		// Blocks loaded by the background prefetch thread
+	uint64_t	mHotBytes{0};		// Memory used by parsed blocks
+	uint64_t	mColdBytes{0};		// Memory used by compressed blocks
+	uint32_t	mHotCount{0};		// Number of parsed blocks in the cache
+	uint32_t	mColdCount{0};		// Number of compressed blocks in the cache
+};
+
+class BlockCache
+{
+public:
+	// Create the cache. 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'.
+	static BlockCache *create(const blocks::Blocks *blocks,const char *dataDir,uint64_t byteBudget);
+
+	// Returns the parsed block at this height, or null if it could not be read.
+	// The returned block remains valid until the next call to getBlock.
+	virtual const BlockChain::Block *getBlock(uint32_t blockHeight) = 0;
+
+	// Set the maximum number of bytes the cache may use; blocks are evicted least recently used first
+	virtual void setByteBudget(uint64_t byteBudget) = 0;
+
+	// When enabled, blocks evicted from the parsed set are kept snappy compressed until the budget requires they be dropped
+	virtual void setCompressColdBlocks(bool state) = 0;
+
+	// Number of heights on either side of each lookup which are loaded by the background thread; zero disables prefetching
+	virtual void setPrefetchDistance(uint32_t distance) = 0;
+
+	// Number of threads used to decode the transactions of a block on a cache miss
+	virtual void setDecodeThreadCount(uint32_t threadCount) = 0;
+
+	// Check the merkle root and witness commitment of each block as it is parsed; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	virtual void getStats(BlockCacheStats &stats) const = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~BlockCache(void)
+	{
+	}
+};
+
+}
@@ -56,6 +56,8 @@ public:
 			responseScriptLength  = 0;
 			responseScript = 0;
 			inputValue = 0;
+			witnessCount = 0;
+			witness = 0;
 		}
 		const uint8_t	*transactionHash;			// The hash of the input transaction; this a is a pointer to the 32 byte hash
 		uint32_t		transactionIndex;			// The index of the transaction
@@ -63,6 +65,8 @@ public:
 		const uint8_t	*responseScript;			// The response script.   This gets run on the bitcoin script virtual machine; see bitcoin docs
 		uint32_t		sequenceNumber;				// The 'sequence' number
 		uint64_t		inputValue;					// The amount of value this input represents (based on the valid transaction hash)
+		uint32_t		witnessCount;				// Number of items on the segregated witness stack for this input; zero for legacy transactions
+		const uint8_t	*witness;					// Points to the serialized witness stack items (each a variable length integer length followed by the data)
 	};
 
 	enum KeyType
@@ -76,55 +80,89 @@ public:
 		KT_STEALTH,
 		KT_SCRIPT_HASH,
 		KT_ZERO_LENGTH,
+		KT_NULL_DATA,				// OP_RETURN followed by arbitrary data; unspendable
+		KT_WITNESS_PUBKEY_HASH,		// witness v0 with a 20 byte public key hash (P2WPKH)
+		KT_WITNESS_SCRIPT_HASH,		// witness v0 with a 32 byte script hash (P2WSH)
+		KT_TAPROOT,					// witness v1 with a 32 byte output key (P2TR)
+		KT_ANCHOR,					// witness v1 pay to anchor; no key
+		KT_WITNESS_UNKNOWN,			// a witness version and program with no defined meaning yet
 		KT_LAST
 	};
 
-	class OutputAddress
+	// The result of checking a block's merkle root and witness commitment against its transactions; see setVerifyMerkle
+	enum MerkleStatus
 	{
-	public:
-		OutputAddress(void)
-		{
-			memset(address,0,sizeof(address));
-		}
+		MS_UNCHECKED,
+		MS_VALID,
+		MS_ROOT_MISMATCH,			// the merkle root of the txids does not match the block header
+		MS_MUTATED,					// the root matches but two sibling hashes are identical; a duplicated run of transactions (CVE-2012-2459)
+		MS_COMMITMENT_MISMATCH,		// the witness commitment in the coinbase does not match the merkle root of the wtxids
+		MS_COMMITMENT_MISSING,		// transactions carry witness data but the coinbase has no usable witness commitment
+		MS_LAST
+	};
 
-		bool operator==(const OutputAddress &other) const
+	// A 20 byte hash160 (public key hash or script hash) or a 32 byte hash or witness program identifying the destination of an output.
+	// Unused trailing bytes are zero.
+	class OutputHash
+	{
+	public:
+		bool operator==(const OutputHash &other) const
 		{
-			return memcmp(address, other.address, sizeof(address)) == 0;
+			return memcmp(hash, other.hash, sizeof(hash)) == 0;
 		}
 
-		uint8_t	address[25];
+		uint8_t	hash[32];
 	};
 
-	// Each transaction has a set of outputs; this class defines that output data stream.
-	class BlockOutput
+	// The outputs are stored as columns; one entry per output in each array.  The columns for the whole block are
+	// held by the Block and each transaction has a view of the same columns which begins at its first output.
+	// The ASCII address of an output is not stored; use 'getOutputAddress' to render it when it is needed.
+	class BlockOutputs
 	{
 	public:
-		BlockOutput(void)
+		BlockOutputs(void)
+		{
+			scriptBase = 0;
+			values = 0;
+			scriptOffsets = 0;
+			scriptLengths = 0;
+			keyTypes = 0;
+			keyCounts = 0;
+			hashes = 0;
+		}
+
+		// Returns the output script for this output; null if the script is empty
+		inline const uint8_t *getScript(uint32_t index) const
 		{
-			value = 0;
-			challengeScriptLength = 0;
-			challengeScript = 0;
-			keyType = KT_UNKNOWN;
-			multiSigFormat = 0;
-			for (uint32_t i=0; i<5; i++)
-			{
-				publicKey[i] = 0;
-			}
-			signatureCount = 1;
-			keyTypeName = "UNKNOWN";
-			asciiAddress[0] = 0;
+			return scriptLengths[index] ? scriptBase + scriptOffsets[index] : 0;
 		}
-		uint64_t		value;					// value of the output (this is the actual value in BTC fixed decimal notation) @See bitcoin docs
-		uint32_t		challengeScriptLength;	// The length of the challenge script  (In theory this could be >32 bits; in practice it never will be.)
-		const uint8_t	*challengeScript;		// The contents of the challenge script.  This gets run on the bitcoin script virtual machine; see bitcoin docs
-		uint32_t		signatureCount;		// Number of keys in the output
-		KeyType			keyType;			// The type of key we encountered; it can be formulated in a number of ways
-		const char		*keyTypeName;		// ASCII representation of the keyType enum
-		uint32_t		multiSigFormat;	// bit flags identifying the format of each signature (compressed/uncompressed)
-		const uint8_t	*publicKey[MAX_MULTISIG];				// The public key output
-		OutputAddress	addresses[MAX_MULTISIG];
-		OutputAddress	multisig;			// The multisig address if there is one
-		char			asciiAddress[512];		// The full address in ASCII format
+
+		inline KeyType getKeyType(uint32_t index) const
+		{
+			return KeyType(keyTypes[index]);
+		}
+
+		// Returns a view of these columns which begins at output 'first'
+		inline BlockOutputs offset(uint32_t first) const
+		{
+			BlockOutputs ret;
+			ret.scriptBase = scriptBase;
+			ret.values = values + first;
+			ret.scriptOffsets = scriptOffsets + first;
+			ret.scriptLengths = scriptLengths + first;
+			ret.keyTypes = keyTypes + first;
+			ret.keyCounts = keyCounts + first;
+			ret.hashes = hashes + first;
+			return ret;
+		}
+
+		const uint8_t	*scriptBase;		// Output scripts are located at this address plus their script offset; this is the start of the block data
+		uint64_t		*values;			// value of the output (this is the actual value in BTC fixed decimal notation) @See bitcoin docs
+		uint32_t		*scriptOffsets;		// Offset of the output (challenge) script from 'scriptBase'
+		uint32_t		*scriptLengths;		// The length of the output script.  This gets run on the bitcoin script virtual machine; see bitcoin docs
+		uint8_t			*keyTypes;			// The KeyType of each output
+		uint8_t			*keyCounts;			// Number of public keys found in the output script; more than one for multisig and zero if the key is malformed or the output has no destination
+		OutputHash		*hashes;			// The hash identifying the destination; for multisig the hash160 of all of its key addresses
 	};
 
 	// Each block contains a series of transactions; each transaction with it's own set of inputs and outputs.  
@@ -137,21 +175,23 @@ public:
 			inputCount = 0;
 			inputs = 0;
 			outputCount = 0;
-			outputs = 0;
 			transactionIndex = 0;
+			hasWitness = false;
 		}
 		uint32_t		transactionVersionNumber;	// The transaction version number
 		uint32_t		inputCount;					// The number of inputs in the block; in theory this could be >32 bits; in practice it never will be.
 		BlockInput		*inputs;					// A pointer to the array of inputs
 		uint32_t		outputCount;				// The number of outputs in the block.
-		BlockOutput		*outputs;					// The outputs in the block; 64bit unsigned int for each output; kind of a fixed decimal representation of bitcoin; see docs
+		BlockOutputs	outputs;					// The outputs of this transaction; a view of the block's output columns
 		uint32_t		lockTime;					// The lock-time; currently always set to zero
 		// This is data which is computed when the file is parsed; it is not contained in the block chain file itself.
 		// This data can uniquely identify the specific transaction with information on how to go back to the seek location on disk and reread it
-		uint8_t			transactionHash[32];		// This is the hash for this transaction
+		uint8_t			transactionHash[32];		// This is the hash for this transaction (txid; excludes any witness data)
+		uint8_t			witnessHash[32];			// The hash of the full serialization including witness data (wtxid); same as the txid for legacy transactions
+		bool			hasWitness;					// True if this transaction was serialized with segregated witness data
 		uint32_t		transactionLength;			// The length of the data comprising this transaction.
 		uint32_t		fileIndex;					// which blk?????.dat file this transaction is contained in.
-		uint32_t		fileOffset;					// the seek file location of this transaction.
+		uint64_t		fileOffset;					// the seek file location of this transaction.
 		uint32_t		transactionIndex;			// the sequential index number of this transaction
 	};
 
@@ -164,6 +204,7 @@ public:
 			transactions = 0;
 			transactionCount = 0;
 			nextBlockHash = 0;
+			merkleStatus = MS_UNCHECKED;
 		}
 		uint32_t		blockLength;				// the length of this block
 		uint32_t		blockFormatVersion;			// The block format version
@@ -174,23 +215,75 @@ public:
 		uint32_t		nonce;						// This is a random number generated during the mining process
 		uint32_t		transactionCount;			// Number of transactions on this block
 		BlockTransaction *transactions;				// The array of transactions in this block.
+		BlockOutputs	outputs;					// The outputs of every transaction in the block, in order
 		// The following data items are not part of the block chain but are computed by convenience for the caller.
 		uint8_t			computedBlockHash[32];		// The computed block hash
 		uint32_t		blockIndex;					// Index of this block, the genesis block is considered zero
 		uint32_t		totalInputCount;			// Total number of inputs in all transactions.
 		uint32_t		totalOutputCount;			// Total number out outputs in all transaction.
 		uint32_t		fileIndex;					// Which file index we are on.
-		uint32_t		fileOffset;					// The file offset location where this block begins
+		uint64_t		fileOffset;					// The file offset location where this block begins
 		uint64_t		blockReward;				// Block redward in BTC
 		const uint8_t	*nextBlockHash;				// The hash of the next block in the block chain; null if this is the last block
 		bool			warning;					// there was a warning issued while processing this block.
+		MerkleStatus	merkleStatus;				// MS_UNCHECKED unless merkle verification is enabled
+	};
+
+	// The outputs spent by the inputs of a block; see 'resolveInputs'
+	class SpentOutputs
+	{
+	public:
+		SpentOutputs(void)
+		{
+			inputCount = 0;
+			unresolvedCount = 0;
+			slots = 0;
+		}
+
+		// Returns the entry in 'outputs' of the output spent by this input of the block; NO_SPENT_OUTPUT if there is none
+		inline uint32_t getSlot(uint32_t blockInputIndex) const
+		{
+			return slots[blockInputIndex];
+		}
+
+		uint32_t		inputCount;			// Number of inputs in the block
+		uint32_t		unresolvedCount;	// Inputs, other than coinbase inputs, whose previous output could not be located
+		const uint32_t	*slots;				// For each input of the block, in order, its entry in 'outputs'
+		BlockOutputs	outputs;			// The spent outputs, classified the same way as the outputs of a block
 	};
 
+	enum : uint32_t { NO_SPENT_OUTPUT = 0xFFFFFFFF };
+
+	// Render the address of this output as ASCII (Base58Check encoded, or Bech32/Bech32m for witness outputs) into
+	// 'dest' and return it.
+	// Multisig outputs list the address of every key; the address is computed from the output hash and
+	// script each time this is called.
+	static const char *getOutputAddress(const BlockOutputs &outputs, uint32_t index, char *dest, uint32_t destLength);
+
+	// Returns the ASCII name of this key type
+	static const char *getKeyTypeName(KeyType k);
+
+	// Returns the ASCII name of this merkle status
+	static const char *getMerkleStatusName(MerkleStatus s);
+
 	// Set the search for ASCII text length.  If this value is non-zero, then the parsing code will
 	// scan each block for significant amounts of ASCII text (textLen or >) and write the results to a file on disk called
 	// AsciiTextReport.txt
 	virtual void setSearchTextLength(uint32_t textLen) = 0;
 
+	// Set the number of threads used to decode the transactions of a single block.
+	// When this is greater than one, a fast serial pass locates the boundaries of every transaction and then
+	// decoding and txid/wtxid hashing is spread across a thread pool.  Zero or one decodes serially (the default).
+	virtual void setDecodeThreadCount(uint32_t threadCount) = 0;
+
+	// The memory for each parsed block comes from an arena which grows to fit the largest block seen.
+	// When enabled, the arena requests huge (large) pages from the operating system where they are available.
+	virtual void setHugePages(bool state) = 0;
+
+	// When enabled, the merkle root of every block parsed is rebuilt from its txids and the SegWit witness commitment
+	// from its wtxids; the result is stored in the block's 'merkleStatus' and any mismatch is logged as a warning.
+	virtual void setVerifyMerkle(bool state) = 0;
+
 	// Initial scan of the blockchain to build the hash table of blocks in forward order.
 	// Contrary to what you might think, or expect, the blocks in the file are not in the order of 
 	// 0,1,2,3,4 etc.  The reason for this is that sometimes, while the client is connected to the network, orphan blocks get written
@@ -206,6 +299,19 @@ public:
 	// Read this block in
 	virtual const Block *readBlock(uint32_t blockIndex) = 0;
 
+	// Parse a single block which has already been loaded into memory; for example one located directly through the LevelDB block index.
+	// The block data must remain valid for as long as the returned block is in use.
+	virtual const Block *processBlock(const void *blockData,		// The raw block data; starting with the 80 byte block header
+									  uint32_t blockLength,			// The length of the block data
+									  uint32_t blockIndex,			// The height of this block
+									  uint32_t fileIndex,			// Which blk?????.dat file the block was read from
+									  uint64_t fileOffset) = 0;		// The file offset of the block data
+
+	// Look up the output spent by every input of a block returned by 'readBlock' and fill in each input's 'inputValue'.
+	// The previous transactions are read in the order they are stored on disk, each region of the block files is read
+	// once, and only the outputs which are spent are decoded.  The result remains valid until the next call.
+	virtual const SpentOutputs *resolveInputs(const Block *b) = 0;
+
 	// print the contents of this block
 	virtual void printBlock(const Block *b) = 0;
 
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "FileInterface.h"
+#include "BlockChain.h"
+
+// Helpers to locate and read raw block data in the blk?????.dat files using the LevelDB block index
+class CBlockIndex;
+
+namespace blocks
+{
+class Blocks;
+}
+
+namespace blockfile
+{
+
+// Reads the raw block data (starting with the 80 byte block header) for this index entry from the
+// blk?????.dat files found in 'dataDir'.  Returns false, after printing the reason, if the block could not be read.
+bool readBlockData(const CBlockIndex &index,const char *dataDir,std::vector< uint8_t > &data);
+
+// Writes the path of the blk?????.dat file with this index in 'dataDir' into 'dest'
+const char *getBlockFileName(const char *dataDir,uint32_t fileIndex,char *dest,uint32_t destLength);
+
+// Returns the offset of the first block magic id (0xF9 0xBE 0xB4 0xD9) in 'data', or 'length' if there is none.
+// Sixteen positions are tested at a time with SSE2 or NEON where available.
+size_t findBlockMagic(const uint8_t *data,size_t length);
+
+// A read only memory mapping of a whole file, made through the FileInterface; used to walk the block files
+// without copying them.  The operating system is told the file will be read sequentially.
+class MappedFile
+{
+public:
+	MappedFile(void)
+	{
+	}
+
+	~MappedFile(void)
+	{
+		close();
+	}
+
+	// Map the whole file; returns false if it could not be opened or mapped.  An empty file maps successfully with no data.
+	bool open(const char *fileName);
+
+	void close(void);
+
+	const uint8_t *getData(void) const
+	{
+		return mData;
+	}
+
+	uint64_t getLength(void) const
+	{
+		return mLength;
+	}
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	FILE_INTERFACE	*mFile{nullptr};
+	const uint8_t	*mData{nullptr};
+	uint64_t		mLength{0};
+};
+
+// Reads blocks by height and parses them on one thread; a pass over the chain gives each of its threads a reader
+// of its own.  The parser is created with the first block, and each block is valid until the next is read.
+class BlockReader
+{
+public:
+	BlockReader(void)
+	{
+	}
+
+	~BlockReader(void);
+
+	// Reads and parses the block at this height, located with 'blocks' in the blk?????.dat files found in
+	// 'dataDir'.  Returns null if the block is not in the index, could not be read or could not be parsed.
+	const BlockChain::Block *read(const blocks::Blocks *blocks,const char *dataDir,uint32_t blockHeight);
+
+	// Parses block data which was read some other way, such as from a mapped block file
+	const BlockChain::Block *parse(const char *dataDir,const uint8_t *data,uint32_t length,uint32_t blockHeight,const CBlockIndex &index);
+
+	// Check the merkle root and witness commitment of every block parsed; see BlockChain::setVerifyMerkle
+	void setVerifyMerkle(bool state);
+
+	// The raw data of the last block read; empty if it could not be read
+	const std::vector< uint8_t > &getData(void) const
+	{
+		return mData;
+	}
+
+private:
+	BlockReader(const BlockReader &);
+	BlockReader &operator=(const BlockReader &);
+
+	BlockChain				*mParser{nullptr};
+	std::vector< uint8_t >	mData;
+	bool					mVerifyMerkle{false};
+};
+
+}
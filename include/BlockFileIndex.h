@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include "blocks.h"
+
+// A block index built directly from the blk?????.dat files, for when there is no bitcoin core LevelDB block
+// index to read; for example when all that is available is a copy of the block files.
+//
+// Each block file is memory mapped and walked on its own thread, hashing the block headers as it goes.
+// The headers are then linked into chains through a flat hash table keyed by block hash and the longest
+// chain is kept; stale blocks are left out.  The result is saved as a compact table of block locations and
+// headers next to the block files, so later runs load it directly as long as the block files are unchanged.
+namespace blockfileindex
+{
+
+class BlockFileIndex : public blocks::Blocks
+{
+public:
+	// Load the index saved in 'dataDir' by an earlier run if it still matches the block files found there;
+	// otherwise scan the block files using 'threadCount' threads (0=all cores) and save the new index.
+	static BlockFileIndex *create(const char *dataDir,uint32_t threadCount);
+
+	// Returns the number of blocks found in the block files which are not on the chain; zero if the index was loaded
+	virtual uint32_t getStaleCount(void) const = 0;
+
+	// Returns the length of the block at this height, not counting the magic id and length which precede it
+	virtual uint32_t getBlockLength(uint32_t blockHeight) const = 0;
+
+protected:
+	virtual ~BlockFileIndex(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// BIP158 basic compact block filters; for finding the few blocks which may pay to or spend from a set of
+// scripts, such as a wallet's addresses, without decoding the whole chain.
+//
+// The filter of a block is a Golomb coded set of every output script in the block (other than empty and
+// OP_RETURN scripts) and every output script its inputs spend.  Each distinct script is hashed with SipHash-2-4,
+// keyed by the first 16 bytes of the block hash, into the range [0, N*M) where N is the number of scripts; the
+// sorted hashes are stored as their differences, Golomb-Rice coded with P bits of remainder.  A script which is
+// in the block always matches; one which is not matches with a probability of about 1/M.
+//
+// The filters of a range of blocks are stored in a directory as BlockFilters.idx (a header and one record per
+// height; the filter's location and length, its SipHash key and its BIP157 filter header) and BlockFilters.dat
+// (each filter serialized as in BIP158, one after the other).  Both are memory mapped when the filters are opened.
+namespace blockfilter
+{
+
+#define BASIC_FILTER_P 19
+#define BASIC_FILTER_M 784931
+
+// Builds the BIP158 basic filter of a set of scripts for the block with this hash; 'filter' receives the
+// CompactSize element count followed by the Golomb-Rice coded set.  Duplicate scripts are counted once.
+void buildBasicFilter(const uint8_t blockHash[32],uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths,std::vector< uint8_t > &filter);
+
+// Returns true if any of the scripts may be in this serialized filter of the block with this hash
+bool matchBasicFilter(const uint8_t blockHash[32],const uint8_t *filter,uint32_t filterLength,uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths);
+
+class BlockFilterStats
+{
+public:
+	uint64_t	mBlockCount{0};
+	uint64_t	mElementCount{0};		// Scripts in every filter
+	uint64_t	mFilterBytes{0};		// Size of every filter
+	uint64_t	mRawBytes{0};			// Size of the blocks read
+	uint64_t	mUnresolvedInputs{0};	// Inputs whose spent output was not found, so its script is missing from the filter
+	uint64_t	mMerkleFailures{0};		// Blocks which failed merkle verification, when it is enabled
+};
+
+// Builds the filters of a range of the block chain
+class BlockFilterWriter
+{
+public:
+	// The chain is found by scanning the block headers of the blk?????.dat files in 'dataDir'
+	static BlockFilterWriter *create(const char *dataDir);
+
+	// Write the filters of the blocks [0,blockCount) into 'filterDir', which must already exist.  The spent scripts
+	// are read back from the block files with BlockChain::resolveInputs, which finds the transactions of the blocks
+	// read before, so the range starts at the genesis block.  Returns false if the filters could not be written.
+	virtual bool write(const char *filterDir,uint32_t blockCount,BlockFilterStats &stats) = 0;
+
+	// Check the merkle root and witness commitment of every block read; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~BlockFilterWriter(void)
+	{
+	}
+};
+
+class BlockFilters
+{
+public:
+	// Returns null if the filters in 'filterDir' could not be opened
+	static BlockFilters *create(const char *filterDir);
+
+	virtual uint32_t getBlockCount(void) const = 0;
+
+	// Returns the serialized filter of the block at this height and its length; null if out of range
+	virtual const uint8_t *getFilter(uint32_t blockHeight,uint32_t &filterLength) const = 0;
+
+	// Returns the BIP157 filter header of the block at this height; the double SHA256 of the filter's hash and the
+	// previous block's filter header
+	virtual const uint8_t *getFilterHeader(uint32_t blockHeight) const = 0;
+
+	// Tests the scripts against the filter of every block in [firstBlock,firstBlock+blockCount), spread across
+	// 'threadCount' threads (zero for every core), and returns the heights which may hold any of them, in order.
+	// False positives are expected; the caller decodes the blocks returned to confirm them.
+	virtual void match(uint32_t threadCount,uint32_t firstBlock,uint32_t blockCount,uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths,std::vector< uint32_t > &blockHeights) const = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~BlockFilters(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Checks the integrity of the raw blk?????.dat files and harvests the blocks which are not part of the
+// main chain.  Every file is walked from start to finish on a pool of threads; each block found has its
+// header hashed and is cross referenced against the LevelDB block index.  Reports damaged regions,
+// truncated blocks, gaps of zeroes between blocks, the zero padding preallocated at the end of the files,
+// index entries whose block could not be found, and stale (or orphaned) blocks which the index does not
+// place on the main chain.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace blockfsck
+{
+
+class BlockFsck
+{
+public:
+	// 'blocks' is the block index to cross reference against the blk?????.dat files found in 'dataDir'
+	static BlockFsck *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Scan every block file using 'threadCount' threads (0=all cores).  A summary is printed to the console
+	// and every finding is written to 'reportFileName'.  Returns true if no damage was found.
+	virtual bool run(uint32_t threadCount,const char *reportFileName) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~BlockFsck(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+// A cursor over a buffer of serialized bitcoin data with the primitive decoders used throughout the code
+// base; fixed size little endian integers, 32 byte hashes, the 'CompactSize' variable length integer used by
+// the block and transaction format, and the base-128 'VARINT' used by bitcoin core's LevelDB records.
+//
+// The reader is parameterised on a checking policy.  A 'Checked' reader tests every read against the end of
+// the buffer; a read which would go past the end returns zero (or a pointer to zeroes), leaves the cursor at
+// the end of the buffer and sets a sticky overflow flag which the caller tests once when it is done.
+// An 'Unchecked' reader only asserts; it is meant for data which has already been walked in full by a
+// checked reader, so the bounds checks are paid once per block rather than on every field.
+//
+// All reads go through memcpy so the data does not need to be aligned.
+namespace bytereader
+{
+
+class Checked
+{
+public:
+	static const bool IS_CHECKED = true;
+};
+
+class Unchecked
+{
+public:
+	static const bool IS_CHECKED = false;
+};
+
+template < typename Policy >
+class ByteReader
+{
+public:
+	ByteReader(void)
+	{
+	}
+
+	ByteReader(const void *begin,const void *end)
+	{
+		setBuffer(begin,end);
+	}
+
+	// Position the cursor at 'begin'; reads may not go past 'end'.  Clears the overflow flag.
+	inline void setBuffer(const void *begin,const void *end)
+	{
+		mRead = static_cast< const uint8_t *>(begin);
+		mEnd = static_cast< const uint8_t *>(end);
+		mOverflow = false;
+	}
+
+	inline uint8_t readU8(void)
+	{
+		uint8_t ret = 0;
+		if ( canRead(sizeof(ret)) )
+		{
+			ret = *mRead;
+			mRead++;
+		}
+		return ret;
+	}
+
+	inline uint16_t readU16(void)
+	{
+		return readValue< uint16_t >();
+	}
+
+	inline uint32_t readU32(void)
+	{
+		return readValue< uint32_t >();
+	}
+
+	inline uint64_t readU64(void)
+	{
+		return readValue< uint64_t >();
+	}
+
+	// Returns the address of the 32 byte hash at the cursor and advances past it
+	inline const uint8_t *readHash(void)
+	{
+		const uint8_t *ret = readBytes(32);
+		return ret ? ret : getZeroHash();
+	}
+
+	// Returns the address of the next 'length' bytes and advances past them; null if they are not all in the buffer
+	inline const uint8_t *readBytes(uint64_t length)
+	{
+		const uint8_t *ret = nullptr;
+		if ( canRead(length) )
+		{
+			ret = mRead;
+			mRead += length;
+		}
+		return ret;
+	}
+
+	inline void skip(uint64_t length)
+	{
+		if ( canRead(length) )
+		{
+			mRead += length;
+		}
+	}
+
+	// Reads a 'CompactSize' variable length integer; the format used for counts and lengths in blocks and transactions.
+	// https://en.bitcoin.it/wiki/Protocol_documentation#Variable_length_integer
+	inline uint64_t readCompactSize(void)
+	{
+		if ( mRead < mEnd && *mRead < 0xFD )
+		{
+			return *mRead++;
+		}
+		uint8_t marker = readU8();
+		uint64_t ret = marker;
+		if ( marker == 0xFD )
+		{
+			ret = readU16();
+		}
+		else if ( marker == 0xFE )
+		{
+			ret = readU32();
+		}
+		else if ( marker == 0xFF )
+		{
+			ret = readU64();
+		}
+		return ret;
+	}
+
+	// Reads bitcoin core's 'VARINT'; seven bits per byte, most significant group first, with one added to the
+	// accumulated value for every byte which has a continuation bit.  Matches ReadVarInt in bitcoin core's serialize.h.
+	// A value too large for 64 bits is treated as an overflow.
+	inline uint64_t readVarint(void)
+	{
+		uint64_t ret = 0;
+		for (;;)
+		{
+			uint8_t byte = readU8();
+			if ( Policy::IS_CHECKED && (mOverflow || ret > (UINT64_MAX >> 7)) )
+			{
+				mOverflow = true;
+				mRead = mEnd;
+				return 0;
+			}
+			ret = (ret << 7) | uint64_t(byte & 0x7F);
+			if ( !(byte & 0x80) )
+			{
+				break;
+			}
+			if ( Policy::IS_CHECKED && ret == UINT64_MAX )
+			{
+				mOverflow = true;
+				mRead = mEnd;
+				return 0;
+			}
+			ret++;
+		}
+		return ret;
+	}
+
+	// True if a read has gone past the end of the buffer since 'setBuffer'; always false for an unchecked reader
+	inline bool hasOverflow(void) const
+	{
+		return mOverflow;
+	}
+
+	inline const uint8_t *getPosition(void) const
+	{
+		return mRead;
+	}
+
+	inline void setPosition(const uint8_t *position)
+	{
+		assert(position <= mEnd);
+		mRead = position;
+	}
+
+	inline const uint8_t *getEnd(void) const
+	{
+		return mEnd;
+	}
+
+	inline size_t getRemaining(void) const
+	{
+		return size_t(mEnd - mRead);
+	}
+
+private:
+	// Returns true if 'size' bytes may be read at the cursor
+	inline bool canRead(uint64_t size)
+	{
+		if ( !Policy::IS_CHECKED )
+		{
+			assert(size <= uint64_t(mEnd - mRead));
+			return true;
+		}
+		if ( size <= uint64_t(mEnd - mRead) )
+		{
+			return true;
+		}
+		mOverflow = true;
+		mRead = mEnd;
+		return false;
+	}
+
+	template < typename T >
+	inline T readValue(void)
+	{
+		T ret = 0;
+		if ( canRead(sizeof(T)) )
+		{
+			memcpy(&ret,mRead,sizeof(T));
+			mRead += sizeof(T);
+		}
+		return ret;
+	}
+
+	static const uint8_t *getZeroHash(void)
+	{
+		static const uint8_t zeroHash[32] = { 0 };
+		return zeroHash;
+	}
+
+	const uint8_t	*mRead{nullptr};	// The current read location
+	const uint8_t	*mEnd{nullptr};		// The end of the buffer
+	bool			mOverflow{false};	// Set when a read would have gone past the end of the buffer
+};
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// The encoders matching the decoders in ByteReader.h; each appends to a byte vector.  Used to re-serialize
+// bitcoin data and to write the files this code base derives from the block chain.
+namespace bytewriter
+{
+
+inline void writeBytes(std::vector< uint8_t > &dest,const void *data,size_t length)
+{
+	const uint8_t *bytes = static_cast< const uint8_t *>(data);
+	dest.insert(dest.end(),bytes,bytes+length);
+}
+
+inline void writeU8(std::vector< uint8_t > &dest,uint8_t value)
+{
+	dest.push_back(value);
+}
+
+inline void writeU32(std::vector< uint8_t > &dest,uint32_t value)
+{
+	for (uint32_t i=0; i<4; i++)
+	{
+		dest.push_back(uint8_t(value >> (i*8)));
+	}
+}
+
+inline void writeU64(std::vector< uint8_t > &dest,uint64_t value)
+{
+	for (uint32_t i=0; i<8; i++)
+	{
+		dest.push_back(uint8_t(value >> (i*8)));
+	}
+}
+
+// Writes a 'CompactSize' variable length integer in its shortest form
+inline void writeCompactSize(std::vector< uint8_t > &dest,uint64_t value)
+{
+	uint32_t size = 1;
+	if ( value < 0xFD )
+	{
+		dest.push_back(uint8_t(value));
+		return;
+	}
+	if ( value <= 0xFFFF )
+	{
+		dest.push_back(0xFD);
+		size = 2;
+	}
+	else if ( value <= 0xFFFFFFFF )
+	{
+		dest.push_back(0xFE);
+		size = 4;
+	}
+	else
+	{
+		dest.push_back(0xFF);
+		size = 8;
+	}
+	for (uint32_t i=0; i<size; i++)
+	{
+		dest.push_back(uint8_t(value >> (i*8)));
+	}
+}
+
+// The inverse of ReadVarInt in bitcoin core's serialize.h
+inline void writeVarint(std::vector< uint8_t > &dest,uint64_t value)
+{
+	uint8_t scratch[10];
+	uint32_t len = 0;
+	for (;;)
+	{
+		scratch[len] = uint8_t((value & 0x7F) | (len ? 0x80 : 0x00));
+		if ( value <= 0x7F )
+		{
+			break;
+		}
+		value = (value >> 7) - 1;
+		len++;
+	}
+	do
+	{
+		dest.push_back(scratch[len]);
+	} while ( len-- );
+}
+
+}
@@ -7,6 +7,9 @@
 #include <string>
 #include <assert.h>
 
+#include "ByteReader.h"
+#include "HexCodec.h"
+
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:4100 4189) // disable these nag warnings on Visual Studio
@@ -162,41 +165,57 @@ public:
 		// LevelDB has a built-in generic compression system which will remove entropy just as efficiently.
 		// Moreover, these data records are extremely tiny and storing them at full resolution would not take up any 
 		// appreciable extra disk space. Some of these engineering decisions are really 'over-engineering' decisions IMO.
-		data = readVarint128(data,mVersionNumber);	// Read the version number from a variable length integer source
-		data = readVarint128(data,mBlockHeight);	// Read the block height from a variable length integer source
-		data = readVarint128(data,mBlockStatus);	// Read the block status bits from a variable length integer source
-		data = readVarint128(data,mTransactionCount);	// Read the total number of transactions in this block from a variable length integer source
+		bytereader::ByteReader< bytereader::Checked > reader(start,start+expectedSize);
+		mVersionNumber = reader.readVarint();	// Read the version number from a variable length integer source
+		mBlockHeight = reader.readVarint();		// Read the block height from a variable length integer source
+		mBlockStatus = reader.readVarint();		// Read the block status bits from a variable length integer source
+		mTransactionCount = reader.readVarint();	// Read the total number of transactions in this block from a variable length integer source
 		// According to documentation provided by Pieter Wuille if bit 8 or bit 16 is set, then we can expect to find a 
 		// variable length integer representing which block file this block is located in.
 		if ( mBlockStatus & BLOCK_HAVE_MASK)
 		{
-			data = readVarint128(data,mFileIndex);
+			mFileIndex = reader.readVarint();
 		}
 		if ( mBlockStatus & BLOCK_HAVE_DATA ) // if bit 8 is set, then we will find an file offset location as a variable length integer next
 		{
-			data = readVarint128(data,mFileOffset);
+			mFileOffset = reader.readVarint();
 		}
 		if ( mBlockStatus & BLOCK_HAVE_UNDO ) // if bit 16 is set, we can expect to find a variable length integer corresponding to the file offset location to access 'undo' data for the block
 		{
-			data = readVarint128(data,mUndoOffset);
+			mUndoOffset = reader.readVarint();
 		}
-		const uint8_t *scan = (const uint8_t *)data;
-		mBlockVersion = *(int32_t *)scan; scan+=sizeof(int32_t); // read the version number
-		memcpy(mHashPrevious,scan,sizeof(mHashPrevious)); scan+=sizeof(mHashPrevious); // read the hash to the previous block
-		memcpy(mHashMerkleRoot,scan,sizeof(mHashMerkleRoot)); scan+=sizeof(mHashMerkleRoot); // read the merkle root hash
-		mTime = *(uint32_t *)scan; scan+=sizeof(uint32_t); // read the time stamp for this block
-		mBits = *(uint32_t *)scan; scan+=sizeof(uint32_t); // read the bits field
-		mNonce = *(uint32_t *)scan; scan+=sizeof(uint32_t); // read the nonce for this block
+		mBlockVersion = int32_t(reader.readU32()); // read the version number
+		memcpy(mHashPrevious,reader.readHash(),sizeof(mHashPrevious)); // read the hash to the previous block
+		memcpy(mHashMerkleRoot,reader.readHash(),sizeof(mHashMerkleRoot)); // read the merkle root hash
+		mTime = reader.readU32(); // read the time stamp for this block
+		mBits = reader.readU32(); // read the bits field
+		mNonce = reader.readU32(); // read the nonce for this block
+
+		// A truncated record leaves the remaining fields zero rather than reading past the end of it
+		assert( !reader.hasOverflow() && reader.getPosition() == start + expectedSize );
 
-		size_t size = scan - start;
-		assert( size == expectedSize );
+		return reader.getPosition();
+	}
 
-		return scan;
+	// Initialize the header fields, and the block hash, from the serialized 80 byte block header; used when
+	// the index is built from the block files rather than read from leveldb
+	void readBlockHeader(const uint8_t *header,const uint8_t blockHash[32])
+	{
+		bytereader::ByteReader< bytereader::Unchecked > reader(header,header+80);
+		mBlockVersion = int32_t(reader.readU32());
+		memcpy(mHashPrevious,reader.readHash(),sizeof(mHashPrevious));
+		memcpy(mHashMerkleRoot,reader.readHash(),sizeof(mHashMerkleRoot));
+		mTime = reader.readU32();
+		mBits = reader.readU32();
+		mNonce = reader.readU32();
+		memcpy(mBlockHash,blockHash,sizeof(mBlockHash));
 	}
 
 	/**
 	* reads a variable length integer using a highly customized algorithm unique to the bitcoin core
 	* code base! This code matches the method called: ReadVarInt in 'serialize.h' in the bitcoin core source code.
+	* Each byte holds seven bits, most significant group first, and one is added to the value for every
+	* byte which has the continuation bit set.  The decoder itself lives in ByteReader.h.
 	* 
 	* @param data : The pointer to the variable length integer
 	* @param value : A reference to a 64 bit integer to return the decompressed value
@@ -205,26 +224,9 @@ public:
 	*/
 	inline const void *readVarint128(const void *data,uint64_t &value)
 	{
-		const uint8_t *ret = (const uint8_t *)data;	// Cast the void pointer to a single byte pointer
-
-		value = 0;		// Set the return value to zero initially
-		uint8_t byte=0; // Each byte we are streaming in
-		do
-		{
-			byte = *ret++;	// Get the byte value and or the 7 lower bits into the result.
-			value = (value<<7) | uint64_t(byte&0x7F);
-			// If this is not the last byte, we increment the value we are accumulating by one.
-			// This is extremely non-standard and I could not find a reference to this technique
-			// anywhere online other than the bitcoin source code itself.
-
-			if ( byte & 0x80 )
-			{
-				value++;
-			}
-		} while ( byte & 0x80 );
-
-
-		return ret; // Return the new pointer location
+		bytereader::ByteReader< bytereader::Unchecked > reader(data,(const uint8_t *)data + 10); // a 64 bit value is never more than 10 bytes
+		value = reader.readVarint();
+		return reader.getPosition();
 	}
 
 	// For debugging purposes, this method will print out the results of the block which
@@ -249,12 +251,8 @@ public:
 
 	void printHash(const uint8_t *hash) const
 	{
-		for (uint32_t i=0; i<32; i++)
-		{
-			uint32_t index = 31-i;
-			printf("%02X", uint32_t(hash[index]));
-		}
-		printf("\n");
+		char scratch[HEX_HASH_SIZE];
+		printf("%s\n", encodeHexReverse(hash,32,scratch,true));
 	}
 
 	void printTime(uint32_t _t) const
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include "BlockChain.h"
+
+// Runs any number of analyses of the block chain in a single pass.  Each analyser subscribes to the block,
+// transaction, input and output callbacks it needs; the driver reads and parses every block once and walks its
+// transactions once, handing each element to every analyser subscribed to it while it is still in cache.  Ten
+// analyses then cost about one read and one parse of the chain rather than ten.
+//
+// The blocks are parsed on every thread.  Each analyser has a shard per thread which only ever sees the blocks
+// parsed on that thread, so no locking is needed; once the pass is complete the shards are merged into the
+// analyser on the calling thread.  The blocks reach a shard in no particular order.
+//
+// The inputs are not resolved against the outputs they spend, so 'inputValue' is always zero.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace chainanalysis
+{
+
+// The callbacks an analyser subscribes to; the driver skips the loops which no analyser needs
+enum AnalyserEvent : uint32_t
+{
+	AE_BLOCK		= (1<<0),
+	AE_TRANSACTION	= (1<<1),
+	AE_INPUT		= (1<<2),
+	AE_OUTPUT		= (1<<3),
+};
+
+// The state of one analyser on one thread
+class AnalyserShard
+{
+public:
+	virtual void onBlock(const BlockChain::Block & /* b */)
+	{
+	}
+
+	// 'transactionIndex' is the position of the transaction in the block; zero is the coinbase
+	virtual void onTransaction(const BlockChain::Block & /* b */,const BlockChain::BlockTransaction & /* t */,uint32_t /* transactionIndex */)
+	{
+	}
+
+	// 'inputIndex' is the position of the input in its transaction
+	virtual void onInput(const BlockChain::Block & /* b */,const BlockChain::BlockTransaction & /* t */,const BlockChain::BlockInput & /* input */,uint32_t /* inputIndex */)
+	{
+	}
+
+	// The output is entry 'outputIndex' of the transaction's output columns, 't.outputs'
+	virtual void onOutput(const BlockChain::Block & /* b */,const BlockChain::BlockTransaction & /* t */,uint32_t /* outputIndex */)
+	{
+	}
+
+	virtual void release(void)
+	{
+		delete this;
+	}
+protected:
+	virtual ~AnalyserShard(void)
+	{
+	}
+};
+
+class Analyser
+{
+public:
+	virtual const char *getName(void) const = 0;
+
+	// The AnalyserEvent flags of the callbacks this analyser's shards implement
+	virtual uint32_t getEvents(void) const = 0;
+
+	// Returns a new shard with empty results
+	virtual AnalyserShard *createShard(void) = 0;
+
+	// Adds the results of a shard to this analyser; the driver releases the shard afterwards
+	virtual void merge(const AnalyserShard *shard) = 0;
+
+	// Print the results merged so far to the console
+	virtual void report(void) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~Analyser(void)
+	{
+	}
+};
+
+// Outputs and value by KeyType
+Analyser *createKeyTypeAnalyser(void);
+// Outputs by the power of ten of their value
+Analyser *createOutputValueAnalyser(void);
+// Transactions by shape (input and output counts), witness use and size
+Analyser *createTransactionAnalyser(void);
+// Inputs by witness use, script size and sequence number (replace by fee and relative lock time)
+Analyser *createInputAnalyser(void);
+// Blocks, bytes and transactions in each subsidy halving epoch
+Analyser *createBlockAnalyser(void);
+
+class ChainAnalysisStats
+{
+public:
+	uint32_t	mBlockCount{0};			// Blocks analysed
+	uint32_t	mFailedCount{0};		// Blocks which could not be read or parsed
+	uint32_t	mMerkleFailures{0};		// Blocks which failed merkle verification, when it is enabled
+	uint64_t	mRawBytes{0};			// Size of the blocks analysed
+	uint64_t	mTransactionCount{0};
+	uint64_t	mInputCount{0};
+	uint64_t	mOutputCount{0};
+	double		mSeconds{0};			// Time taken by the pass, including merging the shards
+};
+
+class ChainAnalysis
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static ChainAnalysis *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Include this analyser in the passes which follow.  The analyser is not owned and must outlive them.
+	virtual void addAnalyser(Analyser *a) = 0;
+
+	// Remove every analyser
+	virtual void clearAnalysers(void) = 0;
+
+	// Also check the merkle root and witness commitment of every block analysed; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	// Feed the blocks [firstBlock,firstBlock+blockCount) to every analyser using 'threadCount' threads (0=all cores)
+	// and merge the shards into the analysers.  Blocks which cannot be read are counted and skipped.
+	// Returns false if there are no analysers.
+	virtual bool run(uint32_t threadCount,uint32_t firstBlock,uint32_t blockCount,ChainAnalysisStats &stats) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~ChainAnalysis(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// A compact, lossless archive of the block chain which is much cheaper to read in full than the raw
+// blk?????.dat files, for analyses which walk the whole chain again and again.
+//
+// Most of the bytes in the raw block files are redundant.  In the archive:
+// - The 32 byte previous transaction hash of each input is replaced by the number of that transaction, counting
+//   every transaction in the chain from the genesis block.
+// - Output scripts which match a standard template are stored as just the hash or key they carry, input scripts
+//   and witnesses which spend a public key hash as just the signature and key, and amounts in bitcoin core's
+//   compressed amount form.
+// - Public keys are stored once each, in a dictionary, and referred to by number after that.
+// - Blocks are grouped into chunks of consecutive heights which are snappy compressed, with an index of the
+//   chunks so any block can be found without reading the ones before it.
+//
+// Every block is reconstructed exactly, byte for byte.  The converter decodes each block again as soon as it
+// has been encoded and stores any block which does not reproduce verbatim.
+//
+// An archive is a directory holding ChainArchive.idx (the chunk index), ChainArchive.dat (the compressed
+// chunks), ChainArchive.txid (32 bytes per transaction, in transaction number order) and ChainArchive.k33 and
+// ChainArchive.k65 (the compressed and uncompressed public key dictionaries).  The fixed width tables are
+// memory mapped when the archive is read.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace chainarchive
+{
+
+class ChainArchiveStats
+{
+public:
+	uint64_t	mBlockCount{0};
+	uint64_t	mTransactionCount{0};
+	uint64_t	mRawBytes{0};			// Size of the blocks in the blk?????.dat files
+	uint64_t	mArchiveBytes{0};		// Size of all of the archive files
+	uint64_t	mChunkBytes{0};			// Size of the compressed chunks; what a full scan of the archive reads
+	uint64_t	mVerbatimBlocks{0};		// Blocks stored as is because their encoding did not reproduce them exactly
+	uint64_t	mLiteralPrevouts{0};	// Inputs whose previous transaction was not found, so its hash is stored
+	uint64_t	mKeyCount{0};			// Public keys in the dictionaries
+	uint64_t	mMerkleFailures{0};		// Blocks which failed merkle verification, when it is enabled
+};
+
+// Converts a range of the block chain into an archive
+class ChainArchiveWriter
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static ChainArchiveWriter *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Archive the blocks [0,blockCount) into 'archiveDir', which must already exist.  Blocks must start at the
+	// genesis block so every previous transaction can be numbered.  Returns false if the archive could not be written.
+	virtual bool write(const char *archiveDir,uint32_t blockCount,ChainArchiveStats &stats) = 0;
+
+	// Check the merkle root and witness commitment of every block archived; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~ChainArchiveWriter(void)
+	{
+	}
+};
+
+// Reads blocks back out of an archive
+class ChainArchive
+{
+public:
+	// Returns null if the archive in 'archiveDir' could not be opened
+	static ChainArchive *create(const char *archiveDir);
+
+	virtual uint32_t getBlockCount(void) const = 0;
+
+	virtual uint64_t getTransactionCount(void) const = 0;
+
+	// Returns the hash of this transaction; transactions are numbered in chain order from zero
+	virtual const uint8_t *getTransactionHash(uint64_t transactionNumber) const = 0;
+
+	// Reconstructs the raw block at this height, exactly as it was stored in the block files (starting with the
+	// 80 byte block header).  Reading consecutive heights only decompresses each chunk once.
+	virtual bool readBlock(uint32_t blockHeight,std::vector< uint8_t > &blockData) = 0;
+
+	// Returns the number of bytes of compressed chunk data read since the archive was opened
+	virtual uint64_t getBytesRead(void) const = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~ChainArchive(void)
+	{
+	}
+};
+
+}
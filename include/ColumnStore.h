@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// A columnar copy of the transactions, inputs and outputs of the block chain, for analyses which are run again
+// and again and only need a few fields of each row; for example the value and script type of every output.
+//
+// There are three tables; one row per transaction, per input and per output, each in chain order.  Every column
+// is a separate file which is memory mapped when the store is opened, so a scan only touches the pages of the
+// columns it reads.  The rows are partitioned by block height and each column holds one chunk per partition.
+// A chunk is stored as its minimum value plus each row's difference from it, in the fewest whole bytes which
+// hold the largest difference (none at all when every row has the same value).  The minimum and maximum of every
+// chunk are kept in the index, so a scan looking for a range of values can skip whole partitions.
+//
+// Transactions and output destinations are identified by number; ColumnStore.txid holds the hash of each
+// transaction and ColumnStore.hash the 32 byte output hash (see BlockChain::OutputHash) of each destination.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace columnstore
+{
+
+enum class Table : uint32_t
+{
+	transactions,
+	inputs,
+	outputs,
+	last
+};
+
+enum class Column : uint32_t
+{
+	// Transaction table
+	txHeight,			// Height of the block holding the transaction
+	txVersion,
+	txLockTime,
+	txSize,				// Serialized length, including any witness data
+	txInputCount,
+	txOutputCount,
+	txWitness,			// 1 if the transaction was serialized with witness data
+	// Input table
+	inputTransaction,	// Number of the transaction holding the input
+	inputPrevTx,		// Number of the transaction spent plus one; zero for coinbase inputs or a transaction not in the store
+	inputPrevIndex,		// The output index spent
+	inputSequence,
+	inputScriptSize,
+	inputWitnessCount,
+	// Output table
+	outputTransaction,	// Number of the transaction holding the output
+	outputValue,		// In satoshis
+	outputKeyType,		// BlockChain::KeyType
+	outputScriptSize,
+	outputHashId,		// Number of the destination's output hash plus one; zero if the output has no destination
+	last
+};
+
+// The rows of each table held by one partition; a range of block heights
+class Partition
+{
+public:
+	uint32_t	mFirstBlock{0};
+	uint32_t	mBlockCount{0};
+	uint64_t	mFirstRow[uint32_t(Table::last)];	// Row number of the partition's first row of each table
+	uint64_t	mRowCount[uint32_t(Table::last)];
+};
+
+// One column of one partition, as stored; row 'i' has the value mBase plus the mWidth byte little endian
+// integer at mData + i*mWidth
+class ColumnChunk
+{
+public:
+	inline uint64_t get(uint64_t row) const
+	{
+		uint64_t v = 0;
+		const uint8_t *p = mData + row*mWidth;
+		for (uint32_t i=0; i<mWidth; i++)
+		{
+			v |= uint64_t(p[i]) << (i*8);
+		}
+		return mBase + v;
+	}
+
+	const uint8_t	*mData{nullptr};
+	uint32_t		mWidth{0};		// 0, 1, 2, 4 or 8 bytes per row
+	uint64_t		mBase{0};		// The minimum value of the chunk
+	uint64_t		mMax{0};		// The maximum value of the chunk
+	uint64_t		mRowCount{0};
+};
+
+class ColumnStoreStats
+{
+public:
+	uint64_t	mBlockCount{0};
+	uint64_t	mTransactionCount{0};
+	uint64_t	mInputCount{0};
+	uint64_t	mOutputCount{0};
+	uint64_t	mHashCount{0};			// Distinct output hashes
+	uint64_t	mRawBytes{0};			// Size of the blocks read
+	uint64_t	mColumnBytes{0};		// Size of every column file
+	uint64_t	mMerkleFailures{0};		// Blocks which failed merkle verification, when it is enabled
+};
+
+// Exports a range of the block chain as column files
+class ColumnStoreWriter
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static ColumnStoreWriter *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Export the blocks [0,blockCount) into 'storeDir', which must already exist, with 'partitionBlocks' blocks in each
+	// partition.  Returns false if the store could not be written.
+	virtual bool write(const char *storeDir,uint32_t blockCount,uint32_t partitionBlocks,ColumnStoreStats &stats) = 0;
+
+	// Check the merkle root and witness commitment of every block exported; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~ColumnStoreWriter(void)
+	{
+	}
+};
+
+class ColumnStore
+{
+public:
+	// Returns null if the store in 'storeDir' could not be opened
+	static ColumnStore *create(const char *storeDir);
+
+	static Table getTable(Column c);
+
+	static const char *getColumnName(Column c);
+
+	virtual uint32_t getBlockCount(void) const = 0;
+
+	virtual uint64_t getRowCount(Table t) const = 0;
+
+	virtual uint32_t getPartitionCount(void) const = 0;
+
+	virtual const Partition &getPartition(uint32_t index) const = 0;
+
+	// Returns the stored chunk of this column for this partition; its rows are read in place from the mapped file
+	virtual bool getChunk(Column c,uint32_t partition,ColumnChunk &chunk) const = 0;
+
+	// Decodes the chunk of this column for this partition into 'values'; one entry per row
+	virtual bool readChunk(Column c,uint32_t partition,std::vector< uint64_t > &values) const = 0;
+
+	// Returns the 32 byte hash of this transaction number; null if out of range
+	virtual const uint8_t *getTransactionHash(uint64_t transaction) const = 0;
+
+	// Returns the 32 byte output hash with this number (an outputHashId minus one); null if out of range
+	virtual const uint8_t *getOutputHash(uint64_t hashId) const = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~ColumnStore(void)
+	{
+	}
+};
+
+}
@@ -10,6 +10,22 @@ enum class CommandType : uint32_t
 	help,
 	bye,
 	block,
+	threads,
+	cache,
+	stress,
+	fuzz,
+	decodebench,
+	fsck,
+	textmine,
+	archive,
+	columns,
+	filters,
+	hashbench,
+	base58bench,
+	bech32bench,
+	merkle,
+	analyse,
+	utxo,
 	last
 };
 
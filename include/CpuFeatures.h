@@ -0,0 +1,18 @@
+#ifndef CPU_FEATURES_H
+
+#define CPU_FEATURES_H
+
+// The instruction set extensions the hash kernels use, which the processor and the operating system support.
+// Always false on processors other than x86.
+class CpuFeatures
+{
+public:
+	bool	mSHA{false};		// SHA extensions, with the SSSE3 and SSE4.1 instructions used alongside them
+	bool	mAVX2{false};
+	bool	mAVX512{false};		// AVX-512 foundation and byte/word instructions
+};
+
+// Read once, on first use
+const CpuFeatures &getCpuFeatures(void);
+
+#endif
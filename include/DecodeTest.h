@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+// Exercises the block decoder and the primitive decoders in ByteReader.h.
+// 'fuzz' feeds randomly damaged copies of a real block to the parser and random byte strings to the
+// CompactSize and VARINT decoders; it is most useful in a build with the address sanitizer enabled.
+// 'benchmark' reports the throughput of the primitive decoders, with and without bounds checks, and of
+// decoding whole blocks.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace decodetest
+{
+
+class DecodeTest
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static DecodeTest *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Parse 'iterations' damaged copies of the block at this height and check the primitive decoders against
+	// a byte at a time reference.  Returns true if no decoder disagreed with the reference and no parsed block
+	// referred to memory outside of its block data.
+	virtual bool fuzz(uint32_t blockHeight,uint32_t iterations,uint32_t seed) = 0;
+
+	// Report the decode throughput of the primitive decoders and of parsing the blocks [firstBlock,firstBlock+blockCount),
+	// then the cost of verifying the merkle root and witness commitment of each block on top of that
+	virtual void benchmark(uint32_t firstBlock,uint32_t blockCount) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~DecodeTest(void)
+	{
+	}
+};
+
+}
@@ -4,11 +4,33 @@
 
 #include <stdint.h>
 
+// A stdio style file interface with 64 bit offsets which can be backed by a file on disk, a read only memory
+// mapping of a file, or a block of memory.
+//
+// Files opened for read only access with 'useMemoryMappedFile' are mapped into memory; reads are copies out of
+// the mapping and fi_getCurrentMemoryLocation/fi_getMemBuffer give direct access to the data so it can be parsed
+// in place.  If the file cannot be mapped it is read through stdio instead.  Files opened for writing always go
+// through stdio, using a large write buffer.
+//
+// If 'mem' is not null, the file reads from the 'len' bytes located there rather than from disk.  If 'fname' is
+// null and 'spec' is for writing, the file writes into a growing block of memory which can be retrieved with
+// fi_getMemBuffer before the file is closed.
+
 typedef struct
 {
   void *mInterface;
 } FILE_INTERFACE;
 
+// Hints about how a range of a file is going to be accessed; used to tune the operating system's read ahead
+enum FileAdvice
+{
+	FA_NORMAL,		// No special treatment
+	FA_SEQUENTIAL,	// The range will be read from start to finish
+	FA_RANDOM,		// Reads will jump around the range; reading ahead is wasted
+	FA_WILLNEED,	// The range will be needed soon; start reading it now
+	FA_DONTNEED,	// The range will not be needed again for a while
+};
+
 FILE_INTERFACE *	fi_fopen(const char *fname,const char *spec,void *mem,uint64_t len,bool useMemoryMappedFile);
 uint64_t			fi_fclose(FILE_INTERFACE *file);
 uint64_t			fi_fread(void *buffer,uint64_t size,uint64_t count,FILE_INTERFACE *fph);
@@ -25,6 +47,8 @@ void				fi_clearerr(FILE_INTERFACE *fph);
 void *				fi_getMemBuffer(FILE_INTERFACE *fph,uint64_t *outputLength);  // return the buffer and length of the file.
 bool				fi_usesMemoryMappedFile(FILE_INTERFACE *fph);
 void *				fi_getCurrentMemoryLocation(FILE_INTERFACE *fph); // only valid for memory based files; but will return the address in memory of the current file location
+uint64_t			fi_getFileLength(FILE_INTERFACE *fph);
+void				fi_fadvise(FILE_INTERFACE *fph,uint64_t offset,uint64_t length,FileAdvice advice); // a hint only; ignored where the platform has no equivalent
 bool                fi_deleteFile(const char *fname);
 
 
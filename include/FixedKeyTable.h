@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace fixedkeytable
+{
+
+// An open addressing hash table over a flat array of fixed width keys; transaction hashes, public keys or
+// output hashes.  The table only stores positions in the key array, which the caller owns and appends to.
+// Keys are hashes or keys, so their bytes are already well distributed; the first and last eight bytes are
+// mixed so neither a public key's prefix byte nor the zero padding of a 20 byte hash weakens the hash code.
+class FixedKeyTable
+{
+public:
+	FixedKeyTable(const std::vector< uint8_t > &keys,uint32_t keyWidth) : mKeys(keys), mKeyWidth(keyWidth)
+	{
+		mSlots.resize(1024,0);
+		mMask = mSlots.size()-1;
+	}
+
+	// Returns the position of this key in the key array, or -1 if it is not in the table
+	int64_t find(const uint8_t *key) const
+	{
+		uint64_t slot = getSlot(key);
+		while ( mSlots[size_t(slot)] )
+		{
+			uint32_t index = mSlots[size_t(slot)]-1;
+			if ( memcmp(&mKeys[size_t(index)*mKeyWidth],key,mKeyWidth) == 0 )
+			{
+				return int64_t(index);
+			}
+			slot = (slot+1) & mMask;
+		}
+		return -1;
+	}
+
+	// Add the key at this position of the key array
+	void insert(uint32_t index)
+	{
+		if ( (mCount+1)*2 > mSlots.size() )
+		{
+			grow();
+		}
+		uint64_t slot = getSlot(&mKeys[size_t(index)*mKeyWidth]);
+		while ( mSlots[size_t(slot)] )
+		{
+			slot = (slot+1) & mMask;
+		}
+		mSlots[size_t(slot)] = index+1;
+		mCount++;
+	}
+
+private:
+	uint64_t getSlot(const uint8_t *key) const
+	{
+		uint64_t a;
+		uint64_t b;
+		memcpy(&a,key,sizeof(a));
+		memcpy(&b,key+mKeyWidth-sizeof(b),sizeof(b));
+		uint64_t h = (a ^ b) * 0x9E3779B97F4A7C15ULL;
+		return (h ^ (h >> 32)) & mMask;
+	}
+
+	void grow(void)
+	{
+		std::vector< uint32_t > old;
+		old.swap(mSlots);
+		mSlots.resize(old.size()*2,0);
+		mMask = mSlots.size()-1;
+		for (auto &i:old)
+		{
+			if ( i )
+			{
+				uint64_t slot = getSlot(&mKeys[size_t(i-1)*mKeyWidth]);
+				while ( mSlots[size_t(slot)] )
+				{
+					slot = (slot+1) & mMask;
+				}
+				mSlots[size_t(slot)] = i;
+			}
+		}
+	}
+
+	const std::vector< uint8_t >	&mKeys;
+	uint32_t						mKeyWidth;
+	uint64_t						mMask{0};
+	uint64_t						mCount{0};
+	std::vector< uint32_t >			mSlots;		// Position in the key array plus one; zero for an empty slot
+};
+
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Measures the hash functions the parser spends most of its time in, for every implementation this processor
+// supports, and checks each implementation produces the same hashes as the portable one.
+namespace hashbench
+{
+
+class HashBench
+{
+public:
+	static HashBench *create(void);
+
+	// Hash 'megabytes' of data in each test; returns false if any implementation disagreed with the portable one
+	virtual bool run(uint32_t megabytes) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~HashBench(void)
+	{
+	}
+};
+
+}
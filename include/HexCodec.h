@@ -0,0 +1,29 @@
+#ifndef HEX_CODEC_H
+
+#define HEX_CODEC_H
+
+// Converts binary data, such as hashes and scripts, to and from hexadecimal ASCII.  Sixteen bytes are converted at a
+// time with SSE2, and thirty two with AVX2 where the processor has it, so dumping large blocks or exporting millions
+// of transaction hashes is not held up by formatting one character at a time.
+//
+// Hashes are shown with their bytes in reverse order, as bitcoin core displays them; the 'Reverse' variants
+// convert in that order.
+#include <stdint.h>
+
+#define HEX_HASH_SIZE 65	// A 32 byte hash as hex digits, with the terminating zero
+
+// Writes the 2*length hex digits of 'data' followed by a terminating zero into 'output', which must hold 2*length+1
+// characters, and returns 'output'
+char *encodeHex(const uint8_t *data,uint32_t length,char *output,bool upperCase=false);
+
+// The same, starting with the last byte of 'data'
+char *encodeHexReverse(const uint8_t *data,uint32_t length,char *output,bool upperCase=false);
+
+// Converts the 2*length hex digits at 'input', in either case, into 'length' bytes at 'output'.  Returns false if
+// any of them is not a hex digit, in which case 'output' is undefined.
+bool decodeHex(const char *input,uint32_t length,uint8_t *output);
+
+// The same, writing the last byte of 'output' first; the inverse of encodeHexReverse
+bool decodeHexReverse(const char *input,uint32_t length,uint8_t *output);
+
+#endif
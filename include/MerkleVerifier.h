@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include "BlockChain.h"
+
+// Checks that the transactions of a parsed block are the ones its header commits to; so blocks copied between
+// hosts, or read back out of derived files, can be trusted.  The merkle tree is rebuilt a level at a time, with
+// every pair of sibling hashes on a level handed to the batched double SHA256 together.  For SegWit blocks the
+// tree of wtxids is rebuilt as well and checked against the witness commitment in the coinbase.
+namespace merkleverifier
+{
+
+class MerkleVerifier
+{
+public:
+	static MerkleVerifier *create(void);
+
+	// Check the merkle root and any witness commitment of this parsed block
+	virtual BlockChain::MerkleStatus verify(const BlockChain::Block &block) = 0;
+
+	// Compute the merkle root of these 'count' hashes.  'mutated' is set if any level has two identical sibling
+	// hashes, other than the copy of an odd last hash.
+	virtual void computeMerkleRoot(const uint8_t (*hashes)[32],uint32_t count,uint8_t root[32],bool &mutated) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~MerkleVerifier(void)
+	{
+	}
+};
+
+}
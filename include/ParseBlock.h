@@ -5,15 +5,23 @@
 // This helper class parses a single bitcoin block
 class CBlockIndex;
 
+namespace blockcache
+{
+class BlockCache;
+}
+
 namespace parseblock
 {
 
 class ParseBlock
 {
 public:
-	static ParseBlock *create(void);
+	// Create the block parser.  Blocks are obtained through 'cache', which owns the parsed block data.
+	static ParseBlock *create(blockcache::BlockCache *cache);
 
-	virtual uint32_t parseBlock(const CBlockIndex &index,const char *dataDir) = 0;
+	// Look up the block described by this index entry and print a summary.
+	// Returns the number of transactions in the block, or zero if the block could not be read.
+	virtual uint32_t parseBlock(const CBlockIndex &index) = 0;
 
 	virtual void release(void) = 0;
 };
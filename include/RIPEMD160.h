@@ -15,4 +15,22 @@ void computeRIPEMD160(const void *input,	// The input data to compute the hash f
 					  uint32_t length,		// The length of the input data
 					  uint8_t hashcode[20]); // The output hash of 160 bits (20 bytes)
 
+// The RIPEMD160 hash of many 32 byte messages, such as the SHA256 hashes of public keys; destHashes[i] receives the
+// hash of inputs[i].  With AVX2 or AVX-512 the messages are hashed 8 or 16 at a time, one per vector lane.
+void computeRIPEMD160Batch(uint32_t count,const uint8_t (*inputs)[32],uint8_t (*destHashes)[20]);
+
+enum RIPEMD160BatchImplementation
+{
+	RIPEMD160_BATCH_SINGLE,		// One message at a time
+	RIPEMD160_BATCH_AVX2,		// Eight messages at a time
+	RIPEMD160_BATCH_AVX512,		// Sixteen messages at a time
+};
+
+RIPEMD160BatchImplementation getRIPEMD160BatchImplementation(void);
+
+// Force a batch implementation, for benchmarks; returns false if this processor or build does not support it
+bool setRIPEMD160BatchImplementation(RIPEMD160BatchImplementation i);
+
+const char *getRIPEMD160BatchImplementationName(RIPEMD160BatchImplementation i);
+
 #endif
@@ -17,4 +17,87 @@ void computeSHA256(const void *input,		// A pointer to the input data to have th
 				   uint32_t size,			// the length of the input data
 				   uint8_t destHash[32]);	// The output 256 bit (32 byte) hash
 
+// The SHA256 hash of the SHA256 hash of the input; how bitcoin hashes transactions, blocks and checksums
+void computeDoubleSHA256(const void *input,uint32_t size,uint8_t destHash[32]);
+
+// Double SHA256 of an 80 byte block header; the padding is fixed so only three blocks are compressed
+void computeDoubleSHA256Header(const uint8_t header[80],uint8_t destHash[32]);
+
+// Double SHA256 of 64 bytes; two concatenated hashes, as in a merkle tree node
+void computeDoubleSHA256Node(const uint8_t node[64],uint8_t destHash[32]);
+
+// An incremental SHA256 for messages which are not contiguous in memory.  The context is plain data; a copy taken
+// part way through is a 'midstate' which can be resumed any number of times, so a prefix shared by many messages is
+// only hashed once.
+class SHA256Context
+{
+public:
+	SHA256Context(void)
+	{
+		reset();
+	}
+
+	void reset(void);
+
+	void update(const void *data,uint32_t size);
+
+	// Finish the hash; the context must be reset before it is used again
+	void finalize(uint8_t destHash[32]);
+
+	// Finish the hash and hash the result again; as computeDoubleSHA256
+	void finalizeDouble(uint8_t destHash[32]);
+
+	// The number of bytes hashed so far
+	uint64_t getLength(void) const
+	{
+		return mTotalLength / 8;
+	}
+
+	uint64_t	mTotalLength;	// In bits
+	uint32_t	mState[8];
+	uint32_t	mBufferLength;	// Bytes waiting in mBuffer for a whole block
+	uint8_t		mBuffer[64];
+};
+
+// Double SHA256 of an 80 byte block header whose first 64 bytes have already been hashed into 'midstate'; only the
+// last 16 bytes (the end of the merkle root, the time, bits and nonce) are given.  Headers which differ only in
+// those fields, such as every nonce tried for one template, share the midstate.
+void computeDoubleSHA256Header(const SHA256Context &midstate,const uint8_t headerTail[16],uint8_t destHash[32]);
+
+// The compression function is chosen at run time from the instructions the processor supports
+enum SHA256Implementation
+{
+	SHA256_PORTABLE,	// Plain C
+	SHA256_SHANI,		// Intel SHA extensions
+	SHA256_ARMV8,		// ARMv8 cryptography extensions
+};
+
+SHA256Implementation getSHA256Implementation(void);
+
+// Force an implementation, for benchmarks and to compare results; returns false if this processor or build does not support it
+bool setSHA256Implementation(SHA256Implementation i);
+
+const char *getSHA256ImplementationName(SHA256Implementation i);
+
+// Hash many independent messages, of any lengths, together; destHashes[i] receives the hash of the sizes[i] bytes at
+// inputs[i].  With AVX2 or AVX-512 the messages are hashed 8 or 16 at a time, one per vector lane.
+void computeSHA256Batch(uint32_t count,const uint8_t *const *inputs,const uint32_t *sizes,uint8_t (*destHashes)[32]);
+
+// The double SHA256 of each message; as computeDoubleSHA256
+void computeDoubleSHA256Batch(uint32_t count,const uint8_t *const *inputs,const uint32_t *sizes,uint8_t (*destHashes)[32]);
+
+enum SHA256BatchImplementation
+{
+	SHA256_BATCH_SINGLE,	// One message at a time, with the selected SHA256Implementation
+	SHA256_BATCH_AVX2,		// Eight messages at a time
+	SHA256_BATCH_AVX512,	// Sixteen messages at a time
+};
+
+SHA256BatchImplementation getSHA256BatchImplementation(void);
+
+// Force a batch implementation, for benchmarks; returns false if this processor or build does not support it
+bool setSHA256BatchImplementation(SHA256BatchImplementation i);
+
+const char *getSHA256BatchImplementationName(SHA256BatchImplementation i);
+
 #endif
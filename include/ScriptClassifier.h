@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include "BlockChain.h"
+
+// Classifies output (scriptPubKey) scripts against the standard script templates; pay to public key,
+// pay to public key hash, pay to script hash, bare multisig, null data (OP_RETURN), witness v0 key hash and
+// script hash, taproot, pay to anchor and future witness versions, along with the legacy forms found in
+// early blocks.  Classification is a table lookup on the first opcode followed by a length and a
+// handful of fixed byte compares for each candidate template.
+namespace scriptclassifier
+{
+
+class ScriptClass
+{
+public:
+	BlockChain::KeyType	keyType{BlockChain::KT_UNKNOWN};	// KT_UNKNOWN if the script did not match any template
+	uint32_t			keyOffset{0};						// Offset of the public key, hash or witness program within the script
+	uint32_t			keyLength{0};						// Length of the public key, hash or witness program; zero if there is none
+};
+
+// Classify a single output script.  Returns false if the script does not match any template.
+// Multisig scripts are only recognized by their shape; the keys themselves still need to be located.
+bool classifyScript(const uint8_t *script,uint32_t scriptLength,ScriptClass &result);
+
+// Classify 'count' output scripts at once.  The scripts are located at 'scriptBase' plus their offset,
+// the same layout as the output columns of a block.
+void classifyScripts(const uint8_t *scriptBase,const uint32_t *scriptOffsets,const uint32_t *scriptLengths,uint32_t count,ScriptClass *results);
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+// Parses a range of blocks on many threads at once, each thread with its own parser, and verifies every
+// block decodes exactly the same as it does in a serial run.  Used to check the parser is reentrant.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace stresstest
+{
+
+class StressTest
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static StressTest *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Parse the blocks [firstBlock,firstBlock+blockCount) serially and then on 'threadCount' threads and compare the results.
+	// Returns true if every block produced the same result both times.
+	virtual bool run(uint32_t threadCount,uint32_t firstBlock,uint32_t blockCount) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~StressTest(void)
+	{
+	}
+};
+
+}
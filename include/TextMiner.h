@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Mines the block chain for embedded text; the coinbase messages, OP_RETURN notes, inscriptions and the
+// like.  Each block is parsed on its own thread and only the parts of it which can carry arbitrary data are
+// searched; every run of printable characters is reported along with where in the block it was found.
+// The text is located in place in the raw block data and the report is written in block order.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace textminer
+{
+
+// Where in a block a run of text was found
+enum class TextLocation : uint32_t
+{
+	coinbase,		// The input script of the coinbase transaction
+	scriptSig,		// The input script of any other transaction
+	witness,		// An item on a segregated witness stack
+	opReturn,		// An output script beginning with OP_RETURN
+	outputScript,	// Any other output script; for example data hidden in fake public keys
+	last
+};
+
+// A run of printable characters; an offset and length relative to the data which was searched
+class TextRun
+{
+public:
+	uint32_t	mOffset;
+	uint32_t	mLength;
+};
+
+// Appends every run of at least 'minLength' printable ASCII characters (0x20 to 0x7E) in 'data' to 'runs'.
+// Sixteen bytes are classified at a time with SSE2 or NEON where available.
+void findTextRuns(const uint8_t *data,uint32_t length,uint32_t minLength,std::vector< TextRun > &runs);
+
+class TextMiner
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static TextMiner *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Search the blocks [firstBlock,firstBlock+blockCount) for runs of at least 'minLength' printable characters
+	// using 'threadCount' threads (0=all cores).  Every run is written to 'reportFileName' and a summary is
+	// printed to the console.  Returns false if the report could not be written.
+	virtual bool run(uint32_t threadCount,uint32_t minLength,uint32_t firstBlock,uint32_t blockCount,const char *reportFileName) = 0;
+
+	// Also check the merkle root and witness commitment of every block mined; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~TextMiner(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// A small fixed size pool of worker threads used to spread independent pieces of work
+// (for example the transactions contained in a single block) across the available cores.
+namespace threadpool
+{
+
+class ThreadPool
+{
+public:
+	// Create a pool with this many worker threads. A thread count of zero means use the hardware concurrency.
+	static ThreadPool *create(uint32_t threadCount);
+
+	// Create a pool for work shared with the calling thread, which takes part in every parallelFor; 'threadCount'
+	// is the number of threads counting the caller, so the pool has one fewer.  Zero means use the hardware concurrency.
+	static ThreadPool *createForCaller(uint32_t threadCount);
+
+	// Returns the number of worker threads in the pool (not counting the calling thread)
+	virtual uint32_t getThreadCount(void) const = 0;
+
+	// Invokes 'func' on the range [0,count) split into chunks of 'grainSize' items.
+	// The calling thread participates in the work and this method does not return until every chunk has been processed.
+	// The 'workerIndex' passed to the callback is in the range [0,getThreadCount()] and is unique to the thread
+	// currently executing the chunk, so it can be used to select per-thread scratch state.
+	virtual void parallelFor(uint32_t count,
+							 uint32_t grainSize,
+							 const std::function<void(uint32_t begin,uint32_t end,uint32_t workerIndex)> &func) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~ThreadPool(void)
+	{
+	}
+};
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// The unspent transaction output set of a range of the block chain, at any height within it.
+//
+// Every output is given a dense global number in chain order (block, transaction, output); the outputs of a
+// transaction are numbered consecutively, so an outpoint is the number of its transaction's first output plus its
+// index.  The set is stored in a directory as columns indexed by these numbers:
+//
+//   Utxo.idx            : a header and the first transaction, output and input number of each height
+//   UtxoTransactions.dat: the txid and first output number of every transaction, in chain order
+//   UtxoTxids.dat       : the transaction numbers sorted by txid; the txid to first output number table
+//   UtxoValues.dat      : the value of each output in 32 bits; larger values index UtxoLargeValues.dat
+//   UtxoScriptIds.dat   : the script id of each output
+//   UtxoInputs.dat      : the output number spent by each input other than coinbase inputs, in chain order; a
+//                         transaction reusing the txid of one with unspent outputs (BIP30) also spends those outputs
+//   UtxoSpent.dat       : one bit per output; set if the output is spent at the last height
+//
+// The columns are memory mapped; only the spent bits, one per output, are held in memory.  The set is moved to
+// another height by replaying the inputs column between the two heights, setting or clearing one bit per input.
+// Outputs with an OP_RETURN script are provably unspendable and are marked spent when they are created.
+namespace blocks
+{
+class Blocks;
+}
+
+namespace utxo
+{
+
+#define UTXO_NO_OUTPUT 0xFFFFFFFFFFFFFFFFULL	// An input whose previous output was not found
+
+// The first eight bytes, as a little endian integer, of the SHA256 of an output script; the script hash used by
+// Electrum servers, truncated.  Outputs paying to the same script have the same id.
+uint64_t computeScriptId(const uint8_t *script,uint32_t scriptLength);
+
+class UtxoWriterStats
+{
+public:
+	uint32_t	mBlockCount{0};
+	uint64_t	mTransactionCount{0};
+	uint64_t	mOutputCount{0};
+	uint64_t	mInputCount{0};				// Inputs other than coinbase inputs, and outputs spent by a reused txid
+	uint64_t	mUnspentCount{0};			// Outputs unspent at the last height
+	uint64_t	mLargeValueCount{0};		// Outputs whose value did not fit in the 32 bit column
+	uint64_t	mUnresolvedInputs{0};		// Inputs whose previous output was not found
+	uint64_t	mDuplicateTransactions{0};	// Transactions reusing the txid of one with unspent outputs, which they spend (BIP30)
+	uint64_t	mPeakLiveTransactions{0};	// The most transactions with unspent outputs held while writing
+	uint64_t	mRawBytes{0};				// Size of the blocks read
+};
+
+// Builds the set of a range of the block chain
+class UtxoWriter
+{
+public:
+	// 'blocks' is the block index used to locate each height in the blk?????.dat files found in 'dataDir'
+	static UtxoWriter *create(const blocks::Blocks *blocks,const char *dataDir);
+
+	// Write the set of the blocks [0,blockCount) into 'utxoDir', which must already exist.  Only the transactions
+	// which still have unspent outputs are held in memory while the blocks are read.  Returns false if the set
+	// could not be written.
+	virtual bool write(const char *utxoDir,uint32_t blockCount,UtxoWriterStats &stats) = 0;
+
+	// Check the merkle root and witness commitment of every block read; see BlockChain::setVerifyMerkle
+	virtual void setVerifyMerkle(bool state) = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~UtxoWriter(void)
+	{
+	}
+};
+
+// The outputs paying to a script
+class UtxoBalance
+{
+public:
+	uint64_t	mReceivedCount{0};		// Outputs created before the height
+	uint64_t	mReceivedValue{0};
+	uint64_t	mUnspentCount{0};		// Those which are unspent at the height
+	uint64_t	mUnspentValue{0};
+};
+
+class UtxoSet
+{
+public:
+	// Returns null if the set in 'utxoDir' could not be opened.  The set starts at its last height.
+	static UtxoSet *create(const char *utxoDir);
+
+	virtual uint32_t getBlockCount(void) const = 0;
+	virtual uint64_t getTransactionCount(void) const = 0;
+	virtual uint64_t getOutputCount(void) const = 0;
+
+	// The set is as it was after the blocks [0,height); in the range [0,getBlockCount()]
+	virtual uint32_t getHeight(void) const = 0;
+
+	// Move the set to this height by replaying the inputs of the blocks in between; forwards or backwards from
+	// the current height, or backwards from the last height, whichever has fewer inputs to replay.  Returns false
+	// if the height is out of range.
+	virtual bool setHeight(uint32_t height) = 0;
+
+	// Returns the global number of this outpoint; UTXO_NO_OUTPUT if the transaction is unknown or has no such
+	// output.  Where a txid was reused the latest transaction is returned.
+	virtual uint64_t findOutput(const uint8_t txid[32],uint32_t outputIndex) const = 0;
+
+	// Returns the number of outputs of the transaction with this txid and sets 'firstOutput' and 'blockHeight';
+	// zero if it is unknown
+	virtual uint32_t findTransaction(const uint8_t txid[32],uint64_t &firstOutput,uint32_t &blockHeight) const = 0;
+
+	// Returns false if the output number is out of range; otherwise its txid, index and the height it was created at
+	virtual bool getOutPoint(uint64_t outputNumber,uint8_t txid[32],uint32_t &outputIndex,uint32_t &blockHeight) const = 0;
+
+	// True if the output was created before the current height and is not spent at it
+	virtual bool isUnspent(uint64_t outputNumber) const = 0;
+
+	virtual uint64_t getValue(uint64_t outputNumber) const = 0;
+
+	virtual uint64_t getScriptId(uint64_t outputNumber) const = 0;
+
+	// Scans the script id column on 'threadCount' threads (zero for every core) for the outputs paying to
+	// each of the scripts at the current height.  If 'unspentOutputs' is not null it is an array of 'count'
+	// vectors; each receives the numbers of the unspent outputs of its script, in order.
+	virtual void getBalances(uint32_t threadCount,uint32_t count,const uint64_t *scriptIds,UtxoBalance *balances,std::vector< uint64_t > *unspentOutputs) const = 0;
+
+	// The outputs of every script; the number and value of the outputs created and unspent at the current height
+	virtual void getTotals(uint32_t threadCount,UtxoBalance &totals) const = 0;
+
+	virtual void release(void) = 0;
+protected:
+	virtual ~UtxoSet(void)
+	{
+	}
+};
+
+}
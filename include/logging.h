@@ -4,11 +4,14 @@
 #include <stdint.h>
 
 // Utility and helper functions to print and log output
+// The functions returning a string use a per thread buffer; the result is valid until the next call on the same thread.
+// logMessage may be called from any thread.
 const char * formatNumber(int32_t number); // JWR  format this integer into a fancy comma delimited string
 const char *getDateString(uint32_t t);
 const char *getTimeString(uint32_t timeStamp);
 void printReverseHash(const uint8_t hash[32]);
 void logMessage(const char *fmt, ...);
+void setLogEnabled(bool state); // When disabled, logMessage discards everything; used to silence diagnostics during fuzzing
 void logBitcoinAddress(const uint8_t address[25]);
 const char *getBitcoinAddressAscii(const uint8_t address[25]);
 uint32_t getKey(void);
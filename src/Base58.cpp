@@ -1,4 +1,5 @@
 #include "Base58.h"
+#include "SHA256.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -400,6 +401,12 @@ bool CBEncodeBase58(BigNumber * bi,char *str,uint32_t maxStrLen)
 		}
 	}
 	uint32_t zeros = x;
+	if ( zeros == bi->length )
+	{
+		// The number is zero; each zero byte is a '1' and there are no other digits
+		str[x] = '\0';
+		return true;
+	}
 	// Make temporary data store
 	uint8_t temp[MAX_BIG_NUMBER];
 	// Encode
@@ -492,4 +499,199 @@ uint32_t decodeBase58(const char *string,		// The base58 encoded string
 	}
 
 	return ret;
-}
\ No newline at end of file
+}
+// The fixed width codec.  25 bytes are held as seven big endian 32 bit limbs, the first holding only one byte.
+#define BASE58_LIMBS 7
+#define BASE58_CHUNKS 7					// 58^35 > 2^200, so seven chunks of five digits hold any 25 byte value
+#define BASE58_CHUNK_DIGITS 5
+#define BASE58_CHUNK 656356768ULL		// 58^5; the largest power of 58 below 2^32
+
+// The value of each ASCII character in the alphabet; -1 for the others
+static const int8_t base58Values[128] =
+{
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1, 0, 1, 2, 3, 4, 5, 6, 7, 8,-1,-1,-1,-1,-1,-1,
+	-1, 9,10,11,12,13,14,15,16,-1,17,18,19,20,21,-1,
+	22,23,24,25,26,27,28,29,30,31,32,-1,-1,-1,-1,-1,
+	-1,33,34,35,36,37,38,39,40,41,42,43,-1,44,45,46,
+	47,48,49,50,51,52,53,54,55,56,57,-1,-1,-1,-1,-1,
+};
+
+uint32_t encodeBase58Address(const uint8_t address[25],char output[BASE58_ADDRESS_SIZE])
+{
+	uint32_t limbs[BASE58_LIMBS];
+	limbs[0] = address[0];
+	for (uint32_t i=1; i<BASE58_LIMBS; i++)
+	{
+		const uint8_t *p = address + 1 + (i-1)*4;
+		limbs[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+	}
+	// Each pass divides the whole value by 58^5; the remainders are the chunks, least significant first
+	uint32_t chunks[BASE58_CHUNKS];
+	for (uint32_t c=BASE58_CHUNKS; c--; )
+	{
+		uint64_t remainder = 0;
+		for (uint32_t i=0; i<BASE58_LIMBS; i++)
+		{
+			uint64_t v = (remainder << 32) | limbs[i];
+			limbs[i] = uint32_t(v / BASE58_CHUNK);
+			remainder = v % BASE58_CHUNK;
+		}
+		chunks[c] = uint32_t(remainder);
+	}
+	uint8_t digits[BASE58_CHUNKS*BASE58_CHUNK_DIGITS];
+	for (uint32_t c=0; c<BASE58_CHUNKS; c++)
+	{
+		uint32_t v = chunks[c];
+		for (uint32_t d=BASE58_CHUNK_DIGITS; d--; )
+		{
+			digits[c*BASE58_CHUNK_DIGITS+d] = uint8_t(v % 58);
+			v /= 58;
+		}
+	}
+	uint32_t len = 0;
+	uint32_t zeros = 0;
+	while ( zeros < 25 && address[zeros] == 0 )
+	{
+		output[len++] = '1';
+		zeros++;
+	}
+	uint32_t first = 0;
+	while ( first < BASE58_CHUNKS*BASE58_CHUNK_DIGITS && digits[first] == 0 )
+	{
+		first++;
+	}
+	for (uint32_t i=first; i<BASE58_CHUNKS*BASE58_CHUNK_DIGITS; i++)
+	{
+		output[len++] = base58Characters[digits[i]];
+	}
+	output[len] = 0;
+	return len;
+}
+
+bool decodeBase58Address(const char *string,uint8_t address[25])
+{
+	uint32_t len = 0;
+	while ( len < BASE58_ADDRESS_SIZE && string[len] )
+	{
+		len++;
+	}
+	if ( len == 0 || len >= BASE58_ADDRESS_SIZE )
+	{
+		return false;
+	}
+	uint32_t limbs[BASE58_LIMBS] = { 0, 0, 0, 0, 0, 0, 0 };
+	// Multiply in up to five digits at a time; the first group takes the odd digits over a multiple of five
+	uint32_t i = 0;
+	uint32_t group = len % BASE58_CHUNK_DIGITS ? len % BASE58_CHUNK_DIGITS : BASE58_CHUNK_DIGITS;
+	while ( i < len )
+	{
+		uint32_t value = 0;
+		uint32_t scale = 1;
+		for (uint32_t j=0; j<group; j++, i++)
+		{
+			uint8_t c = uint8_t(string[i]);
+			int8_t d = c < 128 ? base58Values[c] : -1;
+			if ( d < 0 )
+			{
+				return false;
+			}
+			value = value*58 + uint32_t(d);
+			scale *= 58;
+		}
+		uint64_t carry = value;
+		for (uint32_t l=BASE58_LIMBS; l--; )
+		{
+			uint64_t v = uint64_t(limbs[l])*scale + carry;
+			limbs[l] = uint32_t(v);
+			carry = v >> 32;
+		}
+		if ( carry || limbs[0] > 0xFF )
+		{
+			return false;	// more than 25 bytes
+		}
+		group = BASE58_CHUNK_DIGITS;
+	}
+	address[0] = uint8_t(limbs[0]);
+	for (uint32_t l=1; l<BASE58_LIMBS; l++)
+	{
+		uint8_t *p = address + 1 + (l-1)*4;
+		p[0] = uint8_t(limbs[l] >> 24);
+		p[1] = uint8_t(limbs[l] >> 16);
+		p[2] = uint8_t(limbs[l] >> 8);
+		p[3] = uint8_t(limbs[l]);
+	}
+	// Each leading '1' is a leading zero byte, so the value must fill the rest of the 25 bytes exactly
+	uint32_t ones = 0;
+	while ( ones < len && string[ones] == '1' )
+	{
+		ones++;
+	}
+	uint32_t zeros = 0;
+	while ( zeros < 25 && address[zeros] == 0 )
+	{
+		zeros++;
+	}
+	return ones == zeros;
+}
+
+static bool checksumMatches(const uint8_t address[25],const uint8_t hash[32])
+{
+	return memcmp(address+21,hash,4) == 0;
+}
+
+bool decodeBase58Check(const char *string,uint8_t address[25])
+{
+	if ( !decodeBase58Address(string,address) )
+	{
+		return false;
+	}
+	uint8_t hash[32];
+	computeDoubleSHA256(address,21,hash);
+	return checksumMatches(address,hash);
+}
+
+// Batches are decoded this many at a time, so the checksum scratch memory lives on the stack
+#define BASE58_BATCH_SIZE 64
+
+void encodeBase58AddressBatch(uint32_t count,const uint8_t (*addresses)[25],char (*outputs)[BASE58_ADDRESS_SIZE])
+{
+	for (uint32_t i=0; i<count; i++)
+	{
+		encodeBase58Address(addresses[i],outputs[i]);
+	}
+}
+
+uint32_t decodeBase58CheckBatch(uint32_t count,const char *const *strings,uint8_t (*addresses)[25],bool *valid)
+{
+	uint32_t ret = 0;
+	const uint8_t *inputs[BASE58_BATCH_SIZE];
+	uint32_t sizes[BASE58_BATCH_SIZE];
+	uint32_t index[BASE58_BATCH_SIZE];
+	uint8_t hashes[BASE58_BATCH_SIZE][32];
+	uint32_t i = 0;
+	while ( i < count )
+	{
+		uint32_t n = 0;
+		for (; i<count && n<BASE58_BATCH_SIZE; i++)
+		{
+			valid[i] = decodeBase58Address(strings[i],addresses[i]);
+			if ( valid[i] )
+			{
+				inputs[n] = addresses[i];
+				sizes[n] = 21;
+				index[n] = i;
+				n++;
+			}
+		}
+		computeDoubleSHA256Batch(n,inputs,sizes,hashes);
+		for (uint32_t j=0; j<n; j++)
+		{
+			valid[index[j]] = checksumMatches(addresses[index[j]],hashes[j]);
+			ret += valid[index[j]] ? 1 : 0;
+		}
+	}
+	return ret;
+}
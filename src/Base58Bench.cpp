@@ -0,0 +1,226 @@
+#include "Base58Bench.h"
+#include "Base58.h"
+#include "BitcoinAddress.h"
+#include "SHA256.h"
+#include "ScopedTime.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#define BASE58_BENCH_BATCH 512		// addresses handed to each batch call
+#define BASE58_BENCH_CORRUPT 16		// one string in this many has a character changed, so its checksum fails
+
+namespace base58bench
+{
+
+class Base58BenchImpl : public Base58Bench
+{
+public:
+	virtual bool run(uint32_t count) final
+	{
+		if ( count == 0 )
+		{
+			count = 1;
+		}
+		buildAddresses(count);
+		bool ok = true;
+		printf("Base58 encoding of %s addresses\n", formatNumber(count));
+
+		// The general routines are the reference
+		std::vector< char > reference(size_t(count)*BASE58_ADDRESS_SIZE);
+		Timer t;
+		for (uint32_t i=0; i<count; i++)
+		{
+			encodeBase58(getAddress(i),25,true,&reference[size_t(i)*BASE58_ADDRESS_SIZE],BASE58_ADDRESS_SIZE);
+		}
+		double general = t.getElapsedSeconds();
+		report("general",count,general,general);
+
+		std::vector< char > strings(reference.size());
+		t.reset();
+		for (uint32_t i=0; i<count; i++)
+		{
+			encodeBase58Address(getAddress(i),getString(strings,i));
+		}
+		report("fixed width",count,t.getElapsedSeconds(),general);
+		ok &= compareStrings(reference,strings,"fixed width");
+
+		memset(&strings[0],0,strings.size());
+		t.reset();
+		for (uint32_t i=0; i<count; i+=BASE58_BENCH_BATCH)
+		{
+			uint32_t n = count - i < BASE58_BENCH_BATCH ? count - i : BASE58_BENCH_BATCH;
+			encodeBase58AddressBatch(n,reinterpret_cast< const uint8_t (*)[25] >(getAddress(i)),reinterpret_cast< char (*)[BASE58_ADDRESS_SIZE] >(getString(strings,i)));
+		}
+		report("batch",count,t.getElapsedSeconds(),general);
+		ok &= compareStrings(reference,strings,"batch");
+
+		// Damage some of the strings; a changed character is still in the alphabet so only the checksum catches it
+		for (uint32_t i=0; i<count; i+=BASE58_BENCH_CORRUPT)
+		{
+			char *s = getString(reference,i);
+			size_t len = strlen(s);
+			char &c = s[len/2];
+			c = c == 'z' ? 'y' : 'z';
+		}
+		std::vector< const char *> inputs(count);
+		for (uint32_t i=0; i<count; i++)
+		{
+			inputs[i] = getString(reference,i);
+		}
+
+		printf("Base58Check decoding of %s addresses\n", formatNumber(count));
+		std::vector< uint8_t > expected(size_t(count)*25);
+		std::vector< bool > expectedValid(count);
+		t.reset();
+		for (uint32_t i=0; i<count; i++)
+		{
+			uint8_t *address = &expected[size_t(i)*25];
+			bool valid = decodeBase58(inputs[i],address,25,true) == 25;
+			if ( valid )
+			{
+				uint8_t checksum[32];
+				computeDoubleSHA256(address,21,checksum);
+				valid = memcmp(address+21,checksum,4) == 0;
+			}
+			expectedValid[i] = valid;
+		}
+		general = t.getElapsedSeconds();
+		report("general",count,general,general);
+
+		std::vector< uint8_t > decoded(expected.size());
+		std::vector< uint8_t > valid(count);
+		t.reset();
+		for (uint32_t i=0; i<count; i++)
+		{
+			valid[i] = decodeBase58Check(inputs[i],&decoded[size_t(i)*25]);
+		}
+		report("fixed width",count,t.getElapsedSeconds(),general);
+		ok &= compareDecoded(expected,expectedValid,decoded,valid,"fixed width");
+
+		memset(&decoded[0],0,decoded.size());
+		bool batchValid[BASE58_BENCH_BATCH];
+		t.reset();
+		for (uint32_t i=0; i<count; i+=BASE58_BENCH_BATCH)
+		{
+			uint32_t n = count - i < BASE58_BENCH_BATCH ? count - i : BASE58_BENCH_BATCH;
+			decodeBase58CheckBatch(n,&inputs[i],reinterpret_cast< uint8_t (*)[25] >(&decoded[size_t(i)*25]),batchValid);
+			for (uint32_t j=0; j<n; j++)
+			{
+				valid[i+j] = batchValid[j];
+			}
+		}
+		report("batch",count,t.getElapsedSeconds(),general);
+		ok &= compareDecoded(expected,expectedValid,decoded,valid,"batch");
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Random pay to public key hash and script hash addresses with correct checksums.  Some hashes have leading zero
+	// bytes, which are encoded as extra leading '1's.  Some have a version byte of 0xc4 (testnet script hash) or
+	// above, and the last is the largest payload, every byte 0xFF; these need all 35 characters.
+	void buildAddresses(uint32_t count)
+	{
+		std::mt19937 random(3);
+		mAddresses.resize(size_t(count)*25);
+		for (uint32_t i=0; i<count; i++)
+		{
+			uint8_t hash[20];
+			for (auto &b:hash)
+			{
+				b = uint8_t(random());
+			}
+			uint32_t zeros = random() % 8 == 0 ? random() % 4 : 0;
+			memset(hash,0,zeros);
+			if ( random() & 1 )
+			{
+				bitcoinRIPEMD160ToAddress(hash,getAddress(i));
+			}
+			else
+			{
+				bitcoinRIPEMD160ToScriptAddress(hash,getAddress(i));
+			}
+			if ( random() % 8 == 0 )
+			{
+				uint8_t *address = getAddress(i);
+				address[0] = uint8_t(0xc4 + random() % 0x3c);
+				uint8_t checksum[32];
+				computeDoubleSHA256(address,21,checksum);
+				memcpy(address+21,checksum,4);
+			}
+		}
+		memset(getAddress(count-1),0xFF,25);
+	}
+
+	uint8_t *getAddress(uint32_t index)
+	{
+		return &mAddresses[size_t(index)*25];
+	}
+
+	static char *getString(std::vector< char > &strings,uint32_t index)
+	{
+		return &strings[size_t(index)*BASE58_ADDRESS_SIZE];
+	}
+
+	bool compareStrings(std::vector< char > &reference,std::vector< char > &strings,const char *name)
+	{
+		uint32_t count = uint32_t(mAddresses.size() / 25);
+		for (uint32_t i=0; i<count; i++)
+		{
+			if ( strcmp(getString(reference,i),getString(strings,i)) != 0 )
+			{
+				printf("  ERROR: the %s encoding of address %d is '%s' rather than '%s'.\n", name, i, getString(strings,i), getString(reference,i));
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool compareDecoded(const std::vector< uint8_t > &expected,const std::vector< bool > &expectedValid,const std::vector< uint8_t > &decoded,const std::vector< uint8_t > &valid,const char *name)
+	{
+		uint32_t count = uint32_t(expectedValid.size());
+		uint32_t validCount = 0;
+		for (uint32_t i=0; i<count; i++)
+		{
+			if ( bool(valid[i]) != expectedValid[i] || (valid[i] && memcmp(&expected[size_t(i)*25],&decoded[size_t(i)*25],25) != 0) )
+			{
+				printf("  ERROR: the %s decoding of string %d does not match the general routine.\n", name, i);
+				return false;
+			}
+			validCount += valid[i] ? 1 : 0;
+		}
+		if ( validCount == count || validCount == 0 )
+		{
+			printf("  ERROR: the damaged strings were not rejected by their checksums.\n");
+			return false;
+		}
+		return true;
+	}
+
+	void report(const char *name,uint32_t count,double seconds,double generalSeconds)
+	{
+		if ( seconds <= 0 )
+		{
+			seconds = 1e-9;
+		}
+		printf("  %-12s : %8.1f ns per address %8.2f million/s %6.1fx\n", name, seconds*1e9 / double(count), double(count) / (seconds*1000000), generalSeconds / seconds);
+	}
+
+	std::vector< uint8_t >	mAddresses;	// 25 bytes each
+};
+
+Base58Bench *Base58Bench::create(void)
+{
+	auto ret = new Base58BenchImpl;
+	return static_cast< Base58Bench *>(ret);
+}
+
+}
@@ -0,0 +1,239 @@
+#include "Bech32.h"
+#include <string.h>
+
+#define BECH32_CONSTANT 1				// The checksum constant of Bech32
+#define BECH32M_CONSTANT 0x2bc830a3		// and of Bech32m
+#define BECH32_CHECKSUM_LENGTH 6
+
+static const char bech32Characters[33] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+// The value of each ASCII character in the alphabet, in either case; -1 for the others
+static const int8_t bech32Values[128] =
+{
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	15,-1,10,17,21,20,26,30, 7, 5,-1,-1,-1,-1,-1,-1,
+	-1,29,-1,24,13,25, 9, 8,23,-1,18,22,31,27,19,-1,
+	 1, 0, 3,16,11,28,12,14, 6, 4, 2,-1,-1,-1,-1,-1,
+	-1,29,-1,24,13,25, 9, 8,23,-1,18,22,31,27,19,-1,
+	 1, 0, 3,16,11,28,12,14, 6, 4, 2,-1,-1,-1,-1,-1,
+};
+
+// The generator terms for each value of the five bits shifted out of the checksum at a step
+class Bech32Table
+{
+public:
+	Bech32Table(void)
+	{
+		static const uint32_t generator[5] = { 0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3 };
+		for (uint32_t i=0; i<32; i++)
+		{
+			uint32_t v = 0;
+			for (uint32_t bit=0; bit<5; bit++)
+			{
+				if ( i & (1 << bit) )
+				{
+					v ^= generator[bit];
+				}
+			}
+			mTerms[i] = v;
+		}
+	}
+
+	uint32_t	mTerms[32];
+};
+
+static const Bech32Table gTable;
+
+static inline uint32_t polymodStep(uint32_t checksum,uint32_t value)
+{
+	return ((checksum & 0x1ffffff) << 5) ^ value ^ gTable.mTerms[checksum >> 25];
+}
+
+// The checksum of the human readable part; its high bits, a zero and its low bits
+static uint32_t hrpChecksum(const char *hrp,uint32_t hrpLength)
+{
+	uint32_t checksum = 1;
+	for (uint32_t i=0; i<hrpLength; i++)
+	{
+		checksum = polymodStep(checksum,uint8_t(hrp[i]) >> 5);
+	}
+	checksum = polymodStep(checksum,0);
+	for (uint32_t i=0; i<hrpLength; i++)
+	{
+		checksum = polymodStep(checksum,uint8_t(hrp[i]) & 31);
+	}
+	return checksum;
+}
+
+static bool validProgramLength(uint32_t witnessVersion,uint32_t programLength)
+{
+	if ( witnessVersion > 16 || programLength < 2 || programLength > BECH32_MAX_PROGRAM )
+	{
+		return false;
+	}
+	return witnessVersion != 0 || programLength == 20 || programLength == 32;
+}
+
+uint32_t encodeSegwitAddress(const char *hrp,uint32_t witnessVersion,const uint8_t *program,uint32_t programLength,char output[BECH32_ADDRESS_SIZE])
+{
+	output[0] = 0;
+	uint32_t hrpLength = uint32_t(strlen(hrp));
+	uint32_t dataLength = 1 + (programLength*8 + 4) / 5;
+	if ( !validProgramLength(witnessVersion,programLength) || hrpLength == 0 || hrpLength + 1 + dataLength + BECH32_CHECKSUM_LENGTH >= BECH32_ADDRESS_SIZE )
+	{
+		return 0;
+	}
+	for (uint32_t i=0; i<hrpLength; i++)
+	{
+		if ( hrp[i] < 33 || hrp[i] > 126 || (hrp[i] >= 'A' && hrp[i] <= 'Z') )
+		{
+			return 0;
+		}
+	}
+	memcpy(output,hrp,hrpLength);
+	char *dest = output + hrpLength;
+	*dest++ = '1';
+	uint32_t checksum = hrpChecksum(hrp,hrpLength);
+	checksum = polymodStep(checksum,witnessVersion);
+	*dest++ = bech32Characters[witnessVersion];
+	// Regroup the program's bytes as 5 bit values, the last padded with zero bits
+	uint32_t accumulator = 0;
+	uint32_t bits = 0;
+	for (uint32_t i=0; i<programLength; i++)
+	{
+		accumulator = (accumulator << 8) | program[i];
+		bits += 8;
+		while ( bits >= 5 )
+		{
+			bits -= 5;
+			uint32_t v = (accumulator >> bits) & 31;
+			checksum = polymodStep(checksum,v);
+			*dest++ = bech32Characters[v];
+		}
+	}
+	if ( bits )
+	{
+		uint32_t v = (accumulator << (5 - bits)) & 31;
+		checksum = polymodStep(checksum,v);
+		*dest++ = bech32Characters[v];
+	}
+	for (uint32_t i=0; i<BECH32_CHECKSUM_LENGTH; i++)
+	{
+		checksum = polymodStep(checksum,0);
+	}
+	checksum ^= witnessVersion == 0 ? BECH32_CONSTANT : BECH32M_CONSTANT;
+	for (uint32_t i=0; i<BECH32_CHECKSUM_LENGTH; i++)
+	{
+		*dest++ = bech32Characters[(checksum >> (5 * (5 - i))) & 31];
+	}
+	*dest = 0;
+	return uint32_t(dest - output);
+}
+
+bool decodeSegwitAddress(const char *hrp,const char *address,uint32_t &witnessVersion,uint8_t program[BECH32_MAX_PROGRAM],uint32_t &programLength)
+{
+	witnessVersion = 0;
+	programLength = 0;
+	uint32_t hrpLength = uint32_t(strlen(hrp));
+	uint32_t length = 0;
+	bool lower = false;
+	bool upper = false;
+	uint32_t separator = 0;
+	for (; address[length]; length++)
+	{
+		char c = address[length];
+		if ( length >= BECH32_ADDRESS_SIZE - 1 || c < 33 || c > 126 )
+		{
+			return false;
+		}
+		lower |= c >= 'a' && c <= 'z';
+		upper |= c >= 'A' && c <= 'Z';
+		if ( c == '1' )
+		{
+			separator = length;
+		}
+	}
+	// The separator is the last '1'; the human readable part before it must be the one expected
+	if ( (lower && upper) || separator != hrpLength || length < hrpLength + 1 + 1 + BECH32_CHECKSUM_LENGTH )
+	{
+		return false;
+	}
+	for (uint32_t i=0; i<hrpLength; i++)
+	{
+		char c = address[i];
+		if ( c >= 'A' && c <= 'Z' )
+		{
+			c = char(c - 'A' + 'a');
+		}
+		if ( c != hrp[i] )
+		{
+			return false;
+		}
+	}
+	uint32_t checksum = hrpChecksum(hrp,hrpLength);
+	uint32_t dataLength = length - hrpLength - 1;
+	const char *data = address + hrpLength + 1;
+	uint32_t accumulator = 0;
+	uint32_t bits = 0;
+	for (uint32_t i=0; i<dataLength; i++)
+	{
+		int8_t v = bech32Values[uint8_t(data[i])];
+		if ( v < 0 )
+		{
+			return false;
+		}
+		checksum = polymodStep(checksum,uint32_t(v));
+		if ( i == 0 )
+		{
+			witnessVersion = uint32_t(v);
+		}
+		else if ( i < dataLength - BECH32_CHECKSUM_LENGTH )
+		{
+			// Regroup the 5 bit values of the program as bytes
+			accumulator = (accumulator << 5) | uint32_t(v);
+			bits += 5;
+			if ( bits >= 8 )
+			{
+				bits -= 8;
+				if ( programLength == BECH32_MAX_PROGRAM )
+				{
+					return false;
+				}
+				program[programLength++] = uint8_t(accumulator >> bits);
+			}
+		}
+	}
+	// At most four bits of zero padding
+	if ( bits >= 5 || (accumulator & ((1u << bits) - 1)) != 0 )
+	{
+		return false;
+	}
+	if ( !validProgramLength(witnessVersion,programLength) )
+	{
+		return false;
+	}
+	return checksum == (witnessVersion == 0 ? BECH32_CONSTANT : BECH32M_CONSTANT);
+}
+
+void encodeSegwitAddressBatch(const char *hrp,uint32_t count,const uint8_t *witnessVersions,const uint8_t *const *programs,const uint32_t *programLengths,char (*outputs)[BECH32_ADDRESS_SIZE],uint32_t *lengths)
+{
+	for (uint32_t i=0; i<count; i++)
+	{
+		lengths[i] = encodeSegwitAddress(hrp,witnessVersions[i],programs[i],programLengths[i],outputs[i]);
+	}
+}
+
+uint32_t decodeSegwitAddressBatch(const char *hrp,uint32_t count,const char *const *addresses,uint8_t *witnessVersions,uint8_t (*programs)[BECH32_MAX_PROGRAM],uint32_t *programLengths,bool *valid)
+{
+	uint32_t ret = 0;
+	for (uint32_t i=0; i<count; i++)
+	{
+		uint32_t version;
+		valid[i] = decodeSegwitAddress(hrp,addresses[i],version,programs[i],programLengths[i]);
+		witnessVersions[i] = uint8_t(version);
+		ret += valid[i] ? 1 : 0;
+	}
+	return ret;
+}
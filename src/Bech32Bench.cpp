@@ -0,0 +1,251 @@
+#include "Bech32Bench.h"
+#include "Bech32.h"
+#include "Base58.h"
+#include "HexCodec.h"
+#include "ScopedTime.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <random>
+#include <vector>
+
+#define BECH32_BENCH_BATCH 512		// programs handed to each batch call
+
+namespace bech32bench
+{
+
+// A BIP173 or BIP350 test vector; the script is the witness version opcode, the push and the program, in hex.
+// Invalid addresses have no script.
+class TestVector
+{
+public:
+	const char	*mAddress;
+	const char	*mScript;
+};
+
+static const TestVector gTestVectors[] =
+{
+	{ "BC1QW508D6QEJXTDG4Y5R3ZARVARY0C5XW7KV8F3T4", "0014751e76e8199196d454941c45d1b3a323f1433bd6" },
+	{ "bc1pw508d6qejxtdg4y5r3zarvary0c5xw7kw508d6qejxtdg4y5r3zarvary0c5xw7kt5nd6y", "5128751e76e8199196d454941c45d1b3a323f1433bd6751e76e8199196d454941c45d1b3a323f1433bd6" },
+	{ "BC1SW50QGDZ25J", "6002751e" },
+	{ "bc1zw508d6qejxtdg4y5r3zarvaryvaxxpcs", "5210751e76e8199196d454941c45d1b3a323" },
+	{ "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0", "512079be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798" },
+	{ "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqh2y7hd", nullptr },		// Bech32 checksum on version 1
+	{ "BC1S0XLXVLHEMJA6C4DQV22UAPCTQUPFHLXM9H8Z3K2E72Q4K9HCZ7VQ54WELL", nullptr },		// Bech32 checksum on version 16
+	{ "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kemeawh", nullptr },							// Bech32m checksum on version 0
+	{ "BC130XLXVLHEMJA6C4DQV22UAPCTQUPFHLXM9H8Z3K2E72Q4K9HCZ7VQ7ZWS8R", nullptr },		// version 17
+	{ "bc1pw5dgrnzv", nullptr },														// one byte program
+	{ "BC1QR508D6QEJXTDG4Y5R3ZARVARYV98GJ9P", nullptr },								// 16 byte version 0 program
+	{ "bc1zw508d6qejxtdg4y5r3zarvaryvqyzf3du", nullptr },								// more than four padding bits
+	{ "bc1gmk9yu", nullptr },															// no data
+	{ "tb1qw508d6qejxtdg4y5r3zarvary0c5xw7kxpjzsx", nullptr },							// the test network
+};
+
+class Bech32BenchImpl : public Bech32Bench
+{
+public:
+	virtual bool run(uint32_t count) final
+	{
+		if ( count == 0 )
+		{
+			count = 1;
+		}
+		bool ok = checkTestVectors();
+		buildPrograms(count);
+
+		printf("Bech32/Bech32m encoding of %s witness programs\n", formatNumber(count));
+		std::vector< char > addresses(size_t(count)*BECH32_ADDRESS_SIZE);
+		std::vector< uint32_t > lengths(count);
+		Timer t;
+		for (uint32_t i=0; i<count; i++)
+		{
+			lengths[i] = encodeSegwitAddress("bc",mVersions[i],mPrograms[i],mProgramLengths[i],getAddress(addresses,i));
+		}
+		report("one at a time",count,t.getElapsedSeconds());
+		std::vector< char > batch(addresses.size());
+		std::vector< uint32_t > batchLengths(count);
+		t.reset();
+		for (uint32_t i=0; i<count; i+=BECH32_BENCH_BATCH)
+		{
+			uint32_t n = count - i < BECH32_BENCH_BATCH ? count - i : BECH32_BENCH_BATCH;
+			encodeSegwitAddressBatch("bc",n,&mVersions[i],&mPrograms[i],&mProgramLengths[i],reinterpret_cast< char (*)[BECH32_ADDRESS_SIZE] >(getAddress(batch,i)),&batchLengths[i]);
+		}
+		report("batch",count,t.getElapsedSeconds());
+		for (uint32_t i=0; i<count; i++)
+		{
+			if ( lengths[i] == 0 || lengths[i] != batchLengths[i] || strcmp(getAddress(addresses,i),getAddress(batch,i)) != 0 )
+			{
+				printf("  ERROR: program %d was not encoded, or the batch encoded it differently.\n", i);
+				ok = false;
+				break;
+			}
+		}
+		reportBase58(count);
+
+		printf("Bech32/Bech32m decoding of %s addresses\n", formatNumber(count));
+		std::vector< const char *> inputs(count);
+		for (uint32_t i=0; i<count; i++)
+		{
+			inputs[i] = getAddress(addresses,i);
+		}
+		std::vector< uint8_t > programs(size_t(count)*BECH32_MAX_PROGRAM);
+		std::vector< uint8_t > versions(count);
+		std::vector< uint32_t > programLengths(count);
+		std::vector< uint8_t > valid(count);
+		t.reset();
+		for (uint32_t i=0; i<count; i++)
+		{
+			uint32_t version;
+			valid[i] = decodeSegwitAddress("bc",inputs[i],version,&programs[size_t(i)*BECH32_MAX_PROGRAM],programLengths[i]);
+			versions[i] = uint8_t(version);
+		}
+		report("one at a time",count,t.getElapsedSeconds());
+		ok &= checkRoundTrip(programs,versions,programLengths,valid,"one at a time");
+		memset(&programs[0],0,programs.size());
+		bool batchValid[BECH32_BENCH_BATCH];
+		t.reset();
+		for (uint32_t i=0; i<count; i+=BECH32_BENCH_BATCH)
+		{
+			uint32_t n = count - i < BECH32_BENCH_BATCH ? count - i : BECH32_BENCH_BATCH;
+			decodeSegwitAddressBatch("bc",n,&inputs[i],&versions[i],reinterpret_cast< uint8_t (*)[BECH32_MAX_PROGRAM] >(&programs[size_t(i)*BECH32_MAX_PROGRAM]),&programLengths[i],batchValid);
+			for (uint32_t j=0; j<n; j++)
+			{
+				valid[i+j] = batchValid[j];
+			}
+		}
+		report("batch",count,t.getElapsedSeconds());
+		ok &= checkRoundTrip(programs,versions,programLengths,valid,"batch");
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	bool checkTestVectors(void)
+	{
+		bool ok = true;
+		uint32_t passed = 0;
+		for (auto &v:gTestVectors)
+		{
+			uint32_t version;
+			uint8_t program[BECH32_MAX_PROGRAM];
+			uint32_t programLength;
+			bool valid = decodeSegwitAddress("bc",v.mAddress,version,program,programLength);
+			bool match = valid == (v.mScript != nullptr);
+			if ( match && valid )
+			{
+				// Check the script and that the program encodes back to the address, in lower case
+				uint8_t scriptBytes[BECH32_MAX_PROGRAM+2];
+				char script[2*(BECH32_MAX_PROGRAM+2)+1];
+				scriptBytes[0] = uint8_t(version ? 0x50 + version : 0);
+				scriptBytes[1] = uint8_t(programLength);
+				memcpy(scriptBytes+2,program,programLength);
+				encodeHex(scriptBytes,programLength+2,script);
+				char address[BECH32_ADDRESS_SIZE];
+				char lower[BECH32_ADDRESS_SIZE];
+				encodeSegwitAddress("bc",version,program,programLength,address);
+				size_t len = strlen(v.mAddress);
+				for (size_t i=0; i<=len; i++)
+				{
+					lower[i] = char(tolower(v.mAddress[i]));
+				}
+				match = strcmp(script,v.mScript) == 0 && strcmp(address,lower) == 0;
+			}
+			if ( match )
+			{
+				passed++;
+			}
+			else
+			{
+				printf("  ERROR: test vector '%s' was not %s.\n", v.mAddress, v.mScript ? "decoded correctly" : "rejected");
+				ok = false;
+			}
+		}
+		printf("Bech32/Bech32m test vectors: %d of %d passed\n", passed, uint32_t(sizeof(gTestVectors)/sizeof(gTestVectors[0])));
+		return ok;
+	}
+
+	// Random programs in roughly the proportions seen on chain today: mostly version 0 key and script hashes and
+	// version 1 taproot keys, with a few future versions of other lengths
+	void buildPrograms(uint32_t count)
+	{
+		std::mt19937 random(4);
+		mProgramData.resize(size_t(count)*BECH32_MAX_PROGRAM);
+		for (auto &b:mProgramData)
+		{
+			b = uint8_t(random());
+		}
+		mVersions.resize(count);
+		mPrograms.resize(count);
+		mProgramLengths.resize(count);
+		for (uint32_t i=0; i<count; i++)
+		{
+			uint32_t kind = random() % 16;
+			mVersions[i] = uint8_t(kind < 8 ? 0 : kind < 15 ? 1 : 2 + random() % 15);
+			mProgramLengths[i] = kind < 5 ? 20 : kind < 15 ? 32 : 2 + random() % (BECH32_MAX_PROGRAM - 1);
+			mPrograms[i] = &mProgramData[size_t(i)*BECH32_MAX_PROGRAM];
+		}
+	}
+
+	static char *getAddress(std::vector< char > &addresses,uint32_t index)
+	{
+		return &addresses[size_t(index)*BECH32_ADDRESS_SIZE];
+	}
+
+	bool checkRoundTrip(const std::vector< uint8_t > &programs,const std::vector< uint8_t > &versions,const std::vector< uint32_t > &programLengths,const std::vector< uint8_t > &valid,const char *name)
+	{
+		uint32_t count = uint32_t(mVersions.size());
+		for (uint32_t i=0; i<count; i++)
+		{
+			if ( !valid[i] || versions[i] != mVersions[i] || programLengths[i] != mProgramLengths[i] ||
+				 memcmp(&programs[size_t(i)*BECH32_MAX_PROGRAM],mPrograms[i],mProgramLengths[i]) != 0 )
+			{
+				printf("  ERROR: the %s decoding of address %d does not give back its program.\n", name, i);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// The legacy address codec on the same number of addresses, for comparison
+	void reportBase58(uint32_t count)
+	{
+		char address[BASE58_ADDRESS_SIZE];
+		uint8_t payload[25];
+		Timer t;
+		for (uint32_t i=0; i<count; i++)
+		{
+			memcpy(payload,mPrograms[i],20);
+			memcpy(payload+20,mPrograms[i]+20,5);
+			encodeBase58Address(payload,address);
+		}
+		report("base58 address",count,t.getElapsedSeconds());
+	}
+
+	void report(const char *name,uint32_t count,double seconds)
+	{
+		if ( seconds <= 0 )
+		{
+			seconds = 1e-9;
+		}
+		printf("  %-14s : %8.1f ns per address %8.2f million/s\n", name, seconds*1e9 / double(count), double(count) / (seconds*1000000));
+	}
+
+	std::vector< uint8_t >			mProgramData;
+	std::vector< uint8_t >			mVersions;
+	std::vector< const uint8_t *>	mPrograms;
+	std::vector< uint32_t >			mProgramLengths;
+};
+
+Bech32Bench *Bech32Bench::create(void)
+{
+	auto ret = new Bech32BenchImpl;
+	return static_cast< Bech32Bench *>(ret);
+}
+
+}
@@ -1,5 +1,6 @@
 #include "BitcoinAddress.h"
 #include "Base58.h"
+#include "Bech32.h"
 #include "RIPEMD160.h"
 #include "SHA256.h"
 #include <assert.h>
@@ -24,8 +25,7 @@ bool bitcoinPublicKeyToAddress(const uint8_t input[65], // The 65 bytes long ECD
 		computeSHA256(input,65,hash1);	// Compute the SHA256 hash of the input public ECSDA signature
 		output[0] = 0;	// Store a network byte of 0 (i.e. 'main' network)
 		computeRIPEMD160(hash1,32,&output[1]);	// Compute the RIPEMD160 (20 byte) hash of the SHA256 hash
-		computeSHA256(output,21,hash1);	// Compute the SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
-		computeSHA256(hash1,32,hash1); // now compute the SHA256 hash of the previously computed SHA256 hash (for a checksum)
+		computeDoubleSHA256(output,21,hash1);	// Compute the double SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
 		output[21] = hash1[0];	// Store the checksum in the last 4 bytes of the public key hash
 		output[22] = hash1[1];
 		output[23] = hash1[2];
@@ -46,8 +46,7 @@ bool bitcoinCompressedPublicKeyToAddress(const uint8_t input[33], // The 33 byte
 		computeSHA256(input,33,hash1);	// Compute the SHA256 hash of the input public ECSDA signature
 		output[0] = 0;	// Store a network byte of 0 (i.e. 'main' network)
 		computeRIPEMD160(hash1,32,&output[1]);	// Compute the RIPEMD160 (20 byte) hash of the SHA256 hash
-		computeSHA256(output,21,hash1);	// Compute the SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
-		computeSHA256(hash1,32,hash1); // now compute the SHA256 hash of the previously computed SHA256 hash (for a checksum)
+		computeDoubleSHA256(output,21,hash1);	// Compute the double SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
 		output[21] = hash1[0];	// Store the checksum in the last 4 bytes of the public key hash
 		output[22] = hash1[1];
 		output[23] = hash1[2];
@@ -57,6 +56,69 @@ bool bitcoinCompressedPublicKeyToAddress(const uint8_t input[33], // The 33 byte
 	return ret;
 }
 
+// The keys of a batch are hashed this many at a time, so the intermediate hashes live on the stack
+#define KEY_BATCH_SIZE 64
+
+void bitcoinPublicKeysToHash160(uint32_t count,const uint8_t *const *keys,const uint32_t *keyLengths,uint8_t (*hashes)[20])
+{
+	uint8_t hash1[KEY_BATCH_SIZE][32]; // holds the intermediate SHA256 hash computations
+	for (uint32_t first=0; first<count; first+=KEY_BATCH_SIZE)
+	{
+		uint32_t n = count - first < KEY_BATCH_SIZE ? count - first : KEY_BATCH_SIZE;
+		computeSHA256Batch(n,keys+first,keyLengths+first,hash1);
+		computeRIPEMD160Batch(n,hash1,hashes+first);
+	}
+}
+
+uint32_t bitcoinPublicKeysToAddresses(uint32_t count,const uint8_t *const *keys,const uint32_t *keyLengths,uint8_t (*addresses)[25])
+{
+	uint32_t ret = 0;
+	const uint8_t *validKeys[KEY_BATCH_SIZE];
+	uint32_t validLengths[KEY_BATCH_SIZE];
+	uint8_t *validAddresses[KEY_BATCH_SIZE];
+	uint8_t hash160[KEY_BATCH_SIZE][20];
+	uint8_t checksum[KEY_BATCH_SIZE][32];
+	const uint8_t *checksumInputs[KEY_BATCH_SIZE];
+	uint32_t checksumSizes[KEY_BATCH_SIZE];
+	uint32_t i = 0;
+	while ( i < count )
+	{
+		// Gather the next batch of well formed keys, zeroing the address of any others
+		uint32_t n = 0;
+		for (; i<count && n<KEY_BATCH_SIZE; i++)
+		{
+			const uint8_t *key = keys[i];
+			bool valid = keyLengths[i] == 65 ? key[0] == 0x04 : (keyLengths[i] == 33 && (key[0] == 0x02 || key[0] == 0x03));
+			if ( valid )
+			{
+				validKeys[n] = key;
+				validLengths[n] = keyLengths[i];
+				validAddresses[n] = addresses[i];
+				n++;
+			}
+			else
+			{
+				memset(addresses[i],0,25);
+			}
+		}
+		bitcoinPublicKeysToHash160(n,validKeys,validLengths,hash160);
+		for (uint32_t j=0; j<n; j++)
+		{
+			uint8_t *output = validAddresses[j];
+			output[0] = 0;	// Store a network byte of 0 (i.e. 'main' network)
+			memcpy(&output[1],hash160[j],20);
+			checksumInputs[j] = output;
+			checksumSizes[j] = 21;
+		}
+		computeDoubleSHA256Batch(n,checksumInputs,checksumSizes,checksum);	// the checksum of the RIPEMD16 hash + the one byte header
+		for (uint32_t j=0; j<n; j++)
+		{
+			memcpy(&validAddresses[j][21],checksum[j],4);
+		}
+		ret+=n;
+	}
+	return ret;
+}
 
 bool bitcoinPublicKeyToAscii(const uint8_t input[65], // The 65 bytes long ECDSA public key; first byte will always be 0x4 followed by two 32 byte components
 							 char *output,				// The output ascii representation.
@@ -70,7 +132,7 @@ bool bitcoinPublicKeyToAscii(const uint8_t input[65], // The 65 bytes long ECDSA
 
 	if ( bitcoinPublicKeyToAddress(input,hash2))
 	{
-		ret = encodeBase58(hash2,25,true,output,maxOutputLen);
+		ret = bitcoinAddressToAscii(hash2,output,maxOutputLen);
 	}
 	return ret;
 }
@@ -87,7 +149,7 @@ bool bitcoinCompressedPublicKeyToAscii(const uint8_t input[33], // The 33 bytes
 
 	if ( bitcoinCompressedPublicKeyToAddress(input,hash2))
 	{
-		ret = encodeBase58(hash2,25,true,output,maxOutputLen);
+		ret = bitcoinAddressToAscii(hash2,output,maxOutputLen);
 	}
 	return ret;
 }
@@ -95,22 +157,7 @@ bool bitcoinCompressedPublicKeyToAscii(const uint8_t input[33], // The 33 bytes
 
 bool bitcoinAsciiToAddress(const char *input,uint8_t output[25]) // convert an ASCII bitcoin address into binary.
 {
-	bool ret = false;
-	uint32_t len = decodeBase58(input,output,25,true);
-	if ( len == 25 ) // the output must be *exactly* 25 bytes!
-	{
-		uint8_t checksum[32];
-		computeSHA256(output,21,checksum);
-		computeSHA256(checksum,32,checksum);
-		if ( output[21] == checksum[0] ||
-			 output[22] == checksum[1] ||
-			 output[23] == checksum[2] ||
-			 output[24] == checksum[3] )
-		{
-			ret = true; // the cheksum matches!
-		}
-	}
-	return ret;
+	return decodeBase58Check(input,output); // the output must be *exactly* 25 bytes and the checksum must match
 }
 
 
@@ -119,8 +166,7 @@ void bitcoinRIPEMD160ToAddress(const uint8_t ripeMD160[20],uint8_t output[25])
 	uint8_t hash1[32]; // holds the intermediate SHA256 hash computations
 	output[0] = 0;	// Store a network byte of 0 (i.e. 'main' network)
 	memcpy(&output[1],ripeMD160,20); // copy the 20 byte of the public key address
-	computeSHA256(output,21,hash1);	// Compute the SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
-	computeSHA256(hash1,32,hash1); // now compute the SHA256 hash of the previously computed SHA256 hash (for a checksum)
+	computeDoubleSHA256(output,21,hash1);	// Compute the double SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
 	output[21] = hash1[0];	// Store the checksum in the last 4 bytes of the public key hash
 	output[22] = hash1[1];
 	output[23] = hash1[2];
@@ -132,8 +178,7 @@ void bitcoinRIPEMD160ToScriptAddress(const uint8_t ripeMD160[20],uint8_t output[
 	uint8_t hash1[32]; // holds the intermediate SHA256 hash computations
 	output[0] = 5;	// Store a network byte of 0 (i.e. 'main' network)
 	memcpy(&output[1],ripeMD160,20); // copy the 20 byte of the public key address
-	computeSHA256(output,21,hash1);	// Compute the SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
-	computeSHA256(hash1,32,hash1); // now compute the SHA256 hash of the previously computed SHA256 hash (for a checksum)
+	computeDoubleSHA256(output,21,hash1);	// Compute the double SHA256 hash of the RIPEMD16 hash + the one byte header (for a checksum)
 	output[21] = hash1[0];	// Store the checksum in the last 4 bytes of the public key hash
 	output[22] = hash1[1];
 	output[23] = hash1[2];
@@ -144,7 +189,71 @@ bool bitcoinAddressToAscii(const uint8_t address[25],char *output,uint32_t maxOu
 {
 	bool ret = false;
 
-	ret = encodeBase58(address,25,true,output,maxOutputLen);
+	char temp[BASE58_ADDRESS_SIZE];
+	uint32_t len = encodeBase58Address(address,temp);
+	if ( len < maxOutputLen )
+	{
+		memcpy(output,temp,len+1);
+		ret = true;
+	}
 
 	return ret;
-}
\ No newline at end of file
+}
+#define WITNESS_ADDRESS_HRP "bc"	// The human readable part of main network witness addresses
+
+bool bitcoinWitnessProgramToAscii(uint32_t witnessVersion,const uint8_t *program,uint32_t programLength,char *output,uint32_t maxOutputLen)
+{
+	bool ret = false;
+
+	char temp[BECH32_ADDRESS_SIZE];
+	uint32_t len = encodeSegwitAddress(WITNESS_ADDRESS_HRP,witnessVersion,program,programLength,temp);
+	if ( len && len < maxOutputLen )
+	{
+		memcpy(output,temp,len+1);
+		ret = true;
+	}
+
+	return ret;
+}
+
+bool bitcoinAsciiToWitnessProgram(const char *input,uint32_t &witnessVersion,uint8_t program[40],uint32_t &programLength)
+{
+	return decodeSegwitAddress(WITNESS_ADDRESS_HRP,input,witnessVersion,program,programLength);
+}
+
+bool bitcoinAsciiToOutputScript(const char *input,uint8_t script[42],uint32_t &scriptLength)
+{
+	scriptLength = 0;
+	uint8_t address[25];
+	if ( bitcoinAsciiToAddress(input,address) )
+	{
+		if ( address[0] == 0x00 ) // pay to public key hash: OP_DUP OP_HASH160 <20> OP_EQUALVERIFY OP_CHECKSIG
+		{
+			script[0] = 0x76;
+			script[1] = 0xa9;
+			script[2] = 20;
+			memcpy(script+3,address+1,20);
+			script[23] = 0x88;
+			script[24] = 0xac;
+			scriptLength = 25;
+		}
+		else if ( address[0] == 0x05 ) // pay to script hash: OP_HASH160 <20> OP_EQUAL
+		{
+			script[0] = 0xa9;
+			script[1] = 20;
+			memcpy(script+2,address+1,20);
+			script[22] = 0x87;
+			scriptLength = 23;
+		}
+		return scriptLength != 0;
+	}
+	uint32_t witnessVersion;
+	uint32_t programLength;
+	if ( bitcoinAsciiToWitnessProgram(input,witnessVersion,script+2,programLength) )
+	{
+		script[0] = uint8_t(witnessVersion ? 0x50 + witnessVersion : 0); // OP_0 or OP_1 through OP_16
+		script[1] = uint8_t(programLength);
+		scriptLength = programLength + 2;
+	}
+	return scriptLength != 0;
+}
@@ -0,0 +1,147 @@
+#include "BlockArena.h"
+
+#include <assert.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define MIN_CHUNK_SIZE (1024*1024)			// the smallest chunk requested from the operating system
+#define HUGE_PAGE_SIZE (1024*1024*2)		// chunks backed by huge pages are rounded up to this size
+
+namespace blockarena
+{
+
+// Reserve and commit 'size' bytes of page aligned memory; 'size' is updated to the size actually reserved.
+// If huge pages were requested but are not available, ordinary pages are used instead.
+static uint8_t *allocPages(size_t &size,bool hugePages)
+{
+	uint8_t *ret = nullptr;
+#ifdef _MSC_VER
+	if ( hugePages )
+	{
+		// Large pages require the 'lock pages in memory' privilege; if we don't have it the allocation fails
+		size_t largePageSize = GetLargePageMinimum();
+		if ( largePageSize )
+		{
+			size_t largeSize = (size + largePageSize - 1) & ~(largePageSize - 1);
+			ret = (uint8_t *)VirtualAlloc(nullptr,largeSize,MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES,PAGE_READWRITE);
+			if ( ret )
+			{
+				size = largeSize;
+			}
+		}
+	}
+	if ( ret == nullptr )
+	{
+		ret = (uint8_t *)VirtualAlloc(nullptr,size,MEM_RESERVE|MEM_COMMIT,PAGE_READWRITE);
+	}
+#else
+	if ( hugePages )
+	{
+		size = (size + HUGE_PAGE_SIZE - 1) & ~size_t(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+		// Explicit huge pages only succeed if the administrator has reserved some; otherwise fall back to transparent huge pages
+		void *p = mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		if ( p != MAP_FAILED )
+		{
+			ret = (uint8_t *)p;
+		}
+#endif
+	}
+	if ( ret == nullptr )
+	{
+		void *p = mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if ( p != MAP_FAILED )
+		{
+			ret = (uint8_t *)p;
+#ifdef MADV_HUGEPAGE
+			if ( hugePages )
+			{
+				madvise(p,size,MADV_HUGEPAGE);
+			}
+#endif
+		}
+	}
+#endif
+	if ( ret == nullptr )
+	{
+		throw std::bad_alloc();
+	}
+	return ret;
+}
+
+static void freePages(uint8_t *p,size_t size)
+{
+#ifdef _MSC_VER
+	(void)size;
+	VirtualFree(p,0,MEM_RELEASE);
+#else
+	munmap(p,size);
+#endif
+}
+
+void BlockArena::reset(void)
+{
+	if ( mChunks.size() > 1 )
+	{
+		size_t capacity = mCapacity;
+		freeChunks();
+		addChunk(capacity);
+	}
+	mChunkIndex = 0;
+	mChunkUsed = 0;
+	if ( !mChunks.empty() )
+	{
+		mChunk = mChunks[0].mData;
+		mChunkSize = mChunks[0].mSize;
+	}
+}
+
+void *BlockArena::allocSlow(size_t size,size_t alignment)
+{
+	// Chunks are page aligned, so an allocation at the start of a chunk is always suitably aligned
+	assert( alignment <= 4096 );
+	mChunkIndex++;
+	if ( mChunkIndex >= mChunks.size() || mChunks[mChunkIndex].mSize < size )
+	{
+		size_t chunkSize = mChunks.empty() ? MIN_CHUNK_SIZE : mChunks.back().mSize*2;
+		if ( chunkSize < size )
+		{
+			chunkSize = size;
+		}
+		addChunk(chunkSize);
+		mChunkIndex = mChunks.size() - 1;
+	}
+	mChunk = mChunks[mChunkIndex].mData;
+	mChunkSize = mChunks[mChunkIndex].mSize;
+	mChunkUsed = size;
+	return mChunk;
+}
+
+void BlockArena::addChunk(size_t size)
+{
+	Chunk c;
+	c.mData = allocPages(size,mHugePages);
+	c.mSize = size;
+	mChunks.push_back(c);
+	mCapacity += size;
+}
+
+void BlockArena::freeChunks(void)
+{
+	for (auto &i:mChunks)
+	{
+		freePages(i.mData,i.mSize);
+	}
+	mChunks.clear();
+	mCapacity = 0;
+	mChunk = nullptr;
+	mChunkSize = 0;
+	mChunkUsed = 0;
+	mChunkIndex = 0;
+}
+
+}
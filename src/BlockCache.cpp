@@ -0,0 +1,525 @@
+#include "BlockCache.h"
+#include "BlockFile.h"
+#include "blocks.h"
+#include "CBlockIndex.h"
+#include "snappy.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+namespace blockcache
+{
+
+// A parsed block which owns all of its memory.  The block and transaction pointers refer into the raw block data and the arrays here.
+class CachedBlock
+{
+public:
+	// Take a copy of a block parsed from 'data'. The data is swapped into this object so the pointers into it remain valid.
+	CachedBlock(const BlockChain::Block &b,std::vector< uint8_t > &data)
+	{
+		mData.swap(data);
+		mBlock = b;
+		mTransactions.assign(b.transactions,b.transactions+b.transactionCount);
+		mInputs.reserve(b.totalInputCount);
+		copyColumn(mValues,b.outputs.values,b.totalOutputCount);
+		copyColumn(mScriptOffsets,b.outputs.scriptOffsets,b.totalOutputCount);
+		copyColumn(mScriptLengths,b.outputs.scriptLengths,b.totalOutputCount);
+		copyColumn(mKeyTypes,b.outputs.keyTypes,b.totalOutputCount);
+		copyColumn(mKeyCounts,b.outputs.keyCounts,b.totalOutputCount);
+		copyColumn(mHashes,b.outputs.hashes,b.totalOutputCount);
+		mBlock.outputs.values = mValues.data();
+		mBlock.outputs.scriptOffsets = mScriptOffsets.data();
+		mBlock.outputs.scriptLengths = mScriptLengths.data();
+		mBlock.outputs.keyTypes = mKeyTypes.data();
+		mBlock.outputs.keyCounts = mKeyCounts.data();
+		mBlock.outputs.hashes = mHashes.data();
+		uint32_t firstOutput = 0;
+		for (auto &t:mTransactions)
+		{
+			size_t firstInput = mInputs.size();
+			mInputs.insert(mInputs.end(),t.inputs,t.inputs+t.inputCount);
+			t.inputs = t.inputCount ? &mInputs[firstInput] : nullptr;
+			t.outputs = mBlock.outputs.offset(firstOutput);
+			firstOutput += t.outputCount;
+		}
+		mBlock.transactions = mTransactions.empty() ? nullptr : &mTransactions[0];
+		mBlock.nextBlockHash = nullptr;
+	}
+
+	uint64_t getByteSize(void) const
+	{
+		return sizeof(CachedBlock) + mData.size() +
+			mTransactions.size()*sizeof(BlockChain::BlockTransaction) +
+			mInputs.size()*sizeof(BlockChain::BlockInput) +
+			mValues.size()*(sizeof(uint64_t) + sizeof(uint32_t)*2 + sizeof(uint8_t)*2 + sizeof(BlockChain::OutputHash));
+	}
+
+	template <typename T>
+	static void copyColumn(std::vector< T > &dest,const T *source,uint32_t count)
+	{
+		dest.assign(source,source+count);
+	}
+
+	BlockChain::Block							mBlock;
+	std::vector< uint8_t >						mData;			// The raw block data
+	std::vector< BlockChain::BlockTransaction >	mTransactions;
+	std::vector< BlockChain::BlockInput >		mInputs;
+	std::vector< uint64_t >						mValues;		// The output columns
+	std::vector< uint32_t >						mScriptOffsets;
+	std::vector< uint32_t >						mScriptLengths;
+	std::vector< uint8_t >						mKeyTypes;
+	std::vector< uint8_t >						mKeyCounts;
+	std::vector< BlockChain::OutputHash >		mHashes;
+};
+
+typedef std::shared_ptr< CachedBlock > CachedBlockPtr;
+typedef std::list< uint32_t > HeightList;
+
+// A cache entry is either 'hot' (parsed) or 'cold' (snappy compressed raw block data)
+class CacheEntry
+{
+public:
+	CachedBlockPtr			mParsed;		// The parsed block; null for a cold entry
+	std::string				mCompressed;	// The compressed raw block; empty for a hot entry
+	uint32_t				mFileIndex{0};	// Where the block came from; needed to re-parse a cold entry
+	uint64_t				mFileOffset{0};
+	uint64_t				mByteSize{0};	// Memory charged against the budget for this entry
+	HeightList::iterator	mLRU;			// Position in either the hot or the cold list
+};
+
+typedef std::unordered_map< uint32_t, CacheEntry > CacheEntryMap;
+
+// A parsed block taken out of the hot list which is waiting to be compressed outside of the cache lock
+class PendingDemotion
+{
+public:
+	uint32_t		mBlockHeight{0};
+	CachedBlockPtr	mParsed;
+	std::string		mCompressed;
+};
+
+typedef std::vector< PendingDemotion > PendingDemotionList;
+
+// Reads and parses blocks.  Parsers are not thread safe, so the foreground and the prefetch thread each have their own.
+class BlockLoader
+{
+public:
+	~BlockLoader(void)
+	{
+		if ( mParser )
+		{
+			mParser->release();
+		}
+	}
+
+	// Parse the raw block data; on success the data is moved into the returned block
+	CachedBlockPtr parseBlock(std::vector< uint8_t > &data,uint32_t blockHeight,uint32_t fileIndex,uint64_t fileOffset,const std::string &dataDir)
+	{
+		CachedBlockPtr ret;
+
+		if ( mParser == nullptr )
+		{
+			mParser = BlockChain::createBlockChain(dataDir.c_str(),0);
+			mParser->setDecodeThreadCount(mDecodeThreadCount);
+			mParser->setVerifyMerkle(mVerifyMerkle);
+		}
+		const BlockChain::Block *b = mParser->processBlock(&data[0],uint32_t(data.size()),blockHeight,fileIndex,fileOffset);
+		if ( b )
+		{
+			ret = std::make_shared< CachedBlock >(*b,data);
+		}
+
+		return ret;
+	}
+
+	// A thread count of zero means use all available cores
+	void setDecodeThreadCount(uint32_t threadCount)
+	{
+		if ( threadCount == 0 )
+		{
+			threadCount = uint32_t(std::thread::hardware_concurrency());
+		}
+		mDecodeThreadCount = threadCount ? threadCount : 1;
+		if ( mParser )
+		{
+			mParser->setDecodeThreadCount(mDecodeThreadCount);
+		}
+	}
+
+	void setVerifyMerkle(bool state)
+	{
+		mVerifyMerkle = state;
+		if ( mParser )
+		{
+			mParser->setVerifyMerkle(state);
+		}
+	}
+
+	BlockChain	*mParser{nullptr};
+	uint32_t	mDecodeThreadCount{1};
+	bool		mVerifyMerkle{false};
+};
+
+class BlockCacheImpl : public BlockCache
+{
+public:
+	BlockCacheImpl(const blocks::Blocks *blocks,const char *dataDir,uint64_t byteBudget) : mBlocks(blocks), mDataDir(dataDir), mByteBudget(byteBudget)
+	{
+		mPrefetchThread = new std::thread([this]()
+		{
+			prefetchThread();
+		});
+	}
+
+	virtual ~BlockCacheImpl(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mExit = true;
+		}
+		mPrefetchCond.notify_one();
+		mPrefetchThread->join();
+		delete mPrefetchThread;
+	}
+
+	virtual const BlockChain::Block *getBlock(uint32_t blockHeight) final
+	{
+		const BlockChain::Block *ret = nullptr;
+
+		std::string compressed;
+		uint32_t fileIndex = 0;
+		uint64_t fileOffset = 0;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			CacheEntryMap::iterator found = mEntries.find(blockHeight);
+			if ( found != mEntries.end() )
+			{
+				CacheEntry &e = (*found).second;
+				if ( e.mParsed )
+				{
+					mStats.mHits++;
+					mHot.splice(mHot.begin(),mHot,e.mLRU); // move to the front of the LRU list
+					mCurrent = e.mParsed;
+				}
+				else
+				{
+					mStats.mColdHits++;
+					compressed.swap(e.mCompressed);
+					fileIndex = e.mFileIndex;
+					fileOffset = e.mFileOffset;
+					removeEntry(found);
+				}
+			}
+			else
+			{
+				mStats.mMisses++;
+			}
+			if ( mCurrent && mCurrent->mBlock.blockIndex == blockHeight )
+			{
+				ret = &mCurrent->mBlock;
+			}
+			queuePrefetch(blockHeight);
+		}
+
+		if ( ret == nullptr )
+		{
+			std::vector< uint8_t > data;
+			CachedBlockPtr b;
+			if ( compressed.size() )
+			{
+				size_t uncompressedLength = 0;
+				if ( snappy::GetUncompressedLength(compressed.c_str(),compressed.size(),&uncompressedLength) && uncompressedLength )
+				{
+					data.resize(uncompressedLength);
+					if ( snappy::RawUncompress(compressed.c_str(),compressed.size(),(char *)&data[0]) )
+					{
+						b = mLoader.parseBlock(data,blockHeight,fileIndex,fileOffset,mDataDir);
+					}
+				}
+			}
+			else
+			{
+				const CBlockIndex *index = mBlocks->getBlockIndex(blockHeight);
+				if ( index && blockfile::readBlockData(*index,mDataDir.c_str(),data) )
+				{
+					b = mLoader.parseBlock(data,blockHeight,uint32_t(index->mFileIndex),index->mFileOffset,mDataDir);
+				}
+			}
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCurrent = b;
+			if ( b )
+			{
+				insertEntry(blockHeight,b);
+				ret = &b->mBlock;
+				enforceBudget(lock);
+			}
+		}
+
+		return ret;
+	}
+
+	virtual void setByteBudget(uint64_t byteBudget) final
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mByteBudget = byteBudget;
+		enforceBudget(lock);
+	}
+
+	virtual void setCompressColdBlocks(bool state) final
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mCompressColdBlocks = state;
+	}
+
+	virtual void setPrefetchDistance(uint32_t distance) final
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPrefetchDistance = distance;
+		if ( distance == 0 )
+		{
+			mPrefetchQueue.clear();
+		}
+	}
+
+	virtual void setDecodeThreadCount(uint32_t threadCount) final
+	{
+		mLoader.setDecodeThreadCount(threadCount);
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mLoader.setVerifyMerkle(state);
+	}
+
+	virtual void getStats(BlockCacheStats &stats) const final
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		stats = mStats;
+		stats.mHotCount = uint32_t(mHot.size());
+		stats.mColdCount = uint32_t(mCold.size());
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Queue the neighbours of this height for the background thread; called with the mutex held
+	void queuePrefetch(uint32_t blockHeight)
+	{
+		if ( mPrefetchDistance == 0 )
+		{
+			return;
+		}
+		mPrefetchQueue.clear(); // only the neighbourhood of the most recent lookup is interesting
+		for (uint32_t i=1; i<=mPrefetchDistance; i++)
+		{
+			uint32_t next = blockHeight + i;
+			if ( next <= mBlocks->getBlockHeight() && mEntries.find(next) == mEntries.end() )
+			{
+				mPrefetchQueue.push_back(next);
+			}
+			if ( blockHeight >= i && mEntries.find(blockHeight-i) == mEntries.end() )
+			{
+				mPrefetchQueue.push_back(blockHeight-i);
+			}
+		}
+		if ( !mPrefetchQueue.empty() )
+		{
+			mPrefetchCond.notify_one();
+		}
+	}
+
+	void prefetchThread(void)
+	{
+		BlockLoader loader; // the prefetch thread has its own parser and always decodes serially
+		for (;;)
+		{
+			uint32_t blockHeight = 0;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				while ( !mExit && mPrefetchQueue.empty() )
+				{
+					mPrefetchCond.wait(lock);
+				}
+				if ( mExit )
+				{
+					break;
+				}
+				blockHeight = mPrefetchQueue.front();
+				mPrefetchQueue.pop_front();
+				if ( mEntries.find(blockHeight) != mEntries.end() )
+				{
+					continue;
+				}
+			}
+			const CBlockIndex *index = mBlocks->getBlockIndex(blockHeight);
+			std::vector< uint8_t > data;
+			if ( index && blockfile::readBlockData(*index,mDataDir.c_str(),data) )
+			{
+				CachedBlockPtr b = loader.parseBlock(data,blockHeight,uint32_t(index->mFileIndex),index->mFileOffset,mDataDir);
+				if ( b )
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
+					if ( mEntries.find(blockHeight) == mEntries.end() )
+					{
+						mStats.mPrefetched++;
+						insertEntry(blockHeight,b);
+						enforceBudget(lock);
+					}
+				}
+			}
+		}
+	}
+
+	// Add a parsed block at the front of the hot list; called with the mutex held.  The caller enforces the budget afterwards.
+	void insertEntry(uint32_t blockHeight,const CachedBlockPtr &b)
+	{
+		CacheEntryMap::iterator found = mEntries.find(blockHeight);
+		if ( found != mEntries.end() )
+		{
+			removeEntry(found);
+		}
+		CacheEntry &e = mEntries[blockHeight];
+		e.mParsed = b;
+		e.mFileIndex = b->mBlock.fileIndex;
+		e.mFileOffset = b->mBlock.fileOffset;
+		e.mByteSize = b->getByteSize();
+		mHot.push_front(blockHeight);
+		e.mLRU = mHot.begin();
+		mStats.mHotBytes += e.mByteSize;
+	}
+
+	// Remove an entry entirely; called with the mutex held
+	void removeEntry(CacheEntryMap::iterator found)
+	{
+		CacheEntry &e = (*found).second;
+		if ( e.mParsed )
+		{
+			mStats.mHotBytes -= e.mByteSize;
+			mHot.erase(e.mLRU);
+		}
+		else
+		{
+			mStats.mColdBytes -= e.mByteSize;
+			mCold.erase(e.mLRU);
+		}
+		mEntries.erase(found);
+	}
+
+	// Evict least recently used blocks until the cache fits in its budget.  Parsed blocks are demoted to
+	// compressed blocks first (when enabled), then compressed blocks are dropped.  The most recently
+	// used parsed block is always kept.  Called with the mutex held; the lock is released while the
+	// demoted blocks are compressed so other threads are not stalled behind snappy.
+	void enforceBudget(std::unique_lock<std::mutex> &lock)
+	{
+		PendingDemotionList pending;
+		evictEntries(pending);
+		while ( !pending.empty() )
+		{
+			lock.unlock();
+			for (size_t i=0; i<pending.size(); i++)
+			{
+				const std::vector< uint8_t > &data = pending[i].mParsed->mData;
+				snappy::Compress((const char *)&data[0],data.size(),&pending[i].mCompressed);
+			}
+			lock.lock();
+			for (size_t i=0; i<pending.size(); i++)
+			{
+				insertColdEntry(pending[i]);
+			}
+			pending.clear();
+			evictEntries(pending); // the compressed copies may have pushed the cache over budget again
+		}
+	}
+
+	// The part of enforceBudget which runs under the lock.  Parsed blocks picked for demotion are removed
+	// from the cache and handed back in 'pending'; their bytes are no longer charged until they return cold.
+	void evictEntries(PendingDemotionList &pending)
+	{
+		while ( (mStats.mHotBytes + mStats.mColdBytes) > mByteBudget )
+		{
+			if ( mHot.size() > 1 )
+			{
+				CacheEntryMap::iterator found = mEntries.find(mHot.back());
+				assert( found != mEntries.end() );
+				if ( mCompressColdBlocks )
+				{
+					PendingDemotion d;
+					d.mBlockHeight = (*found).first;
+					d.mParsed = (*found).second.mParsed;
+					pending.push_back(d);
+				}
+				removeEntry(found);
+			}
+			else if ( !mCold.empty() )
+			{
+				CacheEntryMap::iterator found = mEntries.find(mCold.back());
+				assert( found != mEntries.end() );
+				removeEntry(found);
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	// Add a compressed block at the front of the cold list, unless the height was cached again while the
+	// lock was released; called with the mutex held
+	void insertColdEntry(PendingDemotion &d)
+	{
+		if ( mEntries.find(d.mBlockHeight) != mEntries.end() )
+		{
+			return;
+		}
+		CacheEntry &e = mEntries[d.mBlockHeight];
+		e.mCompressed.swap(d.mCompressed);
+		e.mFileIndex = d.mParsed->mBlock.fileIndex;
+		e.mFileOffset = d.mParsed->mBlock.fileOffset;
+		e.mByteSize = e.mCompressed.size();
+		mStats.mColdBytes += e.mByteSize;
+		mCold.push_front(d.mBlockHeight);
+		e.mLRU = mCold.begin();
+	}
+
+	const blocks::Blocks		*mBlocks{nullptr};
+	std::string					mDataDir;
+	uint64_t					mByteBudget{0};
+	bool						mCompressColdBlocks{false};
+	uint32_t					mPrefetchDistance{1};
+	mutable std::mutex			mMutex;				// Protects everything below; and is never held while reading or parsing a block
+	CacheEntryMap				mEntries;
+	HeightList					mHot;				// Parsed blocks, most recently used first
+	HeightList					mCold;				// Compressed blocks, most recently used first
+	CachedBlockPtr				mCurrent;			// The block most recently returned by getBlock; kept alive even if evicted
+	BlockCacheStats				mStats;
+	BlockLoader					mLoader;			// Used by getBlock
+	std::deque< uint32_t >		mPrefetchQueue;
+	std::condition_variable		mPrefetchCond;
+	std::thread					*mPrefetchThread{nullptr};
+	bool						mExit{false};
+};
+
+BlockCache *BlockCache::create(const blocks::Blocks *blocks,const char *dataDir,uint64_t byteBudget)
+{
+	auto ret = new BlockCacheImpl(blocks,dataDir,byteBudget);
+	return static_cast< BlockCache *>(ret);
+}
+
+}
@@ -6,13 +6,24 @@
 #include <stdarg.h>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <unordered_set>
+#include <mutex>
 
 #include "BlockChain.h"			// The header for this system
 #include "Base58.h"				// A helper interface to
 #include "BitcoinAddress.h"
+#include "HexCodec.h"
 #include "RIPEMD160.h"
 #include "SHA256.h"
+#include "ThreadPool.h"
+#include "BlockArena.h"
+#include "ByteReader.h"
+#include "BlockFile.h"
+#include "FileInterface.h"
+#include "ScriptClassifier.h"
+#include "TextMiner.h"
+#include "MerkleVerifier.h"
 #include "logging.h"
 
 //
@@ -42,16 +53,23 @@
 
 // These defines set the limits this parser expects to ever encounter on the blockchain data stream.
 // In a debug build there are asserts to make sure these limits are never exceeded.
-// These limits work for the blockchain current as of July 1, 2013.
-// The limits can be revised when and if necessary.
-#define MAX_BLOCK_SIZE (1024*1024)*32	// never expect to have a block larger than 32mb
-#define MAX_BLOCK_TRANSACTION 32768		// never expect more than 32768 transactions per block.
-#define MAX_BLOCK_INPUTS 32768			// never expect more than 32768 total inputs
-#define MAX_BLOCK_OUTPUTS 32768			// never expect more than 32768 total outputs
+// The number of transactions, inputs and outputs in a block is not limited; the memory for them comes
+// from a per block arena which grows to fit.
+#define MAX_BLOCK_SIZE (1024*1024)*32	// never expect to have a block larger than 32mb; used to reject corrupt block lengths
 
 #define MAX_REASONABLE_SCRIPT_LENGTH (1024*32)	// would never expect any script to be more than 16k in size; that would be very unusual!
 #define MAX_REASONABLE_INPUTS 32678				// really can't imagine any transaction ever having more than 32768 inputs
 #define MAX_REASONABLE_OUTPUTS 32768			// really can't imagine any transaction ever having more than 32768 outputs
+#define MIN_TRANSACTION_SIZE 10					// version, input count, output count and lock time; used to reject corrupt transaction counts
+
+#define MAGIC_SEARCH_CHUNK_SIZE (1024*1024)	// how much of a block file is searched at a time for the next block header
+#define PREVOUT_READ_GAP (1024*64)				// previous transactions this close together in a block file are read with a single read
+#define PREVOUT_READ_SPAN (1024*1024*4)			// the largest single read made while resolving previous outputs
+
+#define MIN_PARALLEL_TRANSACTIONS 64			// blocks with fewer transactions than this are always decoded serially
+#define PARALLEL_TRANSACTION_GRAIN 16			// number of transactions handed to a worker thread at a time
+#define CLASSIFY_BATCH_SIZE 64					// number of output scripts classified at a time
+#define TEXT_REPORT_BUFFER_SIZE (1024*1024)		// stdio buffer used for the ASCII text report
 
 namespace BLOCK_CHAIN
 {
@@ -176,30 +194,13 @@ namespace BLOCK_CHAIN
 		OP_INVALIDOPCODE = 0xff
 	};
 
-	// Some globals for error reporting.
-	static uint32_t	gBlockTime = 0;
-	static uint32_t gBlockIndex = 0;
-	static uint32_t gTransactionIndex = 0;
-	static uint32_t gOutputIndex = 0;
-	static bool		gIsWarning = false;
-	static bool		gReportTransactionHash = false;
+	// Placeholder addresses for outputs whose public key could not be decoded.  These are initialized once
+	// and only read afterwards; all other parsing state lives in the parser objects so parsers can run concurrently.
 	static const char *gDummyKeyAscii = "1BadkEyPaj5oW2Uw4nY5BkYbPRYyTyqs9A";
 	static uint8_t gDummyKey[25];
 	static const char *gZeroByteAscii = "1zeroBTYRExUcufrTkwg27LsAvrhehtCJ";
 	static uint8_t gZeroByte[25];
 
-	static bool inline isASCII(char c)
-	{
-		bool ret = false;
-
-		if ((c >= 32 && c < 127) || c == 13)
-		{
-			ret = true;
-		}
-
-		return ret;
-	}
-
 	// A 256 bit hash
 	class Hash256
 	{
@@ -272,7 +273,7 @@ namespace BLOCK_CHAIN
 		}
 
 		uint32_t	mFileIndex;
-		uint32_t	mFileOffset;
+		uint64_t	mFileOffset;
 		uint32_t	mBlockLength;
 		uint8_t		mPreviousBlockHash[32];
 	};
@@ -284,7 +285,7 @@ namespace BLOCK_CHAIN
 		{
 
 		}
-		FileLocation(const Hash256 &h, uint32_t fileIndex, uint32_t fileOffset, uint32_t fileLength, uint32_t transactionIndex) : Hash256(h)
+		FileLocation(const Hash256 &h, uint32_t fileIndex, uint64_t fileOffset, uint32_t fileLength, uint32_t transactionIndex) : Hash256(h)
 		{
 			mFileIndex = fileIndex;
 			mFileOffset = fileOffset;
@@ -301,8 +302,8 @@ namespace BLOCK_CHAIN
 		}
 
 
+		uint64_t	mFileOffset;
 		uint32_t	mFileIndex;
-		uint32_t	mFileOffset;
 		uint32_t	mFileLength;
 		uint32_t	mTransactionIndex;
 	};
@@ -317,6 +318,24 @@ namespace BLOCK_CHAIN
 		uint32_t	mNonce;						// The block random number 'nonce' field.
 	};
 
+	// An input whose previous output is being looked up, along with where the previous transaction is stored
+	class SpentOutputRequest
+	{
+	public:
+		bool operator<(const SpentOutputRequest &other) const
+		{
+			if (mFileIndex != other.mFileIndex) return mFileIndex < other.mFileIndex;
+			if (mFileOffset != other.mFileOffset) return mFileOffset < other.mFileOffset;
+			return mOutputIndex < other.mOutputIndex;
+		}
+
+		uint64_t	mFileOffset;
+		uint32_t	mFileIndex;
+		uint32_t	mTransactionLength;
+		uint32_t	mOutputIndex;		// Which output of the previous transaction is spent
+		uint32_t	mInputIndex;		// Which input of the block spends it
+	};
+
 #define MAGIC_ID 0xD9B4BEF9
 #define ONE_BTC 100000000
 #define ONE_MBTC (ONE_BTC/1000)
@@ -348,99 +367,299 @@ namespace std
 namespace BLOCK_CHAIN
 {
 
-class BlockImpl : public BlockChain::Block
+// Holds the current read location within a block (or a single transaction) and the primitive methods
+// used to decode the block-chain input stream.  Decoding is not bounds checked; every block and transaction
+// is first walked in full with a checked reader by 'scanTransactions' and only decoded if that succeeds.
+typedef bytereader::ByteReader< bytereader::Unchecked > BlockReader;
+typedef bytereader::ByteReader< bytereader::Checked > BlockScanner;
+
+// A segregated witness transaction has a zero 'marker' byte where the input count would be, followed by a 'flag' byte of one.
+template < typename Reader >
+static inline bool hasWitnessMarker(const Reader &reader)
+{
+	const uint8_t *p = reader.getPosition();
+	return reader.getRemaining() >= 2 && p[0] == 0 && p[1] == 1;
+}
+
+// Locate the public keys in a bare multisig output script.  'publicKey' receives a pointer to each key found and each
+// bit of 'multiSigFormat' is set if that key is in compressed format.  This is used both when the output is decoded
+// and when its address is rendered later on.
+static void scanMultiSigKeys(const uint8_t *script, uint32_t scriptLength, const uint8_t *publicKey[MAX_MULTISIG], uint32_t &multiSigFormat)
 {
-public:
-	// Read one byte from the block-chain input stream.
-	inline uint8_t readU8(void)
+	const uint8_t *scanBegin = script;
+	const uint8_t *scanEnd = &script[scriptLength - 2];
+	bool expectedPrefix = false;
+	bool expectedPostfix = false;
+	switch (*scanBegin)
 	{
-		assert((mBlockRead + sizeof(uint8_t)) <= mBlockEnd);
-		uint8_t ret = *(uint8_t *)mBlockRead;
-		mBlockRead += sizeof(uint8_t);
-		return ret;
+	case OP_0:
+	case OP_1:
+	case OP_2:
+	case OP_3:
+	case OP_4:
+	case OP_5:
+		expectedPrefix = true;
+		break;
+	default:
+		break;
 	}
-
-	// Read two bytes from the block-chain input stream.
-	inline uint16_t readU16(void)
+	switch (*scanEnd)
 	{
-		assert((mBlockRead + sizeof(uint16_t)) <= mBlockEnd);
-		uint16_t ret = *(uint16_t *)mBlockRead;
-		mBlockRead += sizeof(uint16_t);
-		return ret;
+	case OP_1:
+	case OP_2:
+	case OP_3:
+	case OP_4:
+	case OP_5:
+		expectedPostfix = true;
+		break;
+	default:
+		break;
 	}
-
-	// Read four bytes from the block-chain input stream.
-	inline uint32_t readU32(void)
+	if (expectedPrefix && expectedPostfix)
 	{
-		assert((mBlockRead + sizeof(uint32_t)) <= mBlockEnd);
-		uint32_t ret = *(uint32_t *)mBlockRead;
-		mBlockRead += sizeof(uint32_t);
-		return ret;
+		scanBegin++;
+		uint32_t keyIndex = 0;
+		while (keyIndex < 5 && scanBegin < scanEnd)
+		{
+			if (*scanBegin == 0x21)
+			{
+				scanBegin++;
+				publicKey[keyIndex] = scanBegin;
+				scanBegin += 0x21;
+				uint32_t bitMask = 1 << keyIndex;
+				multiSigFormat |= bitMask; // turn this bit on if it is in compressed format
+				keyIndex++;
+			}
+			else if (*scanBegin == 0x41)
+			{
+				scanBegin++;
+				publicKey[keyIndex] = scanBegin;
+				scanBegin += 0x41;
+				keyIndex++;
+			}
+			else
+			{
+				break; //
+			}
+		}
 	}
+}
 
-	// Read eight bytes from the block-chain input stream.
-	inline uint64_t readU64(void)
+// Returns true if this is a well formed public key of the type given; only those have an address
+static bool isValidPublicKey(BlockChain::KeyType keyType, const uint8_t *publicKey)
+{
+	bool ret = true;
+	if (keyType == BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY)
 	{
-		assert((mBlockRead + sizeof(uint64_t)) <= mBlockEnd);
-		uint64_t ret = *(uint64_t *)mBlockRead;
-		mBlockRead += sizeof(uint64_t);
-		return ret;
+		ret = publicKey[0] == 0x04;
+	}
+	else if (keyType == BlockChain::KT_COMPRESSED_PUBLIC_KEY)
+	{
+		ret = publicKey[0] == 0x02 || publicKey[0] == 0x03;
 	}
+	return ret;
+}
 
-	// Return the current stream pointer representing a 32byte hash and advance the read pointer accordingly
-	inline const uint8_t *readHash(void)
+// The public keys of output scripts whose output hashes are waiting to be computed.  Deriving addresses one key at
+// a time keeps the SHA256 and RIPEMD160 kernels on the critical path of blocks full of pay to public key and multisig
+// outputs, so the keys of a whole classify batch are hashed together by 'flush' with the batched address functions.
+class KeyHashQueue
+{
+public:
+	// The hash160 of this key will be written to 'hash'
+	void addKey(const uint8_t *key, uint32_t keyLength, uint8_t *hash)
 	{
-		const uint8_t *ret = mBlockRead;
-		assert((mBlockRead + 32) <= mBlockEnd);
-		mBlockRead += 32;
-		return ret;
+		if (mKeyCount == CLASSIFY_BATCH_SIZE)
+		{
+			flush();
+		}
+		mKeys[mKeyCount] = key;
+		mKeyLengths[mKeyCount] = keyLength;
+		mKeyHashes[mKeyCount] = hash;
+		mKeyCount++;
 	}
 
-	// reads a variable length integer.
-	// See the documentation from here:  https://en.bitcoin.it/wiki/Protocol_specification#Variable_length_integer
-	inline uint32_t readVariableLengthInteger(void)
+	// A compressed key whose sign byte is missing from the script; it is hashed as if the byte were 0x02
+	void addTruncatedKey(const uint8_t *key, uint8_t *hash)
 	{
-		uint32_t ret = 0;
+		if (mKeyCount == CLASSIFY_BATCH_SIZE)
+		{
+			flush();
+		}
+		uint8_t *copy = mTruncatedKeys[mKeyCount];
+		copy[0] = 0x2;
+		memcpy(&copy[1], key, 32);
+		addKey(copy, 33, hash);
+	}
 
-		uint8_t v = readU8();
-		if (v < 0xFD) // If it's less than 0xFD use this value as the unsigned integer
+	// The RIPEMD160 hash of the 25 byte addresses of every key of this multisig output (zero padded to MAX_MULTISIG
+	// addresses) will be written to 'hash'
+	void addMultiSig(const uint8_t *publicKey[MAX_MULTISIG], uint32_t multiSigFormat, uint8_t *hash)
+	{
+		if (mMultiSigCount == CLASSIFY_BATCH_SIZE)
 		{
-			ret = (uint32_t)v;
+			flush();
 		}
-		else
+		MultiSig &m = mMultiSigs[mMultiSigCount++];
+		m.mHash = hash;
+		m.mFirstAddress = mAddressCount;
+		for (uint32_t i = 0; i < MAX_MULTISIG && publicKey[i]; i++)
+		{
+			mAddressKeys[mAddressCount] = publicKey[i];
+			mAddressKeyLengths[mAddressCount] = (multiSigFormat & (1 << i)) ? 33 : 65;
+			mAddressCount++;
+		}
+		m.mAddressCount = mAddressCount - m.mFirstAddress;
+	}
+
+	void flush(void)
+	{
+		if (mKeyCount)
 		{
-			uint16_t v = readU16();
-			if (v < 0xFFFF)
+			bitcoinPublicKeysToHash160(mKeyCount, mKeys, mKeyLengths, mHash160);
+			for (uint32_t i = 0; i < mKeyCount; i++)
 			{
-				ret = (uint32_t)v;
+				memcpy(mKeyHashes[i], mHash160[i], 20);
 			}
-			else
+			mKeyCount = 0;
+		}
+		if (mMultiSigCount)
+		{
+			bitcoinPublicKeysToAddresses(mAddressCount, mAddressKeys, mAddressKeyLengths, mAddresses);
+			for (uint32_t i = 0; i < mMultiSigCount; i++)
 			{
-				uint32_t v = readU32();
-				if (v < 0xFFFFFFFF)
-				{
-					ret = (uint32_t)v;
-				}
-				else
-				{
-					assert(0); // never expect to actually encounter a 64bit integer in the block-chain stream; it's outside of any reasonable expected value
-					uint64_t v = readU64();
-					ret = (uint32_t)v;
-				}
+				const MultiSig &m = mMultiSigs[i];
+				uint8_t addresses[MAX_MULTISIG][25];
+				memset(addresses, 0, sizeof(addresses));
+				memcpy(addresses, mAddresses[m.mFirstAddress], m.mAddressCount * 25);
+				computeRIPEMD160(addresses, sizeof(addresses), m.mHash);
 			}
+			mMultiSigCount = 0;
+			mAddressCount = 0;
 		}
-		return ret;
 	}
 
-	// Get the current read buffer address and advance the stream buffer by this length; used to get the address of input/output scripts
-	inline const uint8_t * getReadBufferAdvance(uint32_t readLength)
+private:
+	class MultiSig
 	{
-		const uint8_t *ret = mBlockRead;
-		mBlockRead += readLength;
-		assert(mBlockRead <= mBlockEnd);
-		return ret;
+	public:
+		uint8_t		*mHash;
+		uint32_t	mFirstAddress;		// Index of the output's first key in mAddressKeys
+		uint32_t	mAddressCount;
+	};
+
+	uint32_t		mKeyCount{0};
+	const uint8_t	*mKeys[CLASSIFY_BATCH_SIZE];
+	uint32_t		mKeyLengths[CLASSIFY_BATCH_SIZE];
+	uint8_t			*mKeyHashes[CLASSIFY_BATCH_SIZE];
+	uint8_t			mTruncatedKeys[CLASSIFY_BATCH_SIZE][33];
+	uint8_t			mHash160[CLASSIFY_BATCH_SIZE][20];
+
+	uint32_t		mMultiSigCount{0};
+	uint32_t		mAddressCount{0};
+	MultiSig		mMultiSigs[CLASSIFY_BATCH_SIZE];
+	const uint8_t	*mAddressKeys[CLASSIFY_BATCH_SIZE * MAX_MULTISIG];
+	uint32_t		mAddressKeyLengths[CLASSIFY_BATCH_SIZE * MAX_MULTISIG];
+	uint8_t			mAddresses[CLASSIFY_BATCH_SIZE * MAX_MULTISIG][25];
+};
+
+// Compute the hash identifying the destination of an output from the key(s) located in its script
+// 'keyLength' is the length of the hash or witness program for the types which carry one directly in the script.
+// Hashes of public keys are left in 'keys' and only written when it is flushed.
+static void computeOutputHash(BlockChain::KeyType keyType, const uint8_t *publicKey[MAX_MULTISIG], uint32_t multiSigFormat, uint32_t keyLength, BlockChain::OutputHash &hash, KeyHashQueue &keys)
+{
+	memset(hash.hash, 0, sizeof(hash.hash));
+	switch (keyType)
+	{
+	case BlockChain::KT_RIPEMD160:
+	case BlockChain::KT_SCRIPT_HASH:
+	case BlockChain::KT_STEALTH:
+	case BlockChain::KT_WITNESS_PUBKEY_HASH:
+		memcpy(hash.hash, publicKey[0], 20);
+		break;
+	case BlockChain::KT_WITNESS_SCRIPT_HASH:
+	case BlockChain::KT_TAPROOT:
+		memcpy(hash.hash, publicKey[0], 32);
+		break;
+	case BlockChain::KT_WITNESS_UNKNOWN:
+		// Programs longer than 32 bytes are truncated; the full program is still in the script
+		memcpy(hash.hash, publicKey[0], keyLength < 32 ? keyLength : 32);
+		break;
+	case BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY:
+		if (isValidPublicKey(keyType, publicKey[0]))
+		{
+			keys.addKey(publicKey[0], 65, hash.hash);
+		}
+		break;
+	case BlockChain::KT_COMPRESSED_PUBLIC_KEY:
+		if (isValidPublicKey(keyType, publicKey[0]))
+		{
+			keys.addKey(publicKey[0], 33, hash.hash);
+		}
+		break;
+	case BlockChain::KT_TRUNCATED_COMPRESSED_KEY:
+		keys.addTruncatedKey(publicKey[0], hash.hash);
+		break;
+	case BlockChain::KT_MULTISIG:
+		keys.addMultiSig(publicKey, multiSigFormat, hash.hash);
+		break;
+	default:
+		break;
+	}
+}
+
+// Describes where a single transaction lives in the block data and which input and output slots it has been assigned.
+// These are built by a fast serial pass over the block so that the transactions can then be decoded in parallel.
+struct TransactionSpan
+{
+	const uint8_t	*mBegin;		// Where the transaction begins in the block data
+	uint32_t		mFirstInput;	// Index of the first input slot assigned to this transaction
+	uint32_t		mInputCount;	// Number of inputs in this transaction
+	uint32_t		mFirstOutput;	// Index of the first output slot assigned to this transaction
+	uint32_t		mOutputCount;	// Number of outputs in this transaction
+};
+
+// A transaction hash waiting to be computed in a batch
+class HashJob
+{
+public:
+	const uint8_t	*mData{nullptr};	// The message; or null if it is at mOffset in the decoder's stripped transaction buffer
+	size_t			mOffset{0};
+	uint32_t		mLength{0};
+	uint8_t			*mDest{nullptr};	// Receives the double SHA256 of the message
+	uint8_t			*mCopy{nullptr};	// If not null, also receives it
+};
+
+// Decodes transactions from the block-chain input stream.
+// Every thread decoding transactions of a block uses its own decoder, so the read cursor, the diagnostic
+// state and the scratch memory are never shared between threads.
+class TransactionDecoder : public BlockReader
+{
+public:
+	// Report a diagnostic message.  Normally this goes straight to the log, but while a block is being decoded
+	// in parallel the messages are deferred so they can be written out in transaction order afterwards.
+	void reportMessage(const char *fmt, ...)
+	{
+		char wbuff[2048];
+		va_list arg;
+		va_start(arg, fmt);
+		vsnprintf(wbuff, sizeof(wbuff), fmt, arg);
+		va_end(arg);
+		if (mDeferredLog)
+		{
+			mDeferredLog->append(wbuff);
+		}
+		else
+		{
+			logMessage("%s", wbuff);
+		}
 	}
 
+	void reportReverseHash(const uint8_t hash[32])
+	{
+		char scratch[HEX_HASH_SIZE];
+		reportMessage("%s", encodeHexReverse(hash, 32, scratch));
+	}
 
 	// Read a transaction input
 	bool readInput(BlockChain::BlockInput &input)
@@ -449,393 +668,224 @@ public:
 
 		input.transactionHash = readHash();	// read the transaction hash
 		input.transactionIndex = readU32();	// read the transaction index
-		input.responseScriptLength = readVariableLengthInteger();	// read the length of the script
+		input.responseScriptLength = uint32_t(readCompactSize());	// read the length of the script
 		assert(input.responseScriptLength < MAX_REASONABLE_SCRIPT_LENGTH);
 
 		if (input.responseScriptLength >= 8192)
 		{
-			logMessage("Block: %d : Unreasonably large input script length of %d bytes.\r\n", gBlockIndex, input.responseScriptLength);
+			reportMessage("Block: %d : Unreasonably large input script length of %d bytes.\r\n", mDecodeBlockIndex, input.responseScriptLength);
 		}
 
 		if (input.responseScriptLength < MAX_REASONABLE_SCRIPT_LENGTH)
 		{
-			input.responseScript = input.responseScriptLength ? getReadBufferAdvance(input.responseScriptLength) : NULL;	// get the script buffer pointer; and advance the read location
+			input.responseScript = input.responseScriptLength ? readBytes(input.responseScriptLength) : NULL;	// get the script buffer pointer; and advance the read location
 			input.sequenceNumber = readU32();
 		}
 		else
 		{
-			logMessage("Block %d : Outrageous sized input script of %d bytes!  Shutting down.\r\n", gBlockIndex, input.responseScriptLength);
-			exit(1);
+			reportMessage("Block %d : Outrageous sized input script of %d bytes!\r\n", mDecodeBlockIndex, input.responseScriptLength);
+			ret = false;
 		}
 		return ret;
 	}
 
-	void getAsciiAddress(BlockChain::BlockOutput &o)
+	// Read an output into slot 'index' of the output columns.  Only the value and the location of the script are
+	// recorded here; the scripts of a transaction are classified as a batch once all of its outputs have been read.
+	bool readOutput(BlockChain::BlockOutputs &outputs, uint32_t index)
 	{
-		o.asciiAddress[0] = 0;
-		char temp[256];
+		uint64_t value = readU64();	// Read the value of the transaction
+		outputs.values[index] = value;
+		mOutputValue += value;
+		uint32_t challengeScriptLength = uint32_t(readCompactSize());
+		assert(challengeScriptLength < MAX_REASONABLE_SCRIPT_LENGTH);
 
-		switch (o.keyType)
+		if (challengeScriptLength >= 8192)
 		{
-		case BlockChain::KT_MULTISIG:
-			sprintf(o.asciiAddress, "MultiSig[%d]", o.signatureCount);
-			break;
-		case BlockChain::KT_STEALTH:
-			strcat(o.asciiAddress, "*STEALTH*");
-			break;
-		case BlockChain::KT_SCRIPT_HASH:
-			strcat(o.asciiAddress, "*SCRIPT_HASH*");
-			break;
-		default:
-			break;
+			reportMessage("Block %d : Unreasonably large output script length of %d bytes.\r\n", mDecodeBlockIndex, challengeScriptLength);
 		}
-		for (uint32_t i = 0; i < MAX_MULTISIG; i++)
+		else if (challengeScriptLength > MAX_REASONABLE_SCRIPT_LENGTH)
 		{
-			if (o.publicKey[i])
+			reportMessage("Block %d : output script too long %d bytes!\r\n", mDecodeBlockIndex, challengeScriptLength);
+			return false;
+		}
+
+		const uint8_t *challengeScript = challengeScriptLength ? readBytes(challengeScriptLength) : NULL; // get the script buffer pointer and advance the read location
+		outputs.scriptOffsets[index] = challengeScript ? (uint32_t)(challengeScript - outputs.scriptBase) : 0;
+		outputs.scriptLengths[index] = challengeScriptLength;
+		return true;
+	}
+
+	// Classify the scripts of these outputs and compute the hash identifying the destination of each one.
+	// The ASCII address is only rendered later if someone asks for it.
+	void classifyOutputs(BlockChain::BlockOutputs &outputs, uint32_t outputCount)
+	{
+		scriptclassifier::ScriptClass classes[CLASSIFY_BATCH_SIZE];
+		for (uint32_t first = 0; first < outputCount; first += CLASSIFY_BATCH_SIZE)
+		{
+			uint32_t count = outputCount - first;
+			if (count > CLASSIFY_BATCH_SIZE)
 			{
-				if (i)
-				{
-					strcat(o.asciiAddress, ":");
-				}
-				bitcoinAddressToAscii(o.addresses[i].address, temp, 256);
-				strcat(o.asciiAddress, temp);
+				count = CLASSIFY_BATCH_SIZE;
 			}
-			else
+			scriptclassifier::classifyScripts(outputs.scriptBase, outputs.scriptOffsets + first, outputs.scriptLengths + first, count, classes);
+			for (uint32_t i = 0; i < count; i++)
 			{
-				break;
+				mOutputIndex = first + i;
+				decodeOutput(outputs, first + i, classes[i]);
 			}
+			mKeyHashes.flush();
 		}
-		// If this is a multi-sig address, *then* we need to generate a multisig address for it.
-		if (o.keyType == BlockChain::KT_MULTISIG)
-		{
-			uint8_t hash[20];
-			computeRIPEMD160(&o.addresses, 25 * MAX_MULTISIG, hash);
-			bitcoinRIPEMD160ToAddress(hash, o.multisig.address);
-		}
-	}
-
-	const char * getKeyType(BlockChain::KeyType k)
-	{
-		const char *ret = "UNKNOWN";
-		switch (k)
-		{
-		case BlockChain::KT_RIPEMD160:
-			ret = "RIPEMD160";
-			break;
-		case BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY:
-			ret = "UNCOMPRESSED_PUBLIC_KEY";
-			break;
-		case BlockChain::KT_COMPRESSED_PUBLIC_KEY:
-			ret = "COMPRESSED_PUBLIC_KEY";
-			break;
-		case BlockChain::KT_TRUNCATED_COMPRESSED_KEY:
-			ret = "TRUNCATED_COMPRESSED_KEY";
-			break;
-		case BlockChain::KT_MULTISIG:
-			ret = "MULTISIG";
-			break;
-		case BlockChain::KT_STEALTH:
-			ret = "STEALTH";
-			break;
-		case BlockChain::KT_ZERO_LENGTH:
-			ret = "ZERO_LENGTH";
-			break;
-		case BlockChain::KT_SCRIPT_HASH:
-			ret = "SCRIPT_HASH";
-			break;
-		default:
-			break;
-		}
-		return ret;
 	}
 
-	// Read an output block
-	bool readOutput(BlockChain::BlockOutput &output)
+	void decodeOutput(BlockChain::BlockOutputs &outputs, uint32_t index, const scriptclassifier::ScriptClass &scriptClass)
 	{
-		bool ret = true;
-
-		new (&output) BlockChain::BlockOutput;
+		const uint8_t *publicKey[MAX_MULTISIG] = { NULL, NULL, NULL, NULL, NULL };
+		uint32_t multiSigFormat = 0;
+		BlockChain::KeyType keyType = scriptClass.keyType;
+		uint32_t keyLength = scriptClass.keyLength;
+		const uint8_t *challengeScript = outputs.getScript(index);
+		uint32_t challengeScriptLength = outputs.scriptLengths[index];
+
+		if (keyType == BlockChain::KT_MULTISIG)
+		{
+			scanMultiSigKeys(challengeScript, challengeScriptLength, publicKey, multiSigFormat);
+			if (publicKey[0] == NULL)
+			{
+				keyType = BlockChain::KT_UNKNOWN;
+			}
+		}
+		else if (keyType != BlockChain::KT_UNKNOWN && keyLength)
+		{
+			publicKey[0] = challengeScript + scriptClass.keyOffset;
+		}
 
-		output.value = readU64();	// Read the value of the transaction
-		blockReward += output.value;
-		output.challengeScriptLength = readVariableLengthInteger();
-		assert(output.challengeScriptLength < MAX_REASONABLE_SCRIPT_LENGTH);
+		if (keyType == BlockChain::KT_UNKNOWN)
+		{
+			decodeUnclassifiedOutput(challengeScript, challengeScriptLength, publicKey);
+			keyType = BlockChain::KT_RIPEMD160;
+			keyLength = 20;
+		}
 
-		if (output.challengeScriptLength >= 8192)
+		computeOutputHash(keyType, publicKey, multiSigFormat, keyLength, outputs.hashes[index], mKeyHashes);
+		outputs.keyTypes[index] = uint8_t(keyType);
+		uint8_t keyCount = 0;
+		while (keyCount < MAX_MULTISIG && publicKey[keyCount])
 		{
-			logMessage("Block %d : Unreasonably large output script length of %d bytes.\r\n", gBlockIndex, output.challengeScriptLength);
+			keyCount++;
 		}
-		else if (output.challengeScriptLength > MAX_REASONABLE_SCRIPT_LENGTH)
+		if (!isValidPublicKey(keyType, publicKey[0]))
 		{
-			logMessage("Block %d : output script too long %d bytes!\r\n", gBlockIndex, output.challengeScriptLength);
-			exit(1);
+			keyCount = 0; // a malformed public key has no address
 		}
+		outputs.keyCounts[index] = keyCount;
 
-		output.challengeScript = output.challengeScriptLength ? getReadBufferAdvance(output.challengeScriptLength) : NULL; // get the script buffer pointer and advance the read location
+		if (mReportTransactionHash)
+		{
+			mIsWarning = true;
+		}
+	}
 
-		if (output.challengeScript)
+	// The slow path for a script which does not match any of the standard templates.  The script is searched
+	// for an embedded pay to public key hash and, failing that, it is reported and given the dummy key.
+	void decodeUnclassifiedOutput(const uint8_t *challengeScript, uint32_t challengeScriptLength, const uint8_t *publicKey[MAX_MULTISIG])
+	{
+		publicKey[0] = NULL;
+		if (challengeScript)
 		{
-			uint8_t lastInstruction = output.challengeScript[output.challengeScriptLength - 1];
-			if (output.challengeScriptLength == 67 && output.challengeScript[0] == 65 && output.challengeScript[66] == OP_CHECKSIG)
-			{
-				output.publicKey[0] = output.challengeScript + 1;
-				output.keyType = BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY;
-			}
-			if (output.challengeScriptLength == 40 && output.challengeScript[0] == OP_RETURN)
-			{
-				output.publicKey[0] = &output.challengeScript[1];
-				output.keyType = BlockChain::KT_STEALTH;
-			}
-			else if (output.challengeScriptLength == 66 && output.challengeScript[65] == OP_CHECKSIG)
-			{
-				output.publicKey[0] = output.challengeScript;
-				output.keyType = BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY;
-			}
-			else if (output.challengeScriptLength == 35 && output.challengeScript[34] == OP_CHECKSIG)
-			{
-				output.publicKey[0] = &output.challengeScript[1];
-				output.keyType = BlockChain::KT_COMPRESSED_PUBLIC_KEY;
-			}
-			else if (output.challengeScriptLength == 33 && output.challengeScript[0] == 0x20)
+			uint8_t lastInstruction = challengeScript[challengeScriptLength - 1];
+			if (challengeScriptLength == 5 &&
+				challengeScript[0] == OP_DUP &&
+				challengeScript[1] == OP_HASH160 &&
+				challengeScript[2] == OP_0 &&
+				challengeScript[3] == OP_EQUALVERIFY &&
+				challengeScript[4] == OP_CHECKSIG)
 			{
-				output.publicKey[0] = &output.challengeScript[1];
-				output.keyType = BlockChain::KT_TRUNCATED_COMPRESSED_KEY;
+				reportMessage("WARNING: Unusual but expected output script. Block %s : Transaction: %s : OutputIndex: %s\r\n", formatNumber(mDecodeBlockIndex), formatNumber(mDecodeTransactionIndex), formatNumber(mOutputIndex));
+				mIsWarning = true;
 			}
-			else if (output.challengeScriptLength == 23 &&
-				output.challengeScript[0] == OP_HASH160 &&
-				output.challengeScript[1] == 20 &&
-				output.challengeScript[22] == OP_EQUAL)
+			else if (lastInstruction == OP_CHECKMULTISIG && challengeScriptLength > 25) // looks to be a multi-sig
 			{
-				output.publicKey[0] = output.challengeScript + 2;
-				output.keyType = BlockChain::KT_SCRIPT_HASH;
-			}
-			else if (output.challengeScriptLength >= 25 &&
-				output.challengeScript[0] == OP_DUP &&
-				output.challengeScript[1] == OP_HASH160 &&
-				output.challengeScript[2] == 20)
-			{
-				output.publicKey[0] = output.challengeScript + 3;
-				output.keyType = BlockChain::KT_RIPEMD160;
-			}
-			else if (output.challengeScriptLength == 5 &&
-				output.challengeScript[0] == OP_DUP &&
-				output.challengeScript[1] == OP_HASH160 &&
-				output.challengeScript[2] == OP_0 &&
-				output.challengeScript[3] == OP_EQUALVERIFY &&
-				output.challengeScript[4] == OP_CHECKSIG)
-			{
-				logMessage("WARNING: Unusual but expected output script. Block %s : Transaction: %s : OutputIndex: %s\r\n", formatNumber(gBlockIndex), formatNumber(gTransactionIndex), formatNumber(gOutputIndex));
-				gIsWarning = true;
-			}
-			else if (lastInstruction == OP_CHECKMULTISIG && output.challengeScriptLength > 25) // looks to be a multi-sig
-			{
-				const uint8_t *scanBegin = output.challengeScript;
-				const uint8_t *scanEnd = &output.challengeScript[output.challengeScriptLength - 2];
-				bool expectedPrefix = false;
-				bool expectedPostfix = false;
-				switch (*scanBegin)
-				{
-				case OP_0:
-				case OP_1:
-				case OP_2:
-				case OP_3:
-				case OP_4:
-				case OP_5:
-					expectedPrefix = true;
-					break;
-				default:
-					//						assert(0); // unexpected
-					break;
-				}
-				switch (*scanEnd)
-				{
-				case OP_1:
-				case OP_2:
-				case OP_3:
-				case OP_4:
-				case OP_5:
-					expectedPostfix = true;
-					break;
-				default:
-					//						assert(0); // unexpected
-					break;
-				}
-				if (expectedPrefix && expectedPostfix)
-				{
-					scanBegin++;
-					uint32_t keyIndex = 0;
-					while (keyIndex < 5 && scanBegin < scanEnd)
-					{
-						if (*scanBegin == 0x21)
-						{
-							output.keyType = BlockChain::KT_MULTISIG;
-							scanBegin++;
-							output.publicKey[keyIndex] = scanBegin;
-							scanBegin += 0x21;
-							uint32_t bitMask = 1 << keyIndex;
-							output.multiSigFormat |= bitMask; // turn this bit on if it is in compressed format
-							keyIndex++;
-						}
-						else if (*scanBegin == 0x41)
-						{
-							output.keyType = BlockChain::KT_MULTISIG;
-							scanBegin++;
-							output.publicKey[keyIndex] = scanBegin;
-							scanBegin += 0x41;
-							keyIndex++;
-						}
-						else
-						{
-							break; //
-						}
-					}
-				}
-				if (output.publicKey[0] == NULL)
-				{
-					logMessage("****MULTI_SIG WARNING: Unable to decipher multi-sig output. Block %s : Transaction: %s : OutputIndex: %s\r\n", formatNumber(gBlockIndex), formatNumber(gTransactionIndex), formatNumber(gOutputIndex));
-					gIsWarning = true;
-				}
+				reportMessage("****MULTI_SIG WARNING: Unable to decipher multi-sig output. Block %s : Transaction: %s : OutputIndex: %s\r\n", formatNumber(mDecodeBlockIndex), formatNumber(mDecodeTransactionIndex), formatNumber(mOutputIndex));
+				mIsWarning = true;
 			}
-			else
+			else if (challengeScriptLength > 25)
 			{
 				// Ok..we are going to scan for this pattern.. OP_DUP, OP_HASH160, 0x14 then exactly 20 bytes after 0x88,0xAC
-				// 25...
-				if (output.challengeScriptLength > 25)
+				uint32_t endIndex = challengeScriptLength - 25;
+				for (uint32_t i = 0; i < endIndex; i++)
 				{
-					uint32_t endIndex = output.challengeScriptLength - 25;
-					for (uint32_t i = 0; i < endIndex; i++)
+					const uint8_t *scan = &challengeScript[i];
+					if (scan[0] == OP_DUP &&
+						scan[1] == OP_HASH160 &&
+						scan[2] == 20 &&
+						scan[23] == OP_EQUALVERIFY &&
+						scan[24] == OP_CHECKSIG)
 					{
-						const uint8_t *scan = &output.challengeScript[i];
-						if (scan[0] == OP_DUP &&
-							scan[1] == OP_HASH160 &&
-							scan[2] == 20 &&
-							scan[23] == OP_EQUALVERIFY &&
-							scan[24] == OP_CHECKSIG)
-						{
-							output.publicKey[0] = &scan[3];
-							output.keyType = BlockChain::KT_RIPEMD160;
-							logMessage("WARNING: Unusual output script. Block %s : Transaction: %s : OutputIndex: %s\r\n", formatNumber(gBlockIndex), formatNumber(gTransactionIndex), formatNumber(gOutputIndex));
-							gIsWarning = true;
-							break;
-						}
+						publicKey[0] = &scan[3];
+						reportMessage("WARNING: Unusual output script. Block %s : Transaction: %s : OutputIndex: %s\r\n", formatNumber(mDecodeBlockIndex), formatNumber(mDecodeTransactionIndex), formatNumber(mOutputIndex));
+						mIsWarning = true;
+						return;
 					}
 				}
 			}
-			if (output.publicKey[0] == NULL)
+			reportMessage("==========================================\r\n");
+			reportMessage("FAILED TO LOCATE PUBLIC KEY\r\n");
+			reportMessage("ChallengeScriptLength: %d bytes long\r\n", challengeScriptLength);
+			// Sixteen bytes to a line, each line formatted in one piece
+			for (uint32_t i = 0; i < challengeScriptLength; i += 16)
 			{
-				logMessage("==========================================\r\n");
-				logMessage("FAILED TO LOCATE PUBLIC KEY\r\n");
-				logMessage("ChallengeScriptLength: %d bytes long\r\n", output.challengeScriptLength);
-				for (uint32_t i = 0; i < output.challengeScriptLength; i++)
+				uint32_t count = challengeScriptLength - i < 16 ? challengeScriptLength - i : 16;
+				char digits[33];
+				char line[16 * 3 + 1];
+				encodeHex(challengeScript + i, count, digits);
+				for (uint32_t j = 0; j < count; j++)
 				{
-					logMessage("%02x ", output.challengeScript[i]);
-					if (((i + 16) & 15) == 0)
-					{
-						logMessage("\r\n");
-					}
+					line[j * 3] = digits[j * 2];
+					line[j * 3 + 1] = digits[j * 2 + 1];
+					line[j * 3 + 2] = ' ';
 				}
-				logMessage("\r\n");
-				logMessage("==========================================\r\n");
-				logMessage("\r\n");
+				line[count * 3] = 0;
+				reportMessage("%s\r\n", line);
 			}
+			reportMessage("==========================================\r\n");
+			reportMessage("\r\n");
+			publicKey[0] = &gDummyKey[1];
 		}
 		else
 		{
-			logMessage("Block %d : has a zero byte length output script?\r\n", gBlockIndex);
-			gReportTransactionHash = true;
-		}
-
-		if (!output.publicKey[0])
-		{
-			if (output.challengeScriptLength == 0)
-			{
-				output.publicKey[0] = &gZeroByte[1];
-			}
-			else
-			{
-				output.publicKey[0] = &gDummyKey[1];
-			}
-			output.keyType = BlockChain::KT_RIPEMD160;
-			logMessage("WARNING: Failed to decode public key in output script. Block %s : Transaction: %s : OutputIndex: %s scriptLength: %s\r\n", formatNumber(gBlockIndex), formatNumber(gTransactionIndex), formatNumber(gOutputIndex), formatNumber(output.challengeScriptLength));
-			gReportTransactionHash = true;
-			gIsWarning = true;
-		}
-
-
-		switch (output.keyType)
-		{
-		case BlockChain::KT_RIPEMD160:
-			bitcoinRIPEMD160ToAddress(output.publicKey[0], output.addresses[0].address);
-			break;
-		case BlockChain::KT_SCRIPT_HASH:
-			bitcoinRIPEMD160ToScriptAddress(output.publicKey[0], output.addresses[0].address);
-			break;
-		case BlockChain::KT_STEALTH:
-			bitcoinRIPEMD160ToAddress(output.publicKey[0], output.addresses[0].address);
-			break;
-		case BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY:
-		{
-			bitcoinPublicKeyToAddress(output.publicKey[0], output.addresses[0].address);
-		}
-		break;
-		case BlockChain::KT_COMPRESSED_PUBLIC_KEY:
-		{
-			bitcoinCompressedPublicKeyToAddress(output.publicKey[0], output.addresses[0].address);
-		}
-		break;
-		case BlockChain::KT_TRUNCATED_COMPRESSED_KEY:
-		{
-			uint8_t key[33];
-			key[0] = 0x2;
-			memcpy(&key, output.publicKey[0], 32);
-			bitcoinCompressedPublicKeyToAddress(key, output.addresses[0].address);
-		}
-		break;
-		case BlockChain::KT_MULTISIG:
-		{
-			for (uint32_t i = 0; i < MAX_MULTISIG; i++)
-			{
-				const uint8_t *key = output.publicKey[i];
-				if (key == NULL)
-					break;
-				uint32_t mask = 1 << i;
-				if (output.multiSigFormat & mask)
-				{
-					bitcoinCompressedPublicKeyToAddress(output.publicKey[i], output.addresses[i].address);
-				}
-				else
-				{
-					bitcoinPublicKeyToAddress(output.publicKey[i], output.addresses[i].address);
-				}
-			}
-		}
-		break;
-		default:
-			break;
+			reportMessage("Block %d : has a zero byte length output script?\r\n", mDecodeBlockIndex);
+			mReportTransactionHash = true;
+			publicKey[0] = &gZeroByte[1];
 		}
-		output.keyTypeName = getKeyType(output.keyType);
-		getAsciiAddress(output);
-
-		//		if ( output.keyType == BlockChain::KT_SCRIPT_HASH )
-		//		{
-		//			logMessage("ScriptHash: %s\r\n", output.asciiAddress );
-		//		}
+		reportMessage("WARNING: Failed to decode public key in output script. Block %s : Transaction: %s : OutputIndex: %s scriptLength: %s\r\n", formatNumber(mDecodeBlockIndex), formatNumber(mDecodeTransactionIndex), formatNumber(mOutputIndex), formatNumber(challengeScriptLength));
+		mReportTransactionHash = true;
+		mIsWarning = true;
+	}
 
-		if (gReportTransactionHash)
+	// Read the segregated witness stack for this input.  The witness items are not decoded, we just record where they live.
+	void readWitness(BlockChain::BlockInput &input)
+	{
+		input.witnessCount = uint32_t(readCompactSize());
+		input.witness = getPosition();
+		for (uint32_t i = 0; i < input.witnessCount; i++)
 		{
-			gIsWarning = true;
+			skip(readCompactSize());
 		}
-		return ret;
 	}
 
-	// Read a single transaction
+	// Read a single transaction.  The inputs and outputs are written to the slots provided; the transaction
+	// must not have more inputs or outputs than the capacity available.
 	bool readTransaction(BlockChain::BlockTransaction &transaction,
-		uint32_t &transactionIndex,
+		BlockChain::BlockInput *inputs,
+		uint32_t inputCapacity,
+		const BlockChain::BlockOutputs &outputs,
+		uint32_t outputCapacity,
 		uint32_t tindex)
 	{
-		bool ret = false;
+		bool ret = true;
 
-		const uint8_t *transactionBegin = mBlockRead;
+		mDecodeTransactionIndex = tindex;
+		const uint8_t *transactionBegin = getPosition();
 
 		transaction.transactionVersionNumber = readU32(); // read the transaction version number; always expect it to be 1
 
@@ -844,97 +894,217 @@ public:
 		}
 		else
 		{
-			gIsWarning = true;
-			logMessage("Encountered unusual and unexpected transaction version number of [%d] for transaction #%d\r\n", transaction.transactionVersionNumber, tindex);
+			mIsWarning = true;
+			reportMessage("Encountered unusual and unexpected transaction version number of [%d] for transaction #%d\r\n", transaction.transactionVersionNumber, tindex);
 		}
 
-		transaction.inputCount = readVariableLengthInteger();
+		// A segregated witness transaction has a zero 'marker' byte where the input count would be, followed by a 'flag' byte of one.
+		transaction.hasWitness = false;
+		if (hasWitnessMarker(*this))
+		{
+			transaction.hasWitness = true;
+			skip(2);
+		}
+		const uint8_t *inputsBegin = getPosition();
+
+		transaction.inputCount = uint32_t(readCompactSize());
 		assert(transaction.inputCount < MAX_REASONABLE_INPUTS);
 		if (transaction.inputCount >= MAX_REASONABLE_INPUTS)
 		{
-			logMessage("Invalid number of inputs found! %d\r\n", transaction.inputCount);
-			exit(1);
+			reportMessage("Invalid number of inputs found! %d\r\n", transaction.inputCount);
+			return false;
 		}
-		transaction.inputs = &mInputs[totalInputCount];
-		totalInputCount += transaction.inputCount;
-		assert(totalInputCount < MAX_BLOCK_INPUTS);
-		if (totalInputCount >= MAX_BLOCK_INPUTS)
+		transaction.inputs = inputs;
+		if (transaction.inputCount > inputCapacity)
 		{
-			logMessage("Invalid number of block inputs: %d\r\n", totalInputCount);
-			exit(1);
+			reportMessage("Invalid number of block inputs: %d\r\n", transaction.inputCount);
+			return false;
 		}
-		if (totalInputCount < MAX_BLOCK_INPUTS)
+		for (uint32_t i = 0; i < transaction.inputCount && ret; i++)
 		{
-			for (uint32_t i = 0; i < transaction.inputCount; i++)
+			BlockChain::BlockInput &input = transaction.inputs[i];
+			input.witnessCount = 0;
+			input.witness = NULL;
+			ret = readInput(input);	// read the input
+			if (!ret)
 			{
-				BlockChain::BlockInput &input = transaction.inputs[i];
-				ret = readInput(input);	// read the input
-				if (!ret)
-				{
-					logMessage("Failed to read input!\r\n");
-					exit(1);
-					//					break;
-				}
+				reportMessage("Failed to read input!\r\n");
 			}
 		}
 		if (ret)
 		{
-			transaction.outputCount = readVariableLengthInteger();
+			transaction.outputCount = uint32_t(readCompactSize());
 			assert(transaction.outputCount < MAX_REASONABLE_OUTPUTS);
 			if (transaction.outputCount > MAX_REASONABLE_OUTPUTS)
 			{
-				logMessage("Exceeded maximum reasonable outputs.\r\n");
-				exit(1);
+				reportMessage("Exceeded maximum reasonable outputs.\r\n");
+				return false;
 			}
-			transaction.outputs = &mOutputs[totalOutputCount];
-			totalOutputCount += transaction.outputCount;
-			assert(totalOutputCount < MAX_BLOCK_OUTPUTS);
-			if (totalOutputCount >= MAX_BLOCK_OUTPUTS)
+			transaction.outputs = outputs;
+			if (transaction.outputCount > outputCapacity)
 			{
-				logMessage("Invalid number of block outputs. %d\r\n", totalOutputCount);
-				exit(1);
+				reportMessage("Invalid number of block outputs. %d\r\n", transaction.outputCount);
+				return false;
 			}
-			if (totalOutputCount < MAX_BLOCK_OUTPUTS)
+			for (uint32_t i = 0; i < transaction.outputCount && ret; i++)
 			{
-				for (uint32_t i = 0; i < transaction.outputCount; i++)
+				mOutputIndex = i;
+				ret = readOutput(transaction.outputs, i);
+				if (!ret)
 				{
-					gOutputIndex = i;
-					BlockChain::BlockOutput &output = transaction.outputs[i];
-					ret = readOutput(output);
-					if (!ret)
-					{
-						logMessage("Failed to read output.\r\n");
-						exit(1);
-						//						break;
-					}
+					reportMessage("Failed to read output.\r\n");
 				}
+			}
+			if (ret)
+			{
+				classifyOutputs(transaction.outputs, transaction.outputCount);
+			}
+		}
+		if (ret)
+		{
+			const uint8_t *witnessBegin = getPosition();
+			if (transaction.hasWitness)
+			{
+				for (uint32_t i = 0; i < transaction.inputCount; i++)
+				{
+					readWitness(transaction.inputs[i]);
+				}
+			}
 
-				transaction.lockTime = readU32();
+			transaction.lockTime = readU32();
 
+			{
+				transaction.transactionLength = (uint32_t)(getPosition() - transactionBegin);
+				// A transaction whose hash is to be reported is hashed straight away, so the report can follow it
+				bool batch = mBatchHashes && !mReportTransactionHash;
+				if (batch)
+				{
+					queueHash(transactionBegin, 0, transaction.transactionLength, transaction.witnessHash, transaction.hasWitness ? nullptr : transaction.transactionHash);
+				}
+				else
+				{
+					computeDoubleSHA256(transactionBegin, transaction.transactionLength, transaction.witnessHash);
+				}
+				if (transaction.hasWitness)
 				{
-					transaction.transactionLength = (uint32_t)(mBlockRead - transactionBegin);
-					transaction.fileIndex = fileIndex;
-					transaction.fileOffset = fileOffset + (uint32_t)(transactionBegin - mBlockData);
-					transaction.transactionIndex = transactionIndex;
-					transactionIndex++;
-					computeSHA256(transactionBegin, transaction.transactionLength, transaction.transactionHash);
-					computeSHA256(transaction.transactionHash, 32, transaction.transactionHash);
-
-					if (gReportTransactionHash)
+					// The txid does not cover the marker, flag or witness data.  It is hashed straight from the
+					// version, the inputs and outputs, and the lock time where they lie in the block; the multi-buffer
+					// kernels need each message contiguous, so for them a stripped copy of the transaction is queued.
+					uint32_t bodyLength = (uint32_t)(witnessBegin - inputsBegin);
+					if (batch)
 					{
-						logMessage("TRANSACTION HASH:");
-						printReverseHash(transaction.transactionHash);
-						logMessage("\r\n");
-						gReportTransactionHash = false;
+						size_t offset = mStrippedTransaction.size();
+						mStrippedTransaction.resize(offset + bodyLength + 8);
+						uint8_t *dest = &mStrippedTransaction[offset];
+						memcpy(dest, transactionBegin, 4);
+						memcpy(dest + 4, inputsBegin, bodyLength);
+						memcpy(dest + 4 + bodyLength, getPosition() - 4, 4);
+						queueHash(nullptr, offset, bodyLength + 8, transaction.transactionHash, nullptr);
 					}
-
+					else
+					{
+						SHA256Context context;
+						context.update(transactionBegin, 4);
+						context.update(inputsBegin, bodyLength);
+						context.update(getPosition() - 4, 4);
+						context.finalizeDouble(transaction.transactionHash);
+					}
+				}
+				else if (!batch)
+				{
+					memcpy(transaction.transactionHash, transaction.witnessHash, 32);
 				}
 
+				if (mReportTransactionHash)
+				{
+					reportMessage("TRANSACTION HASH:");
+					reportReverseHash(transaction.transactionHash);
+					reportMessage("\r\n");
+					mReportTransactionHash = false;
+				}
 			}
 		}
 		return ret;
 	}
 
+	// Defer a transaction hash until 'flushHashes'; 'data' null means the message is at 'offset' in mStrippedTransaction.
+	// 'copy', if not null, receives a second copy of the hash.
+	void queueHash(const uint8_t *data, size_t offset, uint32_t length, uint8_t *dest, uint8_t *copy)
+	{
+		HashJob job;
+		job.mData = data;
+		job.mOffset = offset;
+		job.mLength = length;
+		job.mDest = dest;
+		job.mCopy = copy;
+		mHashJobs.push_back(job);
+	}
+
+	// Compute every hash queued since the last flush, many messages at a time
+	void flushHashes(void)
+	{
+		uint32_t count = uint32_t(mHashJobs.size());
+		if (count == 0)
+		{
+			mStrippedTransaction.clear();
+			return;
+		}
+		mHashInputs.resize(count);
+		mHashSizes.resize(count);
+		mHashResults.resize(size_t(count) * 32);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const HashJob &job = mHashJobs[i];
+			mHashInputs[i] = job.mData ? job.mData : &mStrippedTransaction[job.mOffset];
+			mHashSizes[i] = job.mLength;
+		}
+		uint8_t (*results)[32] = reinterpret_cast< uint8_t (*)[32] >(&mHashResults[0]);
+		computeDoubleSHA256Batch(count, &mHashInputs[0], &mHashSizes[0], results);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const HashJob &job = mHashJobs[i];
+			memcpy(job.mDest, results[i], 32);
+			if (job.mCopy)
+			{
+				memcpy(job.mCopy, results[i], 32);
+			}
+		}
+		mHashJobs.clear();
+		mStrippedTransaction.clear();
+	}
+
+	// Reset the per block diagnostic state and accumulators
+	void beginBlock(uint32_t blockIndex)
+	{
+		mDecodeBlockIndex = blockIndex;
+		mDecodeTransactionIndex = 0;
+		mOutputIndex = 0;
+		mIsWarning = false;
+		mIsFailed = false;
+		mReportTransactionHash = false;
+		mOutputValue = 0;
+	}
+
+	uint32_t				mDecodeBlockIndex{0};		// The block being decoded; for diagnostics
+	uint32_t				mDecodeTransactionIndex{0};	// The transaction being decoded, relative to the start of the block; for diagnostics
+	uint32_t				mOutputIndex{0};			// The output being decoded; for diagnostics
+	bool					mIsWarning{false};			// A warning was issued while decoding
+	bool					mIsFailed{false};			// A transaction could not be decoded since 'beginBlock'
+	bool					mReportTransactionHash{false};	// Report the hash of the current transaction once it is known
+	uint64_t				mOutputValue{0};			// Total value of all outputs decoded since 'beginBlock'
+	std::string				*mDeferredLog{nullptr};		// If not null, diagnostics are appended here rather than logged
+	std::vector< uint8_t >	mStrippedTransaction;		// Stripped copies of the witness transactions queued by 'queueHash'
+	bool					mBatchHashes{false};		// Queue transaction hashes to be computed together by 'flushHashes'
+	std::vector< HashJob >	mHashJobs;
+	std::vector< const uint8_t *>	mHashInputs;		// Scratch memory for 'flushHashes'
+	std::vector< uint32_t >	mHashSizes;
+	std::vector< uint8_t >	mHashResults;
+	KeyHashQueue			mKeyHashes;					// Public keys of the outputs being classified, hashed together
+};
+
+class BlockImpl : public BlockChain::Block, public TransactionDecoder
+{
+public:
 	// @see this link for detailed documentation:
 	//
 	// http://james.lab6.com/2012/01/12/bitcoin-285-bytes-that-changed-the-world/
@@ -968,64 +1138,292 @@ public:
 	{
 		bool ret = true;
 		mBlockData = (const uint8_t *)blockData;
-		mBlockRead = mBlockData;	// Set the block-read scan pointer.
-		mBlockEnd = &mBlockData[blockLength]; // Mark the end of block pointer
-		blockFormatVersion = readU32();	// Read the format version
-		previousBlockHash = readHash();  // get the address of the hash
-		merkleRoot = readHash();	// Get the address of the merkle root hash
-		gBlockTime = timeStamp = readU32();	// Get the timestamp
-		bits = readU32();	// Get the bits field
-		nonce = readU32();	// Get the 'nonce' random number.
-		transactionCount = readVariableLengthInteger();	// Read the number of transactions
-		assert(transactionCount < MAX_BLOCK_TRANSACTION);
-		if (transactionCount >= MAX_BLOCK_TRANSACTION)
-		{
-			logMessage("Too many transactions in the block: %d\r\n", transactionCount);
-			exit(1);
-		}
-		if (transactionCount < MAX_BLOCK_TRANSACTION)
-		{
-			transactions = mTransactions;	// Assign the transactions buffer pointer
+		beginBlock(blockIndex);
+		BlockScanner scan(mBlockData, &mBlockData[blockLength]); // The header is read, and the block walked, with bounds checks
+		blockFormatVersion = scan.readU32();	// Read the format version
+		previousBlockHash = scan.readHash();  // get the address of the hash
+		merkleRoot = scan.readHash();	// Get the address of the merkle root hash
+		timeStamp = scan.readU32();	// Get the timestamp
+		bits = scan.readU32();	// Get the bits field
+		nonce = scan.readU32();	// Get the 'nonce' random number.
+		uint64_t count = scan.readCompactSize();	// Read the number of transactions
+		transactionCount = count <= (scan.getRemaining() / MIN_TRANSACTION_SIZE) ? uint32_t(count) : 0;
+		const uint8_t *transactionsBegin = scan.getPosition();
+		// Walk the block first so the transaction, input and output arrays can be allocated at exactly the size needed
+		if (scan.hasOverflow() || transactionCount != count || !scanTransactions(scan))
+		{
+			logMessage("Block %d : Unable to locate the transactions in the block data; block is corrupt.\r\n", blockIndex);
+			transactionCount = 0;
+			transactions = nullptr;
+			return false;
+		}
+		transactions = mArena.allocArray< BlockChain::BlockTransaction >(transactionCount);
+		mInputs = mArena.allocArray< BlockChain::BlockInput >(totalInputCount);
+		allocOutputs(outputs, totalOutputCount);
+		setBuffer(transactionsBegin, &mBlockData[blockLength]);
+		if (mThreadPool && transactionCount >= MIN_PARALLEL_TRANSACTIONS)
+		{
+			ret = decodeTransactionsParallel(transactionIndex);
+		}
+		else
+		{
+			mBatchHashes = batchHashes();
 			for (uint32_t i = 0; i < transactionCount; i++)
 			{
-				gTransactionIndex = i;
+				const TransactionSpan &span = mSpans[i];
 				BlockChain::BlockTransaction &b = transactions[i];
-				if (!readTransaction(b, transactionIndex, i))	// Read the transaction; if it failed; then abort processing the block chain
+				// Read the transaction; if it failed; then abort processing the block
+				if (!readTransaction(b, &mInputs[span.mFirstInput], span.mInputCount, outputs.offset(span.mFirstOutput), span.mOutputCount, i))
 				{
 					ret = false;
 					break;
 				}
+				setTransactionLocation(b, span.mBegin, transactionIndex);
+				transactionIndex++;
+			}
+			flushHashes();
+			mBatchHashes = false;
+		}
+		blockReward += mOutputValue;
+
+		return ret;
+	}
+
+	// Walks every transaction in the block without decoding it, recording where it begins and how many inputs and
+	// outputs it has; then assigns each transaction its input and output slots.  This sizes the arena allocations
+	// and lets the transactions be decoded in parallel.  Returns false if the block could not be walked.
+	bool scanTransactions(BlockScanner &scan)
+	{
+		bool ret = true;
+
+		mSpans.resize(transactionCount);
+		totalInputCount = 0;
+		totalOutputCount = 0;
+		for (uint32_t i = 0; i < transactionCount && ret; i++)
+		{
+			TransactionSpan &span = mSpans[i];
+			ret = scanTransaction(scan, span);
+			if (ret)
+			{
+				span.mFirstInput = totalInputCount;
+				span.mFirstOutput = totalOutputCount;
+				totalInputCount += span.mInputCount;
+				totalOutputCount += span.mOutputCount;
+			}
+		}
+		if (!ret)
+		{
+			totalInputCount = 0;
+			totalOutputCount = 0;
+		}
+
+		return ret;
+	}
+
+	// Skip over a single transaction, recording where it begins and how many inputs and outputs it has.
+	// Every field is bounds checked here, so once a transaction has been scanned it can be decoded without checks.
+	bool scanTransaction(BlockScanner &scan, TransactionSpan &span)
+	{
+		span.mBegin = scan.getPosition();
+		scan.skip(4); // skip the version number
+		bool hasWitness = false;
+		if (hasWitnessMarker(scan))
+		{
+			hasWitness = true;
+			scan.skip(2);
+		}
+		uint64_t inputCount = scan.readCompactSize();
+		if (inputCount >= MAX_REASONABLE_INPUTS)
+		{
+			return false;
+		}
+		span.mInputCount = uint32_t(inputCount);
+		for (uint32_t i = 0; i < span.mInputCount && !scan.hasOverflow(); i++)
+		{
+			scan.skip(32 + 4); // skip the transaction hash and index
+			scan.skip(scan.readCompactSize()); // skip the script
+			scan.skip(4); // skip the sequence number
+		}
+		uint64_t outputCount = scan.readCompactSize();
+		if (outputCount > MAX_REASONABLE_OUTPUTS)
+		{
+			return false;
+		}
+		span.mOutputCount = uint32_t(outputCount);
+		for (uint32_t i = 0; i < span.mOutputCount && !scan.hasOverflow(); i++)
+		{
+			scan.skip(8); // skip the value
+			scan.skip(scan.readCompactSize()); // skip the script
+		}
+		if (hasWitness)
+		{
+			for (uint32_t i = 0; i < span.mInputCount && !scan.hasOverflow(); i++)
+			{
+				uint64_t itemCount = scan.readCompactSize();
+				for (uint64_t j = 0; j < itemCount && !scan.hasOverflow(); j++)
+				{
+					scan.skip(scan.readCompactSize());
+				}
+			}
+		}
+		scan.skip(4); // skip the lock time
+		return !scan.hasOverflow();
+	}
+
+	// Decode and hash all of the transactions found by 'scanTransactions' using the thread pool.
+	// Each transaction is written directly into its preallocated slots.  Any diagnostics are collected per
+	// transaction and written out in order once every transaction has been decoded, so the log output is the
+	// same as for a serial decode.  Returns false if any transaction could not be decoded, as the serial decode does.
+	bool decodeTransactionsParallel(uint32_t &transactionIndex)
+	{
+		bool ret = true;
+		uint32_t baseTransactionIndex = transactionIndex;
+
+		mTransactionLogs.resize(transactionCount);
+		for (auto &i : mDecoders)
+		{
+			i.beginBlock(blockIndex);
+		}
+		bool batch = batchHashes();
+		mThreadPool->parallelFor(transactionCount, PARALLEL_TRANSACTION_GRAIN, [this, baseTransactionIndex, batch](uint32_t begin, uint32_t end, uint32_t workerIndex)
+		{
+			TransactionDecoder &decoder = mDecoders[workerIndex];
+			decoder.mBatchHashes = batch;
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const TransactionSpan &span = mSpans[i];
+				BlockChain::BlockTransaction &t = transactions[i];
+				mTransactionLogs[i].clear();
+				decoder.mDeferredLog = &mTransactionLogs[i];
+				decoder.setBuffer(span.mBegin, getEnd());
+				if (!decoder.readTransaction(t, &mInputs[span.mFirstInput], span.mInputCount, outputs.offset(span.mFirstOutput), span.mOutputCount, i))
+				{
+					decoder.mIsFailed = true;
+					break;
+				}
+				setTransactionLocation(t, span.mBegin, baseTransactionIndex + i);
+			}
+			decoder.flushHashes();
+			decoder.mBatchHashes = false;
+			decoder.mDeferredLog = nullptr;
+		});
+		for (auto &i : mDecoders)
+		{
+			mIsWarning |= i.mIsWarning;
+			mOutputValue += i.mOutputValue;
+			if (i.mIsFailed)
+			{
+				ret = false;
+			}
+		}
+		for (uint32_t i = 0; i < transactionCount; i++)
+		{
+			const std::string &log = mTransactionLogs[i];
+			// logMessage formats into a fixed size buffer, so long reports are written out in pieces.
+			for (size_t j = 0; j < log.size(); j += 1024)
+			{
+				size_t len = log.size() - j;
+				logMessage("%.*s", int(len < 1024 ? len : 1024), log.c_str() + j);
 			}
 		}
-
+		transactionIndex += transactionCount;
 		return ret;
 	}
+
+	// The transactions of a block are hashed together when a multi-buffer SHA256 is faster than hashing them one at a time
+	static bool batchHashes(void)
+	{
+		return getSHA256BatchImplementation() != SHA256_BATCH_SINGLE;
+	}
+
+	// Record where on disk this transaction can be found
+	void setTransactionLocation(BlockChain::BlockTransaction &transaction, const uint8_t *transactionBegin, uint32_t transactionIndex)
+	{
+		transaction.fileIndex = fileIndex;
+		transaction.fileOffset = fileOffset + uint64_t(transactionBegin - mBlockData);
+		transaction.transactionIndex = transactionIndex;
+	}
+
+	// Use this thread pool to decode large blocks; null to always decode serially
+	void setThreadPool(threadpool::ThreadPool *threadPool)
+	{
+		mThreadPool = threadPool;
+		mDecoders.clear();
+		if (mThreadPool)
+		{
+			mDecoders.resize(mThreadPool->getThreadCount() + 1);
+		}
+	}
+
 	const BlockChain::BlockTransaction *processTransactionData(const void *transactionData, uint32_t transactionLength)
 	{
-		uint32_t transactionIndex = 0;
-		BlockChain::BlockTransaction *ret = &mTransactions[0];
+		BlockChain::BlockTransaction *ret = nullptr;
 		mBlockData = (const uint8_t *)transactionData;
-		mBlockRead = mBlockData;	// Set the block-read scan pointer.
-		mBlockEnd = &mBlockData[transactionLength]; // Mark the end of block pointer
+		BlockScanner scan(mBlockData, &mBlockData[transactionLength]);
 
-		if (!readTransaction(*ret, transactionIndex, 0))	// Read the transaction; if it failed; then abort processing the block chain
+		TransactionSpan span;
+		if (scanTransaction(scan, span))
+		{
+			ret = mArena.allocArray< BlockChain::BlockTransaction >(1);
+			BlockChain::BlockInput *inputs = mArena.allocArray< BlockChain::BlockInput >(span.mInputCount);
+			allocOutputs(outputs, span.mOutputCount);
+			setBuffer(mBlockData, &mBlockData[transactionLength]);
+			if (!readTransaction(*ret, inputs, span.mInputCount, outputs, span.mOutputCount, 0))
+			{
+				ret = nullptr;
+			}
+		}
+		if (ret)
+		{
+			setTransactionLocation(*ret, mBlockData, 0);
+		}
+		else
 		{
-			ret = NULL;
 			logMessage("Failed to process transaction data!\r\n");
-			exit(1);
 		}
 		return ret;
 	}
 
+	// Build and classify output columns for outputs spent by the inputs of some other block.  The scripts are at
+	// 'scriptBase' plus each offset.  They were diagnosed when the block holding them was decoded, so any
+	// diagnostics are discarded here.
+	void decodeSpentOutputs(const uint8_t *scriptBase, const uint64_t *values, const uint32_t *scriptOffsets, const uint32_t *scriptLengths, uint32_t count, uint32_t blockIndex)
+	{
+		mArena.reset();
+		mBlockData = scriptBase;
+		beginBlock(blockIndex);
+		allocOutputs(outputs, count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			outputs.values[i] = values[i];
+			outputs.scriptOffsets[i] = scriptOffsets[i];
+			outputs.scriptLengths[i] = scriptLengths[i];
+		}
+		std::string discarded;
+		mDeferredLog = &discarded;
+		classifyOutputs(outputs, count);
+		mDeferredLog = nullptr;
+	}
 
+	// Allocate the output columns for this many outputs from the arena
+	void allocOutputs(BlockChain::BlockOutputs &o, uint32_t outputCount)
+	{
+		o.scriptBase = mBlockData;
+		o.values = mArena.allocArray< uint64_t >(outputCount);
+		o.scriptOffsets = mArena.allocArray< uint32_t >(outputCount);
+		o.scriptLengths = mArena.allocArray< uint32_t >(outputCount);
+		o.keyTypes = mArena.allocArray< uint8_t >(outputCount);
+		o.keyCounts = mArena.allocArray< uint8_t >(outputCount);
+		o.hashes = mArena.allocArray< BlockChain::OutputHash >(outputCount);
+	}
 
-
-	const uint8_t					*mBlockRead;				// The current read buffer address in the block
-	const uint8_t					*mBlockEnd;					// The EOF marker for the block
-	const uint8_t					*mBlockData;
-	BlockChain::BlockTransaction	mTransactions[MAX_BLOCK_TRANSACTION];	// Holds the array of transactions
-	BlockChain::BlockInput			mInputs[MAX_BLOCK_INPUTS];	// The input arrays
-	BlockChain::BlockOutput			mOutputs[MAX_BLOCK_OUTPUTS]; // The output arrays
+	blockarena::BlockArena			mArena;						// Holds the transactions, inputs and outputs of the current block; reset before each block
+	const uint8_t					*mBlockData{nullptr};
+	threadpool::ThreadPool			*mThreadPool{nullptr};		// Optional thread pool used to decode large blocks in parallel
+	std::vector< TransactionDecoder >	mDecoders;				// One decoder per thread in the pool (plus the calling thread)
+	std::vector< TransactionSpan >	mSpans;						// Location and input/output slot assignment of each transaction in the block
+	std::vector< std::string >		mTransactionLogs;			// Diagnostics deferred while decoding in parallel; one per transaction
+	BlockChain::BlockInput			*mInputs{nullptr};			// The inputs of every transaction in the block; allocated from the arena
 
 
 };
@@ -1034,7 +1432,7 @@ class BlockChainImpl : public BlockChain
 {
 public:
 
-	typedef std::vector< FILE * > FILEVector;
+	typedef std::vector< FILE_INTERFACE * > FILEVector;
 	typedef std::vector< BlockHeader *> BlockHeaderVector;
 	typedef std::unordered_set< BlockHeader > BlockHeaderSet;
 	typedef std::unordered_set< FileLocation > FileLocationSet;
@@ -1054,10 +1452,14 @@ public:
 		mReadCount = 0;
 		mBlockIndex = 0;
 		mFileLength = 0;
-		mCurrentBlockData = mBlockDataBuffer;	// scratch buffer to read up to 3 blocks
 		mBlockChainHeaders = nullptr;
-		bitcoinAsciiToAddress(gDummyKeyAscii, gDummyKey);
-		bitcoinAsciiToAddress(gZeroByteAscii, gZeroByte);
+		mThreadPool = nullptr;
+		static std::once_flag keysOnce; // more than one parser may be created concurrently
+		std::call_once(keysOnce,[]()
+		{
+			bitcoinAsciiToAddress(gDummyKeyAscii, gDummyKey);
+			bitcoinAsciiToAddress(gZeroByteAscii, gZeroByte);
+		});
 		openBlock();
 	}
 
@@ -1066,14 +1468,55 @@ public:
 		logMessage("~BlockChainImpl : Destructor!\r\n");
 		for (FILEVector::iterator i = mBlockDataFiles.begin(); i!=mBlockDataFiles.end(); ++i)
 		{
-			FILE *f = (*i);
-			fclose(f);
+			fi_fclose(*i);
 		}
 		if (mTextReport)
 		{
 			fclose(mTextReport);
 		}
 		delete[]mBlockChainHeaders;
+		if (mThreadPool)
+		{
+			mThreadPool->release();
+		}
+		if (mMerkleVerifier)
+		{
+			mMerkleVerifier->release();
+		}
+	}
+
+	virtual void setHugePages(bool state)
+	{
+		mSingleReadBlock.mArena.setHugePages(state);
+		mSingleTransactionBlock.mArena.setHugePages(state);
+	}
+
+	virtual void setVerifyMerkle(bool state)
+	{
+		if (state && mMerkleVerifier == nullptr)
+		{
+			mMerkleVerifier = merkleverifier::MerkleVerifier::create();
+		}
+		else if (!state && mMerkleVerifier)
+		{
+			mMerkleVerifier->release();
+			mMerkleVerifier = nullptr;
+		}
+	}
+
+	virtual void setDecodeThreadCount(uint32_t threadCount)
+	{
+		mSingleReadBlock.setThreadPool(nullptr);
+		if (mThreadPool)
+		{
+			mThreadPool->release();
+			mThreadPool = nullptr;
+		}
+		if (threadCount > 1)
+		{
+			mThreadPool = threadpool::ThreadPool::createForCaller(threadCount);
+			mSingleReadBlock.setThreadPool(mThreadPool);
+		}
 	}
 
 	// Initial scan of the blockchain to build the hash table of valid blocks; skipping orphan blocks
@@ -1105,48 +1548,53 @@ public:
 		if (mBlockIndex < mBlockDataFiles.size())
 		{
 			// Get the file pointer for the current blk?????.dat file we are scanning
-			FILE *fph = mBlockDataFiles[mBlockIndex];
+			FILE_INTERFACE *fph = mBlockDataFiles[mBlockIndex];
 			uint32_t magicID = 0;
-			uint32_t lastBlockRead = (uint32_t)ftell(fph);
+			uint64_t lastBlockRead = fi_ftell(fph);
 			// Attempt to read the 'magicid' which we expect to see at the start of each block
-			size_t r = fread(&magicID, sizeof(magicID), 1, fph);	// Attempt to read the magic id for the next block
+			uint64_t r = fi_fread(&magicID, sizeof(magicID), 1, fph);	// Attempt to read the magic id for the next block
 			if (r == 0)
 			{
 				if (openBlock()) // Attempt to open the next block, if successful, look for the magicID in it.
 				{
 					fph = mBlockDataFiles[mBlockIndex];
-					r = fread(&magicID, sizeof(magicID), 1, fph); // if we opened up a new file; read the magic id from it's first block.
-					lastBlockRead = ftell(fph);
+					r = fi_fread(&magicID, sizeof(magicID), 1, fph); // if we opened up a new file; read the magic id from it's first block.
+					lastBlockRead = fi_ftell(fph);
 				}
 			}
 			// If after reading the previous block, we did not encounter a block header, we need to scan for the next block header..
 			if (r == 1 && magicID != MAGIC_ID)
 			{
-				fseek(fph, lastBlockRead, SEEK_SET);
+				fi_fseek(fph, lastBlockRead, SEEK_SET);
 				logMessage("Warning: Missing block-header; scanning for next one.\r\n");
-				uint8_t *temp = (uint8_t *)::malloc(MAX_BLOCK_SIZE);
-				memset(temp, 0, MAX_BLOCK_SIZE);
-				uint32_t c = (uint32_t)fread(temp, 1, MAX_BLOCK_SIZE, fph);
 				bool found = false;
-				if (c > 0)
+				uint64_t skipped = 0;
+				for (;;)
 				{
-					for (uint32_t i = 0; i < c; i++)
+					// Search the file a chunk at a time; the last three bytes of each chunk are searched again with the next one
+					// in case the magic id straddles the two.
+					mMagicSearch.resize(MAGIC_SEARCH_CHUNK_SIZE);
+					uint32_t c = (uint32_t)fi_fread(&mMagicSearch[0], 1, MAGIC_SEARCH_CHUNK_SIZE, fph);
+					size_t i = blockfile::findBlockMagic(&mMagicSearch[0], c);
+					if (i < c)
 					{
-						const uint32_t *check = (const uint32_t *)&temp[i];
-						if (*check == MAGIC_ID)
-						{
-							logMessage("Found the next block header after skipping: %s bytes forward in the file.\r\n", formatNumber(i));
-							lastBlockRead += i; // advance to this location.
-							found = true;
-							break;
-						}
+						skipped += i;
+						logMessage("Found the next block header after skipping: %s bytes forward in the file.\r\n", formatNumber(int32_t(skipped)));
+						lastBlockRead += skipped; // advance to this location.
+						found = true;
+						break;
+					}
+					if (c < MAGIC_SEARCH_CHUNK_SIZE)
+					{
+						break;
 					}
+					skipped += c - 3;
+					fi_fseek(fph, lastBlockRead + skipped, SEEK_SET);
 				}
-				::free(temp);
 				if (found)
 				{
-					fseek(fph, lastBlockRead, SEEK_SET);
-					r = fread(&magicID, sizeof(magicID), 1, fph); // if we opened up a new file; read the magic id from it's first block.
+					fi_fseek(fph, lastBlockRead, SEEK_SET);
+					r = fi_fread(&magicID, sizeof(magicID), 1, fph); // if we opened up a new file; read the magic id from it's first block.
 					assert(magicID == MAGIC_ID);
 				}
 
@@ -1158,7 +1606,7 @@ public:
 					if (openBlock())
 					{
 						fph = mBlockDataFiles[mBlockIndex];
-						r = fread(&magicID, sizeof(magicID), 1, fph); // if we opened up a new file; read the magic id from it's first block.
+						r = fi_fread(&magicID, sizeof(magicID), 1, fph); // if we opened up a new file; read the magic id from it's first block.
 						if (r == 1)
 						{
 							if (magicID != MAGIC_ID)
@@ -1179,24 +1627,21 @@ public:
 				BlockHeader header;
 				BlockPrefix prefix;
 				header.mFileIndex = mBlockIndex;
-				r = fread(&header.mBlockLength, sizeof(header.mBlockLength), 1, fph); // read the length of the block
-				header.mFileOffset = (uint32_t)ftell(fph);
+				r = fi_fread(&header.mBlockLength, sizeof(header.mBlockLength), 1, fph); // read the length of the block
+				header.mFileOffset = fi_ftell(fph);
 				if (r == 1)
 				{
 					assert(header.mBlockLength < MAX_BLOCK_SIZE); // make sure the block length does not exceed our maximum expected ever possible block size
 					if (header.mBlockLength < MAX_BLOCK_SIZE)
 					{
-						r = fread(&prefix, sizeof(prefix), 1, fph); // read the rest of the block (less the 8 byte header we have already consumed)
+						r = fi_fread(&prefix, sizeof(prefix), 1, fph); // read the rest of the block (less the 8 byte header we have already consumed)
 						if (r == 1)
 						{
 							Hash256 *blockHash = static_cast<Hash256 *>(&header);
 							memcpy(header.mPreviousBlockHash, prefix.mPreviousBlock, 32);
-							computeSHA256((uint8_t *)&prefix, sizeof(prefix), (uint8_t *)blockHash);
-							computeSHA256((uint8_t *)blockHash, 32, (uint8_t *)blockHash);
-							uint32_t currentFileOffset = ftell(fph); // get the current file offset.
-							uint32_t advance = header.mBlockLength - sizeof(BlockPrefix);
-							currentFileOffset += advance;
-							fseek(fph, currentFileOffset, SEEK_SET); // skip past the block to get to the next header.
+							computeDoubleSHA256((uint8_t *)&prefix, sizeof(prefix), (uint8_t *)blockHash);
+							uint64_t advance = header.mBlockLength - sizeof(BlockPrefix);
+							fi_fseek(fph, header.mFileOffset + sizeof(BlockPrefix) + advance, SEEK_SET); // skip past the block to get to the next header.
 							mLastBlockHeader = header;
 							mBlockHeaderSet.insert(header);
 							ret = true;
@@ -1221,12 +1666,12 @@ public:
 #else
 		sprintf(scratch, "%s/blk%05d.dat", mRootDir.c_str(), mBlockIndex);	// get the filename
 #endif
-		FILE *fph = fopen(scratch, "rb");
+		// The block files are memory mapped where possible so blocks can be parsed where they lie
+		FILE_INTERFACE *fph = fi_fopen(scratch, "rb", nullptr, 0, true);
 		if (fph)
 		{
-			fseek(fph, 0L, SEEK_END);
-			mFileLength = uint32_t(ftell(fph));
-			fseek(fph, 0L, SEEK_SET);
+			mFileLength = fi_getFileLength(fph);
+			fi_fadvise(fph, 0, mFileLength, FA_SEQUENTIAL); // the initial scan walks each file from start to finish
 			mBlockDataFiles.push_back(fph);
 			logMessage("Opened blockchain file '%s' for read access.\r\n", scratch);
 			ret = true;
@@ -1239,6 +1684,28 @@ public:
 		return ret;
 	}
 
+	// Returns the data at this location of a memory mapped block file; null if the file is not mapped or is too short
+	const uint8_t *mapFileData(uint32_t fileIndex, uint64_t offset, uint32_t length)
+	{
+		uint64_t fileLength = 0;
+		const uint8_t *data = static_cast< const uint8_t *>(fi_getMemBuffer(mBlockDataFiles[fileIndex], &fileLength));
+		if (data == nullptr || offset > fileLength || length > fileLength - offset)
+		{
+			return nullptr;
+		}
+		return data + offset;
+	}
+
+	// Reads the data at this location of a block file into 'dest'; the file position is left where it was
+	bool readFileData(uint32_t fileIndex, uint64_t offset, uint32_t length, uint8_t *dest)
+	{
+		FILE_INTERFACE *fph = mBlockDataFiles[fileIndex];
+		uint64_t saveLocation = fi_ftell(fph);
+		bool ret = fi_fseek(fph, offset, SEEK_SET) == 0 && fi_fread(dest, length, 1, fph) == 1;
+		fi_fseek(fph, saveLocation, SEEK_SET);
+		return ret;
+	}
+
 	virtual void release(void) 	// This method releases the block chain interface.
 	{
 		delete this;
@@ -1282,6 +1749,12 @@ public:
 			mBlockCount = blockCount;
 
 			mScanCount = 0;
+
+			// From here on blocks are read in chain order, which jumps between and around the block files
+			for (FILEVector::iterator i = mBlockDataFiles.begin(); i != mBlockDataFiles.end(); ++i)
+			{
+				fi_fadvise(*i, 0, fi_getFileLength(*i), FA_NORMAL);
+			}
 		}
 		return blockCount;
 	}
@@ -1302,88 +1775,67 @@ public:
 
 		if (blockIndex >= mBlockCount) return false;
 		BlockHeader &header = mBlockChainHeaders[blockIndex];
-		FILE *fph = mBlockDataFiles[header.mFileIndex];
+		FILE_INTERFACE *fph = mBlockDataFiles[header.mFileIndex];
 		if (fph)
 		{
-			block.blockIndex = blockIndex;
-			block.warning = false;
-			fseek(fph, header.mFileOffset, SEEK_SET);
-			gBlockIndex = blockIndex;
-			block.blockLength = header.mBlockLength;
-			block.blockReward = 0;
-			block.totalInputCount = 0;
-			block.totalOutputCount = 0;
-			block.fileIndex = header.mFileIndex;
-			block.fileOffset = header.mFileOffset;
-			block.blockLength = header.mBlockLength;
-
 			if (blockIndex < (mBlockCount - 2))
 			{
 				BlockHeader *nextNext = &mBlockChainHeaders[blockIndex + 2];
 				block.nextBlockHash = nextNext->mPreviousBlockHash;
 			}
 
-			uint8_t *blockData = mBlockDataBuffer;
-			size_t r = fread(blockData, block.blockLength, 1, fph); // read the rest of the block (less the 8 byte header we have already consumed)
-
-			if (r == 1)
+			// A memory mapped block is parsed in place; otherwise the raw block data is read into the block's arena
+			// along with everything decoded from it
+			block.mArena.reset();
+			const uint8_t *blockData = mapFileData(header.mFileIndex, header.mFileOffset, header.mBlockLength);
+			if (blockData)
+			{
+				fi_fadvise(fph, header.mFileOffset, header.mBlockLength, FA_WILLNEED); // fault the whole block in with one read
+			}
+			else
 			{
-				computeSHA256(blockData, 4 + 32 + 32 + 4 + 4 + 4, block.computedBlockHash);
-				computeSHA256(block.computedBlockHash, 32, block.computedBlockHash);
-				ret = block.processBlockData(blockData, block.blockLength, mTransactionCount);
+				uint8_t *dest = static_cast< uint8_t *>(block.mArena.alloc(header.mBlockLength));
+				if (readFileData(header.mFileIndex, header.mFileOffset, header.mBlockLength, dest))
+				{
+					blockData = dest;
+				}
+			}
 
+			if (blockData)
+			{
+				ret = parseBlock(block, blockData, header.mBlockLength, blockIndex, header.mFileIndex, header.mFileOffset);
 
 				if (mSearchForText) // if we are searching for ASCII text in the input stream...
 				{
-					uint32_t textCount = 0;
-					const char *scan = (const char *)blockData;
-					const char *end_scan = scan + (block.blockLength - mSearchForText);
-					char *scratch = new char[MAX_BLOCK_SIZE];
-					uint32_t lineCount = 0;
-					uint32_t totalCount = 0;
-					while (scan < end_scan)
+					// The runs are located in place with the vectorised classifier and written straight from the block data
+					mTextRuns.clear();
+					textminer::findTextRuns(blockData, block.blockLength, mSearchForText, mTextRuns);
+					if (!mTextRuns.empty() && mTextReport == 0)
 					{
-						uint32_t count = 0;
-						//						const char *begin = scan;
-						char *dest = scratch;
-						while (isASCII(*scan) && scan < end_scan)
+						mTextReport = fopen("AsciiTextReport.txt", "wb");
+						if (mTextReport)
 						{
-							*dest++ = *scan++;
-							count++;
+							setvbuf(mTextReport, NULL, _IOFBF, TEXT_REPORT_BUFFER_SIZE);
 						}
-						if (count >= mSearchForText)
+					}
+					if (!mTextRuns.empty() && mTextReport)
+					{
+						fprintf(mTextReport, "==========================================\r\n");
+						fprintf(mTextReport, "= ASCII TEXT REPORT for Block #%s on %s\r\n", formatNumber(blockIndex), getDateString(block.timeStamp));
+						fprintf(mTextReport, "==========================================\r\n");
+						uint32_t lineCount = 0;
+						uint32_t totalCount = 0;
+						for (auto &r : mTextRuns)
 						{
-							*dest = 0;
-							if (textCount == 0)
-							{
-								if (mTextReport == 0)
-								{
-									mTextReport = fopen("AsciiTextReport.txt", "wb");
-								}
-								if (mTextReport)
-								{
-									fprintf(mTextReport, "==========================================\r\n");
-									fprintf(mTextReport, "= ASCII TEXT REPORT for Block #%s on %s\r\n", formatNumber(blockIndex), getDateString(block.timeStamp));
-									fprintf(mTextReport, "==========================================\r\n");
-								}
-							}
-							textCount++;
-							if (mTextReport)
+							fwrite(blockData + r.mOffset, r.mLength, 1, mTextReport);
+							lineCount += r.mLength;
+							totalCount += r.mLength;
+							if (lineCount > 80)
 							{
-								fprintf(mTextReport, "%s", scratch);
-								lineCount += count;
-								totalCount += count;
-								if (lineCount > 80)
-								{
-									fprintf(mTextReport, "\r\n");
-									lineCount = 0;
-								}
+								fprintf(mTextReport, "\r\n");
+								lineCount = 0;
 							}
 						}
-						scan++;
-					}
-					if (textCount && mTextReport)
-					{
 						fprintf(mTextReport, "\r\n");
 						fprintf(mTextReport, "==========================================\r\n");
 						if (totalCount >= 128)
@@ -1399,9 +1851,7 @@ public:
 							fprintf(mTextReport, "Short Text: %d bytes\r\n", totalCount);
 						}
 						fprintf(mTextReport, "\r\n");
-						fflush(mTextReport);
 					}
-					delete[]scratch;
 				}
 
 				if (ret)
@@ -1415,8 +1865,52 @@ public:
 				exit(1);
 			}
 		}
-		block.warning = gIsWarning;
-		gIsWarning = false;
+		block.warning = block.mIsWarning;
+		block.mIsWarning = false;
+		return ret;
+	}
+
+	// Initialize the block fields, compute the block hash and decode all of the transactions
+	bool parseBlock(BlockImpl &block, const uint8_t *blockData, uint32_t blockLength, uint32_t blockIndex, uint32_t fileIndex, uint64_t fileOffset)
+	{
+		block.blockIndex = blockIndex;
+		block.warning = false;
+		block.blockLength = blockLength;
+		block.blockReward = 0;
+		block.totalInputCount = 0;
+		block.totalOutputCount = 0;
+		block.fileIndex = fileIndex;
+		block.fileOffset = fileOffset;
+
+		block.merkleStatus = MS_UNCHECKED;
+
+		computeDoubleSHA256Header(static_cast< const uint8_t *>(blockData), block.computedBlockHash);
+		bool ret = block.processBlockData(blockData, block.blockLength, mTransactionCount);
+		if (ret && mMerkleVerifier)
+		{
+			block.merkleStatus = mMerkleVerifier->verify(block);
+			if (block.merkleStatus != MS_VALID)
+			{
+				logMessage("WARNING: Block %s : merkle verification failed : %s\r\n", formatNumber(blockIndex), getMerkleStatusName(block.merkleStatus));
+				block.mIsWarning = true;
+			}
+		}
+		return ret;
+	}
+
+	virtual const Block *processBlock(const void *blockData, uint32_t blockLength, uint32_t blockIndex, uint32_t fileIndex, uint64_t fileOffset)
+	{
+		const Block *ret = nullptr;
+
+		mSingleReadBlock.nextBlockHash = nullptr;
+		mSingleReadBlock.mArena.reset();
+		if (parseBlock(mSingleReadBlock, (const uint8_t *)blockData, blockLength, blockIndex, fileIndex, fileOffset))
+		{
+			ret = &mSingleReadBlock;
+		}
+		mSingleReadBlock.warning = mSingleReadBlock.mIsWarning;
+		mSingleReadBlock.mIsWarning = false;
+
 		return ret;
 	}
 
@@ -1460,40 +1954,36 @@ public:
 		}
 		const FileLocation &f = *found;
 		uint32_t fileIndex = f.mFileIndex;
-		uint32_t fileOffset = f.mFileOffset;
+		uint64_t fileOffset = f.mFileOffset;
 		uint32_t transactionLength = f.mFileLength;
 
 		if ( fileIndex < mBlockDataFiles.size() && mBlockDataFiles[fileIndex] && transactionLength < MAX_BLOCK_SIZE )
 		{
-			FILE *fph = mBlockDataFiles[fileIndex];
-			uint32_t saveLocation = (uint32_t)ftell(fph);
-			fseek(fph,fileOffset,SEEK_SET);
-			uint32_t s = (uint32_t)ftell(fph);
-			if ( s == fileOffset )
+			mSingleTransactionBlock.mArena.reset();
+			const uint8_t *blockData = mapFileData(fileIndex,fileOffset,transactionLength);
+			if ( blockData == nullptr )
 			{
-				uint8_t *blockData = mTransactionBlockBuffer;
-				size_t r = fread(blockData,transactionLength,1,fph);
-				if ( r == 1 ) // if we successfully read in the entire transaction
+				uint8_t *dest = static_cast< uint8_t *>(mSingleTransactionBlock.mArena.alloc(transactionLength));
+				if ( readFileData(fileIndex,fileOffset,transactionLength,dest) )
 				{
-					ret = processSingleTransaction(blockData,transactionLength);
-					if ( ret )
-					{
-						BlockTransaction *t = (BlockTransaction *)ret;
-						t->transactionIndex = f.mTransactionIndex;
-						t->fileIndex = fileIndex;
-						t->fileOffset = fileOffset;
-					}
+					blockData = dest;
 				}
-				else
+			}
+			if ( blockData ) // if we successfully read in the entire transaction
+			{
+				ret = processSingleTransaction(blockData,transactionLength);
+				if ( ret )
 				{
-					assert(0);
+					BlockTransaction *t = (BlockTransaction *)ret;
+					t->transactionIndex = f.mTransactionIndex;
+					t->fileIndex = fileIndex;
+					t->fileOffset = fileOffset;
 				}
 			}
 			else
 			{
 				assert(0);
 			}
-			fseek(fph,saveLocation,SEEK_SET); // restore the file position back to it's previous location.
 		}
 		else
 		{
@@ -1503,6 +1993,170 @@ public:
 	}
 
 
+	virtual const SpentOutputs *resolveInputs(const Block *block)
+	{
+		mSpentRequests.clear();
+		mSpentSlots.assign(block->totalInputCount, NO_SPENT_OUTPUT);
+		mSpentOutputs.inputCount = block->totalInputCount;
+		mSpentOutputs.unresolvedCount = 0;
+
+		// Locate the previous transaction of every input
+		uint32_t inputIndex = 0;
+		for (uint32_t i = 0; i < block->transactionCount; i++)
+		{
+			const BlockTransaction &t = block->transactions[i];
+			for (uint32_t j = 0; j < t.inputCount; j++, inputIndex++)
+			{
+				BlockInput &input = t.inputs[j];
+				input.inputValue = 0;
+				if (input.transactionIndex == 0xFFFFFFFF)
+				{
+					continue; // coinbase
+				}
+				FileLocation key(Hash256(input.transactionHash), 0, 0, 0, 0);
+				FileLocationSet::iterator found = mTransactionSet.find(key);
+				if (found == mTransactionSet.end() || (*found).mFileIndex >= mBlockDataFiles.size())
+				{
+					mSpentOutputs.unresolvedCount++;
+					continue;
+				}
+				SpentOutputRequest r;
+				r.mFileIndex = (*found).mFileIndex;
+				r.mFileOffset = (*found).mFileOffset;
+				r.mTransactionLength = (*found).mFileLength;
+				r.mOutputIndex = input.transactionIndex;
+				r.mInputIndex = inputIndex;
+				mSpentRequests.push_back(r);
+			}
+		}
+
+		// Read the previous transactions in file order; transactions close to each other share a single read
+		std::sort(mSpentRequests.begin(), mSpentRequests.end());
+		mSpentScripts.clear();
+		mSpentValues.clear();
+		mSpentScriptOffsets.clear();
+		mSpentScriptLengths.clear();
+		size_t first = 0;
+		while (first < mSpentRequests.size())
+		{
+			const SpentOutputRequest &begin = mSpentRequests[first];
+			uint64_t spanEnd = uint64_t(begin.mFileOffset) + begin.mTransactionLength;
+			size_t last = first + 1;
+			while (last < mSpentRequests.size())
+			{
+				const SpentOutputRequest &r = mSpentRequests[last];
+				uint64_t end = uint64_t(r.mFileOffset) + r.mTransactionLength;
+				if (r.mFileIndex != begin.mFileIndex || r.mFileOffset > spanEnd + PREVOUT_READ_GAP ||
+					(end - begin.mFileOffset) > PREVOUT_READ_SPAN)
+				{
+					break;
+				}
+				if (end > spanEnd)
+				{
+					spanEnd = end;
+				}
+				last++;
+			}
+			// A memory mapped span is decoded in place
+			uint32_t spanLength = uint32_t(spanEnd - begin.mFileOffset);
+			const uint8_t *span = spanLength < MAX_BLOCK_SIZE ? mapFileData(begin.mFileIndex, begin.mFileOffset, spanLength) : nullptr;
+			if (span == nullptr && spanLength < MAX_BLOCK_SIZE)
+			{
+				mSpentReadBuffer.resize(spanLength);
+				if (readFileData(begin.mFileIndex, begin.mFileOffset, spanLength, &mSpentReadBuffer[0]))
+				{
+					span = &mSpentReadBuffer[0];
+				}
+			}
+			bool ok = span != nullptr;
+			// Decode each distinct previous transaction of the span once, for all of the outputs spent from it
+			size_t transactionFirst = first;
+			while (transactionFirst < last)
+			{
+				size_t transactionLast = transactionFirst + 1;
+				while (transactionLast < last && mSpentRequests[transactionLast].mFileOffset == mSpentRequests[transactionFirst].mFileOffset)
+				{
+					transactionLast++;
+				}
+				const SpentOutputRequest &r = mSpentRequests[transactionFirst];
+				if (ok)
+				{
+					readSpentOutputs(span + (r.mFileOffset - begin.mFileOffset), r.mTransactionLength, transactionFirst, transactionLast);
+				}
+				else
+				{
+					mSpentOutputs.unresolvedCount += uint32_t(transactionLast - transactionFirst);
+				}
+				transactionFirst = transactionLast;
+			}
+			first = last;
+		}
+
+		// Classify the spent outputs as a batch and hand back the values
+		uint32_t spentCount = uint32_t(mSpentValues.size());
+		mSpentBlock.decodeSpentOutputs(mSpentScripts.empty() ? nullptr : &mSpentScripts[0],
+			spentCount ? &mSpentValues[0] : nullptr, spentCount ? &mSpentScriptOffsets[0] : nullptr, spentCount ? &mSpentScriptLengths[0] : nullptr,
+			spentCount, block->blockIndex);
+		mSpentOutputs.outputs = mSpentBlock.outputs;
+		mSpentOutputs.slots = mSpentSlots.empty() ? nullptr : &mSpentSlots[0];
+		inputIndex = 0;
+		for (uint32_t i = 0; i < block->transactionCount; i++)
+		{
+			const BlockTransaction &t = block->transactions[i];
+			for (uint32_t j = 0; j < t.inputCount; j++, inputIndex++)
+			{
+				uint32_t slot = mSpentSlots[inputIndex];
+				if (slot != NO_SPENT_OUTPUT)
+				{
+					t.inputs[j].inputValue = mSpentValues[slot];
+				}
+			}
+		}
+		return &mSpentOutputs;
+	}
+
+	// Walk a previous transaction only as far as its outputs and record the value and script of each output
+	// spent by the requests [first,last), which are sorted by output index.
+	void readSpentOutputs(const uint8_t *transactionData, uint32_t transactionLength, size_t first, size_t last)
+	{
+		BlockScanner scan(transactionData, transactionData + transactionLength);
+		scan.skip(4); // version
+		uint64_t inputCount = scan.readCompactSize();
+		if (inputCount == 0)
+		{
+			scan.skip(1); // the segregated witness marker is followed by a flag byte and then the real input count
+			inputCount = scan.readCompactSize();
+		}
+		for (uint64_t i = 0; i < inputCount && !scan.hasOverflow(); i++)
+		{
+			scan.skip(32 + 4);
+			scan.skip(scan.readCompactSize());
+			scan.skip(4);
+		}
+		uint64_t outputCount = scan.readCompactSize();
+		size_t request = first;
+		for (uint64_t i = 0; i < outputCount && request < last && !scan.hasOverflow(); i++)
+		{
+			uint64_t value = scan.readU64();
+			uint64_t scriptLength = scan.readCompactSize();
+			const uint8_t *script = scan.readBytes(scriptLength);
+			while (request < last && mSpentRequests[request].mOutputIndex == i && script)
+			{
+				mSpentSlots[mSpentRequests[request].mInputIndex] = uint32_t(mSpentValues.size());
+				mSpentValues.push_back(value);
+				mSpentScriptOffsets.push_back(uint32_t(mSpentScripts.size()));
+				mSpentScriptLengths.push_back(uint32_t(scriptLength));
+				request++;
+			}
+			if (script && request > first && mSpentRequests[request - 1].mOutputIndex == i)
+			{
+				mSpentScripts.insert(mSpentScripts.end(), script, script + scriptLength);
+			}
+		}
+		// Requests for outputs the transaction does not have, or which could not be read, are unresolved
+		mSpentOutputs.unresolvedCount += uint32_t(last - request);
+	}
+
 	// print the contents of this block
 	virtual void printBlock(const Block *block) // prints the contents of the block to the console for debugging purposes
 	{
@@ -1540,6 +2194,10 @@ public:
 		logMessage("BlockReward: %f\r\n", (float)block->blockReward / ONE_BTC );
 
 		logMessage("%s transactions\r\n", formatNumber(block->transactionCount) );
+		// The previous outputs of every input are looked up together, rather than one read per input
+		const SpentOutputs *spent = resolveInputs(block);
+		const BlockOutputs &spentOutputs = spent->outputs;
+		uint32_t blockInputIndex = 0;
 		for (uint32_t i=0; i<block->transactionCount; i++)
 		{
 			const BlockTransaction &t = block->transactions[i];
@@ -1547,7 +2205,9 @@ public:
 			logMessage("TransactionHash: ");
 			printReverseHash(t.transactionHash);
 			logMessage("\r\n");
-			for (uint32_t i=0; i<t.inputCount; i++)
+			uint64_t inputValue = 0;
+			bool allResolved = true;
+			for (uint32_t i=0; i<t.inputCount; i++, blockInputIndex++)
 			{
 				const BlockInput &input = t.inputs[i];
 				logMessage("    Input %s : ResponsScriptLength: %s TransactionIndex: %s : TransactionHash: ", formatNumber(i), formatNumber(input.responseScriptLength), formatNumber(input.transactionIndex) );
@@ -1558,41 +2218,57 @@ public:
 
 				if ( input.transactionIndex != 0xFFFFFFFF )
 				{
-					const BlockTransaction *t = readSingleTransaction(input.transactionHash);
-					if ( t == NULL )
+					uint32_t slot = spent->getSlot(blockInputIndex);
+					if ( slot == NO_SPENT_OUTPUT )
 					{
-						logMessage("ERROR: TransactionIndex[%d] FAILED TO LOCATE TRANSACTION FOR HASH: ", input.transactionIndex );
+						logMessage("ERROR: TransactionIndex[%d] FAILED TO LOCATE THE OUTPUT FOR HASH: ", input.transactionIndex );
 						printReverseHash(input.transactionHash);
 						logMessage("\r\n");
+						allResolved = false;
 					}
 					else
 					{
-						if ( input.transactionIndex < t->outputCount )
+						inputValue += input.inputValue;
+						if ( spentOutputs.getKeyType(slot) != KT_UNKNOWN )
 						{
-							const BlockOutput &o = t->outputs[input.transactionIndex];
-							if ( o.publicKey[0] )
-							{
-								logMessage("     Spending From Public Key: %s in the amount of: %0.4f\r\n", o.asciiAddress, (float)o.value / ONE_BTC );
-							}
-							else
-							{
-								logMessage("ERROR: No public key found for this previous output.\r\n");
-							}
+							char address[512];
+							logMessage("     Spending From Public Key: %s in the amount of: %0.4f\r\n", getOutputAddress(spentOutputs, slot, address, sizeof(address)), (float)input.inputValue / ONE_BTC );
 						}
 						else
 						{
-							logMessage("ERROR: Invalid transaction index!\r\n");
+							logMessage("ERROR: No public key found for this previous output.\r\n");
 						}
 					}
 				}
+				else
+				{
+					allResolved = false; // a coinbase transaction has no fee
+				}
+			}
+			if ( allResolved && t.inputCount )
+			{
+				uint64_t outputValue = 0;
+				for (uint32_t i=0; i<t.outputCount; i++)
+				{
+					outputValue += t.outputs.values[i];
+				}
+				if ( inputValue >= outputValue )
+				{
+					logMessage("    Fee: %0.8f BTC\r\n", (double)(inputValue - outputValue) / ONE_BTC );
+				}
+				else
+				{
+					logMessage("ERROR: The outputs spend more than the inputs provide.\r\n");
+				}
 			}
 			for (uint32_t i=0; i<t.outputCount; i++)
 			{
-				const BlockOutput &output = t.outputs[i];
-				logMessage("    Output: %s : %f BTC : ChallengeScriptLength: %s\r\n", formatNumber(i), (float)output.value / ONE_BTC, formatNumber(output.challengeScriptLength) );
-				if ( output.publicKey[0] )
+				const BlockOutputs &outputs = t.outputs;
+				logMessage("    Output: %s : %f BTC : ChallengeScriptLength: %s\r\n", formatNumber(i), (float)outputs.values[i] / ONE_BTC, formatNumber(outputs.scriptLengths[i]) );
+				if ( outputs.getKeyType(i) != KT_UNKNOWN )
 				{
-					logMessage("PublicKey: %s : %s\r\n", output.asciiAddress, output.keyTypeName );
+					char address[512];
+					logMessage("PublicKey: %s : %s\r\n", getOutputAddress(outputs, i, address, sizeof(address)), getKeyTypeName(outputs.getKeyType(i)) );
 				}
 				else
 				{
@@ -1661,10 +2337,8 @@ public:
 	uint32_t					mSearchForText;
 	uint32_t					mScanCount;							// How many blocks we have processed in the 'forward' scan step.
 	uint32_t					mReadCount;
-	uint8_t						*mCurrentBlockData;
-	uint8_t						mBlockDataBuffer[MAX_BLOCK_SIZE];	// Holds one block of data
 	uint32_t					mBlockIndex;						// Index of current file we are processing
-	uint32_t					mFileLength;						// Length of the current file we have open...
+	uint64_t					mFileLength;						// Length of the current file we have open...
 	FILEVector					mBlockDataFiles;						// The array of files
 	BlockHeader					mLastBlockHeader;					// last block header we processed.
 	BlockHeaderSet				mBlockHeaderSet;
@@ -1672,10 +2346,22 @@ public:
 	BlockHeader					*mBlockChainHeaders;				// Headers for every single block in the blockchain
 	BlockImpl					mSingleReadBlock;
 	BlockImpl					mSingleTransactionBlock;
+	BlockImpl					mSpentBlock;						// Holds the classified outputs spent by the inputs of the last block passed to 'resolveInputs'
+	SpentOutputs				mSpentOutputs;
+	std::vector< SpentOutputRequest >	mSpentRequests;				// The previous output of each input being resolved, sorted by file location
+	std::vector< uint32_t >		mSpentSlots;						// For each input of the block, its entry in the spent output columns
+	std::vector< uint8_t >		mSpentReadBuffer;					// One read from a block file, covering one or more previous transactions
+	std::vector< uint8_t >		mSpentScripts;						// The scripts of the spent outputs, back to back
+	std::vector< uint64_t >		mSpentValues;
+	std::vector< uint32_t >		mSpentScriptOffsets;
+	std::vector< uint32_t >		mSpentScriptLengths;
 	uint32_t					mTransactionCount;
 	FILE						*mTextReport;
-	uint8_t						mTransactionBlockBuffer[MAX_BLOCK_SIZE];
+	std::vector< textminer::TextRun >	mTextRuns;		// Runs of text found in the block just read
 	FileLocationSet				mTransactionSet;
+	std::vector< uint8_t >		mMagicSearch;						// Scratch buffer used to search for the next block when a block file loses sync
+	threadpool::ThreadPool		*mThreadPool;						// Thread pool used to decode large blocks in parallel; null when decoding serially
+	merkleverifier::MerkleVerifier	*mMerkleVerifier{nullptr};		// Checks the merkle root of every block parsed; null when disabled
 };
 
 } // end of BLOCK_CHAIN namespace
@@ -1685,3 +2371,195 @@ BlockChain *BlockChain::createBlockChain(const char *rootPath,uint32_t maxBlocks
 	BLOCK_CHAIN::BlockChainImpl *b = new BLOCK_CHAIN::BlockChainImpl(rootPath, maxBlocks);
 	return static_cast< BlockChain *>(b);
 }
+
+const char *BlockChain::getOutputAddress(const BlockOutputs &outputs, uint32_t index, char *dest, uint32_t destLength)
+{
+	if (destLength == 0)
+	{
+		return dest;
+	}
+	dest[0] = 0;
+	KeyType keyType = outputs.getKeyType(index);
+	const uint8_t *script = outputs.getScript(index);
+	uint32_t len = 0;
+	switch (keyType)
+	{
+	case KT_MULTISIG:
+		len = snprintf(dest, destLength, "MultiSig[%d]", outputs.keyCounts[index]);
+		break;
+	case KT_STEALTH:
+		len = snprintf(dest, destLength, "*STEALTH*");
+		break;
+	case KT_SCRIPT_HASH:
+		len = snprintf(dest, destLength, "*SCRIPT_HASH*");
+		break;
+	case KT_NULL_DATA:
+		len = snprintf(dest, destLength, "*NULL_DATA*");
+		break;
+	case KT_ANCHOR:
+		len = snprintf(dest, destLength, "*ANCHOR*");
+		break;
+	case KT_WITNESS_PUBKEY_HASH:
+		len = snprintf(dest, destLength, "*WITNESS_PUBKEY_HASH*");
+		break;
+	case KT_WITNESS_SCRIPT_HASH:
+		len = snprintf(dest, destLength, "*WITNESS_SCRIPT_HASH*");
+		break;
+	case KT_TAPROOT:
+		len = snprintf(dest, destLength, "*TAPROOT*");
+		break;
+	case KT_WITNESS_UNKNOWN:
+		len = snprintf(dest, destLength, "*WITNESS_V%d*", script[0] - 0x50);
+		break;
+	default:
+		break;
+	}
+	if (len >= destLength)
+	{
+		return dest;
+	}
+	char temp[256];
+	if (keyType == KT_NULL_DATA || keyType == KT_ANCHOR)
+	{
+		// No destination
+	}
+	else if (keyType == KT_WITNESS_PUBKEY_HASH || keyType == KT_WITNESS_SCRIPT_HASH || keyType == KT_TAPROOT || keyType == KT_WITNESS_UNKNOWN)
+	{
+		// The witness program follows the version and push opcodes in the script.  A program which has no Bech32
+		// address, such as one longer than 40 bytes, is shown in hex.
+		uint32_t witnessVersion = script[0] == BLOCK_CHAIN::OP_0 ? 0 : uint32_t(script[0] - 0x50);
+		uint32_t programLength = outputs.scriptLengths[index] - 2;
+		if (bitcoinWitnessProgramToAscii(witnessVersion, script + 2, programLength, temp, 256))
+		{
+			snprintf(dest + len, destLength - len, "%s", temp);
+		}
+		else
+		{
+			uint32_t fit = (destLength - len - 1) / 2;
+			encodeHex(script + 2, programLength < fit ? programLength : fit, dest + len);
+		}
+	}
+	else if (keyType == KT_MULTISIG)
+	{
+		// The individual key addresses are not stored; locate the keys in the script again
+		const uint8_t *publicKey[MAX_MULTISIG] = { NULL, NULL, NULL, NULL, NULL };
+		uint32_t multiSigFormat = 0;
+		uint8_t addresses[MAX_MULTISIG][25];
+		uint32_t keyLengths[MAX_MULTISIG];
+		uint32_t keyCount = 0;
+		BLOCK_CHAIN::scanMultiSigKeys(script, outputs.scriptLengths[index], publicKey, multiSigFormat);
+		while (keyCount < MAX_MULTISIG && publicKey[keyCount])
+		{
+			keyLengths[keyCount] = (multiSigFormat & (1 << keyCount)) ? 33 : 65;
+			keyCount++;
+		}
+		bitcoinPublicKeysToAddresses(keyCount, publicKey, keyLengths, addresses);
+		for (uint32_t i = 0; i < MAX_MULTISIG && publicKey[i] && len < destLength; i++)
+		{
+			bitcoinAddressToAscii(addresses[i], temp, 256);
+			len += snprintf(dest + len, destLength - len, "%s%s", i ? ":" : "", temp);
+		}
+	}
+	else if (keyType != KT_UNKNOWN)
+	{
+		uint8_t address[25];
+		const uint8_t *hash = outputs.hashes[index].hash;
+		if (keyType == KT_SCRIPT_HASH)
+		{
+			bitcoinRIPEMD160ToScriptAddress(hash, address);
+		}
+		else if (outputs.keyCounts[index] == 0)
+		{
+			memset(address, 0, sizeof(address)); // the public key in the script was malformed
+		}
+		else
+		{
+			bitcoinRIPEMD160ToAddress(hash, address);
+		}
+		bitcoinAddressToAscii(address, temp, 256);
+		snprintf(dest + len, destLength - len, "%s", temp);
+	}
+	return dest;
+}
+
+const char *BlockChain::getMerkleStatusName(MerkleStatus s)
+{
+	const char *ret = "UNKNOWN";
+	switch (s)
+	{
+	case MS_UNCHECKED:
+		ret = "UNCHECKED";
+		break;
+	case MS_VALID:
+		ret = "VALID";
+		break;
+	case MS_ROOT_MISMATCH:
+		ret = "MERKLE_ROOT_MISMATCH";
+		break;
+	case MS_MUTATED:
+		ret = "MUTATED_MERKLE_TREE";
+		break;
+	case MS_COMMITMENT_MISMATCH:
+		ret = "WITNESS_COMMITMENT_MISMATCH";
+		break;
+	case MS_COMMITMENT_MISSING:
+		ret = "WITNESS_COMMITMENT_MISSING";
+		break;
+	default:
+		break;
+	}
+	return ret;
+}
+
+const char *BlockChain::getKeyTypeName(KeyType k)
+{
+	const char *ret = "UNKNOWN";
+	switch (k)
+	{
+	case KT_RIPEMD160:
+		ret = "RIPEMD160";
+		break;
+	case KT_UNCOMPRESSED_PUBLIC_KEY:
+		ret = "UNCOMPRESSED_PUBLIC_KEY";
+		break;
+	case KT_COMPRESSED_PUBLIC_KEY:
+		ret = "COMPRESSED_PUBLIC_KEY";
+		break;
+	case KT_TRUNCATED_COMPRESSED_KEY:
+		ret = "TRUNCATED_COMPRESSED_KEY";
+		break;
+	case KT_MULTISIG:
+		ret = "MULTISIG";
+		break;
+	case KT_STEALTH:
+		ret = "STEALTH";
+		break;
+	case KT_ZERO_LENGTH:
+		ret = "ZERO_LENGTH";
+		break;
+	case KT_SCRIPT_HASH:
+		ret = "SCRIPT_HASH";
+		break;
+	case KT_NULL_DATA:
+		ret = "NULL_DATA";
+		break;
+	case KT_WITNESS_PUBKEY_HASH:
+		ret = "WITNESS_PUBKEY_HASH";
+		break;
+	case KT_WITNESS_SCRIPT_HASH:
+		ret = "WITNESS_SCRIPT_HASH";
+		break;
+	case KT_TAPROOT:
+		ret = "TAPROOT";
+		break;
+	case KT_ANCHOR:
+		ret = "ANCHOR";
+		break;
+	case KT_WITNESS_UNKNOWN:
+		ret = "WITNESS_UNKNOWN";
+		break;
+	default:
+		break;
+	}
+	return ret;
+}
@@ -0,0 +1,202 @@
+#include "BlockFile.h"
+#include "CBlockIndex.h"
+#include "blocks.h"
+#include "FileInterface.h"
+
+#include <stdio.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_FILE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BLOCK_FILE_NEON 1
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define BLOCK_MAGIC_ID 0xD9B4BEF9
+#define MAX_BLOCK_LENGTH (1024*1024*32)
+
+namespace blockfile
+{
+
+// The block index records the offset of the block header; it is preceded in the file by the magic id
+// and the length of the block.
+bool readBlockData(const CBlockIndex &index,const char *dataDir,std::vector< uint8_t > &data)
+{
+	bool ret = false;
+
+	if ( !(index.mBlockStatus & CBlockIndex::BLOCK_HAVE_DATA) || index.mFileOffset < 8 )
+	{
+		printf("No block data available for block %d\n", uint32_t(index.mBlockHeight));
+		return false;
+	}
+	char scratch[512];
+	getBlockFileName(dataDir,uint32_t(index.mFileIndex),scratch,sizeof(scratch));
+	FILE_INTERFACE *fph = fi_fopen(scratch,"rb",nullptr,0,false);
+	if ( fph )
+	{
+		uint32_t prefix[2] = { 0, 0 }; // magic id and block length
+		fi_fseek(fph,index.mFileOffset-8,SEEK_SET);
+		if ( fi_fread(prefix,sizeof(prefix),1,fph) == 1 && prefix[0] == BLOCK_MAGIC_ID && prefix[1] >= 80 && prefix[1] < MAX_BLOCK_LENGTH )
+		{
+			data.resize(prefix[1]);
+			ret = fi_fread(&data[0],prefix[1],1,fph) == 1;
+		}
+		if ( !ret )
+		{
+			printf("Failed to read block data from '%s' at offset %llu\n", scratch, (unsigned long long)index.mFileOffset);
+		}
+		fi_fclose(fph);
+	}
+	else
+	{
+		printf("Failed to open '%s'\n", scratch);
+	}
+
+	return ret;
+}
+
+const char *getBlockFileName(const char *dataDir,uint32_t fileIndex,char *dest,uint32_t destLength)
+{
+#ifdef _MSC_VER
+	snprintf(dest,destLength,"%s\\blk%05d.dat", dataDir, fileIndex);
+#else
+	snprintf(dest,destLength,"%s/blk%05d.dat", dataDir, fileIndex);
+#endif
+	return dest;
+}
+
+static inline uint32_t countTrailingZeros(uint32_t v)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index,v);
+	return uint32_t(index);
+#else
+	return uint32_t(__builtin_ctz(v));
+#endif
+}
+
+size_t findBlockMagic(const uint8_t *data,size_t length)
+{
+	size_t i = 0;
+	if ( length >= 19 )
+	{
+		size_t last = length - 19; // the last position where four overlapping 16 byte loads still fit
+#if BLOCK_FILE_SSE2
+		const __m128i m0 = _mm_set1_epi8(char(0xF9));
+		const __m128i m1 = _mm_set1_epi8(char(0xBE));
+		const __m128i m2 = _mm_set1_epi8(char(0xB4));
+		const __m128i m3 = _mm_set1_epi8(char(0xD9));
+		for (; i <= last; i+=16)
+		{
+			// Byte j of 'match' is set when the four bytes starting at position i+j are the magic id
+			__m128i match = _mm_and_si128(
+				_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i)),m0),
+							  _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i+1)),m1)),
+				_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i+2)),m2),
+							  _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data+i+3)),m3)));
+			uint32_t mask = uint32_t(_mm_movemask_epi8(match));
+			if ( mask )
+			{
+				return i + countTrailingZeros(mask);
+			}
+		}
+#elif BLOCK_FILE_NEON
+		for (; i <= last; i+=16)
+		{
+			uint8x16_t match = vandq_u8(
+				vandq_u8(vceqq_u8(vld1q_u8(data+i),vdupq_n_u8(0xF9)),vceqq_u8(vld1q_u8(data+i+1),vdupq_n_u8(0xBE))),
+				vandq_u8(vceqq_u8(vld1q_u8(data+i+2),vdupq_n_u8(0xB4)),vceqq_u8(vld1q_u8(data+i+3),vdupq_n_u8(0xD9))));
+			if ( vmaxvq_u8(match) )
+			{
+				break; // the scalar loop below locates the exact position
+			}
+		}
+#endif
+	}
+	for (; i+4 <= length; i++)
+	{
+		if ( data[i] == 0xF9 && data[i+1] == 0xBE && data[i+2] == 0xB4 && data[i+3] == 0xD9 )
+		{
+			return i;
+		}
+	}
+	return length;
+}
+
+bool MappedFile::open(const char *fileName)
+{
+	close();
+	mFile = fi_fopen(fileName,"rb",nullptr,0,true);
+	if ( mFile == nullptr )
+	{
+		return false;
+	}
+	if ( !fi_usesMemoryMappedFile(mFile) )
+	{
+		close();
+		return false;
+	}
+	mData = static_cast< const uint8_t *>(fi_getMemBuffer(mFile,&mLength));
+	fi_fadvise(mFile,0,mLength,FA_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::close(void)
+{
+	if ( mFile )
+	{
+		fi_fclose(mFile);
+	}
+	mFile = nullptr;
+	mData = nullptr;
+	mLength = 0;
+}
+
+BlockReader::~BlockReader(void)
+{
+	if ( mParser )
+	{
+		mParser->release();
+	}
+}
+
+const BlockChain::Block *BlockReader::read(const blocks::Blocks *blocks,const char *dataDir,uint32_t blockHeight)
+{
+	const CBlockIndex *index = blocks->getBlockIndex(blockHeight);
+	if ( index == nullptr || !readBlockData(*index,dataDir,mData) || mData.empty() )
+	{
+		mData.clear();
+		return nullptr;
+	}
+	return parse(dataDir,&mData[0],uint32_t(mData.size()),blockHeight,*index);
+}
+
+const BlockChain::Block *BlockReader::parse(const char *dataDir,const uint8_t *data,uint32_t length,uint32_t blockHeight,const CBlockIndex &index)
+{
+	if ( mParser == nullptr )
+	{
+		mParser = BlockChain::createBlockChain(dataDir,0);
+		mParser->setVerifyMerkle(mVerifyMerkle);
+	}
+	return mParser->processBlock(data,length,blockHeight,uint32_t(index.mFileIndex),index.mFileOffset);
+}
+
+void BlockReader::setVerifyMerkle(bool state)
+{
+	mVerifyMerkle = state;
+	if ( mParser )
+	{
+		mParser->setVerifyMerkle(state);
+	}
+}
+
+}
@@ -0,0 +1,521 @@
+#include "BlockFileIndex.h"
+#include "BlockFile.h"
+#include "ByteReader.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "SHA256.h"
+#include "CBlockIndex.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define BLOCK_MAGIC_ID 0xD9B4BEF9
+#define MAX_BLOCK_LENGTH (1024*1024*32)
+#define BLOCK_HEADER_SIZE 80
+#define HEADER_HASH_BATCH 64			// block headers located before they are hashed together
+#define INDEX_FILE_NAME "BlockFileIndex.bin"
+#define INDEX_FILE_ID "BLKINDEX"
+#define INDEX_FILE_VERSION 2
+
+namespace blockfileindex
+{
+
+// A block found in one of the block files
+class ScannedBlock
+{
+public:
+	uint8_t		mHash[32];
+	uint8_t		mHeader[BLOCK_HEADER_SIZE];
+	uint32_t	mFileIndex{0};
+	uint64_t	mFileOffset{0};			// Offset of the block header; the same convention as the LevelDB index
+	uint32_t	mBlockLength{0};
+	uint32_t	mTransactionCount{0};
+};
+
+// The size and modification time of a block file.  Bitcoin core preallocates the block files in 16MB steps and
+// writes new blocks into the space already allocated, so the size alone does not show that a file has changed.
+class BlockFileInfo
+{
+public:
+	bool operator==(const BlockFileInfo &other) const
+	{
+		return mSize == other.mSize && mModified == other.mModified;
+	}
+
+	uint64_t	mSize{0};
+	uint64_t	mModified{0};			// Seconds since the epoch
+};
+
+// The saved index begins with this header, followed by the BlockFileInfo of each block file and then one record
+// for each block height.  The hash of each block is not stored; it is the previous block hash of the block
+// after it, and the hash of the last block is computed when the index is loaded.
+class IndexFileHeader
+{
+public:
+	char		mId[8];
+	uint32_t	mVersion{INDEX_FILE_VERSION};
+	uint32_t	mFileCount{0};
+	uint32_t	mBlockCount{0};
+	uint32_t	mReserved{0};
+};
+
+class IndexRecord
+{
+public:
+	uint64_t	mFileOffset{0};
+	uint32_t	mFileIndex{0};
+	uint32_t	mBlockLength{0};
+	uint32_t	mTransactionCount{0};
+	uint32_t	mReserved{0};
+	uint8_t		mHeader[BLOCK_HEADER_SIZE];
+};
+
+// An open addressing hash table from block hash to the position of the block in the scanned block list.
+// Block hashes are already uniformly distributed, so the first eight bytes serve as the hash code.
+class BlockHashTable
+{
+public:
+	BlockHashTable(const std::vector< ScannedBlock > &blocks) : mBlocks(blocks)
+	{
+		uint64_t capacity = 16;
+		while ( capacity < uint64_t(blocks.size())*2 )
+		{
+			capacity*=2;
+		}
+		mMask = capacity-1;
+		mSlots.resize(size_t(capacity),0);
+		for (uint32_t i=0; i<uint32_t(blocks.size()); i++)
+		{
+			uint64_t slot = getSlot(blocks[i].mHash);
+			while ( mSlots[size_t(slot)] )
+			{
+				slot = (slot+1) & mMask;
+			}
+			mSlots[size_t(slot)] = i+1;
+		}
+	}
+
+	// Returns the position of the first block with this hash, or -1 if it was not found
+	int64_t find(const uint8_t *hash) const
+	{
+		uint64_t slot = getSlot(hash);
+		while ( mSlots[size_t(slot)] )
+		{
+			uint32_t index = mSlots[size_t(slot)]-1;
+			if ( memcmp(mBlocks[index].mHash,hash,32) == 0 )
+			{
+				return int64_t(index);
+			}
+			slot = (slot+1) & mMask;
+		}
+		return -1;
+	}
+
+private:
+	uint64_t getSlot(const uint8_t *hash) const
+	{
+		uint64_t h;
+		memcpy(&h,hash,sizeof(h));
+		return h & mMask;
+	}
+
+	const std::vector< ScannedBlock >	&mBlocks;
+	uint64_t							mMask{0};
+	std::vector< uint32_t >				mSlots;		// Position in the block list plus one; zero for an empty slot
+};
+
+static bool isZeroHash(const uint8_t *hash)
+{
+	for (uint32_t i=0; i<32; i++)
+	{
+		if ( hash[i] )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Double SHA256 of each header in a batch
+static void hashHeaders(ScannedBlock *blocks,uint32_t count)
+{
+	const uint8_t *headers[HEADER_HASH_BATCH] = {};
+	uint32_t sizes[HEADER_HASH_BATCH] = {};
+	uint8_t hashes[HEADER_HASH_BATCH][32];
+	for (uint32_t i=0; i<count; i++)
+	{
+		headers[i] = blocks[i].mHeader;
+		sizes[i] = BLOCK_HEADER_SIZE;
+	}
+	computeDoubleSHA256Batch(count,headers,sizes,hashes);
+	for (uint32_t i=0; i<count; i++)
+	{
+		memcpy(blocks[i].mHash,hashes[i],32);
+	}
+}
+
+// Walk one memory mapped block file and append every block found to 'blocks'.  When the file loses sync
+// the next magic id is searched for.
+static void scanFile(uint32_t fileIndex,const uint8_t *data,uint64_t length,std::vector< ScannedBlock > &blocks)
+{
+	uint64_t position = 0;
+	size_t batchStart = blocks.size();
+	while ( length - position >= 8 + BLOCK_HEADER_SIZE )
+	{
+		uint32_t prefix[2];
+		memcpy(prefix,data+position,sizeof(prefix));
+		uint64_t blockBegin = position + sizeof(prefix);
+		if ( prefix[0] != BLOCK_MAGIC_ID || prefix[1] < BLOCK_HEADER_SIZE || prefix[1] >= MAX_BLOCK_LENGTH || blockBegin + prefix[1] > length )
+		{
+			position += 1 + blockfile::findBlockMagic(data+position+1,size_t(length-position-1));
+			continue;
+		}
+		ScannedBlock b;
+		b.mFileIndex = fileIndex;
+		b.mFileOffset = blockBegin;
+		b.mBlockLength = prefix[1];
+		memcpy(b.mHeader,data+blockBegin,BLOCK_HEADER_SIZE);
+		bytereader::ByteReader< bytereader::Checked > reader(data+blockBegin+BLOCK_HEADER_SIZE,data+blockBegin+prefix[1]);
+		b.mTransactionCount = uint32_t(reader.readCompactSize());
+		blocks.push_back(b);
+		if ( blocks.size() - batchStart == HEADER_HASH_BATCH )
+		{
+			hashHeaders(&blocks[batchStart],HEADER_HASH_BATCH);
+			batchStart = blocks.size();
+		}
+		position = blockBegin + prefix[1];
+	}
+	if ( blocks.size() > batchStart )
+	{
+		hashHeaders(&blocks[batchStart],uint32_t(blocks.size()-batchStart));
+	}
+}
+
+// Returns false if the file does not exist
+static bool getFileInfo(const char *fileName,BlockFileInfo &info)
+{
+#ifdef _MSC_VER
+	struct _stat64 st;
+	if ( _stat64(fileName,&st) != 0 )
+#else
+	struct stat st;
+	if ( stat(fileName,&st) != 0 )
+#endif
+	{
+		return false;
+	}
+	info.mSize = uint64_t(st.st_size);
+	info.mModified = uint64_t(st.st_mtime);
+	return true;
+}
+
+class BlockFileIndexImpl : public BlockFileIndex
+{
+public:
+	BlockFileIndexImpl(const char *dataDir,uint32_t threadCount) : mDataDir(dataDir)
+	{
+		ScopedTime st("TimeSpent building the block file index");
+		std::vector< BlockFileInfo > files;
+		findBlockFiles(files);
+#ifdef _MSC_VER
+		std::string indexFileName = mDataDir + "\\" + INDEX_FILE_NAME;
+#else
+		std::string indexFileName = mDataDir + "/" + INDEX_FILE_NAME;
+#endif
+		if ( loadIndex(indexFileName.c_str(),files) )
+		{
+			printf("Loaded the index of %d blocks from '%s'\n", uint32_t(mBlocks.size()), indexFileName.c_str());
+		}
+		else
+		{
+			printf("Scanning %d block files.\n", uint32_t(files.size()));
+			scanBlockFiles(uint32_t(files.size()),threadCount);
+			printf("Found %d blocks on the chain and %d stale blocks.\n", uint32_t(mBlocks.size()), mStaleCount);
+			if ( !mBlocks.empty() && !saveIndex(indexFileName.c_str(),files) )
+			{
+				printf("Unable to save the block index to '%s'\n", indexFileName.c_str());
+			}
+		}
+		buildDays();
+	}
+
+	virtual ~BlockFileIndexImpl(void)
+	{
+	}
+
+	virtual uint32_t getDayCount(void) const final
+	{
+		return uint32_t(mDays.size());
+	}
+
+	virtual const char *getDay(uint32_t dayIndex) const final
+	{
+		return dayIndex < mDays.size() ? mDays[dayIndex].c_str() : nullptr;
+	}
+
+	virtual uint32_t getBlockHeight(void) const final
+	{
+		return mBlocks.empty() ? 0 : uint32_t(mBlocks.size()-1);
+	}
+
+	virtual const CBlockIndex *getBlockIndex(uint32_t blockHeight) const final
+	{
+		return blockHeight < mBlocks.size() ? &mBlocks[blockHeight] : nullptr;
+	}
+
+	virtual uint32_t getStaleCount(void) const final
+	{
+		return mStaleCount;
+	}
+
+	virtual uint32_t getBlockLength(uint32_t blockHeight) const final
+	{
+		return blockHeight < mBlockLengths.size() ? mBlockLengths[blockHeight] : 0;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	void findBlockFiles(std::vector< BlockFileInfo > &files) const
+	{
+		for (uint32_t i=0; ; i++)
+		{
+			char fileName[512];
+			BlockFileInfo info;
+			if ( !getFileInfo(blockfile::getBlockFileName(mDataDir.c_str(),i,fileName,sizeof(fileName)),info) )
+			{
+				break;
+			}
+			files.push_back(info);
+		}
+	}
+
+	void scanBlockFiles(uint32_t fileCount,uint32_t threadCount)
+	{
+		std::vector< std::vector< ScannedBlock > > fileBlocks(fileCount);
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		pool->parallelFor(fileCount,1,[this,&fileBlocks](uint32_t begin,uint32_t end,uint32_t /* workerIndex */)
+		{
+			for (uint32_t i=begin; i<end; i++)
+			{
+				char fileName[512];
+				blockfile::MappedFile file;
+				if ( file.open(blockfile::getBlockFileName(mDataDir.c_str(),i,fileName,sizeof(fileName))) )
+				{
+					scanFile(i,file.getData(),file.getLength(),fileBlocks[i]);
+				}
+			}
+		});
+		pool->release();
+
+		std::vector< ScannedBlock > blocks;
+		for (auto &i:fileBlocks)
+		{
+			blocks.insert(blocks.end(),i.begin(),i.end());
+			std::vector< ScannedBlock >().swap(i);
+		}
+		linkChain(blocks);
+	}
+
+	// Find the height of every block by following its previous block hashes back to the genesis block,
+	// then keep the chain which ends at the highest block.  Among blocks of equal height the one found
+	// first in the files is kept, as bitcoin core keeps the first block it saw.
+	void linkChain(const std::vector< ScannedBlock > &blocks)
+	{
+		BlockHashTable table(blocks);
+		std::vector< int64_t > heights(blocks.size(),-2);	// -2 not yet known, -1 not connected to the genesis block
+		std::vector< uint32_t > chain;
+		int64_t tip = -1;
+		for (uint32_t i=0; i<uint32_t(blocks.size()); i++)
+		{
+			chain.clear();
+			int64_t height = -1;
+			int64_t current = i;
+			for (;;)
+			{
+				if ( heights[size_t(current)] != -2 )
+				{
+					height = heights[size_t(current)] < 0 ? -1 : heights[size_t(current)]+1;
+					break;
+				}
+				chain.push_back(uint32_t(current));
+				const uint8_t *previous = blocks[size_t(current)].mHeader+4;
+				if ( isZeroHash(previous) )
+				{
+					height = 0;
+					break;
+				}
+				current = table.find(previous);
+				if ( current < 0 || chain.size() > blocks.size() )
+				{
+					break;
+				}
+			}
+			// 'height' belongs to the last block in the chain; each earlier one is a block further on
+			for (size_t j=chain.size(); j-- > 0;)
+			{
+				heights[chain[j]] = height;
+				if ( height >= 0 )
+				{
+					height++;
+				}
+			}
+			if ( heights[i] >= 0 && (tip < 0 || heights[i] > heights[size_t(tip)]) )
+			{
+				tip = i;
+			}
+		}
+
+		mBlocks.clear();
+		mStaleCount = 0;
+		if ( tip < 0 )
+		{
+			return;
+		}
+		mBlocks.resize(size_t(heights[size_t(tip)]+1));
+		mBlockLengths.resize(mBlocks.size());
+		for (int64_t current = tip; current >= 0; )
+		{
+			const ScannedBlock &b = blocks[size_t(current)];
+			uint32_t height = uint32_t(heights[size_t(current)]);
+			setBlockIndex(mBlocks[height],height,b.mFileIndex,b.mFileOffset,b.mTransactionCount,b.mHeader,b.mHash);
+			mBlockLengths[height] = b.mBlockLength;
+			current = height ? table.find(b.mHeader+4) : -1;
+		}
+		mStaleCount = uint32_t(blocks.size() - mBlocks.size());
+	}
+
+	static void setBlockIndex(CBlockIndex &index,uint32_t height,uint32_t fileIndex,uint64_t fileOffset,uint32_t transactionCount,const uint8_t *header,const uint8_t *hash)
+	{
+		index.mBlockHeight = height;
+		index.mBlockStatus = CBlockIndex::BLOCK_HAVE_DATA;
+		index.mTransactionCount = transactionCount;
+		index.mFileIndex = fileIndex;
+		index.mFileOffset = fileOffset;
+		index.readBlockHeader(header,hash);
+	}
+
+	// The saved index is only used if every block file has the size and modification time it had when the index
+	// was saved
+	bool loadIndex(const char *fileName,const std::vector< BlockFileInfo > &files)
+	{
+		bool ret = false;
+		FILE *fph = fopen(fileName,"rb");
+		if ( fph == nullptr )
+		{
+			return false;
+		}
+		IndexFileHeader header;
+		if ( fread(&header,sizeof(header),1,fph) == 1 && memcmp(header.mId,INDEX_FILE_ID,sizeof(header.mId)) == 0 &&
+			 header.mVersion == INDEX_FILE_VERSION && header.mFileCount == files.size() && header.mBlockCount )
+		{
+			std::vector< BlockFileInfo > savedFiles(header.mFileCount);
+			std::vector< IndexRecord > records(header.mBlockCount);
+			if ( (savedFiles.empty() || fread(&savedFiles[0],sizeof(BlockFileInfo)*savedFiles.size(),1,fph) == 1) &&
+				 savedFiles == files &&
+				 fread(&records[0],sizeof(IndexRecord)*records.size(),1,fph) == 1 )
+			{
+				mBlocks.resize(records.size());
+				mBlockLengths.resize(records.size());
+				for (uint32_t i=0; i<uint32_t(records.size()); i++)
+				{
+					const IndexRecord &r = records[i];
+					uint8_t hash[32];
+					if ( i+1 < records.size() )
+					{
+						memcpy(hash,records[i+1].mHeader+4,32);
+					}
+					else
+					{
+						computeDoubleSHA256Header(r.mHeader,hash);
+					}
+					setBlockIndex(mBlocks[i],i,r.mFileIndex,r.mFileOffset,r.mTransactionCount,r.mHeader,hash);
+					mBlockLengths[i] = r.mBlockLength;
+				}
+				ret = true;
+			}
+		}
+		fclose(fph);
+		return ret;
+	}
+
+	bool saveIndex(const char *fileName,const std::vector< BlockFileInfo > &files) const
+	{
+		FILE *fph = fopen(fileName,"wb");
+		if ( fph == nullptr )
+		{
+			return false;
+		}
+		IndexFileHeader header;
+		memcpy(header.mId,INDEX_FILE_ID,sizeof(header.mId));
+		header.mFileCount = uint32_t(files.size());
+		header.mBlockCount = uint32_t(mBlocks.size());
+		std::vector< IndexRecord > records(mBlocks.size());
+		for (size_t i=0; i<mBlocks.size(); i++)
+		{
+			const CBlockIndex &index = mBlocks[i];
+			IndexRecord &r = records[i];
+			r.mFileIndex = uint32_t(index.mFileIndex);
+			r.mFileOffset = index.mFileOffset;
+			r.mBlockLength = mBlockLengths[i];
+			r.mTransactionCount = uint32_t(index.mTransactionCount);
+			serializeHeader(index,r.mHeader);
+		}
+		bool ret = fwrite(&header,sizeof(header),1,fph) == 1 &&
+			(files.empty() || fwrite(&files[0],sizeof(BlockFileInfo)*files.size(),1,fph) == 1) &&
+			fwrite(&records[0],sizeof(IndexRecord)*records.size(),1,fph) == 1;
+		fclose(fph);
+		return ret;
+	}
+
+	static void serializeHeader(const CBlockIndex &index,uint8_t *header)
+	{
+		memcpy(header,&index.mBlockVersion,4);
+		memcpy(header+4,index.mHashPrevious,32);
+		memcpy(header+36,index.mHashMerkleRoot,32);
+		memcpy(header+68,&index.mTime,4);
+		memcpy(header+72,&index.mBits,4);
+		memcpy(header+76,&index.mNonce,4);
+	}
+
+	// Days are numbered in date order, the same as the LevelDB backed index
+	void buildDays(void)
+	{
+		std::map< std::string, uint32_t > days;
+		for (auto &i:mBlocks)
+		{
+			days[i.getBlockTime()] = 0;
+		}
+		mDays.clear();
+		for (auto &i:days)
+		{
+			mDays.push_back(i.first);
+		}
+	}
+
+	std::string					mDataDir;
+	std::vector< CBlockIndex >	mBlocks;			// Indexed by block height
+	std::vector< uint32_t >		mBlockLengths;		// The length of each block, not counting the magic id and length
+	std::vector< std::string >	mDays;
+	uint32_t					mStaleCount{0};
+};
+
+BlockFileIndex *BlockFileIndex::create(const char *dataDir,uint32_t threadCount)
+{
+	auto ret = new BlockFileIndexImpl(dataDir,threadCount);
+	return static_cast< BlockFileIndex *>(ret);
+}
+
+}
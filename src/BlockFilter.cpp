@@ -0,0 +1,699 @@
+#include "BlockFilter.h"
+#include "BlockChain.h"
+#include "ByteReader.h"
+#include "ByteWriter.h"
+#include "FileInterface.h"
+#include "SHA256.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#pragma warning(disable:4996)
+#endif
+
+#define BLOCK_FILTER_ID "BLKFILTR"
+#define BLOCK_FILTER_VERSION 1
+#define MATCH_GRAIN_SIZE 256		// blocks handed to a thread at a time by a match
+#define OP_RETURN 0x6a
+
+namespace blockfilter
+{
+
+// BlockFilters.idx begins with this header, followed by one FilterRecord per height
+class FilterFileHeader
+{
+public:
+	char		mId[8];
+	uint32_t	mVersion{BLOCK_FILTER_VERSION};
+	uint32_t	mBlockCount{0};
+	uint32_t	mP{BASIC_FILTER_P};
+	uint32_t	mM{BASIC_FILTER_M};
+};
+
+class FilterRecord
+{
+public:
+	uint64_t	mOffset{0};				// Location of the filter in BlockFilters.dat
+	uint32_t	mLength{0};
+	uint32_t	mElementCount{0};
+	uint8_t		mBlockHash[32];			// The first 16 bytes are the filter's SipHash key
+	uint8_t		mFilterHeader[32];
+};
+
+static std::string getFilterFileName(const char *filterDir,const char *extension)
+{
+	std::string ret(filterDir);
+#ifdef _MSC_VER
+	ret += "\\BlockFilters.";
+#else
+	ret += "/BlockFilters.";
+#endif
+	ret += extension;
+	return ret;
+}
+
+static inline uint64_t rotateLeft(uint64_t v,uint32_t bits)
+{
+	return (v << bits) | (v >> (64-bits));
+}
+
+static inline void sipRound(uint64_t &v0,uint64_t &v1,uint64_t &v2,uint64_t &v3)
+{
+	v0 += v1; v1 = rotateLeft(v1,13); v1 ^= v0; v0 = rotateLeft(v0,32);
+	v2 += v3; v3 = rotateLeft(v3,16); v3 ^= v2;
+	v0 += v3; v3 = rotateLeft(v3,21); v3 ^= v0;
+	v2 += v1; v1 = rotateLeft(v1,17); v1 ^= v2; v2 = rotateLeft(v2,32);
+}
+
+// SipHash-2-4 of 'data' with the 128 bit key (k0,k1)
+static uint64_t sipHash(uint64_t k0,uint64_t k1,const uint8_t *data,uint32_t length)
+{
+	uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+	uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+	uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+	uint64_t v3 = 0x7465646279746573ULL ^ k1;
+	uint32_t words = length / 8;
+	for (uint32_t i=0; i<words; i++)
+	{
+		uint64_t m;
+		memcpy(&m,data+i*8,8);
+		v3 ^= m;
+		sipRound(v0,v1,v2,v3);
+		sipRound(v0,v1,v2,v3);
+		v0 ^= m;
+	}
+	uint64_t b = uint64_t(length) << 56;
+	for (uint32_t i=words*8; i<length; i++)
+	{
+		b |= uint64_t(data[i]) << ((i & 7)*8);
+	}
+	v3 ^= b;
+	sipRound(v0,v1,v2,v3);
+	sipRound(v0,v1,v2,v3);
+	v0 ^= b;
+	v2 ^= 0xFF;
+	sipRound(v0,v1,v2,v3);
+	sipRound(v0,v1,v2,v3);
+	sipRound(v0,v1,v2,v3);
+	sipRound(v0,v1,v2,v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Maps a 64 bit hash uniformly onto [0,range); the high 64 bits of the 128 bit product
+static inline uint64_t mapToRange(uint64_t hash,uint64_t range)
+{
+	uint64_t aLow = hash & 0xFFFFFFFF;
+	uint64_t aHigh = hash >> 32;
+	uint64_t bLow = range & 0xFFFFFFFF;
+	uint64_t bHigh = range >> 32;
+	uint64_t lowHigh = aLow * bHigh;
+	uint64_t highLow = aHigh * bLow;
+	uint64_t cross = ((aLow * bLow) >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+	return aHigh * bHigh + (highLow >> 32) + (cross >> 32);
+}
+
+// Hashes each script with the key of the block with this hash into the range of a filter of 'elementCount'
+// scripts, and sorts the result
+static void hashScripts(const uint8_t blockHash[32],uint64_t elementCount,uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths,std::vector< uint64_t > &values)
+{
+	uint64_t k0;
+	uint64_t k1;
+	memcpy(&k0,blockHash,8);
+	memcpy(&k1,blockHash+8,8);
+	uint64_t range = elementCount * BASIC_FILTER_M;
+	values.resize(count);
+	for (uint32_t i=0; i<count; i++)
+	{
+		values[i] = mapToRange(sipHash(k0,k1,scripts[i],scriptLengths[i]),range);
+	}
+	std::sort(values.begin(),values.end());
+}
+
+// 'v' must not be zero
+static inline uint32_t countLeadingZeros(uint64_t v)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index,v);
+	return 63 - uint32_t(index);
+#else
+	return uint32_t(__builtin_clzll(v));
+#endif
+}
+
+static inline uint64_t byteSwap(uint64_t v)
+{
+#ifdef _MSC_VER
+	return _byteswap_uint64(v);
+#else
+	return __builtin_bswap64(v);
+#endif
+}
+
+// Writes bits most significant first, as BIP158 specifies
+class BitWriter
+{
+public:
+	BitWriter(std::vector< uint8_t > &dest) : mDest(dest)
+	{
+	}
+
+	// Append the low 'bits' bits of 'value'; at most 32
+	inline void write(uint64_t value,uint32_t bits)
+	{
+		mBits = (mBits << bits) | (value & ((uint64_t(1) << bits) - 1));
+		mCount += bits;
+		while ( mCount >= 8 )
+		{
+			mCount -= 8;
+			mDest.push_back(uint8_t(mBits >> mCount));
+		}
+	}
+
+	// The quotient in unary (that many one bits and a zero) then the P bit remainder
+	void writeGolombRice(uint64_t value)
+	{
+		uint64_t quotient = value >> BASIC_FILTER_P;
+		while ( quotient >= 32 )
+		{
+			write(0xFFFFFFFF,32);
+			quotient -= 32;
+		}
+		write((uint64_t(1) << quotient) - 1,uint32_t(quotient));
+		write(0,1);
+		write(value,BASIC_FILTER_P);
+	}
+
+	void flush(void)
+	{
+		if ( mCount )
+		{
+			mDest.push_back(uint8_t(mBits << (8-mCount)));
+			mCount = 0;
+		}
+	}
+
+private:
+	std::vector< uint8_t >	&mDest;
+	uint64_t				mBits{0};
+	uint32_t				mCount{0};		// Bits in 'mBits' not yet written; always less than 8 between writes
+};
+
+class BitReader
+{
+public:
+	BitReader(const uint8_t *begin,const uint8_t *end) : mRead(begin), mEnd(end)
+	{
+	}
+
+	// Reads a Golomb-Rice coded value; sets the overflow flag, and returns zero, if the data runs out
+	inline uint64_t readGolombRice(void)
+	{
+		refill();
+		// Almost every quotient is a few bits long, so the unary run and the remainder are already in the buffer
+		uint32_t ones = ~mBits ? countLeadingZeros(~mBits) : 64;
+		if ( ones + 1 + BASIC_FILTER_P <= mCount )
+		{
+			uint64_t bits = mBits << ones;
+			uint64_t remainder = (bits << 1) >> (64-BASIC_FILTER_P);
+			mBits = bits << (1+BASIC_FILTER_P);
+			mCount -= ones + 1 + BASIC_FILTER_P;
+			return (uint64_t(ones) << BASIC_FILTER_P) | remainder;
+		}
+		// A long run of ones, or the end of the data
+		uint64_t quotient = 0;
+		for (;;)
+		{
+			refill();
+			if ( mCount == 0 )
+			{
+				mOverflow = true;
+				return 0;
+			}
+			ones = ~mBits ? countLeadingZeros(~mBits) : 64;
+			if ( ones < mCount )
+			{
+				quotient += ones;
+				mBits = ones < 63 ? mBits << (ones+1) : 0;
+				mCount -= ones + 1;
+				break;
+			}
+			quotient += mCount;
+			mBits = 0;
+			mCount = 0;
+		}
+		refill();
+		if ( mCount < BASIC_FILTER_P )
+		{
+			mOverflow = true;
+			return 0;
+		}
+		uint64_t remainder = mBits >> (64-BASIC_FILTER_P);
+		mBits <<= BASIC_FILTER_P;
+		mCount -= BASIC_FILTER_P;
+		return (quotient << BASIC_FILTER_P) | remainder;
+	}
+
+	inline bool hasOverflow(void) const
+	{
+		return mOverflow;
+	}
+
+private:
+	// Top the buffer up to at least 57 bits while there is data left; eight bytes at a time away from the end
+	inline void refill(void)
+	{
+		if ( mCount <= 56 && mEnd - mRead >= 8 )
+		{
+			uint64_t v;
+			memcpy(&v,mRead,8);
+			uint32_t bytes = (64 - mCount) >> 3;
+			uint32_t count = mCount + bytes*8;
+			mBits |= byteSwap(v) >> mCount;
+			mBits &= count < 64 ? ~uint64_t(0) << (64-count) : ~uint64_t(0);
+			mRead += bytes;
+			mCount = count;
+			return;
+		}
+		while ( mCount <= 56 && mRead < mEnd )
+		{
+			mBits |= uint64_t(*mRead) << (56-mCount);
+			mRead++;
+			mCount += 8;
+		}
+	}
+
+	const uint8_t	*mRead;
+	const uint8_t	*mEnd;
+	uint64_t		mBits{0};		// The next bits to read, from the most significant bit down
+	uint32_t		mCount{0};
+	bool			mOverflow{false};
+};
+
+// Walks the coded set in order alongside the sorted query values; true on the first value found in both
+static bool matchSorted(const uint8_t *bits,const uint8_t *end,uint64_t elementCount,const std::vector< uint64_t > &values)
+{
+	if ( values.empty() )
+	{
+		return false;
+	}
+	BitReader reader(bits,end);
+	uint64_t value = 0;
+	size_t next = 0;
+	for (uint64_t i=0; i<elementCount; i++)
+	{
+		value += reader.readGolombRice();
+		if ( reader.hasOverflow() )
+		{
+			return false;
+		}
+		while ( values[next] < value )
+		{
+			next++;
+			if ( next == values.size() )
+			{
+				return false;
+			}
+		}
+		if ( values[next] == value )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool matchFilter(const uint8_t blockHash[32],const uint8_t *filter,uint32_t filterLength,uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths,std::vector< uint64_t > &values)
+{
+	bytereader::ByteReader< bytereader::Checked > reader(filter,filter+filterLength);
+	uint64_t elementCount = reader.readCompactSize();
+	if ( reader.hasOverflow() || elementCount == 0 || count == 0 )
+	{
+		return false;
+	}
+	hashScripts(blockHash,elementCount,count,scripts,scriptLengths,values);
+	return matchSorted(reader.getPosition(),reader.getEnd(),elementCount,values);
+}
+
+void buildBasicFilter(const uint8_t blockHash[32],uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths,std::vector< uint8_t > &filter)
+{
+	// Order the scripts by their bytes so the duplicates are side by side
+	std::vector< uint32_t > order(count);
+	for (uint32_t i=0; i<count; i++)
+	{
+		order[i] = i;
+	}
+	auto compare = [scripts,scriptLengths](uint32_t a,uint32_t b)
+	{
+		uint32_t length = scriptLengths[a] < scriptLengths[b] ? scriptLengths[a] : scriptLengths[b];
+		int diff = length ? memcmp(scripts[a],scripts[b],length) : 0;
+		return diff ? diff < 0 : scriptLengths[a] < scriptLengths[b];
+	};
+	std::sort(order.begin(),order.end(),compare);
+	std::vector< const uint8_t *> distinct;
+	std::vector< uint32_t > distinctLengths;
+	for (uint32_t i=0; i<count; i++)
+	{
+		if ( i == 0 || compare(order[i-1],order[i]) )
+		{
+			distinct.push_back(scripts[order[i]]);
+			distinctLengths.push_back(scriptLengths[order[i]]);
+		}
+	}
+	uint32_t elementCount = uint32_t(distinct.size());
+	filter.clear();
+	bytewriter::writeCompactSize(filter,elementCount);
+	if ( elementCount == 0 )
+	{
+		return;
+	}
+	std::vector< uint64_t > values;
+	hashScripts(blockHash,elementCount,elementCount,&distinct[0],&distinctLengths[0],values);
+	BitWriter writer(filter);
+	uint64_t previous = 0;
+	for (auto &v:values)
+	{
+		writer.writeGolombRice(v - previous);
+		previous = v;
+	}
+	writer.flush();
+}
+
+bool matchBasicFilter(const uint8_t blockHash[32],const uint8_t *filter,uint32_t filterLength,uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths)
+{
+	std::vector< uint64_t > values;
+	return matchFilter(blockHash,filter,filterLength,count,scripts,scriptLengths,values);
+}
+
+class BlockFilterWriterImpl : public BlockFilterWriter
+{
+public:
+	BlockFilterWriterImpl(const char *dataDir) : mDataDir(dataDir)
+	{
+	}
+
+	virtual ~BlockFilterWriterImpl(void)
+	{
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mVerifyMerkle = state;
+	}
+
+	virtual bool write(const char *filterDir,uint32_t blockCount,BlockFilterStats &stats) final
+	{
+		stats = BlockFilterStats();
+		std::string dataFileName = getFilterFileName(filterDir,"dat");
+		FILE_INTERFACE *fph = fi_fopen(dataFileName.c_str(),"wb",nullptr,0,false);
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s' for write access.\n", dataFileName.c_str());
+			return false;
+		}
+		// The parser indexes the transactions of each block it reads, so it can resolve the outputs spent by later blocks
+		BlockChain *chain = BlockChain::createBlockChain(mDataDir.c_str(),0xFFFFFFFF);
+		chain->setVerifyMerkle(mVerifyMerkle);
+		uint32_t lastBlockRead = 0;
+		while ( !chain->scanBlockChain(lastBlockRead) )
+		{
+		}
+		uint32_t chainLength = chain->buildBlockChain();
+		if ( chainLength < blockCount )
+		{
+			printf("Only %s blocks were found in '%s'; the filters stop there.\n", formatNumber(int32_t(chainLength)), mDataDir.c_str());
+			blockCount = chainLength;
+		}
+		std::vector< FilterRecord > records;
+		std::vector< uint8_t > filter;
+		uint8_t previousHeader[32];
+		memset(previousHeader,0,32);
+		Timer t;
+		bool ok = true;
+		for (uint32_t i=0; i<blockCount; i++)
+		{
+			const BlockChain::Block *b = chain->readBlock(i);
+			if ( b == nullptr )
+			{
+				printf("Unable to read block %d; the filters stop before it.\n", i);
+				ok = false;
+				break;
+			}
+			stats.mRawBytes += b->blockLength;
+			if ( mVerifyMerkle && b->merkleStatus != BlockChain::MS_VALID )
+			{
+				stats.mMerkleFailures++;
+			}
+			collectScripts(*b,*chain->resolveInputs(b),stats);
+			buildBasicFilter(b->computedBlockHash,uint32_t(mScripts.size()),mScripts.empty() ? nullptr : &mScripts[0],mScriptLengths.empty() ? nullptr : &mScriptLengths[0],filter);
+
+			FilterRecord r;
+			r.mOffset = stats.mFilterBytes;
+			r.mLength = uint32_t(filter.size());
+			bytereader::ByteReader< bytereader::Checked > reader(&filter[0],&filter[0]+filter.size());
+			r.mElementCount = uint32_t(reader.readCompactSize());
+			memcpy(r.mBlockHash,b->computedBlockHash,32);
+			uint8_t node[64];
+			computeDoubleSHA256(&filter[0],uint32_t(filter.size()),node);
+			memcpy(node+32,previousHeader,32);
+			computeDoubleSHA256Node(node,r.mFilterHeader);
+			memcpy(previousHeader,r.mFilterHeader,32);
+			records.push_back(r);
+			ok = fi_fwrite(&filter[0],filter.size(),1,fph) == 1;
+			if ( !ok )
+			{
+				break;
+			}
+			stats.mFilterBytes += filter.size();
+			stats.mElementCount += r.mElementCount;
+			if ( (i % 10000) == 0 && i )
+			{
+				printf("Filtered %s of %s blocks.\n", formatNumber(int32_t(i)), formatNumber(int32_t(blockCount)));
+			}
+		}
+		ok = fi_fclose(fph) == 0 && ok;
+		chain->release();
+		if ( ok )
+		{
+			ok = writeIndex(filterDir,records);
+		}
+		stats.mBlockCount = ok ? records.size() : 0;
+		printf("Filtered %s blocks in %0.3f seconds.\n", formatNumber(int32_t(records.size())), t.getElapsedSeconds());
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Gathers the filter's scripts for this block; every output script other than empty and OP_RETURN scripts
+	// and the script of every output spent, as resolved by the parser
+	void collectScripts(const BlockChain::Block &b,const BlockChain::SpentOutputs &spent,BlockFilterStats &stats)
+	{
+		mScripts.clear();
+		mScriptLengths.clear();
+		for (uint32_t i=0; i<b.totalOutputCount; i++)
+		{
+			const uint8_t *script = b.outputs.getScript(i);
+			uint32_t length = b.outputs.scriptLengths[i];
+			if ( length && script[0] != OP_RETURN )
+			{
+				mScripts.push_back(script);
+				mScriptLengths.push_back(length);
+			}
+		}
+		for (uint32_t i=0; i<spent.inputCount; i++)
+		{
+			uint32_t slot = spent.getSlot(i);
+			if ( slot != BlockChain::NO_SPENT_OUTPUT && spent.outputs.scriptLengths[slot] )
+			{
+				mScripts.push_back(spent.outputs.getScript(slot));
+				mScriptLengths.push_back(spent.outputs.scriptLengths[slot]);
+			}
+		}
+		stats.mUnresolvedInputs += spent.unresolvedCount;
+	}
+
+	bool writeIndex(const char *filterDir,const std::vector< FilterRecord > &records)
+	{
+		std::string fileName = getFilterFileName(filterDir,"idx");
+		FILE_INTERFACE *fph = fi_fopen(fileName.c_str(),"wb",nullptr,0,false);
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s' for write access.\n", fileName.c_str());
+			return false;
+		}
+		FilterFileHeader h;
+		memcpy(h.mId,BLOCK_FILTER_ID,8);
+		h.mBlockCount = uint32_t(records.size());
+		bool ok = fi_fwrite(&h,sizeof(h),1,fph) == 1;
+		if ( ok && !records.empty() )
+		{
+			ok = fi_fwrite(&records[0],sizeof(FilterRecord)*records.size(),1,fph) == 1;
+		}
+		ok = fi_fclose(fph) == 0 && ok;
+		return ok;
+	}
+
+	std::string						mDataDir;
+	bool							mVerifyMerkle{false};
+	std::vector< const uint8_t *>	mScripts;			// The filter's scripts, before duplicates are removed
+	std::vector< uint32_t >			mScriptLengths;
+};
+
+class BlockFiltersImpl : public BlockFilters
+{
+public:
+	virtual ~BlockFiltersImpl(void)
+	{
+		if ( mIndexFile )
+		{
+			fi_fclose(mIndexFile);
+		}
+		if ( mDataFile )
+		{
+			fi_fclose(mDataFile);
+		}
+	}
+
+	bool open(const char *filterDir)
+	{
+		std::string indexFileName = getFilterFileName(filterDir,"idx");
+		mIndexFile = fi_fopen(indexFileName.c_str(),"rb",nullptr,0,true);
+		if ( mIndexFile == nullptr || !fi_usesMemoryMappedFile(mIndexFile) || fi_getFileLength(mIndexFile) < sizeof(FilterFileHeader) )
+		{
+			printf("Failed to map '%s'\n", indexFileName.c_str());
+			return false;
+		}
+		const uint8_t *index = static_cast< const uint8_t *>(fi_getMemBuffer(mIndexFile,nullptr));
+		memcpy(&mHeader,index,sizeof(mHeader));
+		if ( memcmp(mHeader.mId,BLOCK_FILTER_ID,8) != 0 || mHeader.mVersion != BLOCK_FILTER_VERSION ||
+			 mHeader.mP != BASIC_FILTER_P || mHeader.mM != BASIC_FILTER_M ||
+			 fi_getFileLength(mIndexFile) < sizeof(FilterFileHeader) + uint64_t(mHeader.mBlockCount)*sizeof(FilterRecord) )
+		{
+			printf("'%s' is not a valid block filter index.\n", indexFileName.c_str());
+			return false;
+		}
+		mRecords = reinterpret_cast< const FilterRecord *>(index + sizeof(FilterFileHeader));
+		uint64_t dataLength = 0;
+		for (uint32_t i=0; i<mHeader.mBlockCount; i++)
+		{
+			uint64_t end = mRecords[i].mOffset + mRecords[i].mLength;
+			dataLength = end > dataLength ? end : dataLength;
+		}
+		if ( dataLength == 0 )
+		{
+			return true;
+		}
+		std::string dataFileName = getFilterFileName(filterDir,"dat");
+		mDataFile = fi_fopen(dataFileName.c_str(),"rb",nullptr,0,true);
+		if ( mDataFile == nullptr || !fi_usesMemoryMappedFile(mDataFile) || fi_getFileLength(mDataFile) < dataLength )
+		{
+			printf("Failed to map '%s'\n", dataFileName.c_str());
+			return false;
+		}
+		mData = static_cast< const uint8_t *>(fi_getMemBuffer(mDataFile,nullptr));
+		return true;
+	}
+
+	virtual uint32_t getBlockCount(void) const final
+	{
+		return mHeader.mBlockCount;
+	}
+
+	virtual const uint8_t *getFilter(uint32_t blockHeight,uint32_t &filterLength) const final
+	{
+		if ( blockHeight >= mHeader.mBlockCount )
+		{
+			filterLength = 0;
+			return nullptr;
+		}
+		filterLength = mRecords[blockHeight].mLength;
+		return mData + mRecords[blockHeight].mOffset;
+	}
+
+	virtual const uint8_t *getFilterHeader(uint32_t blockHeight) const final
+	{
+		return blockHeight < mHeader.mBlockCount ? mRecords[blockHeight].mFilterHeader : nullptr;
+	}
+
+	virtual void match(uint32_t threadCount,uint32_t firstBlock,uint32_t blockCount,uint32_t count,const uint8_t *const *scripts,const uint32_t *scriptLengths,std::vector< uint32_t > &blockHeights) const final
+	{
+		blockHeights.clear();
+		if ( firstBlock >= mHeader.mBlockCount || count == 0 )
+		{
+			return;
+		}
+		if ( blockCount > mHeader.mBlockCount - firstBlock )
+		{
+			blockCount = mHeader.mBlockCount - firstBlock;
+		}
+		class MatchWorker
+		{
+		public:
+			std::vector< uint64_t >	mValues;		// The scripts hashed for the block being tested
+			std::vector< uint32_t >	mHeights;
+		};
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		std::vector< MatchWorker > workers(pool->getThreadCount()+1);
+		pool->parallelFor(blockCount,MATCH_GRAIN_SIZE,[this,firstBlock,count,scripts,scriptLengths,&workers](uint32_t begin,uint32_t end,uint32_t workerIndex)
+		{
+			MatchWorker &w = workers[workerIndex];
+			for (uint32_t i=begin; i<end; i++)
+			{
+				const FilterRecord &r = mRecords[firstBlock+i];
+				if ( r.mElementCount && matchFilter(r.mBlockHash,mData+r.mOffset,r.mLength,count,scripts,scriptLengths,w.mValues) )
+				{
+					w.mHeights.push_back(firstBlock+i);
+				}
+			}
+		});
+		pool->release();
+		for (auto &w:workers)
+		{
+			blockHeights.insert(blockHeights.end(),w.mHeights.begin(),w.mHeights.end());
+		}
+		std::sort(blockHeights.begin(),blockHeights.end());
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	FilterFileHeader	mHeader;
+	FILE_INTERFACE		*mIndexFile{nullptr};
+	FILE_INTERFACE		*mDataFile{nullptr};
+	const FilterRecord	*mRecords{nullptr};		// One per height, read in place from the mapped index
+	const uint8_t		*mData{nullptr};
+};
+
+BlockFilterWriter *BlockFilterWriter::create(const char *dataDir)
+{
+	auto ret = new BlockFilterWriterImpl(dataDir);
+	return static_cast< BlockFilterWriter *>(ret);
+}
+
+BlockFilters *BlockFilters::create(const char *filterDir)
+{
+	auto ret = new BlockFiltersImpl;
+	if ( !ret->open(filterDir) )
+	{
+		delete ret;
+		ret = nullptr;
+	}
+	return static_cast< BlockFilters *>(ret);
+}
+
+}
@@ -0,0 +1,627 @@
+#include "BlockFsck.h"
+#include "BlockFile.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "SHA256.h"
+#include "blocks.h"
+#include "CBlockIndex.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define BLOCK_MAGIC_ID 0xD9B4BEF9
+#define MAX_BLOCK_LENGTH (1024*1024*32)
+#define BLOCK_HEADER_SIZE 80
+#define MAX_MISSING_FILES 16		// Stop looking for more block files after this many are missing in a row
+#define MAX_CONSOLE_FINDINGS 16		// Findings of each kind printed to the console; all of them go to the report
+
+namespace blockfsck
+{
+
+enum RegionType
+{
+	RT_CORRUPT,			// Bytes which are neither a block nor zeroes
+	RT_TRUNCATED,		// A block whose length runs past the next block or the end of the file
+	RT_BAD_LENGTH,		// A magic id followed by an implausible block length
+	RT_ZERO_GAP,		// A run of zeroes between two blocks
+	RT_LAST
+};
+
+static const char *gRegionNames[RT_LAST] =
+{
+	"CORRUPT",
+	"TRUNCATED",
+	"BAD_LENGTH",
+	"ZERO_GAP",
+};
+
+// A damaged or unused stretch of a block file
+class Region
+{
+public:
+	RegionType	mType{RT_CORRUPT};
+	uint32_t	mFileIndex{0};
+	uint64_t	mOffset{0};
+	uint64_t	mLength{0};
+};
+
+// A block found while walking a block file
+class FoundBlock
+{
+public:
+	uint32_t	mFileIndex{0};
+	uint64_t	mFileOffset{0};		// Offset of the block header; the same convention as the block index
+	uint32_t	mLength{0};
+	bool		mValidWork{false};	// The header hash meets the target encoded in its own 'bits' field
+	uint8_t		mHash[32];
+	uint8_t		mPrevious[32];
+};
+
+// Everything found in one block file
+class FileResult
+{
+public:
+	bool						mOpened{false};
+	uint64_t					mFileSize{0};
+	uint64_t					mPadding{0};	// Zeroes at the end of the file preallocated by bitcoin core
+	std::vector< FoundBlock >	mBlocks;
+	std::vector< Region >		mRegions;
+};
+
+class BlockHashKey
+{
+public:
+	BlockHashKey(const uint8_t *hash)
+	{
+		memcpy(mHash,hash,sizeof(mHash));
+	}
+
+	bool operator==(const BlockHashKey &other) const
+	{
+		return memcmp(mHash,other.mHash,sizeof(mHash)) == 0;
+	}
+
+	uint8_t	mHash[32];
+};
+
+class BlockHashKeyHasher
+{
+public:
+	size_t operator()(const BlockHashKey &key) const
+	{
+		// Block hashes are uniformly distributed so any eight bytes will do
+		uint64_t h;
+		memcpy(&h,key.mHash,sizeof(h));
+		return size_t(h);
+	}
+};
+
+typedef std::unordered_map< BlockHashKey, uint32_t, BlockHashKeyHasher > BlockHashMap;
+
+static void computeBlockHash(const uint8_t *header,uint8_t hash[32])
+{
+	computeDoubleSHA256Header(header,hash);
+}
+
+// True if the hash, as a little endian 256 bit number, does not exceed the target encoded in the compact 'bits' form
+static bool checkProofOfWork(const uint8_t hash[32],uint32_t bits)
+{
+	uint32_t exponent = bits >> 24;
+	uint32_t mantissa = bits & 0x007FFFFF;
+	if ( mantissa == 0 || (bits & 0x00800000) || exponent > 32 )
+	{
+		return false;
+	}
+	uint8_t target[32] = { 0 };
+	for (uint32_t i=0; i<3; i++)
+	{
+		int32_t position = int32_t(exponent) - 3 + int32_t(i);
+		if ( position >= 0 && position < 32 )
+		{
+			target[position] = uint8_t(mantissa >> (i*8));
+		}
+	}
+	for (int32_t i=31; i>=0; i--)
+	{
+		if ( hash[i] != target[i] )
+		{
+			return hash[i] < target[i];
+		}
+	}
+	return true;
+}
+
+// Block hashes are displayed most significant byte first
+static const char *getHashString(const uint8_t hash[32],char *dest)
+{
+	static const char hex[] = "0123456789abcdef";
+	for (uint32_t i=0; i<32; i++)
+	{
+		dest[i*2] = hex[hash[31-i] >> 4];
+		dest[i*2+1] = hex[hash[31-i] & 15];
+	}
+	dest[64] = 0;
+	return dest;
+}
+
+static uint64_t countZeroes(const uint8_t *data,uint64_t length)
+{
+	uint64_t i = 0;
+	for (; i+8 <= length; i+=8)
+	{
+		uint64_t v;
+		memcpy(&v,data+i,sizeof(v));
+		if ( v )
+		{
+			break;
+		}
+	}
+	while ( i < length && data[i] == 0 )
+	{
+		i++;
+	}
+	return i;
+}
+
+static bool readFile(const char *fileName,std::vector< uint8_t > &data)
+{
+	FILE *fph = fopen(fileName,"rb");
+	if ( fph == nullptr )
+	{
+		return false;
+	}
+	fseek(fph,0L,SEEK_END);
+	long length = ftell(fph);
+	fseek(fph,0L,SEEK_SET);
+	bool ret = length >= 0;
+	data.resize(size_t(length > 0 ? length : 0));
+	if ( ret && length > 0 )
+	{
+		ret = fread(&data[0],size_t(length),1,fph) == 1;
+	}
+	fclose(fph);
+	return ret;
+}
+
+static void addRegion(FileResult &result,RegionType type,uint32_t fileIndex,uint64_t offset,uint64_t length)
+{
+	Region r;
+	r.mType = type;
+	r.mFileIndex = fileIndex;
+	r.mOffset = offset;
+	r.mLength = length;
+	result.mRegions.push_back(r);
+}
+
+// Computes the block hash of this header; returns true if it meets the target of the header's own 'bits' field
+static bool hashHeader(const uint8_t *header,uint8_t hash[32])
+{
+	computeBlockHash(header,hash);
+	uint32_t bits;
+	memcpy(&bits,header+72,sizeof(bits));
+	return checkProofOfWork(hash,bits);
+}
+
+// A block must be followed by the end of the file, the magic id of the next block or the zero padding
+static bool isBlockBoundary(const uint8_t *data,uint64_t length,uint64_t position)
+{
+	if ( position == length || data[position] == 0 )
+	{
+		return true;
+	}
+	uint32_t magic = 0;
+	if ( length - position >= sizeof(magic) )
+	{
+		memcpy(&magic,data+position,sizeof(magic));
+	}
+	return magic == BLOCK_MAGIC_ID;
+}
+
+// Returns the position of the next magic id after 'position' which is followed by a plausible length and a
+// header with valid proof of work, or 'length' if there is none.  Block data may contain the magic id by chance.
+static uint64_t findNextBlock(const uint8_t *data,uint64_t length,uint64_t position)
+{
+	while ( position < length )
+	{
+		position += blockfile::findBlockMagic(data+position,size_t(length-position));
+		if ( length - position >= 8 + BLOCK_HEADER_SIZE )
+		{
+			uint32_t blockLength;
+			uint8_t hash[32];
+			memcpy(&blockLength,data+position+4,sizeof(blockLength));
+			if ( blockLength >= BLOCK_HEADER_SIZE && blockLength < MAX_BLOCK_LENGTH && hashHeader(data+position+8,hash) )
+			{
+				return position;
+			}
+		}
+		else
+		{
+			return length;
+		}
+		position++;
+	}
+	return length;
+}
+
+// Walk a block file from start to finish.  A block is a magic id, a length and that many bytes of block data;
+// anything else is classified as zeroes or damage up to the next magic id.
+static void scanFile(uint32_t fileIndex,const std::vector< uint8_t > &file,FileResult &result)
+{
+	const uint8_t *data = file.empty() ? nullptr : &file[0];
+	uint64_t length = file.size();
+	uint64_t position = 0;
+	result.mFileSize = length;
+	while ( position < length )
+	{
+		uint32_t prefix[2] = { 0, 0 };
+		if ( length - position >= sizeof(prefix) )
+		{
+			memcpy(prefix,data+position,sizeof(prefix));
+		}
+		if ( prefix[0] == BLOCK_MAGIC_ID )
+		{
+			uint64_t blockBegin = position + sizeof(prefix);
+			if ( prefix[1] < BLOCK_HEADER_SIZE || prefix[1] >= MAX_BLOCK_LENGTH )
+			{
+				uint64_t next = position + 4 + blockfile::findBlockMagic(data+position+4,size_t(length-position-4));
+				addRegion(result,RT_BAD_LENGTH,fileIndex,position,next-position);
+				position = next;
+			}
+			else if ( blockBegin + prefix[1] > length )
+			{
+				uint64_t next = findNextBlock(data,length,blockBegin);
+				addRegion(result,RT_TRUNCATED,fileIndex,position,next-position);
+				position = next;
+			}
+			else
+			{
+				uint64_t blockEnd = blockBegin + prefix[1];
+				if ( !isBlockBoundary(data,length,blockEnd) )
+				{
+					// A block cut short by a crash is followed by the next block written over its tail, so its
+					// claimed length ends in the middle of that block
+					uint64_t next = findNextBlock(data,length,blockBegin);
+					if ( next < blockEnd )
+					{
+						addRegion(result,RT_TRUNCATED,fileIndex,position,next-position);
+						position = next;
+						continue;
+					}
+				}
+				FoundBlock b;
+				b.mFileIndex = fileIndex;
+				b.mFileOffset = blockBegin;
+				b.mLength = prefix[1];
+				b.mValidWork = hashHeader(data+blockBegin,b.mHash);
+				memcpy(b.mPrevious,data+blockBegin+4,32);
+				result.mBlocks.push_back(b);
+				position = blockEnd;
+			}
+		}
+		else
+		{
+			uint64_t zeroes = countZeroes(data+position,length-position);
+			if ( position + zeroes == length )
+			{
+				result.mPadding = zeroes;
+				break;
+			}
+			uint64_t next = position + blockfile::findBlockMagic(data+position,size_t(length-position));
+			addRegion(result,zeroes == next-position ? RT_ZERO_GAP : RT_CORRUPT,fileIndex,position,next-position);
+			position = next;
+		}
+	}
+}
+
+class BlockFsckImpl : public BlockFsck
+{
+public:
+	BlockFsckImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir)
+	{
+	}
+
+	virtual ~BlockFsckImpl(void)
+	{
+	}
+
+	virtual bool run(uint32_t threadCount,const char *reportFileName) final
+	{
+		Timer t;
+		uint32_t fileCount = findFileCount();
+		printf("Scanning %d block files.\n", fileCount);
+
+		std::vector< FileResult > results(fileCount);
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		std::vector< std::vector< uint8_t > > buffers(pool->getThreadCount()+1);
+		pool->parallelFor(fileCount,1,[this,&results,&buffers](uint32_t begin,uint32_t end,uint32_t workerIndex)
+		{
+			for (uint32_t i=begin; i<end; i++)
+			{
+				char fileName[512];
+				blockfile::getBlockFileName(mDataDir.c_str(),i,fileName,sizeof(fileName));
+				std::vector< uint8_t > &data = buffers[workerIndex];
+				results[i].mOpened = readFile(fileName,data);
+				if ( results[i].mOpened )
+				{
+					scanFile(i,data,results[i]);
+				}
+			}
+		});
+		pool->release();
+		double scanTime = t.peekElapsedSeconds();
+
+		FILE *report = fopen(reportFileName,"wb");
+		if ( report == nullptr )
+		{
+			printf("Unable to open '%s' for write access.\n", reportFileName);
+		}
+		bool ok = crossReference(results,report);
+		if ( report )
+		{
+			fclose(report);
+			printf("Details written to '%s'\n", reportFileName);
+		}
+		printf("Completed in %0.3f seconds (%0.3f seconds scanning the files).\n", t.peekElapsedSeconds(), scanTime);
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// The files are numbered from zero; a pruned node deletes the oldest ones so a few missing files are skipped
+	uint32_t findFileCount(void) const
+	{
+		uint32_t indexedFiles = 0;
+		for (uint32_t i=0; i<mBlocks->getBlockHeight(); i++)
+		{
+			const CBlockIndex *index = mBlocks->getBlockIndex(i);
+			if ( index && (index->mBlockStatus & CBlockIndex::BLOCK_HAVE_DATA) && uint32_t(index->mFileIndex) >= indexedFiles )
+			{
+				indexedFiles = uint32_t(index->mFileIndex)+1;
+			}
+		}
+		uint32_t ret = indexedFiles;
+		uint32_t missing = 0;
+		for (uint32_t i=indexedFiles; missing < MAX_MISSING_FILES; i++)
+		{
+			char fileName[512];
+			FILE *fph = fopen(blockfile::getBlockFileName(mDataDir.c_str(),i,fileName,sizeof(fileName)),"rb");
+			if ( fph )
+			{
+				fclose(fph);
+				ret = i+1;
+				missing = 0;
+			}
+			else
+			{
+				missing++;
+			}
+		}
+		return ret;
+	}
+
+	bool crossReference(const std::vector< FileResult > &results,FILE *report)
+	{
+		char hashString[65];
+
+		// Every block in the index, by hash and by location
+		BlockHashMap indexed;
+		std::unordered_map< uint64_t, uint32_t > locations;
+		uint32_t blockHeight = mBlocks->getBlockHeight();
+		uint32_t indexGaps = 0;
+		for (uint32_t i=0; i<blockHeight; i++)
+		{
+			const CBlockIndex *index = mBlocks->getBlockIndex(i);
+			if ( index == nullptr )
+			{
+				writeReport(report,indexGaps,"INDEX_GAP: No block index entry for block %d\n", i);
+				continue;
+			}
+			indexed[BlockHashKey(index->mBlockHash)] = i;
+			if ( index->mBlockStatus & CBlockIndex::BLOCK_HAVE_DATA )
+			{
+				locations[getLocationKey(uint32_t(index->mFileIndex),index->mFileOffset)] = i;
+			}
+		}
+
+		// Every block found which the index does not know about, so stale chains can be followed back to the main chain
+		BlockHashMap unindexed;
+		std::vector< const FoundBlock *> found;
+		for (auto &r:results)
+		{
+			for (auto &b:r.mBlocks)
+			{
+				found.push_back(&b);
+				if ( indexed.find(BlockHashKey(b.mHash)) == indexed.end() && b.mValidWork )
+				{
+					unindexed[BlockHashKey(b.mHash)] = uint32_t(found.size()-1);
+				}
+			}
+		}
+
+		uint32_t missingFiles = 0;
+		uint32_t regionCounts[RT_LAST] = { 0 };
+		uint64_t regionBytes[RT_LAST] = { 0 };
+		uint64_t totalBytes = 0;
+		uint64_t paddingBytes = 0;
+		for (uint32_t i=0; i<uint32_t(results.size()); i++)
+		{
+			const FileResult &r = results[i];
+			if ( !r.mOpened )
+			{
+				writeReport(report,missingFiles,"MISSING_FILE: blk%05d.dat\n", i);
+				continue;
+			}
+			totalBytes += r.mFileSize;
+			paddingBytes += r.mPadding;
+			for (auto &region:r.mRegions)
+			{
+				regionBytes[region.mType] += region.mLength;
+				writeReport(report,regionCounts[region.mType],"%s: blk%05d.dat offset %llu length %llu\n",
+					gRegionNames[region.mType], region.mFileIndex, (unsigned long long)region.mOffset, (unsigned long long)region.mLength);
+			}
+		}
+
+		uint32_t okCount = 0;
+		uint32_t duplicateCount = 0;
+		uint32_t staleCount = 0;
+		uint32_t orphanCount = 0;
+		uint32_t badHeaderCount = 0;
+		std::vector< bool > located(blockHeight,false);
+		std::vector< int32_t > staleHeights(found.size(),-1);
+		for (uint32_t i=0; i<uint32_t(found.size()); i++)
+		{
+			const FoundBlock &b = *found[i];
+			BlockHashMap::const_iterator f = indexed.find(BlockHashKey(b.mHash));
+			if ( f != indexed.end() )
+			{
+				std::unordered_map< uint64_t, uint32_t >::const_iterator l = locations.find(getLocationKey(b.mFileIndex,b.mFileOffset));
+				if ( l != locations.end() && (*l).second == (*f).second )
+				{
+					located[(*f).second] = true;
+					okCount++;
+				}
+				else
+				{
+					writeReport(report,duplicateCount,"DUPLICATE: A copy of block %d (%s) at blk%05d.dat offset %llu\n",
+						(*f).second, getHashString(b.mHash,hashString), b.mFileIndex, (unsigned long long)b.mFileOffset);
+				}
+			}
+			else if ( !b.mValidWork )
+			{
+				writeReport(report,badHeaderCount,"BAD_HEADER: The block at blk%05d.dat offset %llu does not meet its own proof of work target\n",
+					b.mFileIndex, (unsigned long long)b.mFileOffset);
+			}
+			else
+			{
+				int32_t height = resolveStaleHeight(i,found,indexed,unindexed,staleHeights);
+				if ( height >= 0 )
+				{
+					writeReport(report,staleCount,"STALE: Block %s at height %d at blk%05d.dat offset %llu\n",
+						getHashString(b.mHash,hashString), height, b.mFileIndex, (unsigned long long)b.mFileOffset);
+				}
+				else
+				{
+					writeReport(report,orphanCount,"ORPHAN: Block %s with unknown parent at blk%05d.dat offset %llu\n",
+						getHashString(b.mHash,hashString), b.mFileIndex, (unsigned long long)b.mFileOffset);
+				}
+			}
+		}
+
+		uint32_t notFoundCount = 0;
+		for (uint32_t i=0; i<blockHeight; i++)
+		{
+			const CBlockIndex *index = mBlocks->getBlockIndex(i);
+			if ( index && (index->mBlockStatus & CBlockIndex::BLOCK_HAVE_DATA) && !located[i] )
+			{
+				writeReport(report,notFoundCount,"NOT_FOUND: Block %d is indexed at blk%05d.dat offset %llu but no block is stored there\n",
+					i, uint32_t(index->mFileIndex), (unsigned long long)index->mFileOffset);
+			}
+		}
+
+		printf("Files          : %d (%0.2f MB) %d missing\n", uint32_t(results.size()), double(totalBytes)/(1024*1024), missingFiles);
+		printf("Blocks found   : %d\n", uint32_t(found.size()));
+		printf("Indexed        : %d\n", okCount);
+		printf("Duplicates     : %d\n", duplicateCount);
+		printf("Stale blocks   : %d\n", staleCount);
+		printf("Orphan blocks  : %d\n", orphanCount);
+		printf("Bad headers    : %d\n", badHeaderCount);
+		printf("Not found      : %d of the indexed blocks\n", notFoundCount);
+		printf("Index gaps     : %d\n", indexGaps);
+		for (uint32_t i=0; i<RT_LAST; i++)
+		{
+			printf("%-15s: %d regions, %llu bytes\n", gRegionNames[i], regionCounts[i], (unsigned long long)regionBytes[i]);
+		}
+		printf("Padding        : %0.2f MB\n", double(paddingBytes)/(1024*1024));
+
+		return missingFiles == 0 && badHeaderCount == 0 && notFoundCount == 0 &&
+			regionCounts[RT_CORRUPT] == 0 && regionCounts[RT_TRUNCATED] == 0 && regionCounts[RT_BAD_LENGTH] == 0;
+	}
+
+	// Follow the previous block hashes of a block the index does not know about until they reach an indexed
+	// block; returns the height the block would have had, or -1 if its chain does not connect to the index.
+	static int32_t resolveStaleHeight(uint32_t foundIndex,
+									  const std::vector< const FoundBlock *> &found,
+									  const BlockHashMap &indexed,
+									  const BlockHashMap &unindexed,
+									  std::vector< int32_t > &staleHeights)
+	{
+		std::vector< uint32_t > chain;
+		int32_t height = -1;
+		uint32_t current = foundIndex;
+		for (;;)
+		{
+			if ( staleHeights[current] >= 0 )
+			{
+				height = staleHeights[current]+1;
+				break;
+			}
+			chain.push_back(current);
+			const uint8_t *previous = found[current]->mPrevious;
+			BlockHashMap::const_iterator f = indexed.find(BlockHashKey(previous));
+			if ( f != indexed.end() )
+			{
+				height = int32_t((*f).second)+1;
+				break;
+			}
+			f = unindexed.find(BlockHashKey(previous));
+			if ( f == unindexed.end() || chain.size() > found.size() )
+			{
+				return -1;
+			}
+			current = (*f).second;
+		}
+		// 'height' belongs to the last entry in the chain; each earlier entry is one block further on
+		for (size_t i=chain.size(); i-- > 0;)
+		{
+			staleHeights[chain[i]] = height++;
+		}
+		return staleHeights[foundIndex];
+	}
+
+	static uint64_t getLocationKey(uint32_t fileIndex,uint64_t fileOffset)
+	{
+		return (uint64_t(fileIndex) << 40) | fileOffset;
+	}
+
+	// Every finding goes to the report; the first few of each kind are echoed to the console
+	static void writeReport(FILE *report,uint32_t &count,const char *fmt,...)
+	{
+		char scratch[1024];
+		va_list args;
+		va_start(args,fmt);
+		vsnprintf(scratch,sizeof(scratch),fmt,args);
+		va_end(args);
+		if ( report )
+		{
+			fputs(scratch,report);
+		}
+		if ( count < MAX_CONSOLE_FINDINGS )
+		{
+			printf("%s", scratch);
+		}
+		count++;
+	}
+
+	const blocks::Blocks	*mBlocks{nullptr};
+	std::string				mDataDir;
+};
+
+BlockFsck *BlockFsck::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new BlockFsckImpl(blocks,dataDir);
+	return static_cast< BlockFsck *>(ret);
+}
+
+}
@@ -0,0 +1,769 @@
+#include "ChainAnalysis.h"
+#include "BlockFile.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "logging.h"
+#include "blocks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Blocks are handed to the threads this many at a time; progress is printed between batches
+#define CHAIN_ANALYSIS_BATCH_SIZE 10000
+// Number of blocks each thread takes from the pool at a time
+#define CHAIN_ANALYSIS_GRAIN_SIZE 4
+
+#define HALVING_INTERVAL 210000
+#define MAX_HALVING_EPOCHS 34		// The subsidy is zero from the 33rd halving on; later blocks share the last entry
+#define VALUE_DECADES 17			// 1 satoshi up to more than the 21 million BTC supply
+
+namespace chainanalysis
+{
+
+// Each thread has its own block reader and a shard of every analyser
+class Worker
+{
+public:
+	~Worker(void)
+	{
+		for (auto &s:mShards)
+		{
+			s->release();
+		}
+	}
+
+	blockfile::BlockReader			mReader;
+	std::vector< AnalyserShard *>	mShards;		// One per analyser, in the order they were added
+	std::vector< AnalyserShard *>	mBlockShards;	// The shards subscribed to each event
+	std::vector< AnalyserShard *>	mTransactionShards;
+	std::vector< AnalyserShard *>	mInputShards;
+	std::vector< AnalyserShard *>	mOutputShards;
+	ChainAnalysisStats				mStats;
+};
+
+class ChainAnalysisImpl : public ChainAnalysis
+{
+public:
+	ChainAnalysisImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir)
+	{
+	}
+
+	virtual ~ChainAnalysisImpl(void)
+	{
+	}
+
+	virtual void addAnalyser(Analyser *a) final
+	{
+		mAnalysers.push_back(a);
+	}
+
+	virtual void clearAnalysers(void) final
+	{
+		mAnalysers.clear();
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mVerifyMerkle = state;
+	}
+
+	virtual bool run(uint32_t threadCount,uint32_t firstBlock,uint32_t blockCount,ChainAnalysisStats &stats) final
+	{
+		stats = ChainAnalysisStats();
+		if ( mAnalysers.empty() )
+		{
+			return false;
+		}
+		Timer t;
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		std::vector< Worker > workers(pool->getThreadCount()+1);
+		for (auto &w:workers)
+		{
+			w.mReader.setVerifyMerkle(mVerifyMerkle);
+			for (auto &a:mAnalysers)
+			{
+				AnalyserShard *s = a->createShard();
+				uint32_t events = a->getEvents();
+				w.mShards.push_back(s);
+				if ( events & AE_BLOCK )
+				{
+					w.mBlockShards.push_back(s);
+				}
+				if ( events & AE_TRANSACTION )
+				{
+					w.mTransactionShards.push_back(s);
+				}
+				if ( events & AE_INPUT )
+				{
+					w.mInputShards.push_back(s);
+				}
+				if ( events & AE_OUTPUT )
+				{
+					w.mOutputShards.push_back(s);
+				}
+			}
+		}
+
+		for (uint32_t first=0; first<blockCount; first+=CHAIN_ANALYSIS_BATCH_SIZE)
+		{
+			uint32_t count = blockCount - first;
+			if ( count > CHAIN_ANALYSIS_BATCH_SIZE )
+			{
+				count = CHAIN_ANALYSIS_BATCH_SIZE;
+			}
+			uint32_t batchStart = firstBlock + first;
+			pool->parallelFor(count,CHAIN_ANALYSIS_GRAIN_SIZE,[this,&workers,batchStart](uint32_t begin,uint32_t end,uint32_t workerIndex)
+			{
+				for (uint32_t i=begin; i<end; i++)
+				{
+					analyseBlock(workers[workerIndex],batchStart+i);
+				}
+			});
+			if ( first+count < blockCount )
+			{
+				printf("Analysed %s of %s blocks.\n", formatNumber(int32_t(first+count)), formatNumber(int32_t(blockCount)));
+			}
+		}
+		pool->release();
+
+		for (auto &w:workers)
+		{
+			for (size_t i=0; i<mAnalysers.size(); i++)
+			{
+				mAnalysers[i]->merge(w.mShards[i]);
+			}
+			stats.mBlockCount += w.mStats.mBlockCount;
+			stats.mFailedCount += w.mStats.mFailedCount;
+			stats.mMerkleFailures += w.mStats.mMerkleFailures;
+			stats.mRawBytes += w.mStats.mRawBytes;
+			stats.mTransactionCount += w.mStats.mTransactionCount;
+			stats.mInputCount += w.mStats.mInputCount;
+			stats.mOutputCount += w.mStats.mOutputCount;
+		}
+		stats.mSeconds = t.getElapsedSeconds();
+		return true;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Parses one block and walks it once; each transaction, input and output is passed to every subscribed shard
+	// before moving on to the next
+	void analyseBlock(Worker &w,uint32_t blockHeight)
+	{
+		const BlockChain::Block *b = w.mReader.read(mBlocks,mDataDir.c_str(),blockHeight);
+		if ( b == nullptr )
+		{
+			w.mStats.mFailedCount++;
+			return;
+		}
+		w.mStats.mBlockCount++;
+		w.mStats.mRawBytes += w.mReader.getData().size();
+		w.mStats.mTransactionCount += b->transactionCount;
+		w.mStats.mInputCount += b->totalInputCount;
+		w.mStats.mOutputCount += b->totalOutputCount;
+		if ( mVerifyMerkle && b->merkleStatus != BlockChain::MS_VALID )
+		{
+			w.mStats.mMerkleFailures++;
+		}
+
+		for (auto &s:w.mBlockShards)
+		{
+			s->onBlock(*b);
+		}
+		if ( w.mTransactionShards.empty() && w.mInputShards.empty() && w.mOutputShards.empty() )
+		{
+			return;
+		}
+		for (uint32_t i=0; i<b->transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b->transactions[i];
+			for (auto &s:w.mTransactionShards)
+			{
+				s->onTransaction(*b,t,i);
+			}
+			if ( !w.mInputShards.empty() )
+			{
+				for (uint32_t j=0; j<t.inputCount; j++)
+				{
+					for (auto &s:w.mInputShards)
+					{
+						s->onInput(*b,t,t.inputs[j],j);
+					}
+				}
+			}
+			if ( !w.mOutputShards.empty() )
+			{
+				for (uint32_t j=0; j<t.outputCount; j++)
+				{
+					for (auto &s:w.mOutputShards)
+					{
+						s->onOutput(*b,t,j);
+					}
+				}
+			}
+		}
+	}
+
+	const blocks::Blocks		*mBlocks{nullptr};
+	std::string					mDataDir;
+	bool						mVerifyMerkle{false};
+	std::vector< Analyser *>	mAnalysers;
+};
+
+ChainAnalysis *ChainAnalysis::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new ChainAnalysisImpl(blocks,dataDir);
+	return static_cast< ChainAnalysis *>(ret);
+}
+
+static double percent(uint64_t count,uint64_t total)
+{
+	return total ? double(count)*100.0 / double(total) : 0.0;
+}
+
+// The analysers below keep their results in a plain class which is both the shard's state and the merged total;
+// merging adds one into the other.
+
+class KeyTypeCounts
+{
+public:
+	void add(const KeyTypeCounts &other)
+	{
+		for (uint32_t i=0; i<BlockChain::KT_LAST; i++)
+		{
+			mOutputs[i] += other.mOutputs[i];
+			mValue[i] += other.mValue[i];
+			mScriptBytes[i] += other.mScriptBytes[i];
+		}
+	}
+
+	uint64_t	mOutputs[BlockChain::KT_LAST]{};
+	uint64_t	mValue[BlockChain::KT_LAST]{};
+	uint64_t	mScriptBytes[BlockChain::KT_LAST]{};
+};
+
+class KeyTypeShard : public AnalyserShard
+{
+public:
+	virtual void onOutput(const BlockChain::Block & /* b */,const BlockChain::BlockTransaction &t,uint32_t outputIndex) final
+	{
+		uint32_t k = t.outputs.keyTypes[outputIndex];
+		mCounts.mOutputs[k]++;
+		mCounts.mValue[k] += t.outputs.values[outputIndex];
+		mCounts.mScriptBytes[k] += t.outputs.scriptLengths[outputIndex];
+	}
+
+	KeyTypeCounts	mCounts;
+};
+
+class KeyTypeAnalyser : public Analyser
+{
+public:
+	virtual const char *getName(void) const final
+	{
+		return "Key types";
+	}
+
+	virtual uint32_t getEvents(void) const final
+	{
+		return AE_OUTPUT;
+	}
+
+	virtual AnalyserShard *createShard(void) final
+	{
+		return new KeyTypeShard;
+	}
+
+	virtual void merge(const AnalyserShard *shard) final
+	{
+		mCounts.add(static_cast< const KeyTypeShard *>(shard)->mCounts);
+	}
+
+	virtual void report(void) final
+	{
+		uint64_t total = 0;
+		for (uint32_t i=0; i<BlockChain::KT_LAST; i++)
+		{
+			total += mCounts.mOutputs[i];
+		}
+		printf("%-28s %14s %7s %20s %12s\n", "Key type", "Outputs", "%", "Value (BTC)", "Script MB");
+		for (uint32_t i=0; i<BlockChain::KT_LAST; i++)
+		{
+			if ( mCounts.mOutputs[i] )
+			{
+				printf("%-28s %14llu %6.2f%% %20.8f %12.2f\n", BlockChain::getKeyTypeName(BlockChain::KeyType(i)),
+					(unsigned long long)mCounts.mOutputs[i], percent(mCounts.mOutputs[i],total),
+					double(mCounts.mValue[i]) / ONE_BTC, double(mCounts.mScriptBytes[i]) / (1024*1024));
+			}
+		}
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	KeyTypeCounts	mCounts;
+};
+
+class OutputValueCounts
+{
+public:
+	void add(const OutputValueCounts &other)
+	{
+		mZero += other.mZero;
+		for (uint32_t i=0; i<VALUE_DECADES; i++)
+		{
+			mOutputs[i] += other.mOutputs[i];
+			mValue[i] += other.mValue[i];
+		}
+	}
+
+	uint64_t	mZero{0};
+	uint64_t	mOutputs[VALUE_DECADES]{};	// Outputs of at least 10^i satoshis and less than 10^(i+1)
+	uint64_t	mValue[VALUE_DECADES]{};
+};
+
+class OutputValueShard : public AnalyserShard
+{
+public:
+	virtual void onOutput(const BlockChain::Block & /* b */,const BlockChain::BlockTransaction &t,uint32_t outputIndex) final
+	{
+		uint64_t v = t.outputs.values[outputIndex];
+		if ( v == 0 )
+		{
+			mCounts.mZero++;
+			return;
+		}
+		uint32_t decade = 0;
+		for (uint64_t limit=10; v >= limit && decade < VALUE_DECADES-1; limit*=10)
+		{
+			decade++;
+		}
+		mCounts.mOutputs[decade]++;
+		mCounts.mValue[decade] += v;
+	}
+
+	OutputValueCounts	mCounts;
+};
+
+class OutputValueAnalyser : public Analyser
+{
+public:
+	virtual const char *getName(void) const final
+	{
+		return "Output values";
+	}
+
+	virtual uint32_t getEvents(void) const final
+	{
+		return AE_OUTPUT;
+	}
+
+	virtual AnalyserShard *createShard(void) final
+	{
+		return new OutputValueShard;
+	}
+
+	virtual void merge(const AnalyserShard *shard) final
+	{
+		mCounts.add(static_cast< const OutputValueShard *>(shard)->mCounts);
+	}
+
+	virtual void report(void) final
+	{
+		uint64_t total = mCounts.mZero;
+		for (uint32_t i=0; i<VALUE_DECADES; i++)
+		{
+			total += mCounts.mOutputs[i];
+		}
+		printf("%-28s %14s %7s %20s\n", "Value (satoshis)", "Outputs", "%", "Value (BTC)");
+		printf("%-28s %14llu %6.2f%%\n", "zero", (unsigned long long)mCounts.mZero, percent(mCounts.mZero,total));
+		char scratch[64];
+		for (uint32_t i=0; i<VALUE_DECADES; i++)
+		{
+			if ( mCounts.mOutputs[i] )
+			{
+				snprintf(scratch,sizeof(scratch),"1e%d to 1e%d", i, i+1);
+				printf("%-28s %14llu %6.2f%% %20.8f\n", scratch, (unsigned long long)mCounts.mOutputs[i], percent(mCounts.mOutputs[i],total),
+					double(mCounts.mValue[i]) / ONE_BTC);
+			}
+		}
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	OutputValueCounts	mCounts;
+};
+
+class TransactionCounts
+{
+public:
+	void add(const TransactionCounts &other)
+	{
+		mTransactions += other.mTransactions;
+		mCoinbase += other.mCoinbase;
+		mWitness += other.mWitness;
+		mBytes += other.mBytes;
+		mWitnessBytes += other.mWitnessBytes;
+		for (uint32_t i=0; i<3; i++)
+		{
+			for (uint32_t j=0; j<3; j++)
+			{
+				mShapes[i][j] += other.mShapes[i][j];
+			}
+		}
+		if ( other.mLargestLength > mLargestLength )
+		{
+			mLargestLength = other.mLargestLength;
+			mLargestBlock = other.mLargestBlock;
+			mLargestIndex = other.mLargestIndex;
+		}
+	}
+
+	uint64_t	mTransactions{0};
+	uint64_t	mCoinbase{0};
+	uint64_t	mWitness{0};			// Transactions serialized with witness data
+	uint64_t	mBytes{0};
+	uint64_t	mWitnessBytes{0};		// Size of the transactions with witness data
+	uint64_t	mShapes[3][3]{};		// Non coinbase transactions by input count (1, 2, 3 or more) and output count
+	uint32_t	mLargestLength{0};
+	uint32_t	mLargestBlock{0};
+	uint32_t	mLargestIndex{0};
+};
+
+class TransactionShard : public AnalyserShard
+{
+public:
+	virtual void onTransaction(const BlockChain::Block &b,const BlockChain::BlockTransaction &t,uint32_t transactionIndex) final
+	{
+		mCounts.mTransactions++;
+		mCounts.mBytes += t.transactionLength;
+		if ( t.hasWitness )
+		{
+			mCounts.mWitness++;
+			mCounts.mWitnessBytes += t.transactionLength;
+		}
+		if ( transactionIndex == 0 )
+		{
+			mCounts.mCoinbase++;
+		}
+		else
+		{
+			uint32_t i = t.inputCount < 3 ? t.inputCount : 3;
+			uint32_t o = t.outputCount < 3 ? t.outputCount : 3;
+			mCounts.mShapes[i ? i-1 : 0][o ? o-1 : 0]++;
+		}
+		if ( t.transactionLength > mCounts.mLargestLength )
+		{
+			mCounts.mLargestLength = t.transactionLength;
+			mCounts.mLargestBlock = b.blockIndex;
+			mCounts.mLargestIndex = transactionIndex;
+		}
+	}
+
+	TransactionCounts	mCounts;
+};
+
+class TransactionAnalyser : public Analyser
+{
+public:
+	virtual const char *getName(void) const final
+	{
+		return "Transactions";
+	}
+
+	virtual uint32_t getEvents(void) const final
+	{
+		return AE_TRANSACTION;
+	}
+
+	virtual AnalyserShard *createShard(void) final
+	{
+		return new TransactionShard;
+	}
+
+	virtual void merge(const AnalyserShard *shard) final
+	{
+		mCounts.add(static_cast< const TransactionShard *>(shard)->mCounts);
+	}
+
+	virtual void report(void) final
+	{
+		const TransactionCounts &c = mCounts;
+		printf("Transactions    : %llu (%llu coinbase), average %0.1f bytes\n", (unsigned long long)c.mTransactions,
+			(unsigned long long)c.mCoinbase, c.mTransactions ? double(c.mBytes) / double(c.mTransactions) : 0.0);
+		printf("With witness    : %llu (%0.2f%%), %0.2f%% of the bytes\n", (unsigned long long)c.mWitness,
+			percent(c.mWitness,c.mTransactions), percent(c.mWitnessBytes,c.mBytes));
+		printf("Largest         : %s bytes; transaction %d of block %d\n", formatNumber(int32_t(c.mLargestLength)), c.mLargestIndex, c.mLargestBlock);
+		uint64_t spends = c.mTransactions - c.mCoinbase;
+		static const char *gShapeNames[3] = { "1", "2", "3+" };
+		printf("%-16s %16s %16s %16s\n", "Inputs/outputs", "1 output", "2 outputs", "3+ outputs");
+		for (uint32_t i=0; i<3; i++)
+		{
+			printf("%-16s", gShapeNames[i]);
+			for (uint32_t j=0; j<3; j++)
+			{
+				printf(" %15.2f%%", percent(c.mShapes[i][j],spends));
+			}
+			printf("\n");
+		}
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	TransactionCounts	mCounts;
+};
+
+class InputCounts
+{
+public:
+	void add(const InputCounts &other)
+	{
+		mInputs += other.mInputs;
+		mCoinbase += other.mCoinbase;
+		mWitness += other.mWitness;
+		mWitnessItems += other.mWitnessItems;
+		mScriptBytes += other.mScriptBytes;
+		mEmptyScript += other.mEmptyScript;
+		mFinal += other.mFinal;
+		mReplaceable += other.mReplaceable;
+		mRelativeLock += other.mRelativeLock;
+	}
+
+	uint64_t	mInputs{0};
+	uint64_t	mCoinbase{0};
+	uint64_t	mWitness{0};			// Inputs with a witness stack
+	uint64_t	mWitnessItems{0};
+	uint64_t	mScriptBytes{0};		// Input scripts, other than coinbase scripts
+	uint64_t	mEmptyScript{0};		// Inputs with an empty input script; native witness spends
+	uint64_t	mFinal{0};				// Sequence 0xFFFFFFFF
+	uint64_t	mReplaceable{0};		// Sequence below 0xFFFFFFFE; signals replace by fee (BIP125)
+	uint64_t	mRelativeLock{0};		// Version 2 transactions with the disable flag clear; a relative lock time (BIP68)
+};
+
+class InputShard : public AnalyserShard
+{
+public:
+	virtual void onInput(const BlockChain::Block &b,const BlockChain::BlockTransaction &t,const BlockChain::BlockInput &input,uint32_t /* inputIndex */) final
+	{
+		mCounts.mInputs++;
+		if ( &t == b.transactions )
+		{
+			mCounts.mCoinbase++;
+			return;
+		}
+		if ( input.witnessCount )
+		{
+			mCounts.mWitness++;
+			mCounts.mWitnessItems += input.witnessCount;
+		}
+		mCounts.mScriptBytes += input.responseScriptLength;
+		if ( input.responseScriptLength == 0 )
+		{
+			mCounts.mEmptyScript++;
+		}
+		if ( input.sequenceNumber == 0xFFFFFFFF )
+		{
+			mCounts.mFinal++;
+		}
+		else if ( input.sequenceNumber < 0xFFFFFFFE )
+		{
+			mCounts.mReplaceable++;
+		}
+		if ( t.transactionVersionNumber >= 2 && (input.sequenceNumber & (1u<<31)) == 0 )
+		{
+			mCounts.mRelativeLock++;
+		}
+	}
+
+	InputCounts	mCounts;
+};
+
+class InputAnalyser : public Analyser
+{
+public:
+	virtual const char *getName(void) const final
+	{
+		return "Inputs";
+	}
+
+	virtual uint32_t getEvents(void) const final
+	{
+		return AE_INPUT;
+	}
+
+	virtual AnalyserShard *createShard(void) final
+	{
+		return new InputShard;
+	}
+
+	virtual void merge(const AnalyserShard *shard) final
+	{
+		mCounts.add(static_cast< const InputShard *>(shard)->mCounts);
+	}
+
+	virtual void report(void) final
+	{
+		const InputCounts &c = mCounts;
+		uint64_t spends = c.mInputs - c.mCoinbase;
+		printf("Inputs          : %llu (%llu coinbase)\n", (unsigned long long)c.mInputs, (unsigned long long)c.mCoinbase);
+		printf("With witness    : %llu (%0.2f%%), average %0.2f items\n", (unsigned long long)c.mWitness,
+			percent(c.mWitness,spends), c.mWitness ? double(c.mWitnessItems) / double(c.mWitness) : 0.0);
+		printf("Empty script    : %llu (%0.2f%%)\n", (unsigned long long)c.mEmptyScript, percent(c.mEmptyScript,spends));
+		printf("Script bytes    : %0.2f MB, average %0.1f\n", double(c.mScriptBytes) / (1024*1024), spends ? double(c.mScriptBytes) / double(spends) : 0.0);
+		printf("Final sequence  : %0.2f%%\n", percent(c.mFinal,spends));
+		printf("Replaceable     : %0.2f%%\n", percent(c.mReplaceable,spends));
+		printf("Relative lock   : %0.2f%%\n", percent(c.mRelativeLock,spends));
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	InputCounts	mCounts;
+};
+
+class EpochCounts
+{
+public:
+	void add(const EpochCounts &other)
+	{
+		mBlocks += other.mBlocks;
+		mBytes += other.mBytes;
+		mTransactions += other.mTransactions;
+		mReward += other.mReward;
+		if ( other.mLargestBlock > mLargestBlock )
+		{
+			mLargestBlock = other.mLargestBlock;
+		}
+	}
+
+	uint64_t	mBlocks{0};
+	uint64_t	mBytes{0};
+	uint64_t	mTransactions{0};
+	uint64_t	mReward{0};			// Value of the coinbase outputs; subsidy and fees
+	uint32_t	mLargestBlock{0};
+};
+
+class BlockShard : public AnalyserShard
+{
+public:
+	virtual void onBlock(const BlockChain::Block &b) final
+	{
+		uint32_t epoch = b.blockIndex / HALVING_INTERVAL;
+		EpochCounts &e = mEpochs[epoch < MAX_HALVING_EPOCHS ? epoch : MAX_HALVING_EPOCHS-1];
+		e.mBlocks++;
+		e.mBytes += b.blockLength;
+		e.mTransactions += b.transactionCount;
+		if ( b.transactionCount )
+		{
+			const BlockChain::BlockTransaction &coinbase = b.transactions[0];
+			for (uint32_t i=0; i<coinbase.outputCount; i++)
+			{
+				e.mReward += coinbase.outputs.values[i];
+			}
+		}
+		if ( b.blockLength > e.mLargestBlock )
+		{
+			e.mLargestBlock = b.blockLength;
+		}
+	}
+
+	EpochCounts	mEpochs[MAX_HALVING_EPOCHS];
+};
+
+class BlockAnalyser : public Analyser
+{
+public:
+	virtual const char *getName(void) const final
+	{
+		return "Blocks by halving epoch";
+	}
+
+	virtual uint32_t getEvents(void) const final
+	{
+		return AE_BLOCK;
+	}
+
+	virtual AnalyserShard *createShard(void) final
+	{
+		return new BlockShard;
+	}
+
+	virtual void merge(const AnalyserShard *shard) final
+	{
+		const BlockShard *s = static_cast< const BlockShard *>(shard);
+		for (uint32_t i=0; i<MAX_HALVING_EPOCHS; i++)
+		{
+			mEpochs[i].add(s->mEpochs[i]);
+		}
+	}
+
+	virtual void report(void) final
+	{
+		printf("%-6s %10s %12s %12s %12s %14s %16s\n", "Epoch", "Blocks", "Avg bytes", "Max bytes", "Avg txs", "Transactions", "Reward (BTC)");
+		for (uint32_t i=0; i<MAX_HALVING_EPOCHS; i++)
+		{
+			const EpochCounts &e = mEpochs[i];
+			if ( e.mBlocks )
+			{
+				printf("%-6d %10llu %12.0f %12d %12.1f %14llu %16.8f\n", i, (unsigned long long)e.mBlocks,
+					double(e.mBytes) / double(e.mBlocks), e.mLargestBlock, double(e.mTransactions) / double(e.mBlocks),
+					(unsigned long long)e.mTransactions, double(e.mReward) / ONE_BTC);
+			}
+		}
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	EpochCounts	mEpochs[MAX_HALVING_EPOCHS];
+};
+
+Analyser *createKeyTypeAnalyser(void)
+{
+	return new KeyTypeAnalyser;
+}
+
+Analyser *createOutputValueAnalyser(void)
+{
+	return new OutputValueAnalyser;
+}
+
+Analyser *createTransactionAnalyser(void)
+{
+	return new TransactionAnalyser;
+}
+
+Analyser *createInputAnalyser(void)
+{
+	return new InputAnalyser;
+}
+
+Analyser *createBlockAnalyser(void)
+{
+	return new BlockAnalyser;
+}
+
+}
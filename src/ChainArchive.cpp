@@ -0,0 +1,1126 @@
+#include "ChainArchive.h"
+#include "BlockChain.h"
+#include "BlockFile.h"
+#include "ByteReader.h"
+#include "ByteWriter.h"
+#include "FixedKeyTable.h"
+#include "FileInterface.h"
+#include "ScopedTime.h"
+#include "SHA256.h"
+#include "logging.h"
+#include "blocks.h"
+#include "CBlockIndex.h"
+#include "snappy.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define BLOCK_MAGIC_ID 0xD9B4BEF9
+#define MAX_BLOCK_LENGTH (1024*1024*32)
+#define BLOCK_HEADER_SIZE 80
+#define ARCHIVE_FILE_ID "CHAINARC"
+#define ARCHIVE_FILE_VERSION 1
+#define ARCHIVE_CHUNK_BYTES (1024*1024*8)	// a chunk is closed once this much encoded block data has been added to it
+#define ARCHIVE_CHUNK_BLOCKS 1024			// and never holds more blocks than this
+
+namespace chainarchive
+{
+
+typedef bytereader::ByteReader< bytereader::Checked > ArchiveReader;
+typedef bytereader::ByteReader< bytereader::Checked > BlockScanner;
+using namespace bytewriter;
+using fixedkeytable::FixedKeyTable;
+
+// How each block is stored in a chunk
+enum class RecordKind : uint8_t
+{
+	encoded,		// Encoded as described below
+	verbatim,		// The raw block, for blocks whose encoding did not reproduce them exactly
+};
+
+// How an output script is stored
+enum class OutputTemplate : uint8_t
+{
+	raw,			// Length and script
+	pubKeyHash,		// OP_DUP OP_HASH160 <20> OP_EQUALVERIFY OP_CHECKSIG
+	scriptHash,		// OP_HASH160 <20> OP_EQUAL
+	witnessKeyHash,	// OP_0 <20>
+	witnessScript,	// OP_0 <32>
+	taproot,		// OP_1 <32>
+	pubKey33,		// <33 byte key> OP_CHECKSIG; the key is a dictionary reference
+	pubKey65,		// <65 byte key> OP_CHECKSIG; the key is a dictionary reference
+};
+
+// How an input script is stored
+enum class InputTemplate : uint8_t
+{
+	raw,			// Length and script
+	keyHashSpend33,	// <signature> <33 byte key>; the signature and a dictionary reference
+	keyHashSpend65,	// <signature> <65 byte key>
+};
+
+// How the witness of an input is stored
+enum class WitnessTemplate : uint8_t
+{
+	empty,			// No witness items
+	raw,			// Item count, then the length and data of each item
+	keyHashSpend,	// Two items; a signature and a 33 byte key, stored as a dictionary reference
+};
+
+// The previous transaction of an input is stored as a varint; one of these or the transaction number plus PREVOUT_NUMBERED
+enum PrevoutKind : uint32_t
+{
+	PREVOUT_COINBASE = 0,	// The null previous output of a coinbase input
+	PREVOUT_LITERAL = 1,	// The 32 byte hash of a transaction which is not numbered follows
+	PREVOUT_NUMBERED = 2,
+};
+
+// The chunk index begins with this header, followed by one ChunkRecord for each chunk
+class ArchiveFileHeader
+{
+public:
+	char		mId[8];
+	uint32_t	mVersion{ARCHIVE_FILE_VERSION};
+	uint32_t	mBlockCount{0};
+	uint32_t	mChunkCount{0};
+	uint32_t	mReserved{0};
+	uint64_t	mTransactionCount{0};
+	uint64_t	mKey33Count{0};
+	uint64_t	mKey65Count{0};
+};
+
+// A chunk of consecutive blocks.  Uncompressed, a chunk is the number of blocks, the offset of each block's
+// record from the start of the chunk, and then the records.
+class ChunkRecord
+{
+public:
+	uint32_t	mFirstBlock{0};
+	uint32_t	mBlockCount{0};
+	uint64_t	mFileOffset{0};			// Location of the compressed chunk in ChainArchive.dat
+	uint32_t	mCompressedLength{0};
+	uint32_t	mRawLength{0};
+	uint64_t	mFirstTransaction{0};	// Number of the first transaction in the chunk
+	uint8_t		mPreviousBlockHash[32];	// Hash of the block before the first block in the chunk
+};
+
+static std::string getArchiveFileName(const char *archiveDir,const char *extension)
+{
+	std::string ret(archiveDir);
+#ifdef _MSC_VER
+	ret += "\\ChainArchive.";
+#else
+	ret += "/ChainArchive.";
+#endif
+	ret += extension;
+	return ret;
+}
+
+// Bitcoin core's CompressAmount; amounts which are round numbers of satoshis become small integers
+static uint64_t compressAmount(uint64_t n)
+{
+	if ( n == 0 )
+	{
+		return 0;
+	}
+	uint32_t e = 0;
+	while ( (n % 10) == 0 && e < 9 )
+	{
+		n /= 10;
+		e++;
+	}
+	if ( e < 9 )
+	{
+		uint32_t d = uint32_t(n % 10);
+		n /= 10;
+		return 1 + (n*9 + d - 1)*10 + e;
+	}
+	return 1 + (n - 1)*10 + 9;
+}
+
+static uint64_t decompressAmount(uint64_t x)
+{
+	if ( x == 0 )
+	{
+		return 0;
+	}
+	x--;
+	uint32_t e = uint32_t(x % 10);
+	x /= 10;
+	uint64_t n = 0;
+	if ( e < 9 )
+	{
+		uint32_t d = uint32_t(x % 9) + 1;
+		x /= 9;
+		n = x*10 + d;
+	}
+	else
+	{
+		n = x + 1;
+	}
+	while ( e )
+	{
+		n *= 10;
+		e--;
+	}
+	return n;
+}
+
+static void hashHeader(const uint8_t *header,uint8_t hash[32])
+{
+	computeDoubleSHA256Header(header,hash);
+}
+
+// The tables a block record refers to; the transaction hashes and the two public key dictionaries
+class ArchiveTables
+{
+public:
+	const uint8_t	*mTransactionHashes{nullptr};
+	uint64_t		mTransactionCount{0};
+	const uint8_t	*mKeys33{nullptr};
+	uint64_t		mKey33Count{0};
+	const uint8_t	*mKeys65{nullptr};
+	uint64_t		mKey65Count{0};
+};
+
+// Copies the next 'length' bytes of the record to the block; nothing if the record is too short
+static void copyBytes(ArchiveReader &r,std::vector< uint8_t > &block,uint64_t length)
+{
+	const uint8_t *data = r.readBytes(length);
+	if ( data )
+	{
+		writeBytes(block,data,size_t(length));
+	}
+}
+
+// Rebuilds the raw block from a block record; returns false if the record is damaged
+static bool decodeBlock(const uint8_t *record,size_t recordLength,const uint8_t previousBlockHash[32],const ArchiveTables &tables,std::vector< uint8_t > &block)
+{
+	block.clear();
+	ArchiveReader r(record,record+recordLength);
+	RecordKind kind = RecordKind(r.readU8());
+	if ( kind == RecordKind::verbatim )
+	{
+		uint64_t length = r.readVarint();
+		const uint8_t *data = r.readBytes(length);
+		if ( r.hasOverflow() )
+		{
+			return false;
+		}
+		writeBytes(block,data,size_t(length));
+		return true;
+	}
+	if ( kind != RecordKind::encoded )
+	{
+		return false;
+	}
+	writeU32(block,r.readU32());
+	writeBytes(block,previousBlockHash,32);
+	copyBytes(r,block,32+4+4+4); // merkle root, time, bits and nonce
+	uint64_t transactionCount = r.readVarint();
+	writeCompactSize(block,transactionCount);
+	std::vector< uint8_t > witness;
+	for (uint64_t i=0; i<transactionCount && !r.hasOverflow(); i++)
+	{
+		writeU32(block,uint32_t(r.readVarint()));
+		bool hasWitness = r.readU8() != 0;
+		if ( hasWitness )
+		{
+			writeU8(block,0); // marker
+			writeU8(block,1); // flag
+		}
+		uint64_t inputCount = r.readVarint();
+		writeCompactSize(block,inputCount);
+		for (uint64_t j=0; j<inputCount && !r.hasOverflow(); j++)
+		{
+			uint64_t prevout = r.readVarint();
+			if ( prevout == PREVOUT_COINBASE )
+			{
+				uint8_t zero[32];
+				memset(zero,0,sizeof(zero));
+				writeBytes(block,zero,32);
+				writeU32(block,0xFFFFFFFF);
+			}
+			else
+			{
+				const uint8_t *hash = nullptr;
+				if ( prevout == PREVOUT_LITERAL )
+				{
+					hash = r.readHash();
+				}
+				else if ( prevout - PREVOUT_NUMBERED < tables.mTransactionCount )
+				{
+					hash = tables.mTransactionHashes + (prevout - PREVOUT_NUMBERED)*32;
+				}
+				else
+				{
+					return false;
+				}
+				writeBytes(block,hash,32);
+				writeU32(block,uint32_t(r.readVarint()));
+			}
+			InputTemplate t = InputTemplate(r.readU8());
+			if ( t == InputTemplate::raw )
+			{
+				uint64_t length = r.readVarint();
+				writeCompactSize(block,length);
+				copyBytes(r,block,length);
+			}
+			else if ( t == InputTemplate::keyHashSpend33 || t == InputTemplate::keyHashSpend65 )
+			{
+				uint32_t keyLength = t == InputTemplate::keyHashSpend33 ? 33 : 65;
+				uint8_t signatureLength = r.readU8();
+				uint64_t key = r.readVarint();
+				const uint8_t *keys = keyLength == 33 ? tables.mKeys33 : tables.mKeys65;
+				if ( key >= (keyLength == 33 ? tables.mKey33Count : tables.mKey65Count) )
+				{
+					return false;
+				}
+				writeCompactSize(block,2+signatureLength+keyLength);
+				writeU8(block,signatureLength);
+				copyBytes(r,block,signatureLength);
+				writeU8(block,uint8_t(keyLength));
+				writeBytes(block,keys+key*keyLength,keyLength);
+			}
+			else
+			{
+				return false;
+			}
+			writeU32(block,0xFFFFFFFF - uint32_t(r.readVarint()));
+		}
+		uint64_t outputCount = r.readVarint();
+		writeCompactSize(block,outputCount);
+		for (uint64_t j=0; j<outputCount && !r.hasOverflow(); j++)
+		{
+			writeU64(block,decompressAmount(r.readVarint()));
+			OutputTemplate t = OutputTemplate(r.readU8());
+			switch ( t )
+			{
+				case OutputTemplate::raw:
+					{
+						uint64_t length = r.readVarint();
+						writeCompactSize(block,length);
+						copyBytes(r,block,length);
+					}
+					break;
+				case OutputTemplate::pubKeyHash:
+					{
+						static const uint8_t prefix[4] = { 25, 0x76, 0xA9, 20 };
+						static const uint8_t suffix[2] = { 0x88, 0xAC };
+						writeBytes(block,prefix,4);
+						copyBytes(r,block,20);
+						writeBytes(block,suffix,2);
+					}
+					break;
+				case OutputTemplate::scriptHash:
+					{
+						static const uint8_t prefix[3] = { 23, 0xA9, 20 };
+						writeBytes(block,prefix,3);
+						copyBytes(r,block,20);
+						writeU8(block,0x87);
+					}
+					break;
+				case OutputTemplate::witnessKeyHash:
+				case OutputTemplate::witnessScript:
+				case OutputTemplate::taproot:
+					{
+						uint32_t length = t == OutputTemplate::witnessKeyHash ? 20 : 32;
+						writeU8(block,uint8_t(length+2));
+						writeU8(block,t == OutputTemplate::taproot ? 0x51 : 0x00);
+						writeU8(block,uint8_t(length));
+						copyBytes(r,block,length);
+					}
+					break;
+				case OutputTemplate::pubKey33:
+				case OutputTemplate::pubKey65:
+					{
+						uint32_t keyLength = t == OutputTemplate::pubKey33 ? 33 : 65;
+						uint64_t key = r.readVarint();
+						if ( key >= (keyLength == 33 ? tables.mKey33Count : tables.mKey65Count) )
+						{
+							return false;
+						}
+						writeU8(block,uint8_t(keyLength+2));
+						writeU8(block,uint8_t(keyLength));
+						writeBytes(block,(keyLength == 33 ? tables.mKeys33 : tables.mKeys65)+key*keyLength,keyLength);
+						writeU8(block,0xAC);
+					}
+					break;
+				default:
+					return false;
+			}
+		}
+		if ( hasWitness )
+		{
+			for (uint64_t j=0; j<inputCount && !r.hasOverflow(); j++)
+			{
+				WitnessTemplate t = WitnessTemplate(r.readU8());
+				if ( t == WitnessTemplate::empty )
+				{
+					writeCompactSize(block,0);
+				}
+				else if ( t == WitnessTemplate::raw )
+				{
+					uint64_t itemCount = r.readVarint();
+					writeCompactSize(block,itemCount);
+					for (uint64_t k=0; k<itemCount && !r.hasOverflow(); k++)
+					{
+						uint64_t length = r.readVarint();
+						writeCompactSize(block,length);
+						copyBytes(r,block,length);
+					}
+				}
+				else if ( t == WitnessTemplate::keyHashSpend )
+				{
+					uint64_t signatureLength = r.readVarint();
+					writeCompactSize(block,2);
+					writeCompactSize(block,signatureLength);
+					copyBytes(r,block,signatureLength);
+					uint64_t key = r.readVarint();
+					if ( key >= tables.mKey33Count )
+					{
+						return false;
+					}
+					writeCompactSize(block,33);
+					writeBytes(block,tables.mKeys33+key*33,33);
+				}
+				else
+				{
+					return false;
+				}
+			}
+		}
+		writeU32(block,uint32_t(r.readVarint()));
+	}
+	return !r.hasOverflow() && r.getRemaining() == 0;
+}
+
+class ChainArchiveWriterImpl : public ChainArchiveWriter
+{
+public:
+	ChainArchiveWriterImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir),
+		mTransactionTable(mTransactionHashes,32), mKey33Table(mKeys33,33), mKey65Table(mKeys65,65)
+	{
+	}
+
+	virtual ~ChainArchiveWriterImpl(void)
+	{
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mVerifyMerkle = state;
+	}
+
+	virtual bool write(const char *archiveDir,uint32_t blockCount,ChainArchiveStats &stats) final
+	{
+		stats = ChainArchiveStats();
+		std::string chunkFileName = getArchiveFileName(archiveDir,"dat");
+		mChunkFile = fi_fopen(chunkFileName.c_str(),"wb",nullptr,0,false);
+		if ( mChunkFile == nullptr )
+		{
+			printf("Failed to open '%s' for write access.\n", chunkFileName.c_str());
+			return false;
+		}
+		mReader.setVerifyMerkle(mVerifyMerkle);
+		Timer t;
+		bool ok = true;
+		for (uint32_t i=0; i<blockCount && ok; i++)
+		{
+			ok = archiveBlock(i,stats);
+			if ( (i % 10000) == 0 && i )
+			{
+				printf("Archived %s of %s blocks; %0.2f MB raw, %0.2f MB of chunks.\n", formatNumber(int32_t(i)), formatNumber(int32_t(blockCount)),
+					double(stats.mRawBytes) / (1024*1024), double(stats.mChunkBytes) / (1024*1024));
+			}
+		}
+		if ( ok )
+		{
+			flushChunk(stats);
+		}
+		ok = fi_ferror(mChunkFile) == 0 && ok;
+		ok = fi_fclose(mChunkFile) == 0 && ok;
+		mChunkFile = nullptr;
+		if ( ok )
+		{
+			ok = writeTables(archiveDir,blockCount,stats);
+		}
+		stats.mBlockCount = ok ? blockCount : 0;
+		stats.mTransactionCount = mTransactionHashes.size() / 32;
+		stats.mKeyCount = mKeys33.size()/33 + mKeys65.size()/65;
+		printf("Archived %s blocks and %s transactions in %0.3f seconds.\n", formatNumber(int32_t(blockCount)), formatNumber(int32_t(stats.mTransactionCount)), t.getElapsedSeconds());
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Returns the raw data of the block at this height, mapped from its block file
+	const uint8_t *getBlockData(uint32_t blockHeight,uint32_t &blockLength,const CBlockIndex *&index)
+	{
+		index = mBlocks->getBlockIndex(blockHeight);
+		if ( index == nullptr || !(index->mBlockStatus & CBlockIndex::BLOCK_HAVE_DATA) || index->mFileOffset < 8 )
+		{
+			return nullptr;
+		}
+		if ( uint32_t(index->mFileIndex) != mMappedFileIndex )
+		{
+			char scratch[512];
+			blockfile::getBlockFileName(mDataDir.c_str(),uint32_t(index->mFileIndex),scratch,sizeof(scratch));
+			mMappedFileIndex = 0xFFFFFFFF;
+			if ( !mMappedFile.open(scratch) )
+			{
+				printf("Failed to open '%s'\n", scratch);
+				return nullptr;
+			}
+			mMappedFileIndex = uint32_t(index->mFileIndex);
+		}
+		uint32_t prefix[2];
+		if ( index->mFileOffset > mMappedFile.getLength() )
+		{
+			return nullptr;
+		}
+		memcpy(prefix,mMappedFile.getData()+index->mFileOffset-8,sizeof(prefix));
+		if ( prefix[0] != BLOCK_MAGIC_ID || prefix[1] < BLOCK_HEADER_SIZE || prefix[1] >= MAX_BLOCK_LENGTH ||
+			 prefix[1] > mMappedFile.getLength() - index->mFileOffset )
+		{
+			return nullptr;
+		}
+		blockLength = prefix[1];
+		return mMappedFile.getData() + index->mFileOffset;
+	}
+
+	bool archiveBlock(uint32_t blockHeight,ChainArchiveStats &stats)
+	{
+		uint32_t blockLength = 0;
+		const CBlockIndex *index = nullptr;
+		const uint8_t *blockData = getBlockData(blockHeight,blockLength,index);
+		if ( blockData == nullptr )
+		{
+			printf("Unable to read block %d; the archive stops before it.\n", blockHeight);
+			return false;
+		}
+		if ( mChunkBlocks.empty() )
+		{
+			mChunkFirstTransaction = mTransactionHashes.size() / 32;
+			memcpy(mChunkPreviousHash,blockData+4,32);
+		}
+		stats.mRawBytes += blockLength;
+		mChunkBlocks.push_back(uint32_t(mChunkRecords.size()));
+
+		size_t recordBegin = mChunkRecords.size();
+		const BlockChain::Block *b = mReader.parse(mDataDir.c_str(),blockData,blockLength,blockHeight,*index);
+		bool encoded = false;
+		if ( b && mVerifyMerkle && b->merkleStatus != BlockChain::MS_VALID )
+		{
+			stats.mMerkleFailures++;
+		}
+		if ( b )
+		{
+			encodeBlock(*b,blockData,stats);
+			// The record must reproduce the block exactly or the block is stored as it is
+			ArchiveTables tables = getTables();
+			encoded = decodeBlock(&mChunkRecords[recordBegin],mChunkRecords.size()-recordBegin,blockData+4,tables,mVerify) &&
+				mVerify.size() == blockLength && memcmp(&mVerify[0],blockData,blockLength) == 0;
+		}
+		if ( !encoded )
+		{
+			mChunkRecords.resize(recordBegin);
+			writeU8(mChunkRecords,uint8_t(RecordKind::verbatim));
+			writeVarint(mChunkRecords,blockLength);
+			writeBytes(mChunkRecords,blockData,blockLength);
+			stats.mVerbatimBlocks++;
+		}
+		if ( mChunkRecords.size() >= ARCHIVE_CHUNK_BYTES || mChunkBlocks.size() >= ARCHIVE_CHUNK_BLOCKS )
+		{
+			flushChunk(stats);
+		}
+		return true;
+	}
+
+	ArchiveTables getTables(void) const
+	{
+		ArchiveTables ret;
+		ret.mTransactionHashes = mTransactionHashes.empty() ? nullptr : &mTransactionHashes[0];
+		ret.mTransactionCount = mTransactionHashes.size() / 32;
+		ret.mKeys33 = mKeys33.empty() ? nullptr : &mKeys33[0];
+		ret.mKey33Count = mKeys33.size() / 33;
+		ret.mKeys65 = mKeys65.empty() ? nullptr : &mKeys65[0];
+		ret.mKey65Count = mKeys65.size() / 65;
+		return ret;
+	}
+
+	// Returns the dictionary number of this public key, adding it if it is new
+	uint64_t getKey(const uint8_t *key,uint32_t keyLength)
+	{
+		std::vector< uint8_t > &keys = keyLength == 33 ? mKeys33 : mKeys65;
+		FixedKeyTable &table = keyLength == 33 ? mKey33Table : mKey65Table;
+		int64_t found = table.find(key);
+		if ( found >= 0 )
+		{
+			return uint64_t(found);
+		}
+		uint32_t ret = uint32_t(keys.size() / keyLength);
+		writeBytes(keys,key,keyLength);
+		table.insert(ret);
+		return ret;
+	}
+
+	void encodeBlock(const BlockChain::Block &b,const uint8_t *blockData,ChainArchiveStats &stats)
+	{
+		std::vector< uint8_t > &out = mChunkRecords;
+		const uint8_t *blockEnd = blockData + b.blockLength;
+		writeU8(out,uint8_t(RecordKind::encoded));
+		writeBytes(out,blockData,4);							// version
+		writeBytes(out,blockData+36,32+4+4+4);				// merkle root, time, bits and nonce
+		writeVarint(out,b.transactionCount);
+		for (uint32_t i=0; i<b.transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b.transactions[i];
+			writeVarint(out,t.transactionVersionNumber);
+			writeU8(out,t.hasWitness ? 1 : 0);
+			writeVarint(out,t.inputCount);
+			for (uint32_t j=0; j<t.inputCount; j++)
+			{
+				const BlockChain::BlockInput &input = t.inputs[j];
+				encodePrevout(input,stats);
+				encodeInputScript(input.responseScript,input.responseScriptLength);
+				writeVarint(out,0xFFFFFFFF - input.sequenceNumber);
+			}
+			writeVarint(out,t.outputCount);
+			for (uint32_t j=0; j<t.outputCount; j++)
+			{
+				writeVarint(out,compressAmount(t.outputs.values[j]));
+				encodeOutputScript(t.outputs.getScript(j),t.outputs.scriptLengths[j]);
+			}
+			if ( t.hasWitness )
+			{
+				for (uint32_t j=0; j<t.inputCount; j++)
+				{
+					encodeWitness(t.inputs[j],blockEnd);
+				}
+			}
+			writeVarint(out,t.lockTime);
+			// Later transactions, in this block as well as later ones, may spend this one
+			uint32_t number = uint32_t(mTransactionHashes.size() / 32);
+			bool duplicate = mTransactionTable.find(t.transactionHash) >= 0;
+			writeBytes(mTransactionHashes,t.transactionHash,32);
+			if ( !duplicate )
+			{
+				mTransactionTable.insert(number);
+			}
+		}
+	}
+
+	void encodePrevout(const BlockChain::BlockInput &input,ChainArchiveStats &stats)
+	{
+		std::vector< uint8_t > &out = mChunkRecords;
+		bool nullHash = true;
+		for (uint32_t i=0; i<32 && nullHash; i++)
+		{
+			nullHash = input.transactionHash[i] == 0;
+		}
+		if ( nullHash && input.transactionIndex == 0xFFFFFFFF )
+		{
+			writeVarint(out,PREVOUT_COINBASE);
+			return;
+		}
+		int64_t number = mTransactionTable.find(input.transactionHash);
+		if ( number >= 0 )
+		{
+			writeVarint(out,uint64_t(number) + PREVOUT_NUMBERED);
+		}
+		else
+		{
+			writeVarint(out,PREVOUT_LITERAL);
+			writeBytes(out,input.transactionHash,32);
+			stats.mLiteralPrevouts++;
+		}
+		writeVarint(out,input.transactionIndex);
+	}
+
+	void encodeInputScript(const uint8_t *script,uint32_t length)
+	{
+		std::vector< uint8_t > &out = mChunkRecords;
+		// <signature> <public key> with both pushed by a single byte opcode
+		if ( length > 2 && script[0] >= 1 && script[0] <= 75 && uint32_t(script[0]) + 2 < length )
+		{
+			uint32_t signatureLength = script[0];
+			uint32_t keyLength = script[signatureLength+1];
+			if ( (keyLength == 33 || keyLength == 65) && signatureLength + 2 + keyLength == length )
+			{
+				writeU8(out,uint8_t(keyLength == 33 ? InputTemplate::keyHashSpend33 : InputTemplate::keyHashSpend65));
+				writeU8(out,uint8_t(signatureLength));
+				writeVarint(out,getKey(script+signatureLength+2,keyLength));
+				writeBytes(out,script+1,signatureLength);
+				return;
+			}
+		}
+		writeU8(out,uint8_t(InputTemplate::raw));
+		writeVarint(out,length);
+		writeBytes(out,script,length);
+	}
+
+	void encodeOutputScript(const uint8_t *script,uint32_t length)
+	{
+		std::vector< uint8_t > &out = mChunkRecords;
+		if ( length == 25 && script[0] == 0x76 && script[1] == 0xA9 && script[2] == 20 && script[23] == 0x88 && script[24] == 0xAC )
+		{
+			writeU8(out,uint8_t(OutputTemplate::pubKeyHash));
+			writeBytes(out,script+3,20);
+		}
+		else if ( length == 23 && script[0] == 0xA9 && script[1] == 20 && script[22] == 0x87 )
+		{
+			writeU8(out,uint8_t(OutputTemplate::scriptHash));
+			writeBytes(out,script+2,20);
+		}
+		else if ( length == 22 && script[0] == 0x00 && script[1] == 20 )
+		{
+			writeU8(out,uint8_t(OutputTemplate::witnessKeyHash));
+			writeBytes(out,script+2,20);
+		}
+		else if ( length == 34 && (script[0] == 0x00 || script[0] == 0x51) && script[1] == 32 )
+		{
+			writeU8(out,uint8_t(script[0] == 0x00 ? OutputTemplate::witnessScript : OutputTemplate::taproot));
+			writeBytes(out,script+2,32);
+		}
+		else if ( (length == 35 || length == 67) && script[0] == length-2 && script[length-1] == 0xAC )
+		{
+			uint32_t keyLength = length-2;
+			writeU8(out,uint8_t(keyLength == 33 ? OutputTemplate::pubKey33 : OutputTemplate::pubKey65));
+			writeVarint(out,getKey(script+1,keyLength));
+		}
+		else
+		{
+			writeU8(out,uint8_t(OutputTemplate::raw));
+			writeVarint(out,length);
+			if ( length )
+			{
+				writeBytes(out,script,length);
+			}
+		}
+	}
+
+	void encodeWitness(const BlockChain::BlockInput &input,const uint8_t *blockEnd)
+	{
+		std::vector< uint8_t > &out = mChunkRecords;
+		if ( input.witnessCount == 0 )
+		{
+			writeU8(out,uint8_t(WitnessTemplate::empty));
+			return;
+		}
+		BlockScanner scan(input.witness,blockEnd);
+		if ( input.witnessCount == 2 )
+		{
+			uint64_t signatureLength = scan.readCompactSize();
+			const uint8_t *signature = scan.readBytes(signatureLength);
+			uint64_t keyLength = scan.readCompactSize();
+			const uint8_t *key = scan.readBytes(keyLength);
+			if ( !scan.hasOverflow() && keyLength == 33 )
+			{
+				writeU8(out,uint8_t(WitnessTemplate::keyHashSpend));
+				writeVarint(out,signatureLength);
+				writeBytes(out,signature,size_t(signatureLength));
+				writeVarint(out,getKey(key,33));
+				return;
+			}
+			scan.setBuffer(input.witness,blockEnd);
+		}
+		writeU8(out,uint8_t(WitnessTemplate::raw));
+		writeVarint(out,input.witnessCount);
+		for (uint32_t i=0; i<input.witnessCount; i++)
+		{
+			uint64_t length = scan.readCompactSize();
+			const uint8_t *item = scan.readBytes(length);
+			writeVarint(out,length);
+			writeBytes(out,item,size_t(length));
+		}
+	}
+
+	// Compress the current chunk and append it to the chunk file
+	void flushChunk(ChainArchiveStats &stats)
+	{
+		if ( mChunkBlocks.empty() )
+		{
+			return;
+		}
+		uint32_t blockCount = uint32_t(mChunkBlocks.size());
+		uint32_t headerLength = 4 + blockCount*4;
+		mChunkRaw.clear();
+		writeU32(mChunkRaw,blockCount);
+		for (auto &i:mChunkBlocks)
+		{
+			writeU32(mChunkRaw,headerLength + i);
+		}
+		writeBytes(mChunkRaw,&mChunkRecords[0],mChunkRecords.size());
+		snappy::Compress((const char *)&mChunkRaw[0],mChunkRaw.size(),&mCompressed);
+
+		ChunkRecord c;
+		c.mFirstBlock = mNextBlock;
+		c.mBlockCount = blockCount;
+		c.mFileOffset = fi_ftell(mChunkFile);
+		c.mCompressedLength = uint32_t(mCompressed.size());
+		c.mRawLength = uint32_t(mChunkRaw.size());
+		c.mFirstTransaction = mChunkFirstTransaction;
+		memcpy(c.mPreviousBlockHash,mChunkPreviousHash,32);
+		fi_fwrite(mCompressed.c_str(),mCompressed.size(),1,mChunkFile);
+		mChunks.push_back(c);
+		stats.mChunkBytes += mCompressed.size();
+		mNextBlock += blockCount;
+		mChunkBlocks.clear();
+		mChunkRecords.clear();
+	}
+
+	bool writeTable(const char *archiveDir,const char *extension,const void *data,size_t length,ChainArchiveStats &stats)
+	{
+		std::string fileName = getArchiveFileName(archiveDir,extension);
+		FILE_INTERFACE *fph = fi_fopen(fileName.c_str(),"wb",nullptr,0,false);
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s' for write access.\n", fileName.c_str());
+			return false;
+		}
+		bool ok = length == 0 || fi_fwrite(data,length,1,fph) == 1;
+		ok = fi_fclose(fph) == 0 && ok;
+		stats.mArchiveBytes += length;
+		return ok;
+	}
+
+	bool writeTables(const char *archiveDir,uint32_t blockCount,ChainArchiveStats &stats)
+	{
+		ArchiveFileHeader h;
+		memcpy(h.mId,ARCHIVE_FILE_ID,8);
+		h.mBlockCount = blockCount;
+		h.mChunkCount = uint32_t(mChunks.size());
+		h.mTransactionCount = mTransactionHashes.size() / 32;
+		h.mKey33Count = mKeys33.size() / 33;
+		h.mKey65Count = mKeys65.size() / 65;
+		std::vector< uint8_t > index;
+		writeBytes(index,&h,sizeof(h));
+		if ( !mChunks.empty() )
+		{
+			writeBytes(index,&mChunks[0],mChunks.size()*sizeof(ChunkRecord));
+		}
+		stats.mArchiveBytes += stats.mChunkBytes;
+		return writeTable(archiveDir,"txid",mTransactionHashes.empty() ? nullptr : &mTransactionHashes[0],mTransactionHashes.size(),stats) &&
+			writeTable(archiveDir,"k33",mKeys33.empty() ? nullptr : &mKeys33[0],mKeys33.size(),stats) &&
+			writeTable(archiveDir,"k65",mKeys65.empty() ? nullptr : &mKeys65[0],mKeys65.size(),stats) &&
+			writeTable(archiveDir,"idx",&index[0],index.size(),stats); // the index goes last; a partial archive has none
+	}
+
+	const blocks::Blocks		*mBlocks{nullptr};
+	std::string					mDataDir;
+	bool						mVerifyMerkle{false};
+	blockfile::BlockReader		mReader;
+	blockfile::MappedFile		mMappedFile;
+	uint32_t					mMappedFileIndex{0xFFFFFFFF};
+	FILE_INTERFACE				*mChunkFile{nullptr};
+	std::vector< uint8_t >		mTransactionHashes;		// Every transaction hash so far, in transaction number order
+	std::vector< uint8_t >		mKeys33;				// The public key dictionaries
+	std::vector< uint8_t >		mKeys65;
+	FixedKeyTable				mTransactionTable;
+	FixedKeyTable				mKey33Table;
+	FixedKeyTable				mKey65Table;
+	std::vector< ChunkRecord >	mChunks;
+	std::vector< uint32_t >		mChunkBlocks;			// Offset of each block's record in the chunk being built
+	std::vector< uint8_t >		mChunkRecords;			// The records of the chunk being built
+	std::vector< uint8_t >		mChunkRaw;				// The chunk being compressed
+	std::vector< uint8_t >		mVerify;				// A block rebuilt from its record
+	std::string					mCompressed;
+	uint32_t					mNextBlock{0};			// Height of the first block of the chunk being built
+	uint64_t					mChunkFirstTransaction{0};
+	uint8_t						mChunkPreviousHash[32];
+};
+
+class ChainArchiveImpl : public ChainArchive
+{
+public:
+	ChainArchiveImpl(void)
+	{
+	}
+
+	virtual ~ChainArchiveImpl(void)
+	{
+		FILE_INTERFACE *files[] = { mChunkFile, mTransactionFile, mKey33File, mKey65File };
+		for (auto &f:files)
+		{
+			if ( f )
+			{
+				fi_fclose(f);
+			}
+		}
+	}
+
+	bool open(const char *archiveDir)
+	{
+		std::string indexFileName = getArchiveFileName(archiveDir,"idx");
+		FILE_INTERFACE *fph = fi_fopen(indexFileName.c_str(),"rb",nullptr,0,false);
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s'\n", indexFileName.c_str());
+			return false;
+		}
+		ArchiveFileHeader h;
+		bool ok = fi_fread(&h,sizeof(h),1,fph) == 1 && memcmp(h.mId,ARCHIVE_FILE_ID,8) == 0 && h.mVersion == ARCHIVE_FILE_VERSION;
+		if ( ok )
+		{
+			mHeader = h;
+			mChunks.resize(h.mChunkCount);
+			ok = h.mChunkCount == 0 || fi_fread(&mChunks[0],sizeof(ChunkRecord)*h.mChunkCount,1,fph) == 1;
+		}
+		fi_fclose(fph);
+		if ( !ok )
+		{
+			printf("'%s' is not a valid chain archive index.\n", indexFileName.c_str());
+			return false;
+		}
+		mChunkFile = openMapped(archiveDir,"dat",mChunks.empty() ? 0 : mChunks.back().mFileOffset + mChunks.back().mCompressedLength);
+		mTransactionFile = openMapped(archiveDir,"txid",h.mTransactionCount*32);
+		mKey33File = openMapped(archiveDir,"k33",h.mKey33Count*33);
+		mKey65File = openMapped(archiveDir,"k65",h.mKey65Count*65);
+		if ( !mChunkFile || !mTransactionFile || !mKey33File || !mKey65File )
+		{
+			return false;
+		}
+		mTables.mTransactionHashes = static_cast< const uint8_t *>(fi_getMemBuffer(mTransactionFile,nullptr));
+		mTables.mTransactionCount = h.mTransactionCount;
+		mTables.mKeys33 = static_cast< const uint8_t *>(fi_getMemBuffer(mKey33File,nullptr));
+		mTables.mKey33Count = h.mKey33Count;
+		mTables.mKeys65 = static_cast< const uint8_t *>(fi_getMemBuffer(mKey65File,nullptr));
+		mTables.mKey65Count = h.mKey65Count;
+		fi_fadvise(mChunkFile,0,fi_getFileLength(mChunkFile),FA_SEQUENTIAL);
+		return true;
+	}
+
+	virtual uint32_t getBlockCount(void) const final
+	{
+		return mHeader.mBlockCount;
+	}
+
+	virtual uint64_t getTransactionCount(void) const final
+	{
+		return mHeader.mTransactionCount;
+	}
+
+	virtual const uint8_t *getTransactionHash(uint64_t transactionNumber) const final
+	{
+		return transactionNumber < mTables.mTransactionCount ? mTables.mTransactionHashes + transactionNumber*32 : nullptr;
+	}
+
+	virtual bool readBlock(uint32_t blockHeight,std::vector< uint8_t > &blockData) final
+	{
+		if ( blockHeight >= mHeader.mBlockCount || mChunks.empty() )
+		{
+			return false;
+		}
+		// Find the chunk holding this height
+		uint32_t lo = 0;
+		uint32_t hi = uint32_t(mChunks.size());
+		while ( hi - lo > 1 )
+		{
+			uint32_t mid = (lo+hi)/2;
+			if ( mChunks[mid].mFirstBlock <= blockHeight )
+			{
+				lo = mid;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		if ( !loadChunk(lo) )
+		{
+			return false;
+		}
+		const ChunkRecord &c = mChunks[lo];
+		uint32_t first = blockHeight - c.mFirstBlock;
+		if ( first >= c.mBlockCount )
+		{
+			return false;
+		}
+		// The previous block hash of each block is the hash of the header before it; reading in order only hashes one header
+		uint8_t previousHash[32];
+		uint32_t start = 0;
+		if ( mLastHeight + 1 == blockHeight && mLastHeight >= c.mFirstBlock && mLastHeight != 0xFFFFFFFF )
+		{
+			memcpy(previousHash,mLastHash,32);
+			start = first;
+		}
+		else
+		{
+			memcpy(previousHash,c.mPreviousBlockHash,32);
+		}
+		for (uint32_t i=start; i<=first; i++)
+		{
+			const uint8_t *record = nullptr;
+			size_t recordLength = 0;
+			if ( !getRecord(c,i,record,recordLength) )
+			{
+				return false;
+			}
+			if ( i == first )
+			{
+				if ( !decodeBlock(record,recordLength,previousHash,mTables,blockData) )
+				{
+					return false;
+				}
+				hashHeader(&blockData[0],mLastHash);
+				mLastHeight = blockHeight;
+				return true;
+			}
+			uint8_t header[BLOCK_HEADER_SIZE];
+			if ( !getRecordHeader(record,recordLength,previousHash,header) )
+			{
+				return false;
+			}
+			hashHeader(header,previousHash);
+		}
+		return false;
+	}
+
+	virtual uint64_t getBytesRead(void) const final
+	{
+		return mBytesRead;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	FILE_INTERFACE *openMapped(const char *archiveDir,const char *extension,uint64_t expectedLength)
+	{
+		std::string fileName = getArchiveFileName(archiveDir,extension);
+		FILE_INTERFACE *ret = fi_fopen(fileName.c_str(),"rb",nullptr,0,true);
+		// An empty table need not be mapped; some platforms cannot map an empty file
+		if ( ret && expectedLength && (!fi_usesMemoryMappedFile(ret) || fi_getFileLength(ret) < expectedLength) )
+		{
+			fi_fclose(ret);
+			ret = nullptr;
+		}
+		if ( ret == nullptr )
+		{
+			printf("Failed to map '%s'\n", fileName.c_str());
+		}
+		return ret;
+	}
+
+	bool loadChunk(uint32_t chunkIndex)
+	{
+		if ( chunkIndex == mLoadedChunk )
+		{
+			return true;
+		}
+		mLoadedChunk = 0xFFFFFFFF;
+		const ChunkRecord &c = mChunks[chunkIndex];
+		uint64_t fileLength = 0;
+		const char *data = static_cast< const char *>(fi_getMemBuffer(mChunkFile,&fileLength));
+		if ( data == nullptr || c.mFileOffset > fileLength || c.mCompressedLength > fileLength - c.mFileOffset )
+		{
+			return false;
+		}
+		mChunk.resize(c.mRawLength);
+		size_t length = 0;
+		if ( !snappy::GetUncompressedLength(data+c.mFileOffset,c.mCompressedLength,&length) || length != c.mRawLength ||
+			 !snappy::RawUncompress(data+c.mFileOffset,c.mCompressedLength,(char *)&mChunk[0]) )
+		{
+			return false;
+		}
+		mBytesRead += c.mCompressedLength;
+		mLoadedChunk = chunkIndex;
+		return true;
+	}
+
+	// Locate the record of this block of the loaded chunk
+	bool getRecord(const ChunkRecord &c,uint32_t index,const uint8_t *&record,size_t &recordLength) const
+	{
+		uint32_t headerLength = 4 + c.mBlockCount*4;
+		if ( mChunk.size() < headerLength )
+		{
+			return false;
+		}
+		uint32_t begin;
+		uint32_t end = uint32_t(mChunk.size());
+		memcpy(&begin,&mChunk[4+index*4],4);
+		if ( index+1 < c.mBlockCount )
+		{
+			memcpy(&end,&mChunk[4+(index+1)*4],4);
+		}
+		if ( begin < headerLength || begin > end || end > mChunk.size() )
+		{
+			return false;
+		}
+		record = &mChunk[begin];
+		recordLength = end - begin;
+		return true;
+	}
+
+	// Rebuild just the header of a block record
+	static bool getRecordHeader(const uint8_t *record,size_t recordLength,const uint8_t previousHash[32],uint8_t header[BLOCK_HEADER_SIZE])
+	{
+		ArchiveReader r(record,record+recordLength);
+		RecordKind kind = RecordKind(r.readU8());
+		if ( kind == RecordKind::verbatim )
+		{
+			r.readVarint();
+			const uint8_t *data = r.readBytes(BLOCK_HEADER_SIZE);
+			if ( data == nullptr )
+			{
+				return false;
+			}
+			memcpy(header,data,BLOCK_HEADER_SIZE);
+			return true;
+		}
+		const uint8_t *version = r.readBytes(4);
+		const uint8_t *rest = r.readBytes(44);
+		if ( kind != RecordKind::encoded || rest == nullptr )
+		{
+			return false;
+		}
+		memcpy(header,version,4);
+		memcpy(header+4,previousHash,32);
+		memcpy(header+36,rest,44);
+		return true;
+	}
+
+	ArchiveFileHeader			mHeader;
+	std::vector< ChunkRecord >	mChunks;
+	ArchiveTables				mTables;
+	FILE_INTERFACE				*mChunkFile{nullptr};
+	FILE_INTERFACE				*mTransactionFile{nullptr};
+	FILE_INTERFACE				*mKey33File{nullptr};
+	FILE_INTERFACE				*mKey65File{nullptr};
+	std::vector< uint8_t >		mChunk;					// The uncompressed chunk most recently read
+	uint32_t					mLoadedChunk{0xFFFFFFFF};
+	uint32_t					mLastHeight{0xFFFFFFFF};	// The height and hash of the block most recently read
+	uint8_t						mLastHash[32];
+	uint64_t					mBytesRead{0};
+};
+
+ChainArchiveWriter *ChainArchiveWriter::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new ChainArchiveWriterImpl(blocks,dataDir);
+	return static_cast< ChainArchiveWriter *>(ret);
+}
+
+ChainArchive *ChainArchive::create(const char *archiveDir)
+{
+	auto ret = new ChainArchiveImpl;
+	if ( !ret->open(archiveDir) )
+	{
+		delete ret;
+		ret = nullptr;
+	}
+	return static_cast< ChainArchive *>(ret);
+}
+
+}
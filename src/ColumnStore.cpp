@@ -0,0 +1,617 @@
+#include "ColumnStore.h"
+#include "BlockChain.h"
+#include "BlockFile.h"
+#include "ByteWriter.h"
+#include "FixedKeyTable.h"
+#include "FileInterface.h"
+#include "ScopedTime.h"
+#include "logging.h"
+#include "blocks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define COLUMN_STORE_ID "COLSTORE"
+#define COLUMN_STORE_VERSION 1
+#define COLUMN_CHUNK_ALIGNMENT 8	// chunks start on this boundary in their column file
+
+namespace columnstore
+{
+
+using fixedkeytable::FixedKeyTable;
+
+#define COLUMN_COUNT uint32_t(Column::last)
+#define TABLE_COUNT uint32_t(Table::last)
+
+static const char *gColumnNames[COLUMN_COUNT] =
+{
+	"txHeight",
+	"txVersion",
+	"txLockTime",
+	"txSize",
+	"txInputCount",
+	"txOutputCount",
+	"txWitness",
+	"inputTransaction",
+	"inputPrevTx",
+	"inputPrevIndex",
+	"inputSequence",
+	"inputScriptSize",
+	"inputWitnessCount",
+	"outputTransaction",
+	"outputValue",
+	"outputKeyType",
+	"outputScriptSize",
+	"outputHashId",
+};
+
+// The store index begins with this header, followed by 'mPartitionCount' Partition records and then a ChunkRecord
+// for every column of every partition, partition by partition
+class StoreFileHeader
+{
+public:
+	char		mId[8];
+	uint32_t	mVersion{COLUMN_STORE_VERSION};
+	uint32_t	mBlockCount{0};
+	uint32_t	mPartitionCount{0};
+	uint32_t	mColumnCount{COLUMN_COUNT};
+	uint64_t	mRowCount[TABLE_COUNT];
+	uint64_t	mHashCount{0};
+};
+
+class ChunkRecord
+{
+public:
+	uint64_t	mFileOffset{0};		// Location of the chunk in its column file
+	uint64_t	mBase{0};
+	uint64_t	mMax{0};
+	uint32_t	mWidth{0};
+	uint32_t	mReserved{0};
+};
+
+static std::string getStoreFileName(const char *storeDir,const char *extension)
+{
+	std::string ret(storeDir);
+#ifdef _MSC_VER
+	ret += "\\ColumnStore.";
+#else
+	ret += "/ColumnStore.";
+#endif
+	ret += extension;
+	return ret;
+}
+
+Table ColumnStore::getTable(Column c)
+{
+	if ( c < Column::inputTransaction )
+	{
+		return Table::transactions;
+	}
+	return c < Column::outputTransaction ? Table::inputs : Table::outputs;
+}
+
+const char *ColumnStore::getColumnName(Column c)
+{
+	return c < Column::last ? gColumnNames[uint32_t(c)] : "unknown";
+}
+
+class ColumnStoreWriterImpl : public ColumnStoreWriter
+{
+public:
+	ColumnStoreWriterImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir),
+		mTransactionTable(mTransactionHashes,32), mHashTable(mOutputHashes,32)
+	{
+		for (auto &i:mColumnFiles)
+		{
+			i = nullptr;
+		}
+	}
+
+	virtual ~ColumnStoreWriterImpl(void)
+	{
+		closeColumnFiles();
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mVerifyMerkle = state;
+	}
+
+	virtual bool write(const char *storeDir,uint32_t blockCount,uint32_t partitionBlocks,ColumnStoreStats &stats) final
+	{
+		stats = ColumnStoreStats();
+		for (uint32_t i=0; i<COLUMN_COUNT; i++)
+		{
+			std::string fileName = getStoreFileName(storeDir,gColumnNames[i]);
+			mColumnFiles[i] = fi_fopen(fileName.c_str(),"wb",nullptr,0,false);
+			if ( mColumnFiles[i] == nullptr )
+			{
+				printf("Failed to open '%s' for write access.\n", fileName.c_str());
+				closeColumnFiles();
+				return false;
+			}
+		}
+		mReader.setVerifyMerkle(mVerifyMerkle);
+		if ( partitionBlocks == 0 )
+		{
+			partitionBlocks = 1;
+		}
+		Timer t;
+		bool ok = true;
+		for (uint32_t i=0; i<blockCount && ok; i++)
+		{
+			const BlockChain::Block *b = mReader.read(mBlocks,mDataDir.c_str(),i);
+			if ( b == nullptr )
+			{
+				printf("Unable to read block %d; the store stops before it.\n", i);
+				ok = false;
+				break;
+			}
+			stats.mRawBytes += mReader.getData().size();
+			if ( mVerifyMerkle && b->merkleStatus != BlockChain::MS_VALID )
+			{
+				stats.mMerkleFailures++;
+			}
+			addBlock(*b,i);
+			if ( (i+1-mPartition.mFirstBlock) == partitionBlocks || (i+1) == blockCount )
+			{
+				flushPartition(i+1);
+			}
+			if ( (i % 10000) == 0 && i )
+			{
+				printf("Exported %s of %s blocks.\n", formatNumber(int32_t(i)), formatNumber(int32_t(blockCount)));
+			}
+		}
+		for (uint32_t i=0; i<COLUMN_COUNT; i++)
+		{
+			stats.mColumnBytes += fi_ftell(mColumnFiles[i]);
+			ok = fi_ferror(mColumnFiles[i]) == 0 && ok;
+		}
+		ok = closeColumnFiles() && ok;
+		if ( ok )
+		{
+			ok = writeTables(storeDir,blockCount,stats);
+		}
+		stats.mBlockCount = ok ? blockCount : 0;
+		stats.mTransactionCount = mRowCount[uint32_t(Table::transactions)];
+		stats.mInputCount = mRowCount[uint32_t(Table::inputs)];
+		stats.mOutputCount = mRowCount[uint32_t(Table::outputs)];
+		stats.mHashCount = mOutputHashes.size() / 32;
+		printf("Exported %s blocks and %s transactions in %0.3f seconds.\n", formatNumber(int32_t(blockCount)), formatNumber(int32_t(stats.mTransactionCount)), t.getElapsedSeconds());
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	bool closeColumnFiles(void)
+	{
+		bool ok = true;
+		for (auto &i:mColumnFiles)
+		{
+			if ( i )
+			{
+				ok = fi_fclose(i) == 0 && ok;
+				i = nullptr;
+			}
+		}
+		return ok;
+	}
+
+	inline void add(Column c,uint64_t value)
+	{
+		mValues[uint32_t(c)].push_back(value);
+	}
+
+	void addBlock(const BlockChain::Block &b,uint32_t blockHeight)
+	{
+		for (uint32_t i=0; i<b.transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b.transactions[i];
+			uint64_t transaction = mRowCount[uint32_t(Table::transactions)] + mValues[uint32_t(Column::txHeight)].size();
+			add(Column::txHeight,blockHeight);
+			add(Column::txVersion,t.transactionVersionNumber);
+			add(Column::txLockTime,t.lockTime);
+			add(Column::txSize,t.transactionLength);
+			add(Column::txInputCount,t.inputCount);
+			add(Column::txOutputCount,t.outputCount);
+			add(Column::txWitness,t.hasWitness ? 1 : 0);
+			for (uint32_t j=0; j<t.inputCount; j++)
+			{
+				const BlockChain::BlockInput &input = t.inputs[j];
+				int64_t prev = mTransactionTable.find(input.transactionHash);
+				add(Column::inputTransaction,transaction);
+				add(Column::inputPrevTx,uint64_t(prev+1));
+				add(Column::inputPrevIndex,input.transactionIndex);
+				add(Column::inputSequence,input.sequenceNumber);
+				add(Column::inputScriptSize,input.responseScriptLength);
+				add(Column::inputWitnessCount,input.witnessCount);
+			}
+			for (uint32_t j=0; j<t.outputCount; j++)
+			{
+				add(Column::outputTransaction,transaction);
+				add(Column::outputValue,t.outputs.values[j]);
+				add(Column::outputKeyType,t.outputs.keyTypes[j]);
+				add(Column::outputScriptSize,t.outputs.scriptLengths[j]);
+				add(Column::outputHashId,t.outputs.keyCounts[j] ? getHashId(t.outputs.hashes[j].hash)+1 : 0);
+			}
+			// Numbered after its inputs are resolved, so a duplicate transaction hash keeps its first number
+			uint32_t number = uint32_t(mTransactionHashes.size() / 32);
+			bool duplicate = mTransactionTable.find(t.transactionHash) >= 0;
+			bytewriter::writeBytes(mTransactionHashes,t.transactionHash,32);
+			if ( !duplicate )
+			{
+				mTransactionTable.insert(number);
+			}
+		}
+	}
+
+	uint64_t getHashId(const uint8_t *hash)
+	{
+		int64_t found = mHashTable.find(hash);
+		if ( found >= 0 )
+		{
+			return uint64_t(found);
+		}
+		uint32_t ret = uint32_t(mOutputHashes.size() / 32);
+		bytewriter::writeBytes(mOutputHashes,hash,32);
+		mHashTable.insert(ret);
+		return ret;
+	}
+
+	// Encode and write one chunk of every column, then start the next partition at 'nextBlock'
+	void flushPartition(uint32_t nextBlock)
+	{
+		mPartition.mBlockCount = nextBlock - mPartition.mFirstBlock;
+		for (uint32_t t=0; t<TABLE_COUNT; t++)
+		{
+			mPartition.mFirstRow[t] = mRowCount[t];
+		}
+		mPartition.mRowCount[uint32_t(Table::transactions)] = mValues[uint32_t(Column::txHeight)].size();
+		mPartition.mRowCount[uint32_t(Table::inputs)] = mValues[uint32_t(Column::inputTransaction)].size();
+		mPartition.mRowCount[uint32_t(Table::outputs)] = mValues[uint32_t(Column::outputTransaction)].size();
+		for (uint32_t i=0; i<COLUMN_COUNT; i++)
+		{
+			std::vector< uint64_t > &values = mValues[i];
+			ChunkRecord c;
+			c.mFileOffset = fi_ftell(mColumnFiles[i]);
+			if ( !values.empty() )
+			{
+				c.mBase = values[0];
+				c.mMax = values[0];
+				for (auto &v:values)
+				{
+					c.mBase = v < c.mBase ? v : c.mBase;
+					c.mMax = v > c.mMax ? v : c.mMax;
+				}
+			}
+			uint64_t range = c.mMax - c.mBase;
+			c.mWidth = range == 0 ? 0 : range <= 0xFF ? 1 : range <= 0xFFFF ? 2 : range <= 0xFFFFFFFF ? 4 : 8;
+			mEncoded.clear();
+			mEncoded.reserve(values.size()*c.mWidth + COLUMN_CHUNK_ALIGNMENT);
+			for (auto &v:values)
+			{
+				uint64_t d = v - c.mBase;
+				for (uint32_t k=0; k<c.mWidth; k++)
+				{
+					mEncoded.push_back(uint8_t(d >> (k*8)));
+				}
+			}
+			while ( mEncoded.size() % COLUMN_CHUNK_ALIGNMENT )
+			{
+				mEncoded.push_back(0);
+			}
+			if ( !mEncoded.empty() )
+			{
+				fi_fwrite(&mEncoded[0],mEncoded.size(),1,mColumnFiles[i]);
+			}
+			mChunks.push_back(c);
+			values.clear();
+		}
+		for (uint32_t t=0; t<TABLE_COUNT; t++)
+		{
+			mRowCount[t] += mPartition.mRowCount[t];
+		}
+		mPartitions.push_back(mPartition);
+		mPartition.mFirstBlock = nextBlock;
+	}
+
+	bool writeTable(const char *storeDir,const char *extension,const void *data,size_t length,ColumnStoreStats &stats)
+	{
+		std::string fileName = getStoreFileName(storeDir,extension);
+		FILE_INTERFACE *fph = fi_fopen(fileName.c_str(),"wb",nullptr,0,false);
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s' for write access.\n", fileName.c_str());
+			return false;
+		}
+		bool ok = length == 0 || fi_fwrite(data,length,1,fph) == 1;
+		ok = fi_fclose(fph) == 0 && ok;
+		stats.mColumnBytes += length;
+		return ok;
+	}
+
+	bool writeTables(const char *storeDir,uint32_t blockCount,ColumnStoreStats &stats)
+	{
+		StoreFileHeader h;
+		memcpy(h.mId,COLUMN_STORE_ID,8);
+		h.mBlockCount = blockCount;
+		h.mPartitionCount = uint32_t(mPartitions.size());
+		for (uint32_t t=0; t<TABLE_COUNT; t++)
+		{
+			h.mRowCount[t] = mRowCount[t];
+		}
+		h.mHashCount = mOutputHashes.size() / 32;
+		std::vector< uint8_t > index;
+		bytewriter::writeBytes(index,&h,sizeof(h));
+		if ( !mPartitions.empty() )
+		{
+			bytewriter::writeBytes(index,&mPartitions[0],mPartitions.size()*sizeof(Partition));
+			bytewriter::writeBytes(index,&mChunks[0],mChunks.size()*sizeof(ChunkRecord));
+		}
+		return writeTable(storeDir,"txid",mTransactionHashes.empty() ? nullptr : &mTransactionHashes[0],mTransactionHashes.size(),stats) &&
+			writeTable(storeDir,"hash",mOutputHashes.empty() ? nullptr : &mOutputHashes[0],mOutputHashes.size(),stats) &&
+			writeTable(storeDir,"idx",&index[0],index.size(),stats); // the index goes last; a partial store has none
+	}
+
+	const blocks::Blocks		*mBlocks{nullptr};
+	std::string					mDataDir;
+	bool						mVerifyMerkle{false};
+	blockfile::BlockReader		mReader;
+	FILE_INTERFACE				*mColumnFiles[COLUMN_COUNT];
+	std::vector< uint64_t >		mValues[COLUMN_COUNT];	// The rows of the partition being built
+	std::vector< uint8_t >		mEncoded;
+	uint64_t					mRowCount[TABLE_COUNT]{};	// Rows in the partitions already written
+	Partition					mPartition;
+	std::vector< Partition >	mPartitions;
+	std::vector< ChunkRecord >	mChunks;
+	std::vector< uint8_t >		mTransactionHashes;		// Every transaction hash, in transaction number order
+	std::vector< uint8_t >		mOutputHashes;			// Every distinct output hash, in hash id order
+	FixedKeyTable				mTransactionTable;
+	FixedKeyTable				mHashTable;
+};
+
+class ColumnStoreImpl : public ColumnStore
+{
+public:
+	ColumnStoreImpl(void)
+	{
+		for (auto &i:mColumnFiles)
+		{
+			i = nullptr;
+		}
+		for (auto &i:mColumnData)
+		{
+			i = nullptr;
+		}
+	}
+
+	virtual ~ColumnStoreImpl(void)
+	{
+		for (auto &i:mColumnFiles)
+		{
+			if ( i )
+			{
+				fi_fclose(i);
+			}
+		}
+		if ( mTransactionFile )
+		{
+			fi_fclose(mTransactionFile);
+		}
+		if ( mHashFile )
+		{
+			fi_fclose(mHashFile);
+		}
+	}
+
+	bool open(const char *storeDir)
+	{
+		std::string indexFileName = getStoreFileName(storeDir,"idx");
+		FILE_INTERFACE *fph = fi_fopen(indexFileName.c_str(),"rb",nullptr,0,false);
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s'\n", indexFileName.c_str());
+			return false;
+		}
+		bool ok = fi_fread(&mHeader,sizeof(mHeader),1,fph) == 1 && memcmp(mHeader.mId,COLUMN_STORE_ID,8) == 0 &&
+			mHeader.mVersion == COLUMN_STORE_VERSION && mHeader.mColumnCount == COLUMN_COUNT;
+		if ( ok && mHeader.mPartitionCount )
+		{
+			mPartitions.resize(mHeader.mPartitionCount);
+			mChunks.resize(size_t(mHeader.mPartitionCount)*COLUMN_COUNT);
+			ok = fi_fread(&mPartitions[0],sizeof(Partition)*mPartitions.size(),1,fph) == 1 &&
+				fi_fread(&mChunks[0],sizeof(ChunkRecord)*mChunks.size(),1,fph) == 1;
+		}
+		fi_fclose(fph);
+		if ( !ok )
+		{
+			printf("'%s' is not a valid column store index.\n", indexFileName.c_str());
+			return false;
+		}
+		for (uint32_t i=0; i<COLUMN_COUNT && ok; i++)
+		{
+			uint64_t length = 0;
+			for (uint32_t p=0; p<mHeader.mPartitionCount; p++)
+			{
+				const ChunkRecord &c = mChunks[p*COLUMN_COUNT+i];
+				uint64_t end = c.mFileOffset + c.mWidth*mPartitions[p].mRowCount[uint32_t(getTable(Column(i)))];
+				length = end > length ? end : length;
+			}
+			ok = openMapped(storeDir,gColumnNames[i],length,mColumnFiles[i],mColumnData[i]);
+		}
+		const uint8_t *data = nullptr;
+		ok = ok && openMapped(storeDir,"txid",mHeader.mRowCount[uint32_t(Table::transactions)]*32,mTransactionFile,data);
+		mTransactionHashes = data;
+		ok = ok && openMapped(storeDir,"hash",mHeader.mHashCount*32,mHashFile,data);
+		mOutputHashes = data;
+		return ok;
+	}
+
+	virtual uint32_t getBlockCount(void) const final
+	{
+		return mHeader.mBlockCount;
+	}
+
+	virtual uint64_t getRowCount(Table t) const final
+	{
+		return t < Table::last ? mHeader.mRowCount[uint32_t(t)] : 0;
+	}
+
+	virtual uint32_t getPartitionCount(void) const final
+	{
+		return mHeader.mPartitionCount;
+	}
+
+	virtual const Partition &getPartition(uint32_t index) const final
+	{
+		return mPartitions[index];
+	}
+
+	virtual bool getChunk(Column c,uint32_t partition,ColumnChunk &chunk) const final
+	{
+		if ( c >= Column::last || partition >= mHeader.mPartitionCount )
+		{
+			return false;
+		}
+		const ChunkRecord &r = mChunks[partition*COLUMN_COUNT+uint32_t(c)];
+		chunk.mData = r.mWidth ? mColumnData[uint32_t(c)] + r.mFileOffset : nullptr;
+		chunk.mWidth = r.mWidth;
+		chunk.mBase = r.mBase;
+		chunk.mMax = r.mMax;
+		chunk.mRowCount = mPartitions[partition].mRowCount[uint32_t(getTable(c))];
+		return true;
+	}
+
+	virtual bool readChunk(Column c,uint32_t partition,std::vector< uint64_t > &values) const final
+	{
+		ColumnChunk chunk;
+		if ( !getChunk(c,partition,chunk) )
+		{
+			return false;
+		}
+		values.resize(size_t(chunk.mRowCount));
+		uint64_t *dest = values.empty() ? nullptr : &values[0];
+		size_t count = values.size();
+		// One loop per width so each is a simple widening copy the compiler can vectorize
+		switch ( chunk.mWidth )
+		{
+			case 0:
+				for (size_t i=0; i<count; i++)
+				{
+					dest[i] = chunk.mBase;
+				}
+				break;
+			case 1:
+				for (size_t i=0; i<count; i++)
+				{
+					dest[i] = chunk.mBase + chunk.mData[i];
+				}
+				break;
+			case 2:
+				for (size_t i=0; i<count; i++)
+				{
+					uint16_t v;
+					memcpy(&v,chunk.mData+i*2,2);
+					dest[i] = chunk.mBase + v;
+				}
+				break;
+			case 4:
+				for (size_t i=0; i<count; i++)
+				{
+					uint32_t v;
+					memcpy(&v,chunk.mData+i*4,4);
+					dest[i] = chunk.mBase + v;
+				}
+				break;
+			default:
+				for (size_t i=0; i<count; i++)
+				{
+					uint64_t v;
+					memcpy(&v,chunk.mData+i*8,8);
+					dest[i] = chunk.mBase + v;
+				}
+				break;
+		}
+		return true;
+	}
+
+	virtual const uint8_t *getTransactionHash(uint64_t transaction) const final
+	{
+		return transaction < mHeader.mRowCount[uint32_t(Table::transactions)] ? mTransactionHashes + transaction*32 : nullptr;
+	}
+
+	virtual const uint8_t *getOutputHash(uint64_t hashId) const final
+	{
+		return hashId < mHeader.mHashCount ? mOutputHashes + hashId*32 : nullptr;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Map a column or table file which must hold at least 'expectedLength' bytes; files with nothing to read need not be mapped
+	bool openMapped(const char *storeDir,const char *extension,uint64_t expectedLength,FILE_INTERFACE *&file,const uint8_t *&data)
+	{
+		file = nullptr;
+		data = nullptr;
+		if ( expectedLength == 0 )
+		{
+			return true;
+		}
+		std::string fileName = getStoreFileName(storeDir,extension);
+		file = fi_fopen(fileName.c_str(),"rb",nullptr,0,true);
+		if ( file && fi_usesMemoryMappedFile(file) && fi_getFileLength(file) >= expectedLength )
+		{
+			data = static_cast< const uint8_t *>(fi_getMemBuffer(file,nullptr));
+			return true;
+		}
+		if ( file )
+		{
+			fi_fclose(file);
+			file = nullptr;
+		}
+		printf("Failed to map '%s'\n", fileName.c_str());
+		return false;
+	}
+
+	StoreFileHeader				mHeader;
+	std::vector< Partition >	mPartitions;
+	std::vector< ChunkRecord >	mChunks;					// Indexed by partition*COLUMN_COUNT + column
+	FILE_INTERFACE				*mColumnFiles[COLUMN_COUNT];
+	const uint8_t				*mColumnData[COLUMN_COUNT];
+	FILE_INTERFACE				*mTransactionFile{nullptr};
+	FILE_INTERFACE				*mHashFile{nullptr};
+	const uint8_t				*mTransactionHashes{nullptr};
+	const uint8_t				*mOutputHashes{nullptr};
+};
+
+ColumnStoreWriter *ColumnStoreWriter::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new ColumnStoreWriterImpl(blocks,dataDir);
+	return static_cast< ColumnStoreWriter *>(ret);
+}
+
+ColumnStore *ColumnStore::create(const char *storeDir)
+{
+	auto ret = new ColumnStoreImpl;
+	if ( !ret->open(storeDir) )
+	{
+		delete ret;
+		ret = nullptr;
+	}
+	return static_cast< ColumnStore *>(ret);
+}
+
+}
@@ -5,10 +5,32 @@
 #include "rand.h"
 #include "Blocks.h"
 #include "ParseBlock.h"
+#include "BlockCache.h"
+#include "StressTest.h"
+#include "DecodeTest.h"
+#include "BlockFsck.h"
+#include "BlockFileIndex.h"
+#include "TextMiner.h"
+#include "ChainArchive.h"
+#include "ColumnStore.h"
+#include "BlockFilter.h"
+#include "ChainAnalysis.h"
+#include "UtxoSet.h"
+#include "BitcoinAddress.h"
+#include "HexCodec.h"
+#include "HashBench.h"
+#include "Base58Bench.h"
+#include "Bech32Bench.h"
+#include "ThreadPool.h"
+#include "BlockChain.h"
+#include "logging.h"
+#include "BlockFile.h"
+#include "ScopedTime.h"
 #include "CBlockIndex.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream> 
 #include <string> 
 #include <assert.h>
@@ -21,6 +43,8 @@
 
 #define SAFE_RELEASE(x) if ( x ) { x->release(); x = nullptr; }
 
+#define DEFAULT_CACHE_MEGABYTES 512
+
 namespace commands
 {
 
@@ -49,15 +73,47 @@ public:
 		mCommands["help"] = CommandType::help;
 		mCommands["bye"] = CommandType::bye;
 		mCommands["block"] = CommandType::block;
+		mCommands["threads"] = CommandType::threads;
+		mCommands["cache"] = CommandType::cache;
+		mCommands["stress"] = CommandType::stress;
+		mCommands["fuzz"] = CommandType::fuzz;
+		mCommands["decodebench"] = CommandType::decodebench;
+		mCommands["fsck"] = CommandType::fsck;
+		mCommands["textmine"] = CommandType::textmine;
+		mCommands["archive"] = CommandType::archive;
+		mCommands["columns"] = CommandType::columns;
+		mCommands["filters"] = CommandType::filters;
+		mCommands["hashbench"] = CommandType::hashbench;
+		mCommands["base58bench"] = CommandType::base58bench;
+		mCommands["bech32bench"] = CommandType::bech32bench;
+		mCommands["merkle"] = CommandType::merkle;
+		mCommands["analyse"] = CommandType::analyse;
+		mCommands["utxo"] = CommandType::utxo;
 
 		printf("Enter a command. Type 'help' for help. Type 'bye' to exit.\n");
 
-		mBlocks = blocks::Blocks::create(mIndexDir.c_str());
+		// Without bitcoin core's LevelDB block index, for example with a copy of just the block files,
+		// the index is built from the block files themselves
+		std::string indexCurrent = mIndexDir + "/CURRENT";
+		FILE *fph = fopen(indexCurrent.c_str(),"rb");
+		if ( fph )
+		{
+			fclose(fph);
+			mBlocks = blocks::Blocks::create(mIndexDir.c_str());
+		}
+		else
+		{
+			printf("No block index found in '%s'; indexing the block files instead.\n", mIndexDir.c_str());
+			mBlocks = blockfileindex::BlockFileIndex::create(mBlocksDir.c_str(),mThreadCount);
+		}
+		mBlockCache = blockcache::BlockCache::create(mBlocks,mBlocksDir.c_str(),uint64_t(DEFAULT_CACHE_MEGABYTES)*1024*1024);
+		mBlockCache->setDecodeThreadCount(mThreadCount);
 
 	}
 
 	virtual ~CommandsImpl(void)
 	{
+		SAFE_RELEASE(mBlockCache);
 		SAFE_RELEASE(mBlocks);
 	}
 
@@ -93,6 +149,32 @@ public:
 				case CommandType::help:
 					printf("bye        : Exit application\n");
 					printf("block <n>  : Parse bitcoin block at this block height\n");
+					printf("threads <n>: Number of threads used to decode a block (0=all cores, 1=serial)\n");
+					printf("cache      : Show block cache statistics\n");
+					printf("cache <mb> : Set the block cache memory budget in megabytes\n");
+					printf("cache compress <on|off> : Keep evicted blocks snappy compressed\n");
+					printf("cache prefetch <n>      : Number of neighbouring blocks loaded in the background (0=off)\n");
+					printf("stress <threads> <first> <count> : Parse blocks on many threads and verify they match a serial parse\n");
+					printf("fuzz <block> <iterations> [seed] : Parse damaged copies of a block and check the integer decoders\n");
+					printf("decodebench <first> <count>      : Measure decoder throughput and the time to parse a range of blocks\n");
+					printf("fsck [threads]                   : Check every blk file for damage and find blocks missing from the index\n");
+					printf("textmine <minLength> [first] [count] : Find embedded text in the blocks and write it to TextReport.txt\n");
+					printf("archive <dir> [count]                : Convert the first count blocks into a compact archive in this directory\n");
+					printf("archive verify <dir> [first] [count] : Rebuild blocks from the archive and compare them with the block files\n");
+					printf("columns <dir> [count] [partitionBlocks] : Export the first count blocks as transaction, input and output column files\n");
+					printf("columns scan <dir> [minValue]           : Scan the output value and script type columns on every thread\n");
+					printf("filters <dir> [count]                   : Build the BIP158 compact filter of each of the first count blocks\n");
+					printf("filters match <dir> <address|script>... : Find the blocks which pay to or spend from these addresses or hex scripts\n");
+					printf("hashbench [megabytes]                   : Measure and cross check every SHA256 implementation this processor supports\n");
+					printf("base58bench [count]                     : Measure and cross check encoding and decoding addresses with each base58 codec\n");
+					printf("bech32bench [count]                     : Check the Bech32/Bech32m codec against the BIP173/350 vectors and measure it\n");
+					printf("merkle <on|off>                         : Check the merkle root and witness commitment of every block parsed\n");
+					printf("analyse [first] [count]                 : Run every chain analyser over a range of blocks in a single pass\n");
+					printf("analyse separate [first] [count]        : Run each analyser in a pass of its own, for comparison\n");
+					printf("utxo <dir> [count]                      : Number every output of the first count blocks and write the UTXO set\n");
+					printf("utxo supply <dir> [height]              : Count the unspent outputs and their value at a height\n");
+					printf("utxo balance <dir> <height|tip> <address|script>... : Show the balance and unspent outputs of each script\n");
+					printf("utxo tx <dir> <txid> [height]           : Show the outputs of a transaction and whether each is spent\n");
 					break;
 				case CommandType::block:
 					if ( argc >= 2 )
@@ -103,8 +185,8 @@ public:
 							const CBlockIndex *cbi = mBlocks->getBlockIndex(block);
 							if ( cbi )
 							{
-								parseblock::ParseBlock *pb = parseblock::ParseBlock::create();
-								pb->parseBlock(*cbi,mBlocksDir.c_str());
+								parseblock::ParseBlock *pb = parseblock::ParseBlock::create(mBlockCache);
+								pb->parseBlock(*cbi);
 								pb->release();
 							}
 							else
@@ -122,6 +204,210 @@ public:
 						printf("Usage: block <blockNumber>\n");
 					}
 					break;
+				case CommandType::threads:
+					if ( argc >= 2 )
+					{
+						int threadCount = atoi(argv[1]);
+						if ( threadCount >= 0 )
+						{
+							mThreadCount = uint32_t(threadCount);
+							mBlockCache->setDecodeThreadCount(mThreadCount);
+							printf("Blocks will be decoded using %s threads.\n", mThreadCount ? argv[1] : "all available");
+						}
+						else
+						{
+							printf("Invalid thread count:%s\n", argv[1]);
+						}
+					}
+					else
+					{
+						printf("Usage: threads <threadCount>\n");
+					}
+					break;
+				case CommandType::cache:
+					processCache(argc,argv);
+					break;
+				case CommandType::stress:
+					if ( argc >= 4 )
+					{
+						int threadCount = atoi(argv[1]);
+						int first = atoi(argv[2]);
+						int count = atoi(argv[3]);
+						if ( threadCount > 0 && first >= 0 && count > 0 && (first+count) <= (int)mBlocks->getBlockHeight() )
+						{
+							stresstest::StressTest *st = stresstest::StressTest::create(mBlocks,mBlocksDir.c_str());
+							bool ok = st->run(uint32_t(threadCount),uint32_t(first),uint32_t(count));
+							printf("Stress test %s.\n", ok ? "passed" : "FAILED");
+							st->release();
+						}
+						else
+						{
+							printf("Invalid stress test arguments.\n");
+						}
+					}
+					else
+					{
+						printf("Usage: stress <threadCount> <firstBlock> <blockCount>\n");
+					}
+					break;
+				case CommandType::fuzz:
+					if ( argc >= 3 )
+					{
+						int block = atoi(argv[1]);
+						int iterations = atoi(argv[2]);
+						int seed = argc >= 4 ? atoi(argv[3]) : 1;
+						if ( block >= 0 && block < (int)mBlocks->getBlockHeight() && iterations > 0 )
+						{
+							decodetest::DecodeTest *dt = decodetest::DecodeTest::create(mBlocks,mBlocksDir.c_str());
+							bool ok = dt->fuzz(uint32_t(block),uint32_t(iterations),uint32_t(seed));
+							printf("Fuzz test %s.\n", ok ? "passed" : "FAILED");
+							dt->release();
+						}
+						else
+						{
+							printf("Invalid fuzz test arguments.\n");
+						}
+					}
+					else
+					{
+						printf("Usage: fuzz <blockNumber> <iterations> [seed]\n");
+					}
+					break;
+				case CommandType::decodebench:
+					if ( argc >= 3 )
+					{
+						int first = atoi(argv[1]);
+						int count = atoi(argv[2]);
+						if ( first >= 0 && count > 0 && (first+count) <= (int)mBlocks->getBlockHeight() )
+						{
+							decodetest::DecodeTest *dt = decodetest::DecodeTest::create(mBlocks,mBlocksDir.c_str());
+							dt->benchmark(uint32_t(first),uint32_t(count));
+							dt->release();
+						}
+						else
+						{
+							printf("Invalid block range.\n");
+						}
+					}
+					else
+					{
+						printf("Usage: decodebench <firstBlock> <blockCount>\n");
+					}
+					break;
+				case CommandType::fsck:
+					{
+						int threadCount = argc >= 2 ? atoi(argv[1]) : 0;
+						if ( threadCount >= 0 )
+						{
+							blockfsck::BlockFsck *fsck = blockfsck::BlockFsck::create(mBlocks,mBlocksDir.c_str());
+							bool ok = fsck->run(uint32_t(threadCount),"BlockFsckReport.txt");
+							printf("Block file check %s.\n", ok ? "passed" : "found damage");
+							fsck->release();
+						}
+						else
+						{
+							printf("Usage: fsck [threadCount]\n");
+						}
+					}
+					break;
+				case CommandType::textmine:
+					if ( argc >= 2 )
+					{
+						int minLength = atoi(argv[1]);
+						int first = argc >= 3 ? atoi(argv[2]) : 0;
+						int count = argc >= 4 ? atoi(argv[3]) : int(mBlocks->getBlockHeight()) - first;
+						if ( minLength > 0 && first >= 0 && count > 0 && (first+count) <= (int)mBlocks->getBlockHeight() )
+						{
+							textminer::TextMiner *tm = textminer::TextMiner::create(mBlocks,mBlocksDir.c_str());
+							tm->setVerifyMerkle(mVerifyMerkle);
+							tm->run(mThreadCount,uint32_t(minLength),uint32_t(first),uint32_t(count),"TextReport.txt");
+							tm->release();
+						}
+						else
+						{
+							printf("Invalid text mining arguments.\n");
+						}
+					}
+					else
+					{
+						printf("Usage: textmine <minLength> [firstBlock] [blockCount]\n");
+					}
+					break;
+				case CommandType::archive:
+					processArchive(argc,argv);
+					break;
+				case CommandType::columns:
+					processColumns(argc,argv);
+					break;
+				case CommandType::filters:
+					processFilters(argc,argv);
+					break;
+				case CommandType::hashbench:
+					{
+						int megabytes = argc >= 2 ? atoi(argv[1]) : 64;
+						if ( megabytes > 0 )
+						{
+							hashbench::HashBench *hb = hashbench::HashBench::create();
+							bool ok = hb->run(uint32_t(megabytes));
+							printf("Hash benchmark %s.\n", ok ? "passed" : "FAILED");
+							hb->release();
+						}
+						else
+						{
+							printf("Usage: hashbench [megabytes]\n");
+						}
+					}
+					break;
+				case CommandType::base58bench:
+					{
+						int count = argc >= 2 ? atoi(argv[1]) : 1000000;
+						if ( count > 0 )
+						{
+							base58bench::Base58Bench *bb = base58bench::Base58Bench::create();
+							bool ok = bb->run(uint32_t(count));
+							printf("Base58 benchmark %s.\n", ok ? "passed" : "FAILED");
+							bb->release();
+						}
+						else
+						{
+							printf("Usage: base58bench [count]\n");
+						}
+					}
+					break;
+				case CommandType::bech32bench:
+					{
+						int count = argc >= 2 ? atoi(argv[1]) : 1000000;
+						if ( count > 0 )
+						{
+							bech32bench::Bech32Bench *bb = bech32bench::Bech32Bench::create();
+							bool ok = bb->run(uint32_t(count));
+							printf("Bech32 benchmark %s.\n", ok ? "passed" : "FAILED");
+							bb->release();
+						}
+						else
+						{
+							printf("Usage: bech32bench [count]\n");
+						}
+					}
+					break;
+				case CommandType::merkle:
+					if ( argc >= 2 && (strcmp(argv[1],"on") == 0 || strcmp(argv[1],"off") == 0) )
+					{
+						mVerifyMerkle = strcmp(argv[1],"on") == 0;
+						mBlockCache->setVerifyMerkle(mVerifyMerkle);
+						printf("Merkle verification is %s.\n", mVerifyMerkle ? "on" : "off");
+					}
+					else
+					{
+						printf("Usage: merkle <on|off>\n");
+					}
+					break;
+				case CommandType::analyse:
+					processAnalyse(argc,argv);
+					break;
+				case CommandType::utxo:
+					processUtxo(argc,argv);
+					break;
 				case CommandType::last:
 					printf("Unknown command: %s\n", argv[0]);
 					break;
@@ -134,6 +420,662 @@ public:
 		return ret;
 	}
 
+	void processArchive(uint64_t argc,const char **argv)
+	{
+		if ( argc >= 3 && strcmp(argv[1],"verify") == 0 )
+		{
+			chainarchive::ChainArchive *ca = chainarchive::ChainArchive::create(argv[2]);
+			if ( ca == nullptr )
+			{
+				return;
+			}
+			int first = argc >= 4 ? atoi(argv[3]) : 0;
+			int count = argc >= 5 ? atoi(argv[4]) : int(ca->getBlockCount()) - first;
+			if ( first >= 0 && count > 0 && (first+count) <= (int)ca->getBlockCount() && (first+count) <= (int)mBlocks->getBlockHeight() )
+			{
+				std::vector< uint8_t > archived;
+				std::vector< uint8_t > original;
+				uint32_t mismatches = 0;
+				uint64_t rawBytes = 0;
+				double archiveTime = 0;
+				Timer t;
+				for (int i=first; i<(first+count); i++)
+				{
+					t.getElapsedSeconds();
+					bool ok = ca->readBlock(uint32_t(i),archived);
+					archiveTime += t.getElapsedSeconds();
+					const CBlockIndex *cbi = mBlocks->getBlockIndex(uint32_t(i));
+					if ( !ok || cbi == nullptr || !blockfile::readBlockData(*cbi,mBlocksDir.c_str(),original) || archived != original )
+					{
+						if ( mismatches < 10 )
+						{
+							printf("Block %d does not match the block files.\n", i);
+						}
+						mismatches++;
+					}
+					rawBytes += original.size();
+				}
+				printf("Rebuilt %s blocks in %0.3f seconds; %0.2f MB of blocks from %0.2f MB of archive reads (%0.2f times smaller).\n",
+					formatNumber(count), archiveTime, double(rawBytes) / (1024*1024), double(ca->getBytesRead()) / (1024*1024),
+					ca->getBytesRead() ? double(rawBytes) / double(ca->getBytesRead()) : 0.0);
+				printf("Archive verify %s; %d mismatched blocks.\n", mismatches ? "FAILED" : "passed", mismatches);
+			}
+			else
+			{
+				printf("Invalid block range.\n");
+			}
+			ca->release();
+		}
+		else if ( argc >= 2 )
+		{
+			int count = argc >= 3 ? atoi(argv[2]) : int(mBlocks->getBlockHeight());
+			if ( count > 0 && count <= (int)mBlocks->getBlockHeight() )
+			{
+				chainarchive::ChainArchiveStats stats;
+				chainarchive::ChainArchiveWriter *w = chainarchive::ChainArchiveWriter::create(mBlocks,mBlocksDir.c_str());
+				w->setVerifyMerkle(mVerifyMerkle);
+				bool ok = w->write(argv[1],uint32_t(count),stats);
+				w->release();
+				if ( ok )
+				{
+					printf("Blocks          : %s\n", formatNumber(int32_t(stats.mBlockCount)));
+					printf("Transactions    : %s\n", formatNumber(int32_t(stats.mTransactionCount)));
+					printf("Raw blocks      : %0.2f MB\n", double(stats.mRawBytes) / (1024*1024));
+					printf("Archive         : %0.2f MB (%0.2f MB of compressed chunks)\n", double(stats.mArchiveBytes) / (1024*1024), double(stats.mChunkBytes) / (1024*1024));
+					printf("Ratio           : %0.2f\n", stats.mArchiveBytes ? double(stats.mRawBytes) / double(stats.mArchiveBytes) : 0.0);
+					printf("Public keys     : %s\n", formatNumber(int32_t(stats.mKeyCount)));
+					printf("Literal prevouts: %s\n", formatNumber(int32_t(stats.mLiteralPrevouts)));
+					printf("Verbatim blocks : %s\n", formatNumber(int32_t(stats.mVerbatimBlocks)));
+					if ( mVerifyMerkle )
+					{
+						printf("Merkle failures : %s\n", formatNumber(int32_t(stats.mMerkleFailures)));
+					}
+				}
+				else
+				{
+					printf("Failed to write the archive.\n");
+				}
+			}
+			else
+			{
+				printf("Invalid block count.\n");
+			}
+		}
+		else
+		{
+			printf("Usage: archive <dir> [blockCount] or archive verify <dir> [firstBlock] [blockCount]\n");
+		}
+	}
+
+	// Runs the built in analysers over a range of blocks; all of them in one pass, or each in a pass of its own to
+	// show what fusing them saves
+	void processAnalyse(uint64_t argc,const char **argv)
+	{
+		bool separate = argc >= 2 && strcmp(argv[1],"separate") == 0;
+		uint32_t arg = separate ? 2 : 1;
+		int first = argc > arg ? atoi(argv[arg]) : 0;
+		int count = argc > arg+1 ? atoi(argv[arg+1]) : int(mBlocks->getBlockHeight()) - first;
+		if ( first < 0 || count <= 0 || (first+count) > (int)mBlocks->getBlockHeight() )
+		{
+			printf("Usage: analyse [separate] [firstBlock] [blockCount]\n");
+			return;
+		}
+		std::vector< chainanalysis::Analyser *> analysers;
+		analysers.push_back(chainanalysis::createBlockAnalyser());
+		analysers.push_back(chainanalysis::createTransactionAnalyser());
+		analysers.push_back(chainanalysis::createInputAnalyser());
+		analysers.push_back(chainanalysis::createKeyTypeAnalyser());
+		analysers.push_back(chainanalysis::createOutputValueAnalyser());
+
+		chainanalysis::ChainAnalysis *ca = chainanalysis::ChainAnalysis::create(mBlocks,mBlocksDir.c_str());
+		ca->setVerifyMerkle(mVerifyMerkle);
+		chainanalysis::ChainAnalysisStats stats;
+		double seconds = 0;
+		uint32_t passCount = separate ? uint32_t(analysers.size()) : 1;
+		for (uint32_t i=0; i<passCount; i++)
+		{
+			ca->clearAnalysers();
+			if ( separate )
+			{
+				ca->addAnalyser(analysers[i]);
+			}
+			else
+			{
+				for (auto &a:analysers)
+				{
+					ca->addAnalyser(a);
+				}
+			}
+			ca->run(mThreadCount,uint32_t(first),uint32_t(count),stats);
+			seconds += stats.mSeconds;
+			if ( separate )
+			{
+				printf("%s: %0.3f seconds\n", analysers[i]->getName(), stats.mSeconds);
+			}
+		}
+		ca->release();
+
+		for (auto &a:analysers)
+		{
+			printf("\n%s\n", a->getName());
+			a->report();
+			a->release();
+		}
+		printf("\nAnalysed %s blocks (%0.2f MB, %llu transactions, %llu inputs, %llu outputs); %d could not be read.\n",
+			formatNumber(int32_t(stats.mBlockCount)), double(stats.mRawBytes) / (1024*1024), (unsigned long long)stats.mTransactionCount,
+			(unsigned long long)stats.mInputCount, (unsigned long long)stats.mOutputCount, stats.mFailedCount);
+		if ( mVerifyMerkle )
+		{
+			printf("%d blocks failed merkle verification.\n", stats.mMerkleFailures);
+		}
+		printf("%d analysers in %d %s took %0.3f seconds (%0.2f MB/s).\n", int(analysers.size()), passCount, passCount == 1 ? "pass" : "passes",
+			seconds, seconds > 0 ? double(stats.mRawBytes) * passCount / (1024*1024) / seconds : 0);
+	}
+
+	void processColumns(uint64_t argc,const char **argv)
+	{
+		if ( argc >= 3 && strcmp(argv[1],"scan") == 0 )
+		{
+			columnstore::ColumnStore *cs = columnstore::ColumnStore::create(argv[2]);
+			if ( cs )
+			{
+				scanColumns(cs,argc >= 4 ? uint64_t(atoll(argv[3])) : 0);
+				cs->release();
+			}
+		}
+		else if ( argc >= 2 )
+		{
+			int count = argc >= 3 ? atoi(argv[2]) : int(mBlocks->getBlockHeight());
+			int partitionBlocks = argc >= 4 ? atoi(argv[3]) : 1000;
+			if ( count > 0 && count <= (int)mBlocks->getBlockHeight() && partitionBlocks > 0 )
+			{
+				columnstore::ColumnStoreStats stats;
+				columnstore::ColumnStoreWriter *w = columnstore::ColumnStoreWriter::create(mBlocks,mBlocksDir.c_str());
+				w->setVerifyMerkle(mVerifyMerkle);
+				bool ok = w->write(argv[1],uint32_t(count),uint32_t(partitionBlocks),stats);
+				w->release();
+				if ( ok )
+				{
+					printf("Blocks       : %s\n", formatNumber(int32_t(stats.mBlockCount)));
+					printf("Transactions : %s\n", formatNumber(int32_t(stats.mTransactionCount)));
+					printf("Inputs       : %s\n", formatNumber(int32_t(stats.mInputCount)));
+					printf("Outputs      : %s\n", formatNumber(int32_t(stats.mOutputCount)));
+					printf("Output hashes: %s\n", formatNumber(int32_t(stats.mHashCount)));
+					printf("Raw blocks   : %0.2f MB\n", double(stats.mRawBytes) / (1024*1024));
+					printf("Column files : %0.2f MB\n", double(stats.mColumnBytes) / (1024*1024));
+					if ( mVerifyMerkle )
+					{
+						printf("Merkle fails : %s\n", formatNumber(int32_t(stats.mMerkleFailures)));
+					}
+				}
+				else
+				{
+					printf("Failed to write the column store.\n");
+				}
+			}
+			else
+			{
+				printf("Invalid block count.\n");
+			}
+		}
+		else
+		{
+			printf("Usage: columns <dir> [blockCount] [partitionBlocks] or columns scan <dir> [minValue]\n");
+		}
+	}
+
+	void processFilters(uint64_t argc,const char **argv)
+	{
+		if ( argc >= 4 && strcmp(argv[1],"match") == 0 )
+		{
+			blockfilter::BlockFilters *bf = blockfilter::BlockFilters::create(argv[2]);
+			if ( bf )
+			{
+				matchFilters(bf,uint32_t(argc-3),argv+3);
+				bf->release();
+			}
+		}
+		else if ( argc >= 2 && strcmp(argv[1],"match") != 0 )
+		{
+			int count = argc >= 3 ? atoi(argv[2]) : int(mBlocks->getBlockHeight());
+			if ( count > 0 && count <= (int)mBlocks->getBlockHeight() )
+			{
+				blockfilter::BlockFilterStats stats;
+				blockfilter::BlockFilterWriter *w = blockfilter::BlockFilterWriter::create(mBlocksDir.c_str());
+				w->setVerifyMerkle(mVerifyMerkle);
+				bool ok = w->write(argv[1],uint32_t(count),stats);
+				w->release();
+				if ( ok )
+				{
+					printf("Blocks          : %s\n", formatNumber(int32_t(stats.mBlockCount)));
+					printf("Scripts         : %s\n", formatNumber(int32_t(stats.mElementCount)));
+					printf("Raw blocks      : %0.2f MB\n", double(stats.mRawBytes) / (1024*1024));
+					printf("Filters         : %0.2f MB (%0.2f bits per script)\n", double(stats.mFilterBytes) / (1024*1024),
+						stats.mElementCount ? double(stats.mFilterBytes*8) / double(stats.mElementCount) : 0.0);
+					printf("Unresolved spends: %s\n", formatNumber(int32_t(stats.mUnresolvedInputs)));
+					if ( mVerifyMerkle )
+					{
+						printf("Merkle failures : %s\n", formatNumber(int32_t(stats.mMerkleFailures)));
+					}
+				}
+				else
+				{
+					printf("Failed to write the block filters.\n");
+				}
+			}
+			else
+			{
+				printf("Invalid block count.\n");
+			}
+		}
+		else
+		{
+			printf("Usage: filters <dir> [blockCount] or filters match <dir> <address|hexScript>...\n");
+		}
+	}
+
+	void processUtxo(uint64_t argc,const char **argv)
+	{
+		if ( argc >= 3 && (strcmp(argv[1],"supply") == 0 || strcmp(argv[1],"balance") == 0 || strcmp(argv[1],"tx") == 0) )
+		{
+			utxo::UtxoSet *us = utxo::UtxoSet::create(argv[2]);
+			if ( us )
+			{
+				queryUtxo(us,uint32_t(argc-1),argv+1);
+				us->release();
+			}
+		}
+		else if ( argc >= 2 )
+		{
+			int count = argc >= 3 ? atoi(argv[2]) : int(mBlocks->getBlockHeight());
+			if ( count > 0 && count <= (int)mBlocks->getBlockHeight() )
+			{
+				utxo::UtxoWriterStats stats;
+				utxo::UtxoWriter *w = utxo::UtxoWriter::create(mBlocks,mBlocksDir.c_str());
+				w->setVerifyMerkle(mVerifyMerkle);
+				bool ok = w->write(argv[1],uint32_t(count),stats);
+				w->release();
+				if ( ok )
+				{
+					printf("Blocks          : %s\n", formatNumber(int32_t(stats.mBlockCount)));
+					printf("Transactions    : %llu\n", (unsigned long long)stats.mTransactionCount);
+					printf("Outputs         : %llu (%llu unspent, %llu values over 31 bits)\n", (unsigned long long)stats.mOutputCount,
+						(unsigned long long)stats.mUnspentCount, (unsigned long long)stats.mLargeValueCount);
+					printf("Inputs          : %llu (%llu unresolved)\n", (unsigned long long)stats.mInputCount, (unsigned long long)stats.mUnresolvedInputs);
+					printf("Reused txids    : %llu\n", (unsigned long long)stats.mDuplicateTransactions);
+					printf("Peak live txs   : %llu\n", (unsigned long long)stats.mPeakLiveTransactions);
+					printf("Raw blocks      : %0.2f MB; spent bits %0.2f MB\n", double(stats.mRawBytes) / (1024*1024), double(stats.mOutputCount) / (8*1024*1024));
+				}
+				else
+				{
+					printf("Failed to write the UTXO set.\n");
+				}
+			}
+			else
+			{
+				printf("Invalid block count.\n");
+			}
+		}
+		else
+		{
+			printf("Usage: utxo <dir> [blockCount] or utxo supply|balance|tx <dir> ...\n");
+		}
+	}
+
+	// Moves the set to the height named by 'arg'; a block height or 'tip' for the last height
+	bool setUtxoHeight(utxo::UtxoSet *us,const char *arg)
+	{
+		uint32_t height = strcmp(arg,"tip") == 0 ? us->getBlockCount() : uint32_t(atoi(arg));
+		if ( atoi(arg) < 0 || !us->setHeight(height) )
+		{
+			printf("Invalid height; the set covers heights 0 to %d.\n", us->getBlockCount());
+			return false;
+		}
+		return true;
+	}
+
+	// 'args' begins with the query; supply, balance or tx, followed by the set's directory
+	void queryUtxo(utxo::UtxoSet *us,uint32_t argc,const char **args)
+	{
+		Timer t;
+		if ( strcmp(args[0],"supply") == 0 )
+		{
+			if ( argc >= 3 && !setUtxoHeight(us,args[2]) )
+			{
+				return;
+			}
+			double seekTime = t.getElapsedSeconds();
+			utxo::UtxoBalance totals;
+			us->getTotals(mThreadCount,totals);
+			printf("At height %d: %llu of %llu outputs unspent; %0.8f BTC of %0.8f BTC created.\n", us->getHeight(),
+				(unsigned long long)totals.mUnspentCount, (unsigned long long)totals.mReceivedCount,
+				double(totals.mUnspentValue) / ONE_BTC, double(totals.mReceivedValue) / ONE_BTC);
+			printf("Moved to the height in %0.3f seconds; scanned in %0.3f seconds.\n", seekTime, t.getElapsedSeconds());
+		}
+		else if ( strcmp(args[0],"balance") == 0 && argc >= 4 )
+		{
+			if ( !setUtxoHeight(us,args[2]) )
+			{
+				return;
+			}
+			std::vector< uint8_t > scriptData;
+			std::vector< uint32_t > scriptOffsets;
+			std::vector< uint32_t > scriptLengths;
+			std::vector< const char *> names;
+			parseScripts(argc-3,args+3,scriptData,scriptOffsets,scriptLengths,names);
+			if ( scriptLengths.empty() )
+			{
+				return;
+			}
+			uint32_t count = uint32_t(scriptLengths.size());
+			std::vector< uint64_t > scriptIds;
+			for (uint32_t i=0; i<count; i++)
+			{
+				scriptIds.push_back(utxo::computeScriptId(&scriptData[scriptOffsets[i]],scriptLengths[i]));
+			}
+			std::vector< utxo::UtxoBalance > balances(count);
+			std::vector< std::vector< uint64_t > > unspent(count);
+			us->getBalances(mThreadCount,count,&scriptIds[0],&balances[0],&unspent[0]);
+			for (uint32_t i=0; i<count; i++)
+			{
+				const utxo::UtxoBalance &b = balances[i];
+				printf("%s at height %d: %0.8f BTC in %llu unspent outputs; %0.8f BTC received in %llu outputs\n", names[i], us->getHeight(),
+					double(b.mUnspentValue) / ONE_BTC, (unsigned long long)b.mUnspentCount,
+					double(b.mReceivedValue) / ONE_BTC, (unsigned long long)b.mReceivedCount);
+				for (auto &n:unspent[i])
+				{
+					uint8_t txid[32];
+					uint32_t index;
+					uint32_t height;
+					if ( us->getOutPoint(n,txid,index,height) )
+					{
+						char hex[HEX_HASH_SIZE];
+						printf("  %s:%d  %0.8f BTC  block %d\n", encodeHexReverse(txid,32,hex), index, double(us->getValue(n)) / ONE_BTC, height);
+					}
+				}
+			}
+			printf("Scanned the outputs in %0.3f seconds.\n", t.getElapsedSeconds());
+		}
+		else if ( strcmp(args[0],"tx") == 0 && argc >= 3 )
+		{
+			uint8_t txid[32];
+			if ( strlen(args[2]) != 64 || !decodeHexReverse(args[2],32,txid) )
+			{
+				printf("'%s' is not a transaction hash.\n", args[2]);
+				return;
+			}
+			if ( argc >= 4 && !setUtxoHeight(us,args[3]) )
+			{
+				return;
+			}
+			uint64_t firstOutput;
+			uint32_t height;
+			uint32_t outputCount = us->findTransaction(txid,firstOutput,height);
+			if ( outputCount == 0 )
+			{
+				printf("Transaction %s is not in the set.\n", args[2]);
+				return;
+			}
+			printf("Transaction %s in block %d; outputs %llu to %llu\n", args[2], height,
+				(unsigned long long)firstOutput, (unsigned long long)(firstOutput + outputCount - 1));
+			for (uint32_t i=0; i<outputCount; i++)
+			{
+				uint64_t n = firstOutput + i;
+				printf("  %d: %0.8f BTC  script id %016llx  %s at height %d\n", i, double(us->getValue(n)) / ONE_BTC,
+					(unsigned long long)us->getScriptId(n), height >= us->getHeight() ? "not created" : us->isUnspent(n) ? "unspent" : "spent", us->getHeight());
+			}
+		}
+		else
+		{
+			printf("Usage: utxo supply <dir> [height], utxo balance <dir> <height|tip> <address|script>... or utxo tx <dir> <txid> [height]\n");
+		}
+	}
+
+	// Converts each argument, an address or a hex script, into an output script; the scripts are stored one after
+	// the other in 'scriptData'.  Arguments which are neither are reported and skipped.
+	void parseScripts(uint32_t count,const char **args,std::vector< uint8_t > &scriptData,std::vector< uint32_t > &scriptOffsets,
+					  std::vector< uint32_t > &scriptLengths,std::vector< const char *> &names)
+	{
+		for (uint32_t i=0; i<count; i++)
+		{
+			uint8_t script[42];
+			uint32_t length = 0;
+			if ( bitcoinAsciiToOutputScript(args[i],script,length) )
+			{
+				scriptOffsets.push_back(uint32_t(scriptData.size()));
+				scriptData.insert(scriptData.end(),script,script+length);
+				scriptLengths.push_back(length);
+				names.push_back(args[i]);
+				continue;
+			}
+			uint32_t hexLength = uint32_t(strlen(args[i]));
+			size_t offset = scriptData.size();
+			scriptData.resize(offset + hexLength/2);
+			if ( hexLength == 0 || (hexLength & 1) || !decodeHex(args[i],hexLength/2,&scriptData[offset]) )
+			{
+				printf("'%s' is not an address or a hex script; it is ignored.\n", args[i]);
+				scriptData.resize(offset);
+				continue;
+			}
+			scriptOffsets.push_back(uint32_t(offset));
+			scriptLengths.push_back(hexLength/2);
+			names.push_back(args[i]);
+		}
+	}
+
+	// Tests the scripts against every filter on every thread, then decodes just the blocks which matched to find
+	// the outputs paying to the scripts and the inputs spending those outputs; the rest are false positives
+	void matchFilters(blockfilter::BlockFilters *bf,uint32_t count,const char **args)
+	{
+		std::vector< uint8_t > scriptData;
+		std::vector< uint32_t > scriptOffsets;
+		std::vector< uint32_t > scriptLengths;
+		std::vector< const char *> names;
+		parseScripts(count,args,scriptData,scriptOffsets,scriptLengths,names);
+		if ( scriptLengths.empty() )
+		{
+			return;
+		}
+		std::vector< const uint8_t *> scripts;
+		for (auto &i:scriptOffsets)
+		{
+			scripts.push_back(&scriptData[i]);
+		}
+		uint32_t scriptCount = uint32_t(scripts.size());
+		uint32_t blockCount = bf->getBlockCount();
+		if ( blockCount > mBlocks->getBlockHeight() )
+		{
+			blockCount = mBlocks->getBlockHeight();
+		}
+		std::vector< uint32_t > heights;
+		Timer t;
+		bf->match(mThreadCount,0,blockCount,scriptCount,&scripts[0],&scriptLengths[0],heights);
+		double matchTime = t.getElapsedSeconds();
+
+		// Candidates come back in height order, so an output is always seen before the input which spends it
+		class Received
+		{
+		public:
+			uint8_t		mHash[32];
+			uint32_t	mIndex;
+			uint64_t	mValue;
+		};
+		std::vector< Received > received;
+		blockfile::BlockReader reader;
+		uint32_t confirmed = 0;
+		uint64_t balance = 0;
+		for (auto &h:heights)
+		{
+			const BlockChain::Block *b = reader.read(mBlocks,mBlocksDir.c_str(),h);
+			if ( b == nullptr )
+			{
+				printf("Unable to read block %d.\n", h);
+				continue;
+			}
+			bool found = false;
+			for (uint32_t i=0; i<b->transactionCount; i++)
+			{
+				const BlockChain::BlockTransaction &tx = b->transactions[i];
+				for (uint32_t j=0; j<tx.inputCount; j++)
+				{
+					const BlockChain::BlockInput &input = tx.inputs[j];
+					for (auto &r:received)
+					{
+						if ( r.mIndex == input.transactionIndex && memcmp(r.mHash,input.transactionHash,32) == 0 && r.mValue )
+						{
+							printf("Block %7d transaction %4d spends %0.8f BTC\n", h, i, double(r.mValue) / ONE_BTC);
+							balance -= r.mValue;
+							r.mValue = 0;
+							found = true;
+						}
+					}
+				}
+				for (uint32_t j=0; j<tx.outputCount; j++)
+				{
+					uint32_t length = tx.outputs.scriptLengths[j];
+					const uint8_t *script = tx.outputs.getScript(j);
+					for (uint32_t k=0; k<scriptCount; k++)
+					{
+						if ( length == scriptLengths[k] && length && memcmp(script,scripts[k],length) == 0 )
+						{
+							printf("Block %7d transaction %4d receives %0.8f BTC to %s\n", h, i, double(tx.outputs.values[j]) / ONE_BTC, names[k]);
+							Received r;
+							memcpy(r.mHash,tx.transactionHash,32);
+							r.mIndex = j;
+							r.mValue = tx.outputs.values[j];
+							received.push_back(r);
+							balance += r.mValue;
+							found = true;
+						}
+					}
+				}
+			}
+			confirmed += found ? 1 : 0;
+		}
+		printf("Matched %s filters in %0.3f seconds; %s candidate blocks, %s confirmed and %s false positives.\n",
+			formatNumber(int32_t(blockCount)), matchTime, formatNumber(int32_t(heights.size())), formatNumber(int32_t(confirmed)),
+			formatNumber(int32_t(heights.size() - confirmed)));
+		printf("Unspent balance : %0.8f BTC; decoded the candidate blocks in %0.3f seconds.\n", double(balance) / ONE_BTC, t.getElapsedSeconds());
+	}
+
+	// Totals the outputs of at least 'minValue' satoshis by script type; partitions whose largest output is
+	// below 'minValue' are skipped without reading their rows
+	void scanColumns(columnstore::ColumnStore *cs,uint64_t minValue)
+	{
+		class ScanTotals
+		{
+		public:
+			uint64_t	mValue[BlockChain::KT_LAST+1]{};
+			uint64_t	mCount[BlockChain::KT_LAST+1]{};
+			uint64_t	mBytes{0};
+			uint32_t	mSkipped{0};
+			std::vector< uint64_t >	mValues;	// The decoded rows of the partition being scanned
+			std::vector< uint64_t >	mKeyTypes;
+		};
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(mThreadCount);
+		std::vector< ScanTotals > totals(pool->getThreadCount()+1);
+		Timer t;
+		pool->parallelFor(cs->getPartitionCount(),1,[cs,minValue,&totals](uint32_t begin,uint32_t end,uint32_t workerIndex)
+		{
+			ScanTotals &st = totals[workerIndex];
+			for (uint32_t p=begin; p<end; p++)
+			{
+				columnstore::ColumnChunk values;
+				columnstore::ColumnChunk keyTypes;
+				cs->getChunk(columnstore::Column::outputValue,p,values);
+				cs->getChunk(columnstore::Column::outputKeyType,p,keyTypes);
+				if ( values.mRowCount == 0 || values.mMax < minValue )
+				{
+					st.mSkipped++;
+					continue;
+				}
+				st.mBytes += values.mRowCount*(values.mWidth + keyTypes.mWidth);
+				cs->readChunk(columnstore::Column::outputValue,p,st.mValues);
+				cs->readChunk(columnstore::Column::outputKeyType,p,st.mKeyTypes);
+				for (size_t i=0; i<st.mValues.size(); i++)
+				{
+					uint64_t v = st.mValues[i];
+					uint64_t k = st.mKeyTypes[i] < BlockChain::KT_LAST ? st.mKeyTypes[i] : BlockChain::KT_LAST;
+					if ( v >= minValue )
+					{
+						st.mValue[k] += v;
+						st.mCount[k]++;
+					}
+				}
+			}
+		});
+		double seconds = t.getElapsedSeconds();
+		pool->release();
+		ScanTotals sum;
+		for (auto &i:totals)
+		{
+			for (uint32_t k=0; k<=BlockChain::KT_LAST; k++)
+			{
+				sum.mValue[k] += i.mValue[k];
+				sum.mCount[k] += i.mCount[k];
+			}
+			sum.mBytes += i.mBytes;
+			sum.mSkipped += i.mSkipped;
+		}
+		for (uint32_t k=0; k<BlockChain::KT_LAST; k++)
+		{
+			if ( sum.mCount[k] )
+			{
+				printf("%-28s : %12s outputs %18.8f BTC\n", BlockChain::getKeyTypeName(BlockChain::KeyType(k)), formatNumber(int32_t(sum.mCount[k])), double(sum.mValue[k]) / ONE_BTC);
+			}
+		}
+		printf("Scanned %s outputs in %0.3f seconds; %0.2f MB of columns at %0.2f GB/s, %d of %d partitions skipped.\n",
+			formatNumber(int32_t(cs->getRowCount(columnstore::Table::outputs))), seconds, double(sum.mBytes) / (1024*1024),
+			seconds > 0 ? double(sum.mBytes) / (seconds*1024*1024*1024) : 0.0, sum.mSkipped, cs->getPartitionCount());
+	}
+
+	void processCache(uint64_t argc,const char **argv)
+	{
+		if ( argc == 1 )
+		{
+			blockcache::BlockCacheStats stats;
+			mBlockCache->getStats(stats);
+			printf("Hits            : %d\n", uint32_t(stats.mHits));
+			printf("ColdHits        : %d\n", uint32_t(stats.mColdHits));
+			printf("Misses          : %d\n", uint32_t(stats.mMisses));
+			printf("Prefetched      : %d\n", uint32_t(stats.mPrefetched));
+			printf("ParsedBlocks    : %d using %0.2f MB\n", stats.mHotCount, double(stats.mHotBytes) / (1024*1024));
+			printf("CompressedBlocks: %d using %0.2f MB\n", stats.mColdCount, double(stats.mColdBytes) / (1024*1024));
+		}
+		else if ( argc >= 3 && strcmp(argv[1],"compress") == 0 )
+		{
+			bool state = strcmp(argv[2],"on") == 0;
+			mBlockCache->setCompressColdBlocks(state);
+			printf("Evicted blocks will %s.\n", state ? "be kept compressed" : "be discarded");
+		}
+		else if ( argc >= 3 && strcmp(argv[1],"prefetch") == 0 )
+		{
+			int distance = atoi(argv[2]);
+			if ( distance >= 0 )
+			{
+				mBlockCache->setPrefetchDistance(uint32_t(distance));
+				printf("Prefetch distance set to %d blocks.\n", distance);
+			}
+			else
+			{
+				printf("Invalid prefetch distance:%s\n", argv[2]);
+			}
+		}
+		else
+		{
+			int megabytes = atoi(argv[1]);
+			if ( megabytes > 0 )
+			{
+				mBlockCache->setByteBudget(uint64_t(megabytes)*1024*1024);
+				printf("Block cache budget set to %d MB.\n", megabytes);
+			}
+			else
+			{
+				printf("Usage: cache [megabytes | compress on|off | prefetch <n>]\n");
+			}
+		}
+	}
+
 	virtual void release(void) final
 	{
 		delete this;
@@ -155,9 +1097,12 @@ public:
 	bool			mExit{false};
 	CommandTypeMap mCommands;
 	blocks::Blocks	*mBlocks{nullptr};
+	blockcache::BlockCache	*mBlockCache{nullptr};
 	std::string		mDataDir;
 	std::string		mIndexDir;
 	std::string		mBlocksDir;
+	uint32_t		mThreadCount{0};	// Number of threads used to decode a block; zero means all available cores
+	bool			mVerifyMerkle{false};	// Check the merkle root and witness commitment of the blocks each command parses
 };
 
 Commands *Commands::create(uint32_t argc,const char **argv)
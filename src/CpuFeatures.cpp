@@ -0,0 +1,71 @@
+#include "CpuFeatures.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static CpuFeatures readCpuFeatures(void)
+{
+	CpuFeatures ret;
+	uint32_t leaf1[4] = { 0, 0, 0, 0 };
+	uint32_t leaf7[4] = { 0, 0, 0, 0 };
+	uint64_t xcr0 = 0;
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+	{
+		return ret;
+	}
+	__cpuid(regs, 1);
+	memcpy(leaf1, regs, sizeof(leaf1));
+	__cpuidex(regs, 7, 0);
+	memcpy(leaf7, regs, sizeof(leaf7));
+	if (leaf1[2] & (1 << 27))
+	{
+		xcr0 = _xgetbv(0);
+	}
+#else
+	if (__get_cpuid_max(0, nullptr) < 7)
+	{
+		return ret;
+	}
+	__get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+	__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+	if (leaf1[2] & (1 << 27))
+	{
+		uint32_t lo, hi;
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		xcr0 = (uint64_t(hi) << 32) | lo;
+	}
+#endif
+	bool ssse3 = (leaf1[2] & (1 << 9)) != 0;
+	bool sse41 = (leaf1[2] & (1 << 19)) != 0;
+	bool avx = (leaf1[2] & (1 << 28)) != 0 && (xcr0 & 0x6) == 0x6;				// the operating system saves the ymm registers
+	bool avx512State = (xcr0 & 0xE6) == 0xE6;										// and the zmm and mask registers
+	ret.mSHA = ssse3 && sse41 && (leaf7[1] & (1 << 29)) != 0;
+	ret.mAVX2 = avx && (leaf7[1] & (1 << 5)) != 0;
+	ret.mAVX512 = ret.mAVX2 && avx512State && (leaf7[1] & (1 << 16)) != 0 && (leaf7[1] & (1u << 30)) != 0;
+	return ret;
+}
+
+#else
+
+static CpuFeatures readCpuFeatures(void)
+{
+	return CpuFeatures();
+}
+
+#endif
+
+const CpuFeatures &getCpuFeatures(void)
+{
+	static CpuFeatures features = readCpuFeatures();
+	return features;
+}
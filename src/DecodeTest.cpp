@@ -0,0 +1,384 @@
+#include "DecodeTest.h"
+#include "BlockChain.h"
+#include "BlockFile.h"
+#include "ByteReader.h"
+#include "ByteWriter.h"
+#include "ScopedTime.h"
+#include "blocks.h"
+#include "CBlockIndex.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <random>
+
+#define DECODE_BENCHMARK_VALUES (1024*1024*4)	// number of integers decoded by each primitive decoder benchmark
+#define FUZZ_STRINGS_PER_ITERATION 64			// random byte strings fed to the primitive decoders per fuzz iteration
+
+namespace decodetest
+{
+
+typedef bytereader::ByteReader< bytereader::Checked > CheckedReader;
+typedef bytereader::ByteReader< bytereader::Unchecked > UncheckedReader;
+
+using bytewriter::writeCompactSize;
+using bytewriter::writeVarint;
+
+// Byte at a time reference decoders; return false if the encoding runs past 'length' or does not fit in 64 bits
+static bool referenceCompactSize(const uint8_t *data,uint32_t length,uint64_t &value,uint32_t &consumed)
+{
+	if ( length == 0 )
+	{
+		return false;
+	}
+	uint32_t size = data[0] == 0xFD ? 2 : data[0] == 0xFE ? 4 : data[0] == 0xFF ? 8 : 0;
+	if ( size == 0 )
+	{
+		value = data[0];
+		consumed = 1;
+		return true;
+	}
+	if ( length < size+1 )
+	{
+		return false;
+	}
+	value = 0;
+	for (uint32_t i=0; i<size; i++)
+	{
+		value |= uint64_t(data[i+1]) << (i*8);
+	}
+	consumed = size+1;
+	return true;
+}
+
+static bool referenceVarint(const uint8_t *data,uint32_t length,uint64_t &value,uint32_t &consumed)
+{
+	value = 0;
+	for (uint32_t i=0; i<length; i++)
+	{
+		if ( value > (UINT64_MAX >> 7) )
+		{
+			return false;
+		}
+		value = (value << 7) | (data[i] & 0x7F);
+		if ( !(data[i] & 0x80) )
+		{
+			consumed = i+1;
+			return true;
+		}
+		if ( value == UINT64_MAX )
+		{
+			return false;
+		}
+		value++;
+	}
+	return false;
+}
+
+// Returns true if the checked reader agrees with the reference decoder on this byte string
+template < typename Reference, typename Decode >
+static bool compareDecoder(const uint8_t *data,uint32_t length,Reference reference,Decode decode)
+{
+	uint64_t expected = 0;
+	uint32_t consumed = 0;
+	bool valid = reference(data,length,expected,consumed);
+	CheckedReader r(data,data+length);
+	uint64_t value = decode(r);
+	if ( r.getPosition() > r.getEnd() )
+	{
+		return false;
+	}
+	if ( !valid )
+	{
+		return r.hasOverflow() && value == 0;
+	}
+	return !r.hasOverflow() && value == expected && uint32_t(r.getPosition() - data) == consumed;
+}
+
+// A random 64 bit value with a random number of significant bits, so every encoded length is covered
+static uint64_t randomValue(std::mt19937_64 &random)
+{
+	uint32_t bits = uint32_t(random() % 65);
+	uint64_t v = random();
+	return bits == 64 ? v : (v & ((uint64_t(1) << bits) - 1));
+}
+
+static bool inBlock(const uint8_t *p,uint64_t length,const uint8_t *begin,const uint8_t *end)
+{
+	return length == 0 || (p >= begin && p <= end && length <= uint64_t(end - p));
+}
+
+class DecodeTestImpl : public DecodeTest
+{
+public:
+	DecodeTestImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir)
+	{
+		mParser = BlockChain::createBlockChain(dataDir,0);
+	}
+
+	virtual ~DecodeTestImpl(void)
+	{
+		mParser->release();
+	}
+
+	virtual bool fuzz(uint32_t blockHeight,uint32_t iterations,uint32_t seed) final
+	{
+		std::mt19937_64 random(seed);
+		uint32_t failures = 0;
+
+		printf("Checking the CompactSize and VARINT decoders.\n");
+		for (uint32_t i=0; i<iterations*FUZZ_STRINGS_PER_ITERATION; i++)
+		{
+			// Round trip a value through each encoder and both readers
+			uint64_t value = randomValue(random);
+			std::vector< uint8_t > encoded;
+			writeCompactSize(encoded,value);
+			size_t compactLength = encoded.size();
+			writeVarint(encoded,value);
+			CheckedReader checked(&encoded[0],&encoded[0]+encoded.size());
+			UncheckedReader unchecked(&encoded[0],&encoded[0]+encoded.size());
+			if ( checked.readCompactSize() != value || unchecked.readCompactSize() != value ||
+				 size_t(checked.getPosition() - &encoded[0]) != compactLength ||
+				 checked.readVarint() != value || unchecked.readVarint() != value ||
+				 checked.hasOverflow() || checked.getRemaining() != 0 || unchecked.getRemaining() != 0 )
+			{
+				if ( failures < 16 )
+				{
+					printf("FAILED: Round trip of %llu\n", (unsigned long long)value);
+				}
+				failures++;
+			}
+
+			// A random byte string, biased towards the marker and continuation bytes
+			uint8_t data[16];
+			uint32_t length = uint32_t(random() % (sizeof(data)+1));
+			for (uint32_t j=0; j<length; j++)
+			{
+				uint32_t r = uint32_t(random());
+				data[j] = (r & 3) == 0 ? uint8_t(0xFD + (r>>2)%3) : (r & 3) == 1 ? uint8_t(0x80 | (r>>2)) : uint8_t(r>>2);
+			}
+			const uint8_t *buffer = length ? data : nullptr;
+			bool compactOk = compareDecoder(buffer,length,referenceCompactSize,[](CheckedReader &r) { return r.readCompactSize(); });
+			bool varintOk = compareDecoder(buffer,length,referenceVarint,[](CheckedReader &r) { return r.readVarint(); });
+			if ( !compactOk || !varintOk )
+			{
+				if ( failures < 16 )
+				{
+					printf("FAILED: The %s decoder disagreed with the reference on a %d byte string.\n", compactOk ? "VARINT" : "CompactSize", length);
+				}
+				failures++;
+			}
+		}
+
+		std::vector< uint8_t > original;
+		const CBlockIndex *index = mBlocks->getBlockIndex(blockHeight);
+		if ( index == nullptr || !blockfile::readBlockData(*index,mDataDir.c_str(),original) || original.size() <= 80 )
+		{
+			printf("Unable to read block %d\n", blockHeight);
+			return false;
+		}
+
+		printf("Parsing %d damaged copies of block %d (%d bytes).\n", iterations, blockHeight, uint32_t(original.size()));
+		uint32_t parsed = 0;
+		setLogEnabled(false); // damaged blocks produce a great many diagnostics
+		for (uint32_t i=0; i<iterations; i++)
+		{
+			std::vector< uint8_t > damaged(original);
+			damageBlock(random,damaged);
+			// Copy into an allocation of exactly the block size so a read past the end is caught by the address sanitizer
+			uint8_t *data = new uint8_t[damaged.size()];
+			memcpy(data,&damaged[0],damaged.size());
+			const BlockChain::Block *b = mParser->processBlock(data,uint32_t(damaged.size()),blockHeight,0,0);
+			if ( b )
+			{
+				parsed++;
+				if ( !checkBlock(*b,data,data+damaged.size()) )
+				{
+					if ( failures < 16 )
+					{
+						setLogEnabled(true);
+						printf("FAILED: Iteration %d decoded a block which refers to memory outside of the block data.\n", i);
+						setLogEnabled(false);
+					}
+					failures++;
+				}
+			}
+			delete []data;
+		}
+		setLogEnabled(true);
+		printf("Parsed     : %d of %d damaged blocks\n", parsed, iterations);
+		printf("Failures   : %d\n", failures);
+		return failures == 0;
+	}
+
+	virtual void benchmark(uint32_t firstBlock,uint32_t blockCount) final
+	{
+		// Integers with the size distribution of script lengths and counts; almost all of them a single byte
+		std::mt19937_64 random(1);
+		std::vector< uint8_t > compactData;
+		std::vector< uint8_t > varintData;
+		for (uint32_t i=0; i<DECODE_BENCHMARK_VALUES; i++)
+		{
+			uint32_t r = uint32_t(random() % 100);
+			uint64_t value = r < 90 ? random() % 0xFD : r < 99 ? random() % 0x10000 : random() % 0x100000000ULL;
+			writeCompactSize(compactData,value);
+			writeVarint(varintData,value);
+		}
+		benchmarkDecoder< CheckedReader >("CompactSize checked  ",compactData,[](CheckedReader &r) { return r.readCompactSize(); });
+		benchmarkDecoder< UncheckedReader >("CompactSize unchecked",compactData,[](UncheckedReader &r) { return r.readCompactSize(); });
+		benchmarkDecoder< CheckedReader >("VARINT checked       ",varintData,[](CheckedReader &r) { return r.readVarint(); });
+		benchmarkDecoder< UncheckedReader >("VARINT unchecked     ",varintData,[](UncheckedReader &r) { return r.readVarint(); });
+
+		// Load the blocks first so only the decoding is timed
+		std::vector< std::vector< uint8_t > > data(blockCount);
+		uint64_t totalBytes = 0;
+		for (uint32_t i=0; i<blockCount; i++)
+		{
+			const CBlockIndex *index = mBlocks->getBlockIndex(firstBlock+i);
+			if ( index )
+			{
+				blockfile::readBlockData(*index,mDataDir.c_str(),data[i]);
+			}
+			totalBytes += data[i].size();
+		}
+		uint64_t totalOutputs = 0;
+		double seconds = parseBlocks(firstBlock,data,totalOutputs);
+		printf("Decoded %d blocks (%0.2f MB, %llu outputs) in %0.3f seconds; %0.2f MB/s\n",
+			blockCount, double(totalBytes)/(1024*1024), (unsigned long long)totalOutputs, seconds,
+			seconds > 0 ? double(totalBytes)/(1024*1024)/seconds : 0.0);
+
+		// The same blocks again with the merkle root and witness commitment of each one checked
+		mParser->setVerifyMerkle(true);
+		uint32_t failures = 0;
+		double verifySeconds = parseBlocks(firstBlock,data,totalOutputs,&failures);
+		mParser->setVerifyMerkle(false);
+		printf("With merkle verification %0.3f seconds; %0.1f%% extra; %d blocks failed verification\n",
+			verifySeconds, seconds > 0 ? (verifySeconds-seconds)*100/seconds : 0.0, failures);
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	// Parse every block loaded and return the seconds taken.  'failures', if not null, counts the blocks which
+	// failed merkle verification.
+	double parseBlocks(uint32_t firstBlock,const std::vector< std::vector< uint8_t > > &data,uint64_t &totalOutputs,uint32_t *failures=nullptr)
+	{
+		totalOutputs = 0;
+		Timer t;
+		for (uint32_t i=0; i<uint32_t(data.size()); i++)
+		{
+			if ( !data[i].empty() )
+			{
+				const BlockChain::Block *b = mParser->processBlock(&data[i][0],uint32_t(data[i].size()),firstBlock+i,0,0);
+				if ( b )
+				{
+					totalOutputs += b->totalOutputCount;
+				}
+				if ( failures && (b == nullptr || b->merkleStatus != BlockChain::MS_VALID) )
+				{
+					(*failures)++;
+				}
+			}
+		}
+		return t.getElapsedSeconds();
+	}
+
+	template < typename Reader, typename Decode >
+	static void benchmarkDecoder(const char *name,const std::vector< uint8_t > &data,Decode decode)
+	{
+		Timer t;
+		Reader r(&data[0],&data[0]+data.size());
+		uint64_t sum = 0;
+		uint32_t count = 0;
+		while ( r.getRemaining() )
+		{
+			sum += decode(r);
+			count++;
+		}
+		double seconds = t.getElapsedSeconds();
+		printf("%s : %0.2f ns per value, %0.2f MB/s (checksum %llu)\n", name,
+			count ? seconds*1e9/count : 0.0,
+			seconds > 0 ? double(data.size())/(1024*1024)/seconds : 0.0,
+			(unsigned long long)sum);
+	}
+
+	// Apply a few random kinds of damage; changed bytes, truncation and implausible variable length integers
+	static void damageBlock(std::mt19937_64 &random,std::vector< uint8_t > &data)
+	{
+		uint32_t damageCount = 1 + uint32_t(random() % 4);
+		for (uint32_t i=0; i<damageCount && data.size() > 81; i++)
+		{
+			size_t position = 80 + size_t(random() % (data.size()-80));
+			switch ( random() % 4 )
+			{
+				case 0:
+					data[position] = uint8_t(random());
+					break;
+				case 1:
+					data.resize(position);
+					break;
+				case 2:
+					data[position] = uint8_t(0xFD + random() % 3);
+					for (size_t j=position+1; j<data.size() && j<position+9; j++)
+					{
+						data[j] = uint8_t(random());
+					}
+					break;
+				default:
+					for (size_t j=position; j<data.size() && j<position+4; j++)
+					{
+						data[j] = 0xFF;
+					}
+					break;
+			}
+		}
+	}
+
+	// Every script, witness and transaction of a parsed block must lie within the block data
+	static bool checkBlock(const BlockChain::Block &b,const uint8_t *begin,const uint8_t *end)
+	{
+		for (uint32_t i=0; i<b.transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b.transactions[i];
+			if ( !inBlock(begin + (t.fileOffset - b.fileOffset),t.transactionLength,begin,end) )
+			{
+				return false;
+			}
+			for (uint32_t j=0; j<t.inputCount; j++)
+			{
+				const BlockChain::BlockInput &input = t.inputs[j];
+				if ( !inBlock(input.transactionHash,32,begin,end) ||
+					 !inBlock(input.responseScript,input.responseScriptLength,begin,end) ||
+					 (input.witnessCount && !inBlock(input.witness,1,begin,end)) )
+				{
+					return false;
+				}
+			}
+			for (uint32_t j=0; j<t.outputCount; j++)
+			{
+				if ( !inBlock(t.outputs.getScript(j),t.outputs.scriptLengths[j],begin,end) )
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	const blocks::Blocks	*mBlocks{nullptr};
+	std::string				mDataDir;
+	BlockChain				*mParser{nullptr};
+};
+
+DecodeTest *DecodeTest::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new DecodeTestImpl(blocks,dataDir);
+	return static_cast< DecodeTest *>(ret);
+}
+
+}
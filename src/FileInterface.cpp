@@ -0,0 +1,608 @@
+#include "FileInterface.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define FILE_WRITE_BUFFER_SIZE (1024*1024)	// stdio buffer used for files opened for writing
+#define FILE_PRINTF_SCRATCH 1024			// fi_fprintf formats into a stack buffer this size before falling back to the heap
+
+namespace fileinterface
+{
+
+static int seek64(FILE *fph,uint64_t loc,int mode)
+{
+#ifdef _MSC_VER
+	return _fseeki64(fph,int64_t(loc),mode);
+#else
+	return fseeko(fph,off_t(loc),mode);
+#endif
+}
+
+static uint64_t tell64(FILE *fph)
+{
+#ifdef _MSC_VER
+	return uint64_t(_ftelli64(fph));
+#else
+	return uint64_t(ftello(fph));
+#endif
+}
+
+// True if 'spec' opens the file for reading only
+static bool isReadOnly(const char *spec)
+{
+	return spec && strchr(spec,'r') && !strchr(spec,'+') && !strchr(spec,'w') && !strchr(spec,'a');
+}
+
+class FileInterfaceImpl
+{
+public:
+	enum class Mode
+	{
+		stdio,			// A file on disk read or written through stdio
+		mapped,			// A read only memory mapping of a file
+		memoryRead,		// A block of memory supplied by the caller
+		memoryWrite,	// A growing block of memory owned by the interface
+	};
+
+	FileInterfaceImpl(void)
+	{
+		mHandle.mInterface = this;
+	}
+
+	~FileInterfaceImpl(void)
+	{
+		close();
+	}
+
+	bool openFile(const char *fname,const char *spec,bool useMemoryMappedFile)
+	{
+		if ( useMemoryMappedFile && isReadOnly(spec) && openMapping(fname) )
+		{
+			return true;
+		}
+		mFile = fopen(fname,spec);
+		if ( mFile == nullptr )
+		{
+			return false;
+		}
+		mMode = Mode::stdio;
+		if ( !isReadOnly(spec) )
+		{
+			mWriteBuffer.resize(FILE_WRITE_BUFFER_SIZE);
+			setvbuf(mFile,&mWriteBuffer[0],_IOFBF,mWriteBuffer.size());
+		}
+		return true;
+	}
+
+	void openMemory(void *mem,uint64_t len)
+	{
+		mMode = Mode::memoryRead;
+		mData = static_cast< const uint8_t *>(mem);
+		mLength = len;
+	}
+
+	void openMemoryWrite(uint64_t reserve)
+	{
+		mMode = Mode::memoryWrite;
+		mMemory.reserve(size_t(reserve));
+	}
+
+	uint64_t close(void)
+	{
+		uint64_t ret = 0;
+		if ( mFile )
+		{
+			ret = uint64_t(fclose(mFile));
+			mFile = nullptr;
+		}
+		closeMapping();
+		mData = nullptr;
+		mLength = 0;
+		mLocation = 0;
+		return ret;
+	}
+
+	uint64_t read(void *buffer,uint64_t size,uint64_t count)
+	{
+		if ( mMode == Mode::stdio )
+		{
+			return uint64_t(fread(buffer,size_t(size),size_t(count),mFile));
+		}
+		if ( size == 0 || count == 0 )
+		{
+			return 0;
+		}
+		uint64_t length = getLength();
+		uint64_t available = mLocation < length ? length - mLocation : 0;
+		uint64_t ret = count;
+		if ( available / size < count )
+		{
+			ret = available / size;
+			mEof = true;
+		}
+		if ( ret )
+		{
+			memcpy(buffer,getData() + mLocation,size_t(ret * size));
+			mLocation += ret * size;
+		}
+		return ret;
+	}
+
+	uint64_t write(const void *buffer,uint64_t size,uint64_t count)
+	{
+		if ( mMode == Mode::stdio )
+		{
+			return uint64_t(fwrite(buffer,size_t(size),size_t(count),mFile));
+		}
+		if ( mMode != Mode::memoryWrite )
+		{
+			mError = true; // memory mapped and caller supplied memory files are read only
+			return 0;
+		}
+		uint64_t length = size * count;
+		if ( mLocation + length > mMemory.size() )
+		{
+			mMemory.resize(size_t(mLocation + length));
+		}
+		if ( length )
+		{
+			memcpy(&mMemory[size_t(mLocation)],buffer,size_t(length));
+		}
+		mLocation += length;
+		return count;
+	}
+
+	uint64_t seek(uint64_t loc,int mode)
+	{
+		if ( mMode == Mode::stdio )
+		{
+			return uint64_t(seek64(mFile,loc,mode));
+		}
+		int64_t base = 0;
+		switch ( mode )
+		{
+			case SEEK_CUR:
+				base = int64_t(mLocation);
+				break;
+			case SEEK_END:
+				base = int64_t(getLength());
+				break;
+			default:
+				break;
+		}
+		int64_t location = base + int64_t(loc); // relative seeks pass negative offsets as their two's complement
+		if ( location < 0 )
+		{
+			return 1;
+		}
+		mLocation = uint64_t(location);
+		mEof = false;
+		return 0;
+	}
+
+	uint64_t tell(void)
+	{
+		return mMode == Mode::stdio ? tell64(mFile) : mLocation;
+	}
+
+	uint64_t flush(void)
+	{
+		return mMode == Mode::stdio ? uint64_t(fflush(mFile)) : 0;
+	}
+
+	bool eof(void)
+	{
+		return mMode == Mode::stdio ? feof(mFile) != 0 : mEof;
+	}
+
+	bool error(void)
+	{
+		return mMode == Mode::stdio ? ferror(mFile) != 0 : mError;
+	}
+
+	void clearError(void)
+	{
+		if ( mMode == Mode::stdio )
+		{
+			clearerr(mFile);
+		}
+		mEof = false;
+		mError = false;
+	}
+
+	const uint8_t *getData(void) const
+	{
+		if ( mMode == Mode::memoryWrite )
+		{
+			return mMemory.empty() ? nullptr : &mMemory[0];
+		}
+		return mData;
+	}
+
+	uint64_t getLength(void)
+	{
+		switch ( mMode )
+		{
+			case Mode::stdio:
+			{
+				uint64_t loc = tell64(mFile);
+				seek64(mFile,0,SEEK_END);
+				uint64_t ret = tell64(mFile);
+				seek64(mFile,loc,SEEK_SET);
+				return ret;
+			}
+			case Mode::memoryWrite:
+				return uint64_t(mMemory.size());
+			default:
+				break;
+		}
+		return mLength;
+	}
+
+	void advise(uint64_t offset,uint64_t length,FileAdvice advice)
+	{
+#ifdef _WIN32
+		(void)offset;
+		(void)length;
+		(void)advice;
+#else
+		if ( mMode == Mode::mapped && mData && offset < mLength )
+		{
+			if ( length > mLength - offset )
+			{
+				length = mLength - offset;
+			}
+			// madvise wants a page aligned address
+			uint64_t pageSize = uint64_t(sysconf(_SC_PAGESIZE));
+			uint64_t begin = offset & ~(pageSize-1);
+			int a = MADV_NORMAL;
+			switch ( advice )
+			{
+				case FA_SEQUENTIAL: a = MADV_SEQUENTIAL; break;
+				case FA_RANDOM:		a = MADV_RANDOM; break;
+				case FA_WILLNEED:	a = MADV_WILLNEED; break;
+				case FA_DONTNEED:	a = MADV_DONTNEED; break;
+				default: break;
+			}
+			madvise(const_cast< uint8_t *>(mData) + begin,size_t(offset + length - begin),a);
+		}
+#if defined(POSIX_FADV_NORMAL)
+		else if ( mMode == Mode::stdio )
+		{
+			int a = POSIX_FADV_NORMAL;
+			switch ( advice )
+			{
+				case FA_SEQUENTIAL: a = POSIX_FADV_SEQUENTIAL; break;
+				case FA_RANDOM:		a = POSIX_FADV_RANDOM; break;
+				case FA_WILLNEED:	a = POSIX_FADV_WILLNEED; break;
+				case FA_DONTNEED:	a = POSIX_FADV_DONTNEED; break;
+				default: break;
+			}
+			posix_fadvise(fileno(mFile),off_t(offset),off_t(length),a);
+		}
+#endif
+#endif
+	}
+
+	FILE_INTERFACE		mHandle;
+	Mode				mMode{Mode::stdio};
+	FILE				*mFile{nullptr};
+	const uint8_t		*mData{nullptr};		// The mapped file or caller supplied memory
+	uint64_t			mLength{0};				// Length of the mapped file or caller supplied memory
+	uint64_t			mLocation{0};			// The current read or write location for memory based files
+	bool				mEof{false};
+	bool				mError{false};
+	std::vector< uint8_t >	mMemory;			// The contents of a file written to memory
+	std::vector< char >		mWriteBuffer;		// The stdio buffer for files opened for writing
+#ifdef _WIN32
+	HANDLE				mMappedFile{INVALID_HANDLE_VALUE};
+	HANDLE				mMapping{nullptr};
+#endif
+
+private:
+#ifdef _WIN32
+
+	bool openMapping(const char *fname)
+	{
+		HANDLE file = CreateFileA(fname,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE,nullptr,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,nullptr);
+		if ( file == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+		LARGE_INTEGER size;
+		if ( !GetFileSizeEx(file,&size) || uint64_t(size.QuadPart) > uint64_t(SIZE_MAX) )
+		{
+			CloseHandle(file);
+			return false;
+		}
+		mMode = Mode::mapped;
+		mMappedFile = file;
+		mLength = uint64_t(size.QuadPart);
+		if ( mLength == 0 )
+		{
+			return true; // an empty file maps successfully with no data
+		}
+		mMapping = CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+		if ( mMapping )
+		{
+			mData = static_cast< const uint8_t *>(MapViewOfFile(mMapping,FILE_MAP_READ,0,0,0));
+		}
+		if ( mData == nullptr )
+		{
+			closeMapping();
+			mMode = Mode::stdio;
+			mLength = 0;
+			return false;
+		}
+		return true;
+	}
+
+	void closeMapping(void)
+	{
+		if ( mMode == Mode::mapped && mData )
+		{
+			UnmapViewOfFile(mData);
+		}
+		if ( mMapping )
+		{
+			CloseHandle(mMapping);
+			mMapping = nullptr;
+		}
+		if ( mMappedFile != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle(mMappedFile);
+			mMappedFile = INVALID_HANDLE_VALUE;
+		}
+	}
+
+#else
+
+	bool openMapping(const char *fname)
+	{
+		int fd = ::open(fname,O_RDONLY);
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		struct stat st;
+		if ( fstat(fd,&st) != 0 || uint64_t(st.st_size) > uint64_t(SIZE_MAX) )
+		{
+			::close(fd);
+			return false;
+		}
+		uint64_t length = uint64_t(st.st_size);
+		if ( length )
+		{
+			void *data = mmap(nullptr,size_t(length),PROT_READ,MAP_PRIVATE,fd,0);
+			if ( data == MAP_FAILED )
+			{
+				::close(fd);
+				return false;
+			}
+			mData = static_cast< const uint8_t *>(data);
+		}
+		::close(fd); // the mapping keeps the file open
+		mMode = Mode::mapped;
+		mLength = length;
+		return true;
+	}
+
+	void closeMapping(void)
+	{
+		if ( mMode == Mode::mapped && mData )
+		{
+			munmap(const_cast< uint8_t *>(mData),size_t(mLength));
+		}
+	}
+
+#endif
+};
+
+static FileInterfaceImpl *getImpl(FILE_INTERFACE *fph)
+{
+	return fph ? static_cast< FileInterfaceImpl *>(fph->mInterface) : nullptr;
+}
+
+}
+
+using namespace fileinterface;
+
+FILE_INTERFACE *fi_fopen(const char *fname,const char *spec,void *mem,uint64_t len,bool useMemoryMappedFile)
+{
+	FileInterfaceImpl *f = new FileInterfaceImpl;
+	bool ok = true;
+	if ( mem )
+	{
+		f->openMemory(mem,len);
+	}
+	else if ( fname == nullptr )
+	{
+		ok = spec && !isReadOnly(spec);
+		if ( ok )
+		{
+			f->openMemoryWrite(len);
+		}
+	}
+	else
+	{
+		ok = f->openFile(fname,spec,useMemoryMappedFile);
+	}
+	if ( !ok )
+	{
+		delete f;
+		return nullptr;
+	}
+	return &f->mHandle;
+}
+
+uint64_t fi_fclose(FILE_INTERFACE *file)
+{
+	uint64_t ret = 0;
+	FileInterfaceImpl *f = getImpl(file);
+	if ( f )
+	{
+		ret = f->close();
+		delete f;
+	}
+	return ret;
+}
+
+uint64_t fi_fread(void *buffer,uint64_t size,uint64_t count,FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->read(buffer,size,count) : 0;
+}
+
+uint64_t fi_fwrite(const void *buffer,uint64_t size,uint64_t count,FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->write(buffer,size,count) : 0;
+}
+
+uint64_t fi_fprintf(FILE_INTERFACE *fph,const char *fmt,...)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	if ( f == nullptr )
+	{
+		return 0;
+	}
+	char scratch[FILE_PRINTF_SCRATCH];
+	va_list args;
+	va_start(args,fmt);
+	int len = vsnprintf(scratch,sizeof(scratch),fmt,args);
+	va_end(args);
+	if ( len < 0 )
+	{
+		return 0;
+	}
+	if ( len < int(sizeof(scratch)) )
+	{
+		return f->write(scratch,1,uint64_t(len));
+	}
+	std::vector< char > large(size_t(len)+1);
+	va_start(args,fmt);
+	vsnprintf(&large[0],large.size(),fmt,args);
+	va_end(args);
+	return f->write(&large[0],1,uint64_t(len));
+}
+
+uint64_t fi_fflush(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->flush() : 0;
+}
+
+uint64_t fi_fseek(FILE_INTERFACE *fph,uint64_t loc,int mode)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->seek(loc,mode) : 1;
+}
+
+uint64_t fi_ftell(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->tell() : 0;
+}
+
+uint64_t fi_fputc(char c,FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->write(&c,1,1) : 0;
+}
+
+uint64_t fi_fputs(const char *str,FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->write(str,1,uint64_t(strlen(str))) : 0;
+}
+
+uint64_t fi_feof(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? uint64_t(f->eof()) : 1;
+}
+
+uint64_t fi_ferror(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? uint64_t(f->error()) : 1;
+}
+
+void fi_clearerr(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	if ( f )
+	{
+		f->clearError();
+	}
+}
+
+void *fi_getMemBuffer(FILE_INTERFACE *fph,uint64_t *outputLength)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	if ( f == nullptr || f->mMode == FileInterfaceImpl::Mode::stdio )
+	{
+		if ( outputLength )
+		{
+			*outputLength = 0;
+		}
+		return nullptr;
+	}
+	if ( outputLength )
+	{
+		*outputLength = f->getLength();
+	}
+	return const_cast< uint8_t *>(f->getData());
+}
+
+bool fi_usesMemoryMappedFile(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f && f->mMode == FileInterfaceImpl::Mode::mapped;
+}
+
+void *fi_getCurrentMemoryLocation(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	if ( f == nullptr || f->mMode == FileInterfaceImpl::Mode::stdio || f->getData() == nullptr || f->mLocation > f->getLength() )
+	{
+		return nullptr;
+	}
+	return const_cast< uint8_t *>(f->getData() + f->mLocation);
+}
+
+uint64_t fi_getFileLength(FILE_INTERFACE *fph)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	return f ? f->getLength() : 0;
+}
+
+void fi_fadvise(FILE_INTERFACE *fph,uint64_t offset,uint64_t length,FileAdvice advice)
+{
+	FileInterfaceImpl *f = getImpl(fph);
+	if ( f )
+	{
+		f->advise(offset,length,advice);
+	}
+}
+
+bool fi_deleteFile(const char *fname)
+{
+	return remove(fname) == 0;
+}
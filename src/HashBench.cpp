@@ -0,0 +1,356 @@
+#include "HashBench.h"
+#include "SHA256.h"
+#include "RIPEMD160.h"
+#include "BitcoinAddress.h"
+#include "ScopedTime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#define HASH_BENCH_MESSAGE_SIZE 4096	// bytes in each message of the bulk throughput test
+#define HASH_BENCH_BATCH 512			// messages handed to each batch call; about one block's worth of transactions
+
+namespace hashbench
+{
+
+class HashBenchImpl : public HashBench
+{
+public:
+	virtual bool run(uint32_t megabytes) final
+	{
+		if ( megabytes == 0 )
+		{
+			megabytes = 1;
+		}
+		std::mt19937 random(1);
+		mData.resize(size_t(megabytes)*1024*1024 + 64);
+		for (auto &i:mData)
+		{
+			i = uint8_t(random());
+		}
+		SHA256Implementation original = getSHA256Implementation();
+		bool ok = true;
+		std::vector< uint8_t > reference;
+		const SHA256Implementation implementations[] = { SHA256_PORTABLE, SHA256_SHANI, SHA256_ARMV8 };
+		for (auto &i:implementations)
+		{
+			if ( !setSHA256Implementation(i) )
+			{
+				continue;
+			}
+			printf("SHA256 %s%s\n", getSHA256ImplementationName(i), i == original ? " (selected)" : "");
+			mDigests.clear();
+			benchmarkSHA256();
+			if ( reference.empty() )
+			{
+				reference = mDigests;
+			}
+			else if ( reference != mDigests )
+			{
+				printf("  ERROR: the %s hashes do not match the portable implementation.\n", getSHA256ImplementationName(i));
+				ok = false;
+			}
+		}
+		setSHA256Implementation(original);
+		if ( !benchmarkMidstates() )
+		{
+			ok = false;
+		}
+		if ( !benchmarkBatches() )
+		{
+			ok = false;
+		}
+		if ( !benchmarkHash160() )
+		{
+			ok = false;
+		}
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	void addDigest(const uint8_t hash[32])
+	{
+		mDigests.insert(mDigests.end(),hash,hash+32);
+	}
+
+	// Reports the message rate and throughput of each form of hashing the parser uses
+	void benchmarkSHA256(void)
+	{
+		size_t length = mData.size() - 64;
+		uint8_t hash[32];
+		Timer t;
+		for (size_t i=0; i+HASH_BENCH_MESSAGE_SIZE<=length; i+=HASH_BENCH_MESSAGE_SIZE)
+		{
+			computeSHA256(&mData[i],HASH_BENCH_MESSAGE_SIZE,hash);
+			addDigest(hash);
+		}
+		report("  single, 4KB messages ",length/HASH_BENCH_MESSAGE_SIZE,length,t.getElapsedSeconds());
+
+		size_t headers = length / 80;
+		for (size_t i=0; i<headers; i++)
+		{
+			computeSHA256(&mData[i*80],80,hash);
+			computeSHA256(hash,32,hash);
+			addDigest(hash);
+		}
+		report("  double, 80 bytes     ",headers,headers*80,t.getElapsedSeconds());
+		for (size_t i=0; i<headers; i++)
+		{
+			computeDoubleSHA256Header(&mData[i*80],hash);
+			addDigest(hash);
+		}
+		report("  header specialisation",headers,headers*80,t.getElapsedSeconds());
+
+		size_t nodes = length / 64;
+		for (size_t i=0; i<nodes; i++)
+		{
+			computeSHA256(&mData[i*64],64,hash);
+			computeSHA256(hash,32,hash);
+			addDigest(hash);
+		}
+		report("  double, 64 bytes     ",nodes,nodes*64,t.getElapsedSeconds());
+		for (size_t i=0; i<nodes; i++)
+		{
+			computeDoubleSHA256Node(&mData[i*64],hash);
+			addDigest(hash);
+		}
+		report("  node specialisation  ",nodes,nodes*64,t.getElapsedSeconds());
+	}
+
+	// Compares hashing messages in full against resuming a saved midstate; a sweep of the nonce of one block header,
+	// and the txid of a witness transaction hashed from a stripped copy against hashing its pieces in place
+	bool benchmarkMidstates(void)
+	{
+		printf("SHA256 midstates, %s\n", getSHA256ImplementationName(getSHA256Implementation()));
+		bool ok = true;
+		size_t length = mData.size() - 64;
+		uint32_t nonces = uint32_t(length / 80);
+		uint8_t header[80];
+		memcpy(header,&mData[0],80);
+		std::vector< uint8_t > full(size_t(nonces)*32);
+		std::vector< uint8_t > resumed(size_t(nonces)*32);
+		Timer t;
+		for (uint32_t i=0; i<nonces; i++)
+		{
+			memcpy(header+76,&i,4);
+			computeDoubleSHA256Header(header,&full[size_t(i)*32]);
+		}
+		report("  header, in full      ",nonces,size_t(nonces)*80,t.getElapsedSeconds());
+		SHA256Context midstate;
+		midstate.update(header,64);
+		for (uint32_t i=0; i<nonces; i++)
+		{
+			memcpy(header+76,&i,4);
+			computeDoubleSHA256Header(midstate,header+64,&resumed[size_t(i)*32]);
+		}
+		report("  header, midstate     ",nonces,size_t(nonces)*80,t.getElapsedSeconds());
+		if ( full != resumed )
+		{
+			printf("  ERROR: the header hashes resumed from a midstate do not match.\n");
+			ok = false;
+		}
+
+		// A 600 byte witness transaction; 4 bytes of version, 2 of marker and flag, a 300 byte body, witness data
+		// and 4 bytes of lock time
+		const uint32_t bodyLength = 300;
+		const uint32_t transactionLength = 600;
+		uint32_t transactions = uint32_t(length / transactionLength);
+		std::vector< uint8_t > stripped(bodyLength+8);
+		for (uint32_t i=0; i<transactions; i++)
+		{
+			const uint8_t *tx = &mData[size_t(i)*transactionLength];
+			memcpy(&stripped[0],tx,4);
+			memcpy(&stripped[4],tx+6,bodyLength);
+			memcpy(&stripped[4+bodyLength],tx+transactionLength-4,4);
+			computeDoubleSHA256(&stripped[0],bodyLength+8,&full[size_t(i)*32]);
+		}
+		report("  txid, stripped copy  ",transactions,size_t(transactions)*(bodyLength+8),t.getElapsedSeconds());
+		for (uint32_t i=0; i<transactions; i++)
+		{
+			const uint8_t *tx = &mData[size_t(i)*transactionLength];
+			SHA256Context context;
+			context.update(tx,4);
+			context.update(tx+6,bodyLength);
+			context.update(tx+transactionLength-4,4);
+			context.finalizeDouble(&resumed[size_t(i)*32]);
+		}
+		report("  txid, in place       ",transactions,size_t(transactions)*(bodyLength+8),t.getElapsedSeconds());
+		if ( memcmp(&full[0],&resumed[0],size_t(transactions)*32) != 0 )
+		{
+			printf("  ERROR: the txids hashed in place do not match.\n");
+			ok = false;
+		}
+		return ok;
+	}
+
+	// Compares hashing transaction sized messages one at a time with the selected single message implementation
+	// against each batch implementation, reporting the cost of each message
+	bool benchmarkBatches(void)
+	{
+		// Messages of 150 to 650 bytes; the size range of most transactions
+		std::mt19937 random(2);
+		size_t length = mData.size() - 64;
+		mInputs.clear();
+		mSizes.clear();
+		for (size_t i=0;;)
+		{
+			uint32_t size = 150 + uint32_t(random() % 500);
+			if ( i + size > length )
+			{
+				break;
+			}
+			mInputs.push_back(&mData[i]);
+			mSizes.push_back(size);
+			i += size;
+		}
+		mHashes.resize(mInputs.size()*32);
+		SHA256BatchImplementation original = getSHA256BatchImplementation();
+		printf("SHA256 batches of %d messages, double hashed, %s for single messages\n", HASH_BENCH_BATCH, getSHA256ImplementationName(getSHA256Implementation()));
+		bool ok = true;
+		std::vector< uint8_t > reference;
+		const SHA256BatchImplementation implementations[] = { SHA256_BATCH_SINGLE, SHA256_BATCH_AVX2, SHA256_BATCH_AVX512 };
+		for (auto &i:implementations)
+		{
+			if ( !setSHA256BatchImplementation(i) )
+			{
+				continue;
+			}
+			mDigests.clear();
+			benchmarkBatch(i,i == original);
+			if ( reference.empty() )
+			{
+				reference = mDigests;
+			}
+			else if ( reference != mDigests )
+			{
+				printf("  ERROR: the %s batch hashes do not match hashing one message at a time.\n", getSHA256BatchImplementationName(i));
+				ok = false;
+			}
+		}
+		setSHA256BatchImplementation(original);
+		return ok;
+	}
+
+	void benchmarkBatch(SHA256BatchImplementation implementation,bool selected)
+	{
+		size_t count = mInputs.size();
+		size_t bytes = 0;
+		for (auto &i:mSizes)
+		{
+			bytes += i;
+		}
+		Timer t;
+		for (size_t i=0; i<count; i+=HASH_BENCH_BATCH)
+		{
+			uint32_t n = uint32_t(count - i < HASH_BENCH_BATCH ? count - i : HASH_BENCH_BATCH);
+			computeDoubleSHA256Batch(n,&mInputs[i],&mSizes[i],reinterpret_cast< uint8_t (*)[32] >(&mHashes[i*32]));
+		}
+		double seconds = t.getElapsedSeconds();
+		mDigests = mHashes;
+		if ( seconds <= 0 )
+		{
+			seconds = 1e-9;
+		}
+		printf("  %-13s%s : %10.1f ns per message %10.2f MB/s\n", getSHA256BatchImplementationName(implementation), selected ? " (selected)" : "           ",
+			seconds*1e9 / double(count ? count : 1), double(bytes) / (seconds*1024*1024));
+	}
+
+	// Compares deriving the hash160 of public keys one at a time, as the address functions do, against the batched
+	// hash160 with each RIPEMD160 batch implementation
+	bool benchmarkHash160(void)
+	{
+		// Alternating compressed and full public keys, as in the multisig outputs of the early chain
+		size_t length = mData.size() - 64;
+		mInputs.clear();
+		mSizes.clear();
+		for (size_t i=0;;)
+		{
+			uint32_t size = (mInputs.size() & 1) ? 65 : 33;
+			if ( i + size > length )
+			{
+				break;
+			}
+			mData[i] = size == 65 ? 0x04 : 0x02;
+			mInputs.push_back(&mData[i]);
+			mSizes.push_back(size);
+			i += size;
+		}
+		size_t count = mInputs.size();
+		mHashes.resize(count*20);
+		printf("Hash160 of public keys, %s for SHA256\n", getSHA256BatchImplementationName(getSHA256BatchImplementation()));
+		Timer t;
+		for (size_t i=0; i<count; i++)
+		{
+			uint8_t hash1[32];
+			computeSHA256(mInputs[i],mSizes[i],hash1);
+			computeRIPEMD160(hash1,32,&mHashes[i*20]);
+		}
+		reportHash160("one key at a time",false,count,t.getElapsedSeconds());
+		std::vector< uint8_t > reference = mHashes;
+		RIPEMD160BatchImplementation original = getRIPEMD160BatchImplementation();
+		bool ok = true;
+		const RIPEMD160BatchImplementation implementations[] = { RIPEMD160_BATCH_SINGLE, RIPEMD160_BATCH_AVX2, RIPEMD160_BATCH_AVX512 };
+		for (auto &i:implementations)
+		{
+			if ( !setRIPEMD160BatchImplementation(i) )
+			{
+				continue;
+			}
+			memset(&mHashes[0],0,mHashes.size());
+			t.reset();
+			for (size_t j=0; j<count; j+=HASH_BENCH_BATCH)
+			{
+				uint32_t n = uint32_t(count - j < HASH_BENCH_BATCH ? count - j : HASH_BENCH_BATCH);
+				bitcoinPublicKeysToHash160(n,&mInputs[j],&mSizes[j],reinterpret_cast< uint8_t (*)[20] >(&mHashes[j*20]));
+			}
+			reportHash160(getRIPEMD160BatchImplementationName(i),i == original,count,t.getElapsedSeconds());
+			if ( reference != mHashes )
+			{
+				printf("  ERROR: the %s hash160 batch does not match hashing one key at a time.\n", getRIPEMD160BatchImplementationName(i));
+				ok = false;
+			}
+		}
+		setRIPEMD160BatchImplementation(original);
+		return ok;
+	}
+
+	void reportHash160(const char *name,bool selected,size_t count,double seconds)
+	{
+		if ( seconds <= 0 )
+		{
+			seconds = 1e-9;
+		}
+		printf("  %-17s%s : %10.1f ns per key %10.2f million keys/s\n", name, selected ? " (selected)" : "           ",
+			seconds*1e9 / double(count ? count : 1), double(count) / (seconds*1000000));
+	}
+
+	void report(const char *name,size_t messages,size_t bytes,double seconds)
+	{
+		if ( seconds <= 0 )
+		{
+			seconds = 1e-9;
+		}
+		printf("%s : %10.2f million hashes/s %10.2f MB/s\n", name, double(messages) / (seconds*1000000), double(bytes) / (seconds*1024*1024));
+	}
+
+	std::vector< uint8_t >	mData;
+	std::vector< uint8_t >	mDigests;	// Every hash computed by one implementation, in order
+	std::vector< const uint8_t *>	mInputs;	// The messages of the batch test
+	std::vector< uint32_t >			mSizes;
+	std::vector< uint8_t >			mHashes;	// 32 bytes per message; 20 in the hash160 test
+};
+
+HashBench *HashBench::create(void)
+{
+	auto ret = new HashBenchImpl;
+	return static_cast< HashBench *>(ret);
+}
+
+}
@@ -0,0 +1,224 @@
+#include "HexCodec.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HEX_CODEC_X86
+#endif
+
+static const char gLowerDigits[16] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
+static const char gUpperDigits[16] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
+
+// The value of each ASCII character as a hex digit; 0xFF if it is not one
+class HexValues
+{
+public:
+	HexValues(void)
+	{
+		memset(mValues,0xFF,sizeof(mValues));
+		for (uint8_t i=0; i<16; i++)
+		{
+			mValues[uint8_t(gLowerDigits[i])] = i;
+			mValues[uint8_t(gUpperDigits[i])] = i;
+		}
+	}
+
+	uint8_t	mValues[256];
+};
+
+static const HexValues gHexValues;
+
+static inline void encodeByte(uint8_t c,char *dest,const char *digits)
+{
+	dest[0] = digits[c >> 4];
+	dest[1] = digits[c & 15];
+}
+
+static inline bool decodeByte(const char *src,uint8_t &c)
+{
+	uint8_t high = gHexValues.mValues[uint8_t(src[0])];
+	uint8_t low = gHexValues.mValues[uint8_t(src[1])];
+	c = uint8_t((high << 4) | low);
+	return high < 16 && low < 16;
+}
+
+#ifdef HEX_CODEC_X86
+
+#include "CpuFeatures.h"
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define HEX_CODEC_TARGET_AVX2
+#else
+#define HEX_CODEC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// SSE2 is part of every x86-64 processor, so the 16 byte kernels need no check.
+// A nibble n becomes the character n + '0', plus the gap to 'a' or 'A' when n is more than 9.
+static inline __m128i nibblesToAscii(__m128i n,__m128i letterGap)
+{
+	__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n,_mm_set1_epi8(9)),letterGap);
+	return _mm_add_epi8(_mm_add_epi8(n,_mm_set1_epi8('0')),letters);
+}
+
+static inline void encode16(__m128i v,char *dest,__m128i letterGap)
+{
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	__m128i high = _mm_and_si128(_mm_srli_epi16(v,4),mask);
+	__m128i low = _mm_and_si128(v,mask);
+	_mm_storeu_si128((__m128i *)dest,nibblesToAscii(_mm_unpacklo_epi8(high,low),letterGap));
+	_mm_storeu_si128((__m128i *)(dest+16),nibblesToAscii(_mm_unpackhi_epi8(high,low),letterGap));
+}
+
+// Reverses the 16 bytes of a register; the dwords, then the words in each dword, then the bytes in each word
+static inline __m128i reverse16(__m128i v)
+{
+	v = _mm_shuffle_epi32(v,_MM_SHUFFLE(0,1,2,3));
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v,_MM_SHUFFLE(2,3,0,1)),_MM_SHUFFLE(2,3,0,1));
+	return _mm_or_si128(_mm_slli_epi16(v,8),_mm_srli_epi16(v,8));
+}
+
+// Converts 32 characters to 16 bytes; returns false if any is not a hex digit
+static inline bool decode16(const char *src,__m128i &out)
+{
+	const __m128i a = _mm_loadu_si128((const __m128i *)src);
+	const __m128i b = _mm_loadu_si128((const __m128i *)(src+16));
+	__m128i valid = _mm_set1_epi8(-1);
+	__m128i values[2];
+	const __m128i in[2] = { a, b };
+	for (uint32_t i=0; i<2; i++)
+	{
+		// Digits are c-'0' below 10; letters of either case are (c|0x20)-'a' below 6.  Unsigned x <= k is min(x,k) == x.
+		__m128i digit = _mm_sub_epi8(in[i],_mm_set1_epi8('0'));
+		__m128i letter = _mm_sub_epi8(_mm_or_si128(in[i],_mm_set1_epi8(0x20)),_mm_set1_epi8('a'));
+		__m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit,_mm_set1_epi8(9)),digit);
+		__m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter,_mm_set1_epi8(5)),letter);
+		valid = _mm_and_si128(valid,_mm_or_si128(isDigit,isLetter));
+		__m128i v = _mm_or_si128(_mm_and_si128(isDigit,digit),_mm_andnot_si128(isDigit,_mm_add_epi8(letter,_mm_set1_epi8(10))));
+		// Each 16 bit lane holds the high nibble in its low byte and the low nibble in its high byte
+		values[i] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v,_mm_set1_epi16(0x00FF)),4),_mm_srli_epi16(v,8));
+	}
+	out = _mm_packus_epi16(values[0],values[1]);
+	return _mm_movemask_epi8(valid) == 0xFFFF;
+}
+
+HEX_CODEC_TARGET_AVX2 static inline __m256i nibblesToAsciiAVX2(__m256i n,__m256i letterGap)
+{
+	__m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(n,_mm256_set1_epi8(9)),letterGap);
+	return _mm256_add_epi8(_mm256_add_epi8(n,_mm256_set1_epi8('0')),letters);
+}
+
+// Unpacking works within each 128 bit lane, so the quadwords are first ordered 0,2,1,3; the low halves of the lanes
+// then hold bytes 0-15 and the high halves bytes 16-31.  'reverse' reverses the bytes of each lane and takes the
+// lanes the other way round, 2,3,0,1 ordered 0,2,1,3.
+HEX_CODEC_TARGET_AVX2 static void encodeAVX2(const uint8_t *data,uint32_t blocks,char *dest,bool reverse,__m128i letterGap128)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0F);
+	const __m256i letterGap = _mm256_broadcastsi128_si256(letterGap128);
+	const __m256i reverseBytes = _mm256_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+	for (uint32_t i=0; i<blocks; i++)
+	{
+		__m256i v;
+		if ( reverse )
+		{
+			v = _mm256_loadu_si256((const __m256i *)(data - (i+1)*32));
+			v = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v,reverseBytes),_MM_SHUFFLE(1,3,0,2));
+		}
+		else
+		{
+			v = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(data + i*32)),_MM_SHUFFLE(3,1,2,0));
+		}
+		__m256i high = _mm256_and_si256(_mm256_srli_epi16(v,4),mask);
+		__m256i low = _mm256_and_si256(v,mask);
+		_mm256_storeu_si256((__m256i *)(dest + i*64),nibblesToAsciiAVX2(_mm256_unpacklo_epi8(high,low),letterGap));
+		_mm256_storeu_si256((__m256i *)(dest + i*64 + 32),nibblesToAsciiAVX2(_mm256_unpackhi_epi8(high,low),letterGap));
+	}
+}
+
+#endif // HEX_CODEC_X86
+
+char *encodeHex(const uint8_t *data,uint32_t length,char *output,bool upperCase)
+{
+	const char *digits = upperCase ? gUpperDigits : gLowerDigits;
+	uint32_t i = 0;
+#ifdef HEX_CODEC_X86
+	const __m128i letterGap = _mm_set1_epi8(char((upperCase ? 'A' : 'a') - '0' - 10));
+	if ( length >= 32 && getCpuFeatures().mAVX2 )
+	{
+		encodeAVX2(data,length/32,output,false,letterGap);
+		i = length & ~31u;
+	}
+	for (; i+16<=length; i+=16)
+	{
+		encode16(_mm_loadu_si128((const __m128i *)(data+i)),output+i*2,letterGap);
+	}
+#endif
+	for (; i<length; i++)
+	{
+		encodeByte(data[i],output+i*2,digits);
+	}
+	output[length*2] = 0;
+	return output;
+}
+
+char *encodeHexReverse(const uint8_t *data,uint32_t length,char *output,bool upperCase)
+{
+	const char *digits = upperCase ? gUpperDigits : gLowerDigits;
+	uint32_t i = 0;		// Bytes written so far, from the end of 'data'
+#ifdef HEX_CODEC_X86
+	const __m128i letterGap = _mm_set1_epi8(char((upperCase ? 'A' : 'a') - '0' - 10));
+	if ( length >= 32 && getCpuFeatures().mAVX2 )
+	{
+		encodeAVX2(data+length,length/32,output,true,letterGap);
+		i = length & ~31u;
+	}
+	for (; i+16<=length; i+=16)
+	{
+		encode16(reverse16(_mm_loadu_si128((const __m128i *)(data+length-i-16))),output+i*2,letterGap);
+	}
+#endif
+	for (; i<length; i++)
+	{
+		encodeByte(data[length-1-i],output+i*2,digits);
+	}
+	output[length*2] = 0;
+	return output;
+}
+
+bool decodeHex(const char *input,uint32_t length,uint8_t *output)
+{
+	uint32_t i = 0;
+	bool ok = true;
+#ifdef HEX_CODEC_X86
+	for (; i+16<=length; i+=16)
+	{
+		__m128i v;
+		ok &= decode16(input+i*2,v);
+		_mm_storeu_si128((__m128i *)(output+i),v);
+	}
+#endif
+	for (; i<length; i++)
+	{
+		ok &= decodeByte(input+i*2,output[i]);
+	}
+	return ok;
+}
+
+bool decodeHexReverse(const char *input,uint32_t length,uint8_t *output)
+{
+	uint32_t i = 0;
+	bool ok = true;
+#ifdef HEX_CODEC_X86
+	for (; i+16<=length; i+=16)
+	{
+		__m128i v;
+		ok &= decode16(input+i*2,v);
+		_mm_storeu_si128((__m128i *)(output+length-i-16),reverse16(v));
+	}
+#endif
+	for (; i<length; i++)
+	{
+		ok &= decodeByte(input+i*2,output[length-1-i]);
+	}
+	return ok;
+}
@@ -0,0 +1,154 @@
+#include "MerkleVerifier.h"
+#include "SHA256.h"
+
+#include <string.h>
+#include <vector>
+
+// The witness commitment is an output script of OP_RETURN, a 36 byte push, this 4 byte tag and the 32 byte commitment
+#define WITNESS_COMMITMENT_SIZE 38
+#define WITNESS_COMMITMENT_OFFSET 6
+
+namespace merkleverifier
+{
+
+static const uint8_t gWitnessCommitmentHeader[WITNESS_COMMITMENT_OFFSET] = { 0x6a, 0x24, 0xaa, 0x21, 0xa9, 0xed };
+
+class MerkleVerifierImpl : public MerkleVerifier
+{
+public:
+	virtual BlockChain::MerkleStatus verify(const BlockChain::Block &block) final
+	{
+		uint32_t count = block.transactionCount;
+		if ( count == 0 || block.transactions == nullptr || block.merkleRoot == nullptr )
+		{
+			return BlockChain::MS_ROOT_MISMATCH;
+		}
+		mLeaves.resize(size_t(count)*32);
+		bool hasWitness = false;
+		for (uint32_t i=0; i<count; i++)
+		{
+			memcpy(&mLeaves[size_t(i)*32],block.transactions[i].transactionHash,32);
+			hasWitness |= block.transactions[i].hasWitness;
+		}
+		uint8_t root[32];
+		bool mutated;
+		computeMerkleRoot(getLeaves(),count,root,mutated);
+		if ( memcmp(root,block.merkleRoot,32) != 0 )
+		{
+			return BlockChain::MS_ROOT_MISMATCH;
+		}
+		if ( mutated )
+		{
+			return BlockChain::MS_MUTATED;
+		}
+		return verifyWitnessCommitment(block,hasWitness);
+	}
+
+	virtual void computeMerkleRoot(const uint8_t (*hashes)[32],uint32_t count,uint8_t root[32],bool &mutated) final
+	{
+		mutated = false;
+		if ( count == 0 )
+		{
+			memset(root,0,32);
+			return;
+		}
+		// Each level is stored as one contiguous run of hashes, so every pair of siblings is already the 64 byte
+		// message to be hashed and the whole level goes to the batch in place.  An odd last hash is paired with a copy.
+		mLevel.assign(hashes[0],hashes[0]+size_t(count)*32);
+		while ( count > 1 )
+		{
+			for (uint32_t i=0; i+1<count; i+=2)
+			{
+				if ( memcmp(&mLevel[size_t(i)*32],&mLevel[size_t(i+1)*32],32) == 0 )
+				{
+					mutated = true;
+				}
+			}
+			if ( count & 1 )
+			{
+				mLevel.resize(size_t(count+1)*32);
+				memcpy(&mLevel[size_t(count)*32],&mLevel[size_t(count-1)*32],32);
+				count++;
+			}
+			uint32_t pairs = count / 2;
+			mInputs.resize(pairs);
+			mSizes.resize(pairs);
+			for (uint32_t i=0; i<pairs; i++)
+			{
+				mInputs[i] = &mLevel[size_t(i)*64];
+				mSizes[i] = 64;
+			}
+			mNextLevel.resize(size_t(pairs)*32);
+			computeDoubleSHA256Batch(pairs,&mInputs[0],&mSizes[0],reinterpret_cast< uint8_t (*)[32] >(&mNextLevel[0]));
+			mLevel.swap(mNextLevel);
+			count = pairs;
+		}
+		memcpy(root,&mLevel[0],32);
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	const uint8_t (*getLeaves(void) const)[32]
+	{
+		return reinterpret_cast< const uint8_t (*)[32] >(&mLeaves[0]);
+	}
+
+	// BIP141: the last coinbase output carrying the commitment header holds the double SHA256 of the wtxid merkle
+	// root (with the coinbase's wtxid taken as zero) followed by the 32 byte reserved value, which is the single
+	// item on the coinbase input's witness stack
+	BlockChain::MerkleStatus verifyWitnessCommitment(const BlockChain::Block &block,bool hasWitness)
+	{
+		const BlockChain::BlockTransaction &coinbase = block.transactions[0];
+		const uint8_t *commitment = nullptr;
+		for (uint32_t i=0; i<coinbase.outputCount; i++)
+		{
+			const uint8_t *script = coinbase.outputs.getScript(i);
+			if ( coinbase.outputs.scriptLengths[i] >= WITNESS_COMMITMENT_SIZE && memcmp(script,gWitnessCommitmentHeader,WITNESS_COMMITMENT_OFFSET) == 0 )
+			{
+				commitment = script + WITNESS_COMMITMENT_OFFSET;
+			}
+		}
+		const uint8_t *reserved = nullptr;
+		if ( coinbase.inputCount && coinbase.inputs[0].witnessCount == 1 && coinbase.inputs[0].witness[0] == 32 )
+		{
+			reserved = coinbase.inputs[0].witness + 1;
+		}
+		// Before SegWit a block may carry an output which looks like a commitment by chance; only a block with
+		// witness data is required to commit to it
+		if ( commitment == nullptr || reserved == nullptr )
+		{
+			return hasWitness ? BlockChain::MS_COMMITMENT_MISSING : BlockChain::MS_VALID;
+		}
+		uint32_t count = block.transactionCount;
+		memset(&mLeaves[0],0,32);
+		for (uint32_t i=1; i<count; i++)
+		{
+			memcpy(&mLeaves[size_t(i)*32],block.transactions[i].witnessHash,32);
+		}
+		uint8_t node[64];
+		bool mutated;
+		computeMerkleRoot(getLeaves(),count,node,mutated);
+		memcpy(node+32,reserved,32);
+		uint8_t expected[32];
+		computeDoubleSHA256Node(node,expected);
+		return memcmp(expected,commitment,32) == 0 ? BlockChain::MS_VALID : BlockChain::MS_COMMITMENT_MISMATCH;
+	}
+
+	std::vector< uint8_t >			mLeaves;	// The txids, or wtxids, of the block; 32 bytes each
+	std::vector< uint8_t >			mLevel;		// The level of the tree being hashed
+	std::vector< uint8_t >			mNextLevel;
+	std::vector< const uint8_t *>	mInputs;	// The sibling pairs of the level, for the batch
+	std::vector< uint32_t >			mSizes;
+};
+
+MerkleVerifier *MerkleVerifier::create(void)
+{
+	auto ret = new MerkleVerifierImpl;
+	return static_cast< MerkleVerifier *>(ret);
+}
+
+}
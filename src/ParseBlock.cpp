@@ -1,8 +1,13 @@
 #include "ParseBlock.h"
 #include "CBlockIndex.h"
+#include "BlockChain.h"
+#include "BlockCache.h"
+#include "ScopedTime.h"
+
+#include <stdio.h>
 
 #ifdef _MSC_VER
-#pragma warning(disable:4100)
+#pragma warning(disable:4100 4996)
 #endif
 
 namespace parseblock
@@ -11,7 +16,7 @@ namespace parseblock
 class ParseBlockImpl : public ParseBlock
 {
 public:
-	ParseBlockImpl(void)
+	ParseBlockImpl(blockcache::BlockCache *cache) : mBlockCache(cache)
 	{
 	}
 
@@ -19,12 +24,39 @@ public:
 	{
 	}
 
-	virtual uint32_t parseBlock(const CBlockIndex &index,const char *dataDir) final
+	virtual uint32_t parseBlock(const CBlockIndex &index) final
 	{
 		uint32_t ret = 0;
 
 		index.printInfo();
 
+		Timer t;
+		const BlockChain::Block *b = mBlockCache->getBlock(uint32_t(index.mBlockHeight));
+		double lookupTime = t.getElapsedSeconds();
+		if ( b )
+		{
+			uint32_t witnessCount = 0;
+			for (uint32_t i=0; i<b->transactionCount; i++)
+			{
+				if ( b->transactions[i].hasWitness )
+				{
+					witnessCount++;
+				}
+			}
+			printf("BlockLength     : %d\n", b->blockLength);
+			printf("Transactions    : %d (%d with witness data)\n", b->transactionCount, witnessCount);
+			printf("Inputs          : %d\n", b->totalInputCount);
+			printf("Outputs         : %d\n", b->totalOutputCount);
+			printf("OutputValue     : %0.8f\n", double(b->blockReward) / ONE_BTC);
+			printf("Warning         : %s\n", b->warning ? "true" : "false");
+			printf("LookupTime      : %0.3f ms\n", lookupTime*1000);
+			ret = b->transactionCount;
+		}
+		else
+		{
+			printf("Failed to parse block %d\n", uint32_t(index.mBlockHeight));
+		}
+
 		return ret;
 	}
 
@@ -32,11 +64,13 @@ public:
 	{
 		delete this;
 	}
+
+	blockcache::BlockCache	*mBlockCache{nullptr};
 };
 
-ParseBlock *ParseBlock::create(void)
+ParseBlock *ParseBlock::create(blockcache::BlockCache *cache)
 {
-	auto ret = new ParseBlockImpl;
+	auto ret = new ParseBlockImpl(cache);
 	return static_cast< ParseBlock *>(ret);
 }
 
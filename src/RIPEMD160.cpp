@@ -1,6 +1,7 @@
 #include "RIPEMD160.h"
 #include <string.h>
 #include <stdio.h>
+#include <atomic>
 
 
 /********************************************************************\
@@ -407,3 +408,340 @@ void computeRIPEMD160(const void *_message,uint32_t length,uint8_t hashcode[20])
 }
 
 /************************ end of file rmd160.c **********************/
+
+// Multi-buffer kernels; each compresses one block of 8 (AVX2) or 16 (AVX-512) independent messages at once, with
+// each message in its own vector lane.  'state' holds the five state words of every lane and 'words' the sixteen
+// message words of every lane, both word by word.
+#define RIPEMD160_MAX_LANES 16
+
+typedef void (*RIPEMD160LanesTransform)(uint32_t *state, const uint32_t *words);
+
+// The message word and rotation of each of the 80 steps of the left and right lines; step j of a line uses the
+// function and constant of round j/16
+static const uint8_t gLeftWord[80] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13 };
+static const uint8_t gRightWord[80] = {
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11 };
+static const uint8_t gLeftShift[80] = {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6 };
+static const uint8_t gRightShift[80] = {
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11 };
+static const uint32_t gLeftConstant[5] = { 0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e };
+static const uint32_t gRightConstant[5] = { 0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000 };
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RIPEMD160_X86
+#endif
+
+#ifdef RIPEMD160_X86
+
+#include "CpuFeatures.h"
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define RIPEMD160_TARGET_AVX2
+#define RIPEMD160_TARGET_AVX512
+#else
+#define RIPEMD160_TARGET_AVX2 __attribute__((target("avx2")))
+#define RIPEMD160_TARGET_AVX512 __attribute__((target("avx2,avx512f")))
+#endif
+
+// The five boolean functions; round g of the left line uses function g and round g of the right line function 4-g
+RIPEMD160_TARGET_AVX2 static inline __m256i functionAVX2(uint32_t f, __m256i x, __m256i y, __m256i z)
+{
+	const __m256i ones = _mm256_set1_epi32(-1);
+	switch (f)
+	{
+		case 0:
+			return _mm256_xor_si256(_mm256_xor_si256(x, y), z);
+		case 1:
+			return _mm256_or_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z));
+		case 2:
+			return _mm256_xor_si256(_mm256_or_si256(x, _mm256_xor_si256(y, ones)), z);
+		case 3:
+			return _mm256_or_si256(_mm256_and_si256(x, z), _mm256_andnot_si256(z, y));
+		default:
+			return _mm256_xor_si256(x, _mm256_or_si256(y, _mm256_xor_si256(z, ones)));
+	}
+}
+
+RIPEMD160_TARGET_AVX2 static inline __m256i rotateAVX2(__m256i x, uint32_t n)
+{
+	return _mm256_or_si256(_mm256_slli_epi32(x, int(n)), _mm256_srli_epi32(x, int(32 - n)));
+}
+
+RIPEMD160_TARGET_AVX2 static void transformLanesAVX2(uint32_t *state, const uint32_t *words)
+{
+	__m256i x[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		x[i] = _mm256_loadu_si256((const __m256i *)(words + i * 8));
+	}
+	__m256i h[5];
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		h[i] = _mm256_loadu_si256((const __m256i *)(state + i * 8));
+	}
+	__m256i al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4];
+	__m256i ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4];
+	for (uint32_t g = 0; g < 5; g++)
+	{
+		const __m256i kl = _mm256_set1_epi32(int(gLeftConstant[g]));
+		const __m256i kr = _mm256_set1_epi32(int(gRightConstant[g]));
+		for (uint32_t j = g * 16; j < g * 16 + 16; j++)
+		{
+			__m256i t = _mm256_add_epi32(_mm256_add_epi32(al, functionAVX2(g, bl, cl, dl)), _mm256_add_epi32(x[gLeftWord[j]], kl));
+			t = _mm256_add_epi32(rotateAVX2(t, gLeftShift[j]), el);
+			al = el;
+			el = dl;
+			dl = rotateAVX2(cl, 10);
+			cl = bl;
+			bl = t;
+			t = _mm256_add_epi32(_mm256_add_epi32(ar, functionAVX2(4 - g, br, cr, dr)), _mm256_add_epi32(x[gRightWord[j]], kr));
+			t = _mm256_add_epi32(rotateAVX2(t, gRightShift[j]), er);
+			ar = er;
+			er = dr;
+			dr = rotateAVX2(cr, 10);
+			cr = br;
+			br = t;
+		}
+	}
+	__m256i t = _mm256_add_epi32(_mm256_add_epi32(h[1], cl), dr);
+	h[1] = _mm256_add_epi32(_mm256_add_epi32(h[2], dl), er);
+	h[2] = _mm256_add_epi32(_mm256_add_epi32(h[3], el), ar);
+	h[3] = _mm256_add_epi32(_mm256_add_epi32(h[4], al), br);
+	h[4] = _mm256_add_epi32(_mm256_add_epi32(h[0], bl), cr);
+	h[0] = t;
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		_mm256_storeu_si256((__m256i *)(state + i * 8), h[i]);
+	}
+}
+
+// AVX-512 has a variable rotate and a three input logic instruction which computes each function in one step.
+// GCC's AVX-512 intrinsics initialize their unused merge source with itself, which trips its own warning.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+RIPEMD160_TARGET_AVX512 static inline __m512i functionAVX512(uint32_t f, __m512i x, __m512i y, __m512i z)
+{
+	switch (f)
+	{
+		case 0:
+			return _mm512_ternarylogic_epi32(x, y, z, 0x96);	// x ^ y ^ z
+		case 1:
+			return _mm512_ternarylogic_epi32(x, y, z, 0xCA);	// (x & y) | (~x & z)
+		case 2:
+			return _mm512_ternarylogic_epi32(x, y, z, 0x59);	// (x | ~y) ^ z
+		case 3:
+			return _mm512_ternarylogic_epi32(x, y, z, 0xE4);	// (x & z) | (y & ~z)
+		default:
+			return _mm512_ternarylogic_epi32(x, y, z, 0x2D);	// x ^ (y | ~z)
+	}
+}
+
+RIPEMD160_TARGET_AVX512 static void transformLanesAVX512(uint32_t *state, const uint32_t *words)
+{
+	__m512i x[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		x[i] = _mm512_loadu_si512((const void *)(words + i * 16));
+	}
+	__m512i h[5];
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		h[i] = _mm512_loadu_si512((const void *)(state + i * 16));
+	}
+	const __m512i ten = _mm512_set1_epi32(10);
+	__m512i al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4];
+	__m512i ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4];
+	for (uint32_t g = 0; g < 5; g++)
+	{
+		const __m512i kl = _mm512_set1_epi32(int(gLeftConstant[g]));
+		const __m512i kr = _mm512_set1_epi32(int(gRightConstant[g]));
+		for (uint32_t j = g * 16; j < g * 16 + 16; j++)
+		{
+			__m512i t = _mm512_add_epi32(_mm512_add_epi32(al, functionAVX512(g, bl, cl, dl)), _mm512_add_epi32(x[gLeftWord[j]], kl));
+			t = _mm512_add_epi32(_mm512_rolv_epi32(t, _mm512_set1_epi32(gLeftShift[j])), el);
+			al = el;
+			el = dl;
+			dl = _mm512_rolv_epi32(cl, ten);
+			cl = bl;
+			bl = t;
+			t = _mm512_add_epi32(_mm512_add_epi32(ar, functionAVX512(4 - g, br, cr, dr)), _mm512_add_epi32(x[gRightWord[j]], kr));
+			t = _mm512_add_epi32(_mm512_rolv_epi32(t, _mm512_set1_epi32(gRightShift[j])), er);
+			ar = er;
+			er = dr;
+			dr = _mm512_rolv_epi32(cr, ten);
+			cr = br;
+			br = t;
+		}
+	}
+	__m512i t = _mm512_add_epi32(_mm512_add_epi32(h[1], cl), dr);
+	h[1] = _mm512_add_epi32(_mm512_add_epi32(h[2], dl), er);
+	h[2] = _mm512_add_epi32(_mm512_add_epi32(h[3], el), ar);
+	h[3] = _mm512_add_epi32(_mm512_add_epi32(h[4], al), br);
+	h[4] = _mm512_add_epi32(_mm512_add_epi32(h[0], bl), cr);
+	h[0] = t;
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		_mm512_storeu_si512((void *)(state + i * 16), h[i]);
+	}
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // RIPEMD160_X86
+
+// Returns the kernel and lane count of a batch implementation; null if it is not supported here
+static RIPEMD160LanesTransform getLanesTransform(RIPEMD160BatchImplementation i, uint32_t &lanes)
+{
+	lanes = 1;
+#ifdef RIPEMD160_X86
+	if (i == RIPEMD160_BATCH_AVX2 && getCpuFeatures().mAVX2)
+	{
+		lanes = 8;
+		return transformLanesAVX2;
+	}
+	if (i == RIPEMD160_BATCH_AVX512 && getCpuFeatures().mAVX512)
+	{
+		lanes = 16;
+		return transformLanesAVX512;
+	}
+#else
+	(void)i;
+#endif
+	return nullptr;
+}
+
+// There are no RIPEMD160 instructions, so the widest lanes the processor has always win
+static RIPEMD160BatchImplementation detectBatchImplementation(void)
+{
+	uint32_t lanes;
+	if (getLanesTransform(RIPEMD160_BATCH_AVX512, lanes))
+	{
+		return RIPEMD160_BATCH_AVX512;
+	}
+	if (getLanesTransform(RIPEMD160_BATCH_AVX2, lanes))
+	{
+		return RIPEMD160_BATCH_AVX2;
+	}
+	return RIPEMD160_BATCH_SINGLE;
+}
+
+static std::atomic< int > gBatchImplementation(-1);	// -1 until first use
+
+RIPEMD160BatchImplementation getRIPEMD160BatchImplementation(void)
+{
+	int i = gBatchImplementation.load(std::memory_order_relaxed);
+	if (i < 0)
+	{
+		i = int(detectBatchImplementation());
+		gBatchImplementation.store(i, std::memory_order_relaxed);
+	}
+	return RIPEMD160BatchImplementation(i);
+}
+
+bool setRIPEMD160BatchImplementation(RIPEMD160BatchImplementation i)
+{
+	uint32_t lanes;
+	if (i != RIPEMD160_BATCH_SINGLE && getLanesTransform(i, lanes) == nullptr)
+	{
+		return false;
+	}
+	gBatchImplementation.store(int(i), std::memory_order_relaxed);
+	return true;
+}
+
+const char *getRIPEMD160BatchImplementationName(RIPEMD160BatchImplementation i)
+{
+	switch (i)
+	{
+		case RIPEMD160_BATCH_SINGLE:
+			return "one at a time";
+		case RIPEMD160_BATCH_AVX2:
+			return "AVX2 x8";
+		case RIPEMD160_BATCH_AVX512:
+			return "AVX-512 x16";
+	}
+	return "unknown";
+}
+
+void computeRIPEMD160Batch(uint32_t count, const uint8_t (*inputs)[32], uint8_t (*destHashes)[20])
+{
+	uint32_t lanes = 1;
+	RIPEMD160LanesTransform transform = getLanesTransform(getRIPEMD160BatchImplementation(), lanes);
+	// A batch too small to fill half of the lanes is quicker one message at a time
+	if (transform == nullptr || count * 2 < lanes)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			computeRIPEMD160(inputs[i], 32, destHashes[i]);
+		}
+		return;
+	}
+	// A 32 byte message is a single block; the padding bit and the 256 bit length are the same in every lane
+	uint32_t words[16 * RIPEMD160_MAX_LANES];
+	uint32_t state[5 * RIPEMD160_MAX_LANES];
+	memset(words, 0, sizeof(words));
+	for (uint32_t l = 0; l < lanes; l++)
+	{
+		words[8 * lanes + l] = 0x80;
+		words[14 * lanes + l] = 256;
+	}
+	for (uint32_t first = 0; first < count; first += lanes)
+	{
+		uint32_t active = count - first < lanes ? count - first : lanes;
+		for (uint32_t l = 0; l < active; l++)
+		{
+			const uint8_t *message = inputs[first + l];
+			for (uint32_t w = 0; w < 8; w++)
+			{
+				words[w * lanes + l] = BYTES_TO_DWORD(message + w * 4);
+			}
+		}
+		uint32_t initialState[5];
+		MDinit(initialState);
+		for (uint32_t w = 0; w < 5; w++)
+		{
+			for (uint32_t l = 0; l < lanes; l++)
+			{
+				state[w * lanes + l] = initialState[w];
+			}
+		}
+		transform(state, words);	// idle lanes hash whatever their words hold; the result is ignored
+		for (uint32_t l = 0; l < active; l++)
+		{
+			uint8_t *hashcode = destHashes[first + l];
+			for (uint32_t w = 0; w < 5; w++)
+			{
+				uint32_t v = state[w * lanes + l];
+				hashcode[w * 4] = uint8_t(v);
+				hashcode[w * 4 + 1] = uint8_t(v >> 8);
+				hashcode[w * 4 + 2] = uint8_t(v >> 16);
+				hashcode[w * 4 + 3] = uint8_t(v >> 24);
+			}
+		}
+	}
+}
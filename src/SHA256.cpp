@@ -29,7 +29,9 @@
  */
 
 #include "SHA256.h"
+#include "CpuFeatures.h"
 #include <string.h>
+#include <atomic>
 
 #ifdef _MSC_VER 
 #pragma warning(disable:4718) // Disable a compiler optimization warning on visual studio
@@ -46,17 +48,7 @@
 // Uncomment this line of code if you want this routine to compile for a big-endian processor
 //#define WORDS_BIGENDIAN
 
-typedef struct 
-{
-	uint64_t totalLength;
-	uint32_t hash[SHA256_HASH_WORDS];
-	uint32_t bufferLength;
-	union 
-	{
-		uint32_t words[16];
-		uint8_t bytes[64];
-	} buffer;
-} sha256_ctx_t;
+typedef SHA256Context sha256_ctx_t;
 
 void sha256_init(sha256_ctx_t * sc);
 void sha256_update(sha256_ctx_t * sc, const void *data, uint32_t len);
@@ -174,6 +166,11 @@ static inline void setEndian(void)
 
 #endif				/* !RUNTIME_ENDIAN */
 
+static const uint32_t initialState[SHA256_HASH_WORDS] = 
+{
+	0x6a09e667L, 0xbb67ae85L, 0x3c6ef372L, 0xa54ff53aL, 0x510e527fL, 0x9b05688cL, 0x1f83d9abL, 0x5be0cd19L
+};
+
 static const uint8_t padding[64] = {
 	0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -191,29 +188,12 @@ void sha256_init(sha256_ctx_t * sc)
 	setEndian();
 #endif				/* RUNTIME_ENDIAN */
 
-	sc->totalLength = 0LL;
-	sc->hash[0] = 0x6a09e667L;
-	sc->hash[1] = 0xbb67ae85L;
-	sc->hash[2] = 0x3c6ef372L;
-	sc->hash[3] = 0xa54ff53aL;
-	sc->hash[4] = 0x510e527fL;
-	sc->hash[5] = 0x9b05688cL;
-	sc->hash[6] = 0x1f83d9abL;
-	sc->hash[7] = 0x5be0cd19L;
-	sc->bufferLength = 0L;
-}
-
-static void burnStack(int size)
-{
-	char buf[128];
-
-	memset(buf, 0, sizeof(buf));
-	size -= sizeof(buf);
-	if (size > 0)
-		burnStack(size);
+	sc->mTotalLength = 0LL;
+	memcpy(sc->mState, initialState, sizeof(sc->mState));
+	sc->mBufferLength = 0L;
 }
 
-static void SHA256Guts(sha256_ctx_t * sc, const uint32_t * cbuf)
+static void SHA256Guts(uint32_t state[SHA256_HASH_WORDS], const uint8_t * cbuf)
 {
 	uint32_t buf[64];
 	uint32_t *W, *W2, *W7, *W15, *W16;
@@ -226,8 +206,10 @@ static void SHA256Guts(sha256_ctx_t * sc, const uint32_t * cbuf)
 
 	for (i = 15; i >= 0; i--) 
 	{
-		*(W++) = BYTESWAP(*cbuf);
-		cbuf++;
+		uint32_t word;
+		memcpy(&word, cbuf, sizeof(word)); // the input need not be aligned
+		*(W++) = BYTESWAP(word);
+		cbuf += sizeof(word);
 	}
 
 	W16 = &buf[0];
@@ -242,14 +224,14 @@ static void SHA256Guts(sha256_ctx_t * sc, const uint32_t * cbuf)
 		W15++;
 	}
 
-	a = sc->hash[0];
-	b = sc->hash[1];
-	c = sc->hash[2];
-	d = sc->hash[3];
-	e = sc->hash[4];
-	f = sc->hash[5];
-	g = sc->hash[6];
-	h = sc->hash[7];
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
 
 	Kp = K;
 	W = buf;
@@ -407,64 +389,385 @@ static void SHA256Guts(sha256_ctx_t * sc, const uint32_t * cbuf)
 #error "SHA256_UNROLL must be 1, 2, 4, 8, 16, 32, or 64!"
 #endif
 
-	sc->hash[0] += a;
-	sc->hash[1] += b;
-	sc->hash[2] += c;
-	sc->hash[3] += d;
-	sc->hash[4] += e;
-	sc->hash[5] += f;
-	sc->hash[6] += g;
-	sc->hash[7] += h;
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+// Applies the compression function to 'blockCount' consecutive 64 byte blocks
+typedef void (*SHA256Transform)(uint32_t state[SHA256_HASH_WORDS], const uint8_t *data, uint32_t blockCount);
+
+static void transformPortable(uint32_t state[SHA256_HASH_WORDS], const uint8_t *data, uint32_t blockCount)
+{
+	for (uint32_t i = 0; i < blockCount; i++)
+	{
+		SHA256Guts(state, data + i * 64);
+	}
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHA256_X86
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define SHA256_ARMV8
+#endif
+
+#ifdef SHA256_X86
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define SHA256_TARGET_SHANI
+#else
+#define SHA256_TARGET_SHANI __attribute__((target("sha,sse4.1,ssse3")))
+#endif
+
+// Four rounds using the Intel SHA extensions.  'g' is the group of four rounds; M0 holds the message words of this
+// group, M1 those of the next group and so on.  The message schedule for group g+4 is built in M1 (the oldest
+// words) as the rounds go.
+#define SHANI_ROUNDS(g, M0, M1, M2, M3) { \
+		msg = _mm_add_epi32(M0, _mm_loadu_si128((const __m128i *)&K[(g) * 4])); \
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+		if ((g) >= 3 && (g) <= 14) \
+		{ \
+			tmp = _mm_alignr_epi8(M0, M3, 4); \
+			M1 = _mm_add_epi32(M1, tmp); \
+			M1 = _mm_sha256msg2_epu32(M1, M0); \
+		} \
+		msg = _mm_shuffle_epi32(msg, 0x0E); \
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+		if ((g) >= 1 && (g) <= 12) \
+		{ \
+			M3 = _mm_sha256msg1_epu32(M3, M0); \
+		} \
+	}
+
+SHA256_TARGET_SHANI static void transformSHANI(uint32_t state[SHA256_HASH_WORDS], const uint8_t *data, uint32_t blockCount)
+{
+	const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	__m128i state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);					// CDAB
+	state1 = _mm_shuffle_epi32(state1, 0x1B);			// EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);	// ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);		// CDGH
+	__m128i msg;
+	for (uint32_t i = 0; i < blockCount; i++, data += 64)
+	{
+		__m128i saveState0 = state0;
+		__m128i saveState1 = state1;
+		__m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), byteSwap);
+		__m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), byteSwap);
+		__m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), byteSwap);
+		__m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), byteSwap);
+		SHANI_ROUNDS(0, m0, m1, m2, m3);
+		SHANI_ROUNDS(1, m1, m2, m3, m0);
+		SHANI_ROUNDS(2, m2, m3, m0, m1);
+		SHANI_ROUNDS(3, m3, m0, m1, m2);
+		SHANI_ROUNDS(4, m0, m1, m2, m3);
+		SHANI_ROUNDS(5, m1, m2, m3, m0);
+		SHANI_ROUNDS(6, m2, m3, m0, m1);
+		SHANI_ROUNDS(7, m3, m0, m1, m2);
+		SHANI_ROUNDS(8, m0, m1, m2, m3);
+		SHANI_ROUNDS(9, m1, m2, m3, m0);
+		SHANI_ROUNDS(10, m2, m3, m0, m1);
+		SHANI_ROUNDS(11, m3, m0, m1, m2);
+		SHANI_ROUNDS(12, m0, m1, m2, m3);
+		SHANI_ROUNDS(13, m1, m2, m3, m0);
+		SHANI_ROUNDS(14, m2, m3, m0, m1);
+		SHANI_ROUNDS(15, m3, m0, m1, m2);
+		state0 = _mm_add_epi32(state0, saveState0);
+		state1 = _mm_add_epi32(state1, saveState1);
+	}
+	tmp = _mm_shuffle_epi32(state0, 0x1B);				// FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);			// DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);		// DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8);			// ABEF
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+#endif // SHA256_X86
+
+#ifdef SHA256_ARMV8
+
+#include <arm_neon.h>
+
+// The ARMv8 cryptography extensions; only compiled when the target architecture guarantees them
+static void transformARMV8(uint32_t state[SHA256_HASH_WORDS], const uint8_t *data, uint32_t blockCount)
+{
+	uint32x4_t state0 = vld1q_u32(&state[0]);
+	uint32x4_t state1 = vld1q_u32(&state[4]);
+	for (uint32_t i = 0; i < blockCount; i++, data += 64)
+	{
+		uint32x4_t saveState0 = state0;
+		uint32x4_t saveState1 = state1;
+		uint32x4_t m[4];
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			m[j] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + j * 16)));
+		}
+		for (uint32_t g = 0; g < 16; g++)
+		{
+			uint32x4_t &cur = m[g & 3];
+			uint32x4_t k = vaddq_u32(cur, vld1q_u32(&K[g * 4]));
+			if (g < 12)
+			{
+				cur = vsha256su0q_u32(cur, m[(g + 1) & 3]);
+			}
+			uint32x4_t previous = state0;
+			state0 = vsha256hq_u32(state0, state1, k);
+			state1 = vsha256h2q_u32(state1, previous, k);
+			if (g < 12)
+			{
+				cur = vsha256su1q_u32(cur, m[(g + 2) & 3], m[(g + 3) & 3]);
+			}
+		}
+		state0 = vaddq_u32(state0, saveState0);
+		state1 = vaddq_u32(state1, saveState1);
+	}
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+#endif // SHA256_ARMV8
+
+// Multi-buffer kernels; each compresses one block of 8 (AVX2) or 16 (AVX-512) independent messages at once, with
+// each message in its own vector lane.  'state' holds the eight state words of every lane, word by word, and
+// 'blocks' the 64 byte block of each lane, one after the other.
+#define SHA256_MAX_LANES 16
+
+typedef void (*SHA256LanesTransform)(uint32_t *state, const uint8_t *blocks);
+
+#ifdef SHA256_X86
+
+#ifdef _MSC_VER
+#define SHA256_TARGET_AVX2
+#define SHA256_TARGET_AVX512
+#else
+#define SHA256_TARGET_AVX2 __attribute__((target("avx2")))
+#define SHA256_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+
+#define AVX2_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define AVX2_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+SHA256_TARGET_AVX2 static void transformLanesAVX2(uint32_t *state, const uint8_t *blocks)
+{
+	const __m256i byteSwap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+											  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const __m256i offsets = _mm256_setr_epi32(0, 64, 128, 192, 256, 320, 384, 448);
+	__m256i w[16];
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)(blocks + i * 4), offsets, 1), byteSwap);
+	}
+	__m256i v[8];
+	for (int i = 0; i < 8; i++)
+	{
+		v[i] = _mm256_loadu_si256((const __m256i *)(state + i * 8));
+	}
+	__m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+	for (int i = 0; i < 64; i++)
+	{
+		__m256i wi = w[i & 15];
+		if (i >= 16)
+		{
+			__m256i w2 = w[(i - 2) & 15];
+			__m256i w15 = w[(i - 15) & 15];
+			__m256i s1 = AVX2_XOR3(AVX2_ROR(w2, 17), AVX2_ROR(w2, 19), _mm256_srli_epi32(w2, 10));
+			__m256i s0 = AVX2_XOR3(AVX2_ROR(w15, 7), AVX2_ROR(w15, 18), _mm256_srli_epi32(w15, 3));
+			wi = _mm256_add_epi32(_mm256_add_epi32(wi, s0), _mm256_add_epi32(s1, w[(i - 7) & 15]));
+			w[i & 15] = wi;
+		}
+		__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+		__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+		__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, AVX2_XOR3(AVX2_ROR(e, 6), AVX2_ROR(e, 11), AVX2_ROR(e, 25))),
+									  _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32(int(K[i]))), wi));
+		__m256i t2 = _mm256_add_epi32(AVX2_XOR3(AVX2_ROR(a, 2), AVX2_ROR(a, 13), AVX2_ROR(a, 22)), maj);
+		h = g;
+		g = f;
+		f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c;
+		c = b;
+		b = a;
+		a = _mm256_add_epi32(t1, t2);
+	}
+	__m256i r[8] = { a, b, c, d, e, f, g, h };
+	for (int i = 0; i < 8; i++)
+	{
+		_mm256_storeu_si256((__m256i *)(state + i * 8), _mm256_add_epi32(v[i], r[i]));
+	}
+}
+
+// AVX-512 has a rotate instruction and a three input logic instruction, which covers Ch, Maj and the three way xors.
+// GCC's AVX-512 intrinsics initialize their unused merge source with itself, which trips its own warning.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#define AVX512_XOR3(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+
+SHA256_TARGET_AVX512 static void transformLanesAVX512(uint32_t *state, const uint8_t *blocks)
+{
+	const __m512i byteSwap = _mm512_set4_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+	const __m512i offsets = _mm512_setr_epi32(0, 64, 128, 192, 256, 320, 384, 448, 512, 576, 640, 704, 768, 832, 896, 960);
+	__m512i w[16];
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = _mm512_shuffle_epi8(_mm512_i32gather_epi32(offsets, (const void *)(blocks + i * 4), 1), byteSwap);
+	}
+	__m512i v[8];
+	for (int i = 0; i < 8; i++)
+	{
+		v[i] = _mm512_loadu_si512((const void *)(state + i * 16));
+	}
+	__m512i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+	for (int i = 0; i < 64; i++)
+	{
+		__m512i wi = w[i & 15];
+		if (i >= 16)
+		{
+			__m512i w2 = w[(i - 2) & 15];
+			__m512i w15 = w[(i - 15) & 15];
+			__m512i s1 = AVX512_XOR3(_mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19), _mm512_srli_epi32(w2, 10));
+			__m512i s0 = AVX512_XOR3(_mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18), _mm512_srli_epi32(w15, 3));
+			wi = _mm512_add_epi32(_mm512_add_epi32(wi, s0), _mm512_add_epi32(s1, w[(i - 7) & 15]));
+			w[i & 15] = wi;
+		}
+		__m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+		__m512i maj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+		__m512i t1 = _mm512_add_epi32(_mm512_add_epi32(h, AVX512_XOR3(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11), _mm512_ror_epi32(e, 25))),
+									  _mm512_add_epi32(_mm512_add_epi32(ch, _mm512_set1_epi32(int(K[i]))), wi));
+		__m512i t2 = _mm512_add_epi32(AVX512_XOR3(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13), _mm512_ror_epi32(a, 22)), maj);
+		h = g;
+		g = f;
+		f = e;
+		e = _mm512_add_epi32(d, t1);
+		d = c;
+		c = b;
+		b = a;
+		a = _mm512_add_epi32(t1, t2);
+	}
+	__m512i r[8] = { a, b, c, d, e, f, g, h };
+	for (int i = 0; i < 8; i++)
+	{
+		_mm512_storeu_si512((void *)(state + i * 16), _mm512_add_epi32(v[i], r[i]));
+	}
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // SHA256_X86
+
+static SHA256Transform getTransform(SHA256Implementation i)
+{
+	switch (i)
+	{
+		case SHA256_PORTABLE:
+			return transformPortable;
+#ifdef SHA256_X86
+		case SHA256_SHANI:
+			return getCpuFeatures().mSHA ? transformSHANI : nullptr;
+#endif
+#ifdef SHA256_ARMV8
+		case SHA256_ARMV8:
+			return transformARMV8;
+#endif
+		default:
+			break;
+	}
+	return nullptr;
+}
+
+static SHA256Implementation detectImplementation(void)
+{
+	if (getTransform(SHA256_SHANI))
+	{
+		return SHA256_SHANI;
+	}
+	if (getTransform(SHA256_ARMV8))
+	{
+		return SHA256_ARMV8;
+	}
+	return SHA256_PORTABLE;
+}
+
+static void transformFirstUse(uint32_t state[SHA256_HASH_WORDS], const uint8_t *data, uint32_t blockCount);
+
+// Chosen on first use from the instructions the processor supports; constant initialized so hashing works even
+// from other static initializers
+static std::atomic< SHA256Implementation > gImplementation(SHA256_PORTABLE);
+static std::atomic< SHA256Transform > gTransformPointer(transformFirstUse);
+
+#define gTransform (gTransformPointer.load(std::memory_order_relaxed))
+
+static void transformFirstUse(uint32_t state[SHA256_HASH_WORDS], const uint8_t *data, uint32_t blockCount)
+{
+	SHA256Implementation i = detectImplementation();
+	gImplementation.store(i, std::memory_order_relaxed);
+	gTransformPointer.store(getTransform(i), std::memory_order_relaxed);
+	gTransform(state, data, blockCount);
 }
 
 void sha256_update(sha256_ctx_t * sc, const void *data, uint32_t len)
 {
 	uint32_t bufferBytesLeft;
 	uint32_t bytesToCopy;
-	int needBurn = 0;
 
-	if (sc->bufferLength) 
+	if (sc->mBufferLength) 
 	{
-		bufferBytesLeft = 64L - sc->bufferLength;
+		bufferBytesLeft = 64L - sc->mBufferLength;
 		bytesToCopy = bufferBytesLeft;
 		if (bytesToCopy > len)
 		{
 			bytesToCopy = len;
 		}
-		memcpy(&sc->buffer.bytes[sc->bufferLength], data, bytesToCopy);
-		sc->totalLength += bytesToCopy * 8L;
-		sc->bufferLength += bytesToCopy;
+		memcpy(&sc->mBuffer[sc->mBufferLength], data, bytesToCopy);
+		sc->mTotalLength += bytesToCopy * 8L;
+		sc->mBufferLength += bytesToCopy;
 		data = ((uint8_t *) data) + bytesToCopy;
 		len -= bytesToCopy;
-		if (sc->bufferLength == 64L) 
+		if (sc->mBufferLength == 64L) 
 		{
-			SHA256Guts(sc, sc->buffer.words);
-			needBurn = 1;
-			sc->bufferLength = 0L;
+			gTransform(sc->mState, sc->mBuffer, 1);
+			sc->mBufferLength = 0L;
 		}
 	}
 
-	while (len > 63L) 
+	if (len > 63L) 
 	{
-		sc->totalLength += 512L;
-
-		SHA256Guts(sc, (const uint32_t *)data);
-		needBurn = 1;
-
-		data = ((uint8_t *) data) + 64L;
-		len -= 64L;
+		uint32_t blockCount = len / 64;
+		sc->mTotalLength += uint64_t(blockCount) * 512L;
+		gTransform(sc->mState, (const uint8_t *)data, blockCount);
+		data = ((uint8_t *) data) + blockCount * 64L;
+		len -= blockCount * 64L;
 	}
 
 	if (len) 
 	{
-		memcpy(&sc->buffer.bytes[sc->bufferLength], data, len);
-		sc->totalLength += len * 8L;
-		sc->bufferLength += len;
+		memcpy(&sc->mBuffer[sc->mBufferLength], data, len);
+		sc->mTotalLength += len * 8L;
+		sc->mBufferLength += len;
 	}
+}
 
-	if (needBurn)
+static void storeHash(const uint32_t state[SHA256_HASH_WORDS], uint8_t hash[SHA256_HASH_SIZE])
+{
+	for (int i = 0; i < SHA256_HASH_WORDS; i++) 
 	{
-		burnStack(sizeof(uint32_t[74]) + sizeof(uint32_t *[6]) +  sizeof(int));
+		hash[i * 4 + 0] = uint8_t(state[i] >> 24);
+		hash[i * 4 + 1] = uint8_t(state[i] >> 16);
+		hash[i * 4 + 2] = uint8_t(state[i] >> 8);
+		hash[i * 4 + 3] = uint8_t(state[i]);
 	}
 }
 
@@ -472,26 +775,21 @@ void sha256_finalize(sha256_ctx_t * sc, uint8_t hash[SHA256_HASH_SIZE])
 {
 	uint32_t bytesToPad;
 	uint64_t lengthPad;
-	int i;
 
-	bytesToPad = 120L - sc->bufferLength;
+	bytesToPad = 120L - sc->mBufferLength;
 	if (bytesToPad > 64L)
 	{
 		bytesToPad -= 64L;
 	}
 
-	lengthPad = BYTESWAP64(sc->totalLength);
+	lengthPad = BYTESWAP64(sc->mTotalLength);
 
 	sha256_update(sc, padding, bytesToPad);
 	sha256_update(sc, &lengthPad, 8L);
 
 	if (hash) 
 	{
-		for (i = 0; i < SHA256_HASH_WORDS; i++) 
-		{
-			*((uint32_t *) hash) = BYTESWAP(sc->hash[i]);
-			hash += 4;
-		}
+		storeHash(sc->mState, hash);
 	}
 }
 
@@ -504,3 +802,369 @@ void computeSHA256(const void *input,uint32_t size,uint8_t destHash[32])
 	sha256_finalize(&sc,destHash);
 }
 
+// The second hash of a double hash is always of one 32 byte hash, so it is a single block with fixed padding
+static void hashDigest(const uint32_t digest[SHA256_HASH_WORDS], uint8_t destHash[32])
+{
+	uint8_t block[64];
+	storeHash(digest, block);
+	memset(block + 32, 0, 32);
+	block[32] = 0x80;
+	block[62] = 0x01;	// 256 bits, big endian
+	uint32_t state[SHA256_HASH_WORDS];
+	memcpy(state, initialState, sizeof(state));
+	gTransform(state, block, 1);
+	storeHash(state, destHash);
+}
+
+void computeDoubleSHA256(const void *input,uint32_t size,uint8_t destHash[32])
+{
+	sha256_ctx_t sc;
+	sha256_init(&sc);
+	sha256_update(&sc,input,size);
+	sha256_finalize(&sc,nullptr);
+	hashDigest(sc.mState,destHash);
+}
+
+void computeDoubleSHA256Header(const uint8_t header[80],uint8_t destHash[32])
+{
+	uint32_t state[SHA256_HASH_WORDS];
+	memcpy(state, initialState, sizeof(state));
+	uint8_t block[64];
+	memcpy(block, header + 64, 16);
+	memset(block + 16, 0, 48);
+	block[16] = 0x80;
+	block[62] = 0x02;	// 640 bits, big endian
+	block[63] = 0x80;
+	gTransform(state, header, 1);
+	gTransform(state, block, 1);
+	hashDigest(state, destHash);
+}
+
+void computeDoubleSHA256Header(const SHA256Context &midstate,const uint8_t headerTail[16],uint8_t destHash[32])
+{
+	uint32_t state[SHA256_HASH_WORDS];
+	memcpy(state, midstate.mState, sizeof(state));
+	uint8_t block[64];
+	memcpy(block, headerTail, 16);
+	memset(block + 16, 0, 48);
+	block[16] = 0x80;
+	block[62] = 0x02;	// 640 bits, big endian
+	block[63] = 0x80;
+	gTransform(state, block, 1);
+	hashDigest(state, destHash);
+}
+
+void SHA256Context::reset(void)
+{
+	sha256_init(this);
+}
+
+void SHA256Context::update(const void *data,uint32_t size)
+{
+	sha256_update(this, data, size);
+}
+
+void SHA256Context::finalize(uint8_t destHash[32])
+{
+	sha256_finalize(this, destHash);
+}
+
+void SHA256Context::finalizeDouble(uint8_t destHash[32])
+{
+	sha256_finalize(this, nullptr);
+	hashDigest(mState, destHash);
+}
+
+void computeDoubleSHA256Node(const uint8_t node[64],uint8_t destHash[32])
+{
+	static const uint8_t paddingBlock[64] = 
+	{
+		0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00	// 512 bits, big endian
+	};
+	uint32_t state[SHA256_HASH_WORDS];
+	memcpy(state, initialState, sizeof(state));
+	gTransform(state, node, 1);
+	gTransform(state, paddingBlock, 1);
+	hashDigest(state, destHash);
+}
+
+SHA256Implementation getSHA256Implementation(void)
+{
+	if (gTransform == transformFirstUse)
+	{
+		uint32_t state[SHA256_HASH_WORDS];
+		uint8_t block[64] = { 0 };
+		gTransform(state, block, 1);
+	}
+	return gImplementation.load(std::memory_order_relaxed);
+}
+
+bool setSHA256Implementation(SHA256Implementation i)
+{
+	SHA256Transform t = getTransform(i);
+	if (t == nullptr)
+	{
+		return false;
+	}
+	gImplementation.store(i, std::memory_order_relaxed);
+	gTransformPointer.store(t, std::memory_order_relaxed);
+	return true;
+}
+
+const char *getSHA256ImplementationName(SHA256Implementation i)
+{
+	switch (i)
+	{
+		case SHA256_PORTABLE:
+			return "portable";
+		case SHA256_SHANI:
+			return "SHA-NI";
+		case SHA256_ARMV8:
+			return "ARMv8";
+	}
+	return "unknown";
+}
+
+// Returns the kernel and lane count of a batch implementation; null if it is not supported here
+static SHA256LanesTransform getLanesTransform(SHA256BatchImplementation i, uint32_t &lanes)
+{
+	lanes = 1;
+#ifdef SHA256_X86
+	if (i == SHA256_BATCH_AVX2 && getCpuFeatures().mAVX2)
+	{
+		lanes = 8;
+		return transformLanesAVX2;
+	}
+	if (i == SHA256_BATCH_AVX512 && getCpuFeatures().mAVX512)
+	{
+		lanes = 16;
+		return transformLanesAVX512;
+	}
+#else
+	(void)i;
+#endif
+	return nullptr;
+}
+
+// The SHA extensions hashing one message at a time outrun sixteen AVX-512 lanes, so the lanes are only used on
+// processors without them; there even eight AVX2 lanes beat the portable code.
+static SHA256BatchImplementation detectBatchImplementation(void)
+{
+	uint32_t lanes;
+	if (getTransform(SHA256_SHANI) || getTransform(SHA256_ARMV8))
+	{
+		return SHA256_BATCH_SINGLE;
+	}
+	if (getLanesTransform(SHA256_BATCH_AVX512, lanes))
+	{
+		return SHA256_BATCH_AVX512;
+	}
+	if (getLanesTransform(SHA256_BATCH_AVX2, lanes))
+	{
+		return SHA256_BATCH_AVX2;
+	}
+	return SHA256_BATCH_SINGLE;
+}
+
+static std::atomic< int > gBatchImplementation(-1);	// -1 until first use
+
+SHA256BatchImplementation getSHA256BatchImplementation(void)
+{
+	int i = gBatchImplementation.load(std::memory_order_relaxed);
+	if (i < 0)
+	{
+		i = int(detectBatchImplementation());
+		gBatchImplementation.store(i, std::memory_order_relaxed);
+	}
+	return SHA256BatchImplementation(i);
+}
+
+bool setSHA256BatchImplementation(SHA256BatchImplementation i)
+{
+	uint32_t lanes;
+	if (i != SHA256_BATCH_SINGLE && getLanesTransform(i, lanes) == nullptr)
+	{
+		return false;
+	}
+	gBatchImplementation.store(int(i), std::memory_order_relaxed);
+	return true;
+}
+
+const char *getSHA256BatchImplementationName(SHA256BatchImplementation i)
+{
+	switch (i)
+	{
+		case SHA256_BATCH_SINGLE:
+			return "one at a time";
+		case SHA256_BATCH_AVX2:
+			return "AVX2 x8";
+		case SHA256_BATCH_AVX512:
+			return "AVX-512 x16";
+	}
+	return "unknown";
+}
+
+// One message being hashed in a lane of a multi-buffer kernel.  The whole blocks are read from the message in
+// place; the last one or two blocks, holding the padding and the bit length, are built in 'mTail'.
+class SHA256Lane
+{
+public:
+	void begin(uint32_t message, const uint8_t *data, uint32_t size)
+	{
+		mMessage = message;
+		mData = data;
+		mFullBlocks = size / 64;
+		uint32_t remainder = size % 64;
+		uint32_t tailBlocks = remainder + 9 <= 64 ? 1 : 2;
+		memset(mTail, 0, sizeof(mTail));
+		memcpy(mTail, data + mFullBlocks * 64, remainder);
+		mTail[remainder] = 0x80;
+		uint64_t bits = uint64_t(size) * 8;
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			mTail[tailBlocks * 64 - 1 - i] = uint8_t(bits >> (i * 8));
+		}
+		mTotalBlocks = mFullBlocks + tailBlocks;
+		mBlock = 0;
+		mSecond = false;
+		mActive = true;
+	}
+
+	// Hash the 32 byte digest of the first pass; a single block
+	void beginSecond(const uint8_t digest[32])
+	{
+		memset(mTail, 0, 64);
+		memcpy(mTail, digest, 32);
+		mTail[32] = 0x80;
+		mTail[62] = 0x01;	// 256 bits, big endian
+		mData = nullptr;
+		mFullBlocks = 0;
+		mTotalBlocks = 1;
+		mBlock = 0;
+		mSecond = true;
+	}
+
+	const uint8_t *getBlock(void) const
+	{
+		return mBlock < mFullBlocks ? mData + mBlock * 64 : mTail + (mBlock - mFullBlocks) * 64;
+	}
+
+	const uint8_t	*mData{nullptr};
+	uint32_t		mMessage{0};
+	uint32_t		mFullBlocks{0};
+	uint32_t		mTotalBlocks{0};
+	uint32_t		mBlock{0};
+	bool			mSecond{false};		// Hashing the digest of the first pass of a double hash
+	bool			mActive{false};
+	uint8_t			mTail[128];
+};
+
+// Hash the messages with a multi-buffer kernel.  Each lane takes the next message as soon as it finishes one, so
+// messages of different lengths keep every lane busy until the last few.
+static void hashLanes(SHA256LanesTransform transform, uint32_t lanes, uint32_t count, const uint8_t *const *inputs, const uint32_t *sizes, uint8_t (*destHashes)[32], bool doubleHash)
+{
+	SHA256Lane lane[SHA256_MAX_LANES];
+	uint32_t state[SHA256_HASH_WORDS * SHA256_MAX_LANES];
+	uint8_t blocks[64 * SHA256_MAX_LANES];
+	memset(state, 0, sizeof(state));
+	uint32_t next = 0;
+	for (;;)
+	{
+		uint32_t active = 0;
+		for (uint32_t l = 0; l < lanes; l++)
+		{
+			if (!lane[l].mActive && next < count)
+			{
+				lane[l].begin(next, inputs[next], sizes[next]);
+				for (uint32_t w = 0; w < SHA256_HASH_WORDS; w++)
+				{
+					state[w * lanes + l] = initialState[w];
+				}
+				next++;
+			}
+			if (lane[l].mActive)
+			{
+				memcpy(blocks + l * 64, lane[l].getBlock(), 64);
+				active++;
+			}
+		}
+		if (active == 0)
+		{
+			break;
+		}
+		transform(state, blocks);	// idle lanes hash whatever their block holds; the result is ignored
+		for (uint32_t l = 0; l < lanes; l++)
+		{
+			SHA256Lane &ln = lane[l];
+			if (!ln.mActive || ++ln.mBlock < ln.mTotalBlocks)
+			{
+				continue;
+			}
+			uint8_t digest[32];
+			uint32_t words[SHA256_HASH_WORDS];
+			for (uint32_t w = 0; w < SHA256_HASH_WORDS; w++)
+			{
+				words[w] = state[w * lanes + l];
+			}
+			storeHash(words, digest);
+			if (doubleHash && !ln.mSecond)
+			{
+				ln.beginSecond(digest);
+				for (uint32_t w = 0; w < SHA256_HASH_WORDS; w++)
+				{
+					state[w * lanes + l] = initialState[w];
+				}
+			}
+			else
+			{
+				memcpy(destHashes[ln.mMessage], digest, 32);
+				ln.mActive = false;
+			}
+		}
+	}
+}
+
+static void hashBatch(uint32_t count, const uint8_t *const *inputs, const uint32_t *sizes, uint8_t (*destHashes)[32], bool doubleHash)
+{
+	uint32_t lanes = 1;
+	SHA256LanesTransform transform = getLanesTransform(getSHA256BatchImplementation(), lanes);
+	// A batch too small to fill half of the lanes is quicker one message at a time
+	if (transform == nullptr || count * 2 < lanes)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			// Merkle tree nodes and block headers have their own single message kernels
+			if (doubleHash && sizes[i] == 64)
+			{
+				computeDoubleSHA256Node(inputs[i], destHashes[i]);
+			}
+			else if (doubleHash && sizes[i] == 80)
+			{
+				computeDoubleSHA256Header(inputs[i], destHashes[i]);
+			}
+			else if (doubleHash)
+			{
+				computeDoubleSHA256(inputs[i], sizes[i], destHashes[i]);
+			}
+			else
+			{
+				computeSHA256(inputs[i], sizes[i], destHashes[i]);
+			}
+		}
+		return;
+	}
+	hashLanes(transform, lanes, count, inputs, sizes, destHashes, doubleHash);
+}
+
+void computeSHA256Batch(uint32_t count, const uint8_t *const *inputs, const uint32_t *sizes, uint8_t (*destHashes)[32])
+{
+	hashBatch(count, inputs, sizes, destHashes, false);
+}
+
+void computeDoubleSHA256Batch(uint32_t count, const uint8_t *const *inputs, const uint32_t *sizes, uint8_t (*destHashes)[32])
+{
+	hashBatch(count, inputs, sizes, destHashes, true);
+}
@@ -0,0 +1,223 @@
+#include "ScriptClassifier.h"
+
+#include <string.h>
+#include <vector>
+
+#define ANY_OPCODE -1				// The template matches any first opcode
+#define MAX_BYTE_CHECKS 3
+#define MAX_DIRECT_LENGTH 72		// Scripts up to this length have their own row in the lookup table
+#define MAX_SCRIPT_LENGTH 0xFFFFFFFF
+
+namespace scriptclassifier
+{
+
+enum ScriptOpcodes
+{
+	OP_0 = 0x00,
+	OP_1 = 0x51,
+	OP_5 = 0x55,
+	OP_16 = 0x60,
+	OP_DUP = 0x76,
+	OP_EQUAL = 0x87,
+	OP_EQUALVERIFY = 0x88,
+	OP_HASH160 = 0xa9,
+	OP_CHECKSIG = 0xac,
+	OP_CHECKMULTISIG = 0xae,
+	OP_RETURN = 0x6a,
+};
+
+// A byte which must have this value; a negative position means the last byte of the script
+struct ByteCheck
+{
+	int32_t	mPosition;
+	uint8_t	mValue;
+};
+
+struct ScriptTemplate
+{
+	BlockChain::KeyType	mKeyType;
+	int32_t				mFirstOpcode;			// The opcode the script begins with, or ANY_OPCODE
+	uint32_t			mMinLength;
+	uint32_t			mMaxLength;
+	uint32_t			mKeyOffset;
+	uint32_t			mKeyLength;				// Zero if the template carries no key or hash
+	bool				mWitnessProgram;		// The second byte pushes the rest of the script; the key is the whole witness program
+	uint32_t			mCheckCount;
+	ByteCheck			mChecks[MAX_BYTE_CHECKS];
+};
+
+// Every template, in the order they take precedence.  The legacy forms come first so that outputs in early
+// blocks are classified exactly as they always have been.
+static const ScriptTemplate gTemplates[] =
+{
+	// <65 byte key> OP_CHECKSIG
+	{ BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY, 65, 67, 67, 1, 65, false, 1, { { -1, OP_CHECKSIG } } },
+	// OP_RETURN <20 byte hash> ; the original stealth address output
+	{ BlockChain::KT_STEALTH, OP_RETURN, 40, 40, 1, 20, false, 0, { { 0, 0 } } },
+	// 65 byte key without a push opcode followed by OP_CHECKSIG; found in early blocks
+	{ BlockChain::KT_UNCOMPRESSED_PUBLIC_KEY, ANY_OPCODE, 66, 66, 0, 65, false, 1, { { -1, OP_CHECKSIG } } },
+	// <33 byte key> OP_CHECKSIG
+	{ BlockChain::KT_COMPRESSED_PUBLIC_KEY, ANY_OPCODE, 35, 35, 1, 33, false, 1, { { -1, OP_CHECKSIG } } },
+	// A 32 byte push of a compressed key missing its prefix byte
+	{ BlockChain::KT_TRUNCATED_COMPRESSED_KEY, 0x20, 33, 33, 1, 32, false, 0, { { 0, 0 } } },
+	// OP_HASH160 <20 byte hash> OP_EQUAL
+	{ BlockChain::KT_SCRIPT_HASH, OP_HASH160, 23, 23, 2, 20, false, 2, { { 1, 20 }, { -1, OP_EQUAL } } },
+	// OP_DUP OP_HASH160 <20 byte hash> ... ; the trailing OP_EQUALVERIFY OP_CHECKSIG is not required
+	{ BlockChain::KT_RIPEMD160, OP_DUP, 25, MAX_SCRIPT_LENGTH, 3, 20, false, 2, { { 1, OP_HASH160 }, { 2, 20 } } },
+	// OP_0 <20 byte hash>
+	{ BlockChain::KT_WITNESS_PUBKEY_HASH, OP_0, 22, 22, 2, 20, false, 1, { { 1, 20 } } },
+	// OP_0 <32 byte hash>
+	{ BlockChain::KT_WITNESS_SCRIPT_HASH, OP_0, 34, 34, 2, 32, false, 1, { { 1, 32 } } },
+	// OP_1 <32 byte output key>
+	{ BlockChain::KT_TAPROOT, OP_1, 34, 34, 2, 32, false, 1, { { 1, 32 } } },
+	// OP_1 <0x4e73>
+	{ BlockChain::KT_ANCHOR, OP_1, 4, 4, 0, 0, false, 3, { { 1, 2 }, { 2, 0x4e }, { 3, 0x73 } } },
+	// OP_m <keys> OP_n OP_CHECKMULTISIG
+	{ BlockChain::KT_MULTISIG, OP_0, 26, MAX_SCRIPT_LENGTH, 0, 0, false, 1, { { -1, OP_CHECKMULTISIG } } },
+	{ BlockChain::KT_MULTISIG, OP_1, 26, MAX_SCRIPT_LENGTH, 0, 0, false, 1, { { -1, OP_CHECKMULTISIG } } },
+	{ BlockChain::KT_MULTISIG, OP_1 + 1, 26, MAX_SCRIPT_LENGTH, 0, 0, false, 1, { { -1, OP_CHECKMULTISIG } } },
+	{ BlockChain::KT_MULTISIG, OP_1 + 2, 26, MAX_SCRIPT_LENGTH, 0, 0, false, 1, { { -1, OP_CHECKMULTISIG } } },
+	{ BlockChain::KT_MULTISIG, OP_1 + 3, 26, MAX_SCRIPT_LENGTH, 0, 0, false, 1, { { -1, OP_CHECKMULTISIG } } },
+	{ BlockChain::KT_MULTISIG, OP_5, 26, MAX_SCRIPT_LENGTH, 0, 0, false, 1, { { -1, OP_CHECKMULTISIG } } },
+	// OP_1..OP_16 <2 to 40 byte witness program> ; a witness version which has no meaning yet
+	{ BlockChain::KT_WITNESS_UNKNOWN, OP_1, 4, 42, 2, 0, true, 0, { { 0, 0 } } },
+	// OP_RETURN <anything>
+	{ BlockChain::KT_NULL_DATA, OP_RETURN, 1, MAX_SCRIPT_LENGTH, 0, 0, false, 0, { { 0, 0 } } },
+};
+
+#define TEMPLATE_COUNT (sizeof(gTemplates)/sizeof(gTemplates[0]))
+
+// A template compiled for one (length, opcode) slot of the lookup table.  Every byte check of a template is
+// at one of the first four bytes or at the last byte of the script, so a candidate matches when the first four
+// bytes and the last byte agree with it under these masks.
+struct Candidate
+{
+	uint32_t	mHeadMask;
+	uint32_t	mHeadValue;
+	uint8_t		mTailMask;
+	uint8_t		mTailValue;
+	uint8_t		mTemplate;			// Index into gTemplates
+};
+
+// For each script length and first opcode, the templates which may match, in order of precedence.
+// Lengths beyond MAX_DIRECT_LENGTH share a single bucket.  The candidate lists are stored back to back
+// in one array and each (length, opcode) slot records where its list begins.
+class TemplateTable
+{
+public:
+	TemplateTable(void)
+	{
+		for (uint32_t length=1; length<=MAX_DIRECT_LENGTH+1; length++)
+		{
+			for (uint32_t opcode=0; opcode<256; opcode++)
+			{
+				uint32_t first = uint32_t(mCandidates.size());
+				for (uint32_t i=0; i<TEMPLATE_COUNT; i++)
+				{
+					Candidate c;
+					if ( compile(gTemplates[i],length,opcode,c) )
+					{
+						c.mTemplate = uint8_t(i);
+						mCandidates.push_back(c);
+					}
+				}
+				mFirst[length][opcode] = uint16_t(first);
+				mCount[length][opcode] = uint8_t(mCandidates.size()-first);
+			}
+		}
+	}
+
+	// Build the candidate for this template at this length and first opcode; returns false if it can never match there
+	static bool compile(const ScriptTemplate &t,uint32_t length,uint32_t opcode,Candidate &c)
+	{
+		bool opcodeMatch = t.mFirstOpcode == ANY_OPCODE || uint32_t(t.mFirstOpcode) == opcode ||
+			(t.mWitnessProgram && opcode >= OP_1 && opcode <= OP_16);
+		bool lengthMatch = length > MAX_DIRECT_LENGTH ? t.mMaxLength > MAX_DIRECT_LENGTH : (length >= t.mMinLength && length <= t.mMaxLength);
+		if ( !opcodeMatch || !lengthMatch )
+		{
+			return false;
+		}
+		c.mHeadMask = 0;
+		c.mHeadValue = 0;
+		c.mTailMask = 0;
+		c.mTailValue = 0;
+		for (uint32_t i=0; i<t.mCheckCount; i++)
+		{
+			const ByteCheck &check = t.mChecks[i];
+			if ( check.mPosition < 0 )
+			{
+				c.mTailMask = 0xFF;
+				c.mTailValue = check.mValue;
+			}
+			else
+			{
+				c.mHeadMask |= uint32_t(0xFF) << (check.mPosition*8);
+				c.mHeadValue |= uint32_t(check.mValue) << (check.mPosition*8);
+			}
+		}
+		if ( t.mWitnessProgram )
+		{
+			// The witness program push is known for each length
+			c.mHeadMask |= uint32_t(0xFF) << 8;
+			c.mHeadValue |= uint32_t(length-2) << 8;
+		}
+		return true;
+	}
+
+	uint16_t					mFirst[MAX_DIRECT_LENGTH+2][256];
+	uint8_t						mCount[MAX_DIRECT_LENGTH+2][256];
+	std::vector< Candidate >	mCandidates;
+};
+
+static TemplateTable gTemplateTable;
+
+bool classifyScript(const uint8_t *script,uint32_t scriptLength,ScriptClass &result)
+{
+	result.keyType = BlockChain::KT_UNKNOWN;
+	result.keyOffset = 0;
+	result.keyLength = 0;
+	if ( scriptLength == 0 )
+	{
+		return false;
+	}
+	// The first four bytes, little endian and zero padded for very short scripts
+	uint32_t head = 0;
+	if ( scriptLength >= 4 )
+	{
+		memcpy(&head,script,4);
+	}
+	else
+	{
+		for (uint32_t i=0; i<scriptLength; i++)
+		{
+			head |= uint32_t(script[i]) << (i*8);
+		}
+	}
+	uint8_t tail = script[scriptLength-1];
+	uint32_t row = scriptLength > MAX_DIRECT_LENGTH ? MAX_DIRECT_LENGTH+1 : scriptLength;
+	const Candidate *candidates = &gTemplateTable.mCandidates[gTemplateTable.mFirst[row][script[0]]];
+	uint32_t candidateCount = gTemplateTable.mCount[row][script[0]];
+	for (uint32_t i=0; i<candidateCount; i++)
+	{
+		const Candidate &c = candidates[i];
+		if ( (head & c.mHeadMask) == c.mHeadValue && (tail & c.mTailMask) == c.mTailValue )
+		{
+			const ScriptTemplate &t = gTemplates[c.mTemplate];
+			result.keyType = t.mKeyType;
+			result.keyOffset = t.mKeyOffset;
+			result.keyLength = t.mWitnessProgram ? scriptLength-2 : t.mKeyLength;
+			return true;
+		}
+	}
+	return false;
+}
+
+void classifyScripts(const uint8_t *scriptBase,const uint32_t *scriptOffsets,const uint32_t *scriptLengths,uint32_t count,ScriptClass *results)
+{
+	for (uint32_t i=0; i<count; i++)
+	{
+		classifyScript(scriptBase+scriptOffsets[i],scriptLengths[i],results[i]);
+	}
+}
+
+}
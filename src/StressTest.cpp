@@ -0,0 +1,190 @@
+#include "StressTest.h"
+#include "BlockChain.h"
+#include "BlockFile.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "SHA256.h"
+#include "blocks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace stresstest
+{
+
+// The hash of everything decoded from a block; two parses of the same block must produce the same digest
+class BlockDigest
+{
+public:
+	bool operator==(const BlockDigest &other) const
+	{
+		return mValid == other.mValid && memcmp(mHash,other.mHash,sizeof(mHash)) == 0;
+	}
+
+	bool	mValid{false};		// False if the block could not be read or parsed
+	uint8_t	mHash[32];
+};
+
+// Each thread has its own block reader and scratch memory
+class Worker
+{
+public:
+	blockfile::BlockReader	mReader;
+	std::string				mSerialized;	// The decoded block serialized for hashing
+};
+
+class StressTestImpl : public StressTest
+{
+public:
+	StressTestImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir)
+	{
+	}
+
+	virtual ~StressTestImpl(void)
+	{
+	}
+
+	virtual bool run(uint32_t threadCount,uint32_t firstBlock,uint32_t blockCount) final
+	{
+		if ( threadCount == 0 )
+		{
+			threadCount = 1;
+		}
+		std::vector< BlockDigest > serial(blockCount);
+		std::vector< BlockDigest > parallel(blockCount);
+
+		printf("Parsing %d blocks starting at block %d serially.\n", blockCount, firstBlock);
+		Timer t;
+		{
+			Worker worker;
+			for (uint32_t i=0; i<blockCount; i++)
+			{
+				parseBlock(worker,firstBlock+i,serial[i]);
+			}
+		}
+		double serialTime = t.getElapsedSeconds();
+
+		printf("Parsing %d blocks starting at block %d on %d threads.\n", blockCount, firstBlock, threadCount);
+		t.reset();
+		{
+			std::vector< Worker > workers(threadCount);
+			threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+			pool->parallelFor(blockCount,1,[this,&workers,&parallel,firstBlock](uint32_t begin,uint32_t end,uint32_t workerIndex)
+			{
+				for (uint32_t i=begin; i<end; i++)
+				{
+					parseBlock(workers[workerIndex],firstBlock+i,parallel[i]);
+				}
+			});
+			pool->release();
+		}
+		double parallelTime = t.getElapsedSeconds();
+
+		uint32_t mismatchCount = 0;
+		uint32_t failedCount = 0;
+		for (uint32_t i=0; i<blockCount; i++)
+		{
+			if ( !serial[i].mValid )
+			{
+				failedCount++;
+			}
+			if ( !(serial[i] == parallel[i]) )
+			{
+				if ( mismatchCount < 16 )
+				{
+					printf("MISMATCH: Block %d decoded differently on multiple threads.\n", firstBlock+i);
+				}
+				mismatchCount++;
+			}
+		}
+		printf("Serial     : %0.3f seconds\n", serialTime);
+		printf("Parallel   : %0.3f seconds using %d threads\n", parallelTime, threadCount);
+		printf("Unreadable : %d blocks\n", failedCount);
+		printf("Mismatches : %d blocks\n", mismatchCount);
+
+		return mismatchCount == 0;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	void parseBlock(Worker &worker,uint32_t blockHeight,BlockDigest &digest)
+	{
+		digest.mValid = false;
+		const BlockChain::Block *b = worker.mReader.read(mBlocks,mDataDir.c_str(),blockHeight);
+		if ( b )
+		{
+			serializeBlock(*b,worker.mSerialized);
+			computeSHA256(worker.mSerialized.c_str(),uint32_t(worker.mSerialized.size()),digest.mHash);
+			digest.mValid = true;
+		}
+	}
+
+	template <typename T>
+	static void append(std::string &dest,const T &v)
+	{
+		dest.append((const char *)&v,sizeof(T));
+	}
+
+	// Serialize every decoded field of the block which does not depend on where in memory it was parsed
+	static void serializeBlock(const BlockChain::Block &b,std::string &dest)
+	{
+		dest.clear();
+		dest.append((const char *)b.computedBlockHash,32);
+		append(dest,b.transactionCount);
+		append(dest,b.totalInputCount);
+		append(dest,b.totalOutputCount);
+		append(dest,b.blockReward);
+		append(dest,b.warning);
+		for (uint32_t i=0; i<b.transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b.transactions[i];
+			dest.append((const char *)t.transactionHash,32);
+			dest.append((const char *)t.witnessHash,32);
+			append(dest,t.transactionVersionNumber);
+			append(dest,t.lockTime);
+			append(dest,t.transactionLength);
+			append(dest,t.fileOffset);
+			append(dest,t.hasWitness);
+			append(dest,t.inputCount);
+			append(dest,t.outputCount);
+			for (uint32_t j=0; j<t.inputCount; j++)
+			{
+				const BlockChain::BlockInput &input = t.inputs[j];
+				dest.append((const char *)input.transactionHash,32);
+				append(dest,input.transactionIndex);
+				append(dest,input.responseScriptLength);
+				append(dest,input.sequenceNumber);
+				append(dest,input.witnessCount);
+			}
+			for (uint32_t j=0; j<t.outputCount; j++)
+			{
+				const BlockChain::BlockOutputs &outputs = t.outputs;
+				char address[512];
+				append(dest,outputs.values[j]);
+				append(dest,outputs.scriptLengths[j]);
+				append(dest,outputs.keyTypes[j]);
+				append(dest,outputs.keyCounts[j]);
+				append(dest,outputs.hashes[j]);
+				dest.append(BlockChain::getOutputAddress(outputs,j,address,sizeof(address)));
+				dest.append(1,0);
+			}
+		}
+	}
+
+	const blocks::Blocks	*mBlocks{nullptr};
+	std::string				mDataDir;
+};
+
+StressTest *StressTest::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new StressTestImpl(blocks,dataDir);
+	return static_cast< StressTest *>(ret);
+}
+
+}
@@ -0,0 +1,394 @@
+#include "TextMiner.h"
+#include "BlockChain.h"
+#include "BlockFile.h"
+#include "ByteReader.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "logging.h"
+#include "blocks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_MINER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TEXT_MINER_NEON 1
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#pragma warning(disable:4996)
+#endif
+
+// Blocks are mined this many at a time; the text found in a batch is written out in block order before the next batch starts
+#define TEXT_MINER_BATCH_SIZE 1024
+// Size of the stdio buffer used for the report file
+#define TEXT_REPORT_BUFFER_SIZE (1024*1024*4)
+
+namespace textminer
+{
+
+static inline uint32_t countTrailingZeros64(uint64_t v)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index,v);
+	return uint32_t(index);
+#else
+	return uint32_t(__builtin_ctzll(v));
+#endif
+}
+
+// Returns a mask with bit 'i' set if data[i] is printable, for the (up to 64) bytes starting at 'data'
+static inline uint64_t getPrintableMask(const uint8_t *data,uint32_t length)
+{
+	uint64_t ret = 0;
+	uint32_t i = 0;
+#if TEXT_MINER_SSE2
+	// Bytes of 0x80 and above are negative as signed chars, so a signed compare against 0x1F rejects them as well
+	const __m128i low = _mm_set1_epi8(0x1F);
+	const __m128i high = _mm_set1_epi8(0x7F);
+	for (; i+16 <= length; i+=16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(data+i));
+		__m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v,low),_mm_cmplt_epi8(v,high));
+		ret |= uint64_t(uint32_t(_mm_movemask_epi8(printable))) << i;
+	}
+#elif TEXT_MINER_NEON
+	static const uint8_t bitWeights[16] = { 1,2,4,8,16,32,64,128,1,2,4,8,16,32,64,128 };
+	const uint8x16_t weights = vld1q_u8(bitWeights);
+	for (; i+16 <= length; i+=16)
+	{
+		uint8x16_t v = vld1q_u8(data+i);
+		uint8x16_t printable = vandq_u8(vandq_u8(vcgeq_u8(v,vdupq_n_u8(0x20)),vcleq_u8(v,vdupq_n_u8(0x7E))),weights);
+		uint64_t mask = uint64_t(vaddv_u8(vget_low_u8(printable))) | (uint64_t(vaddv_u8(vget_high_u8(printable))) << 8);
+		ret |= mask << i;
+	}
+#endif
+	for (; i<length; i++)
+	{
+		if ( data[i] >= 0x20 && data[i] < 0x7F )
+		{
+			ret |= uint64_t(1) << i;
+		}
+	}
+	return ret;
+}
+
+void findTextRuns(const uint8_t *data,uint32_t length,uint32_t minLength,std::vector< TextRun > &runs)
+{
+	if ( minLength == 0 )
+	{
+		minLength = 1;
+	}
+	bool inRun = false;
+	uint32_t runStart = 0;
+	for (uint32_t base=0; base<length; base+=64)
+	{
+		uint32_t count = (length-base) < 64 ? (length-base) : 64;
+		uint64_t mask = getPrintableMask(data+base,count);
+		// Walk the transitions in this word; bits past the end of the data are clear so a run always ends there
+		uint32_t bit = 0;
+		while ( bit < 64 )
+		{
+			if ( !inRun )
+			{
+				uint64_t start = mask >> bit;
+				if ( start == 0 )
+				{
+					break;
+				}
+				bit += countTrailingZeros64(start);
+				runStart = base + bit;
+				inRun = true;
+			}
+			uint64_t stop = ~mask >> bit;
+			if ( stop == 0 )
+			{
+				break; // the run continues into the next word
+			}
+			bit += countTrailingZeros64(stop);
+			inRun = false;
+			uint32_t runLength = base + bit - runStart;
+			if ( runLength >= minLength )
+			{
+				TextRun r;
+				r.mOffset = runStart;
+				r.mLength = runLength;
+				runs.push_back(r);
+			}
+		}
+	}
+	// A run which reaches the very end of a whole word of data has not been closed yet
+	if ( inRun && (length - runStart) >= minLength )
+	{
+		TextRun r;
+		r.mOffset = runStart;
+		r.mLength = length - runStart;
+		runs.push_back(r);
+	}
+}
+
+static const char *gLocationNames[uint32_t(TextLocation::last)] =
+{
+	"COINBASE",
+	"SCRIPT_SIG",
+	"WITNESS",
+	"OP_RETURN",
+	"OUTPUT_SCRIPT",
+};
+
+// The text found in one block, formatted for the report
+class BlockText
+{
+public:
+	void clear(void)
+	{
+		mReport.clear();
+		mValid = false;
+		mBlockLength = 0;
+		mMerkleStatus = BlockChain::MS_UNCHECKED;
+		for (uint32_t i=0; i<uint32_t(TextLocation::last); i++)
+		{
+			mRunCount[i] = 0;
+			mByteCount[i] = 0;
+		}
+	}
+
+	bool		mValid{false};
+	uint32_t	mBlockLength{0};	// Size of the block searched
+	BlockChain::MerkleStatus	mMerkleStatus{BlockChain::MS_UNCHECKED};
+	std::string	mReport;
+	uint32_t	mRunCount[uint32_t(TextLocation::last)];
+	uint64_t	mByteCount[uint32_t(TextLocation::last)];
+};
+
+// Each thread has its own block reader and scratch memory
+class Worker
+{
+public:
+	blockfile::BlockReader	mReader;
+	std::vector< TextRun >	mRuns;
+};
+
+class TextMinerImpl : public TextMiner
+{
+public:
+	TextMinerImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir)
+	{
+	}
+
+	virtual ~TextMinerImpl(void)
+	{
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mVerifyMerkle = state;
+	}
+
+	virtual bool run(uint32_t threadCount,uint32_t minLength,uint32_t firstBlock,uint32_t blockCount,const char *reportFileName) final
+	{
+		FILE *fph = fopen(reportFileName,"wb");
+		if ( fph == nullptr )
+		{
+			printf("Failed to open '%s' for write access.\n", reportFileName);
+			return false;
+		}
+		std::vector< char > buffer(TEXT_REPORT_BUFFER_SIZE);
+		setvbuf(fph,&buffer[0],_IOFBF,buffer.size());
+
+		printf("Mining %d blocks starting at block %d for text of at least %d characters.\n", blockCount, firstBlock, minLength);
+		Timer t;
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		std::vector< Worker > workers(pool->getThreadCount()+1);
+		for (auto &w:workers)
+		{
+			w.mReader.setVerifyMerkle(mVerifyMerkle);
+		}
+		std::vector< BlockText > batch(TEXT_MINER_BATCH_SIZE);
+		uint32_t runCount[uint32_t(TextLocation::last)] = { 0 };
+		uint64_t byteCount[uint32_t(TextLocation::last)] = { 0 };
+		uint64_t blockBytes = 0;
+		uint32_t failedCount = 0;
+		uint32_t textBlockCount = 0;
+		uint32_t merkleFailures = 0;
+
+		for (uint32_t first=0; first<blockCount; first+=TEXT_MINER_BATCH_SIZE)
+		{
+			uint32_t count = blockCount - first;
+			if ( count > TEXT_MINER_BATCH_SIZE )
+			{
+				count = TEXT_MINER_BATCH_SIZE;
+			}
+			uint32_t batchStart = firstBlock + first;
+			pool->parallelFor(count,1,[this,&workers,&batch,batchStart,minLength](uint32_t begin,uint32_t end,uint32_t workerIndex)
+			{
+				for (uint32_t i=begin; i<end; i++)
+				{
+					mineBlock(workers[workerIndex],batchStart+i,minLength,batch[i]);
+				}
+			});
+			// The blocks are written out in order regardless of which thread finished first
+			for (uint32_t i=0; i<count; i++)
+			{
+				const BlockText &bt = batch[i];
+				if ( !bt.mValid )
+				{
+					failedCount++;
+					continue;
+				}
+				if ( !bt.mReport.empty() )
+				{
+					fwrite(bt.mReport.c_str(),bt.mReport.size(),1,fph);
+					textBlockCount++;
+				}
+				blockBytes += bt.mBlockLength;
+				if ( mVerifyMerkle && bt.mMerkleStatus != BlockChain::MS_VALID )
+				{
+					merkleFailures++;
+				}
+				for (uint32_t j=0; j<uint32_t(TextLocation::last); j++)
+				{
+					runCount[j] += bt.mRunCount[j];
+					byteCount[j] += bt.mByteCount[j];
+				}
+			}
+		}
+		pool->release();
+		bool ok = ferror(fph) == 0;
+		if ( fclose(fph) != 0 )
+		{
+			ok = false;
+		}
+		double seconds = t.getElapsedSeconds();
+
+		printf("Found text in %s blocks; %d blocks could not be read.\n", formatNumber(int32_t(textBlockCount)), failedCount);
+		if ( mVerifyMerkle )
+		{
+			printf("%d blocks failed merkle verification.\n", merkleFailures);
+		}
+		for (uint32_t i=0; i<uint32_t(TextLocation::last); i++)
+		{
+			printf("%-14s: %s runs, %s bytes\n", gLocationNames[i], formatNumber(int32_t(runCount[i])), formatNumber(int32_t(byteCount[i])));
+		}
+		printf("Mined %0.2f MB of blocks in %0.3f seconds (%0.2f MB/s); report written to '%s'\n",
+			double(blockBytes) / (1024*1024), seconds, seconds > 0 ? double(blockBytes) / (1024*1024) / seconds : 0, reportFileName);
+		if ( !ok )
+		{
+			printf("Failed to write the report to '%s'\n", reportFileName);
+		}
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	void mineBlock(Worker &worker,uint32_t blockHeight,uint32_t minLength,BlockText &text)
+	{
+		text.clear();
+		const BlockChain::Block *b = worker.mReader.read(mBlocks,mDataDir.c_str(),blockHeight);
+		if ( b == nullptr )
+		{
+			return;
+		}
+		const std::vector< uint8_t > &data = worker.mReader.getData();
+		const uint8_t *blockData = &data[0];
+		const uint8_t *blockEnd = blockData + data.size();
+		text.mValid = true;
+		text.mBlockLength = uint32_t(data.size());
+		text.mMerkleStatus = b->merkleStatus;
+
+		for (uint32_t i=0; i<b->transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b->transactions[i];
+			for (uint32_t j=0; j<t.inputCount; j++)
+			{
+				const BlockChain::BlockInput &input = t.inputs[j];
+				searchRegion(worker,*b,text,i == 0 ? TextLocation::coinbase : TextLocation::scriptSig,i,j,0,input.responseScript,input.responseScriptLength,minLength);
+				if ( input.witnessCount )
+				{
+					bytereader::ByteReader< bytereader::Checked > witness(input.witness,blockEnd);
+					for (uint32_t k=0; k<input.witnessCount; k++)
+					{
+						uint64_t itemLength = witness.readCompactSize();
+						const uint8_t *item = witness.readBytes(itemLength);
+						if ( witness.hasOverflow() )
+						{
+							break;
+						}
+						searchRegion(worker,*b,text,TextLocation::witness,i,j,k,item,uint32_t(itemLength),minLength);
+					}
+				}
+			}
+			for (uint32_t j=0; j<t.outputCount; j++)
+			{
+				const uint8_t *script = t.outputs.getScript(j);
+				uint32_t scriptLength = t.outputs.scriptLengths[j];
+				if ( script )
+				{
+					searchRegion(worker,*b,text,script[0] == 0x6A ? TextLocation::opReturn : TextLocation::outputScript,i,j,0,script,scriptLength,minLength);
+				}
+			}
+		}
+		if ( !text.mReport.empty() )
+		{
+			text.mReport += "\r\n";
+		}
+	}
+
+	// Report each run of text in one region of the block
+	void searchRegion(Worker &worker,const BlockChain::Block &b,BlockText &text,TextLocation location,uint32_t transactionIndex,uint32_t index,uint32_t item,const uint8_t *data,uint32_t length,uint32_t minLength)
+	{
+		if ( data == nullptr || length < minLength )
+		{
+			return;
+		}
+		worker.mRuns.clear();
+		findTextRuns(data,length,minLength,worker.mRuns);
+		char scratch[512];
+		for (auto &r:worker.mRuns)
+		{
+			if ( text.mReport.empty() )
+			{
+				snprintf(scratch,sizeof(scratch),"==========================================\r\n"
+					"= TEXT REPORT for Block #%s on %s\r\n"
+					"==========================================\r\n", formatNumber(int32_t(b.blockIndex)), getDateString(b.timeStamp));
+				text.mReport += scratch;
+			}
+			if ( location == TextLocation::witness )
+			{
+				snprintf(scratch,sizeof(scratch),"%-13s : Transaction %d : Input %d : Item %d : %d bytes : ", gLocationNames[uint32_t(location)], transactionIndex, index, item, r.mLength);
+			}
+			else
+			{
+				snprintf(scratch,sizeof(scratch),"%-13s : Transaction %d : %s %d : %d bytes : ", gLocationNames[uint32_t(location)], transactionIndex,
+					location == TextLocation::opReturn || location == TextLocation::outputScript ? "Output" : "Input", index, r.mLength);
+			}
+			text.mReport += scratch;
+			text.mReport.append((const char *)data + r.mOffset,r.mLength);
+			text.mReport += "\r\n";
+			text.mRunCount[uint32_t(location)]++;
+			text.mByteCount[uint32_t(location)] += r.mLength;
+		}
+	}
+
+	const blocks::Blocks	*mBlocks{nullptr};
+	std::string				mDataDir;
+	bool					mVerifyMerkle{false};
+};
+
+TextMiner *TextMiner::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new TextMinerImpl(blocks,dataDir);
+	return static_cast< TextMiner *>(ret);
+}
+
+}
@@ -0,0 +1,170 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+namespace threadpool
+{
+
+typedef std::function<void(uint32_t begin,uint32_t end,uint32_t workerIndex)> ParallelForFunc;
+
+class ThreadPoolImpl : public ThreadPool
+{
+public:
+	ThreadPoolImpl(uint32_t threadCount)
+	{
+		for (uint32_t i=0; i<threadCount; i++)
+		{
+			mThreads.push_back(new std::thread([this,i]()
+			{
+				workerThread(i);
+			}));
+		}
+	}
+
+	virtual ~ThreadPoolImpl(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mExit = true;
+		}
+		mWorkCond.notify_all();
+		for (auto &i:mThreads)
+		{
+			i->join();
+			delete i;
+		}
+	}
+
+	virtual uint32_t getThreadCount(void) const final
+	{
+		return uint32_t(mThreads.size());
+	}
+
+	virtual void parallelFor(uint32_t count,uint32_t grainSize,const ParallelForFunc &func) final
+	{
+		if ( count == 0 )
+		{
+			return;
+		}
+		if ( grainSize == 0 )
+		{
+			grainSize = 1;
+		}
+		// Only one parallelFor may be in flight at a time; any other caller waits its turn.
+		std::lock_guard<std::mutex> callLock(mCallMutex);
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFunc = &func;
+			mCount = count;
+			mGrainSize = grainSize;
+			mNext = 0;
+			mPending = uint32_t(mThreads.size());
+			mGeneration++;
+		}
+		mWorkCond.notify_all();
+
+		// The calling thread gets the last worker index
+		runJob(uint32_t(mThreads.size()));
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		while ( mPending )
+		{
+			mDoneCond.wait(lock);
+		}
+		mFunc = nullptr;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	void workerThread(uint32_t workerIndex)
+	{
+		uint64_t generation = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				while ( !mExit && mGeneration == generation )
+				{
+					mWorkCond.wait(lock);
+				}
+				if ( mExit )
+				{
+					break;
+				}
+				generation = mGeneration;
+			}
+			runJob(workerIndex);
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				assert(mPending);
+				mPending--;
+				if ( mPending == 0 )
+				{
+					mDoneCond.notify_one();
+				}
+			}
+		}
+	}
+
+	// Grab chunks of the current job until there are none left
+	void runJob(uint32_t workerIndex)
+	{
+		for (;;)
+		{
+			uint32_t begin = mNext.fetch_add(mGrainSize);
+			if ( begin >= mCount )
+			{
+				break;
+			}
+			uint32_t end = begin + mGrainSize;
+			if ( end > mCount || end < begin )
+			{
+				end = mCount;
+			}
+			(*mFunc)(begin,end,workerIndex);
+		}
+	}
+
+	std::vector< std::thread *>	mThreads;
+	std::mutex					mCallMutex;		// serializes calls to parallelFor
+	std::mutex					mMutex;			// protects the job description below
+	std::condition_variable		mWorkCond;		// signalled when a new job is posted or on exit
+	std::condition_variable		mDoneCond;		// signalled when the last worker finishes a job
+	const ParallelForFunc		*mFunc{nullptr};
+	uint32_t					mCount{0};
+	uint32_t					mGrainSize{1};
+	std::atomic< uint32_t >		mNext{0};
+	uint32_t					mPending{0};
+	uint64_t					mGeneration{0};
+	bool						mExit{false};
+};
+
+// The number of threads to use when asked for zero
+static uint32_t getHardwareThreadCount(void)
+{
+	uint32_t ret = uint32_t(std::thread::hardware_concurrency());
+	return ret ? ret : 1;
+}
+
+ThreadPool *ThreadPool::create(uint32_t threadCount)
+{
+	auto ret = new ThreadPoolImpl(threadCount ? threadCount : getHardwareThreadCount());
+	return static_cast< ThreadPool *>(ret);
+}
+
+ThreadPool *ThreadPool::createForCaller(uint32_t threadCount)
+{
+	auto ret = new ThreadPoolImpl((threadCount ? threadCount : getHardwareThreadCount()) - 1);
+	return static_cast< ThreadPool *>(ret);
+}
+
+}
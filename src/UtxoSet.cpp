@@ -0,0 +1,1170 @@
+#include "UtxoSet.h"
+#include "BlockChain.h"
+#include "BlockFile.h"
+#include "FileInterface.h"
+#include "SHA256.h"
+#include "ThreadPool.h"
+#include "ScopedTime.h"
+#include "logging.h"
+#include "blocks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <queue>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define UTXO_SET_ID "UTXOSET_"
+#define UTXO_SET_VERSION 1
+#define LARGE_VALUE_FLAG 0x80000000u	// Set in the value column when the low 31 bits index the large value column
+#define SCAN_GRAIN_SIZE (1<<20)			// outputs handed to a thread at a time by a scan
+#define OP_RETURN 0x6a
+#define LIVE_TABLE_MIN_SIZE 1024		// slots of an empty live transaction table
+#define LIVE_TABLE_NO_SLOT 0xFFFFFFFFFFFFFFFFULL
+#define TXID_RUN_SIZE (1<<21)			// transactions sorted in memory at a time while writing the txid index
+#define TXID_MERGE_BUFFER_SIZE 4096		// entries read from each sorted run at a time while merging them
+
+namespace utxo
+{
+
+// Utxo.idx begins with this header, followed by mBlockCount+1 HeightRecords; the last marks the end of the columns
+class UtxoFileHeader
+{
+public:
+	char		mId[8];
+	uint32_t	mVersion{UTXO_SET_VERSION};
+	uint32_t	mBlockCount{0};
+	uint64_t	mTransactionCount{0};
+	uint64_t	mOutputCount{0};
+	uint64_t	mInputCount{0};
+	uint64_t	mLargeValueCount{0};
+};
+
+// Where the transactions, outputs and inputs of a height begin in their columns
+class HeightRecord
+{
+public:
+	uint64_t	mFirstTransaction{0};
+	uint64_t	mFirstOutput{0};
+	uint64_t	mFirstInput{0};
+};
+
+class TransactionRecord
+{
+public:
+	uint8_t		mTxid[32];
+	uint64_t	mFirstOutput;
+};
+
+enum ColumnFile : uint32_t
+{
+	CF_TRANSACTIONS,
+	CF_VALUES,
+	CF_LARGE_VALUES,
+	CF_SCRIPT_IDS,
+	CF_INPUTS,
+	CF_LAST
+};
+
+static const char *gColumnFileNames[CF_LAST] =
+{
+	"UtxoTransactions.dat",
+	"UtxoValues.dat",
+	"UtxoLargeValues.dat",
+	"UtxoScriptIds.dat",
+	"UtxoInputs.dat",
+};
+
+static std::string getUtxoFileName(const char *utxoDir,const char *name)
+{
+	std::string ret(utxoDir);
+#ifdef _MSC_VER
+	ret += "\\";
+#else
+	ret += "/";
+#endif
+	ret += name;
+	return ret;
+}
+
+uint64_t computeScriptId(const uint8_t *script,uint32_t scriptLength)
+{
+	uint8_t hash[32];
+	computeSHA256(script,scriptLength,hash);
+	uint64_t ret;
+	memcpy(&ret,hash,sizeof(ret));
+	return ret;
+}
+
+static bool writeFile(const char *utxoDir,const char *name,const void *data,uint64_t length)
+{
+	std::string fileName = getUtxoFileName(utxoDir,name);
+	FILE_INTERFACE *fph = fi_fopen(fileName.c_str(),"wb",nullptr,0,false);
+	if ( fph == nullptr )
+	{
+		printf("Failed to open '%s' for write access.\n", fileName.c_str());
+		return false;
+	}
+	bool ok = length == 0 || fi_fwrite(data,length,1,fph) == 1;
+	ok = fi_fclose(fph) == 0 && ok;
+	return ok;
+}
+
+// A memory mapped column file
+class MappedFile
+{
+public:
+	~MappedFile(void)
+	{
+		close();
+	}
+
+	// An empty column is not mapped; 'mData' stays null
+	bool open(const char *utxoDir,const char *name,uint64_t length)
+	{
+		if ( length == 0 )
+		{
+			return true;
+		}
+		std::string fileName = getUtxoFileName(utxoDir,name);
+		mFile = fi_fopen(fileName.c_str(),"rb",nullptr,0,true);
+		if ( mFile == nullptr || !fi_usesMemoryMappedFile(mFile) || fi_getFileLength(mFile) < length )
+		{
+			printf("Failed to map '%s'\n", fileName.c_str());
+			return false;
+		}
+		mData = static_cast< const uint8_t *>(fi_getMemBuffer(mFile,nullptr));
+		return true;
+	}
+
+	void close(void)
+	{
+		if ( mFile )
+		{
+			fi_fclose(mFile);
+			mFile = nullptr;
+		}
+		mData = nullptr;
+	}
+
+	FILE_INTERFACE	*mFile{nullptr};
+	const uint8_t	*mData{nullptr};
+};
+
+// A transaction which still has unspent outputs while the set is being written; one 24 byte slot of the LiveTable
+class LiveTransaction
+{
+public:
+	uint64_t	mTxidPrefix;		// The first eight bytes of the txid
+	uint64_t	mFirstOutput:40;
+	uint64_t	mOutputCount:24;
+	uint32_t	mTransaction;		// The transaction number; locates the full txid in the transaction column
+	uint32_t	mUnspentCount:31;	// Spendable outputs not spent yet; zero for an empty slot, so the entry is removed when it reaches zero
+	uint32_t	mSharedPrefix:1;	// Another live transaction had the same txid prefix, so the full txids must be compared
+};
+
+// The live transactions, in an open addressing table keyed by txid prefix with linear probing.  Entries with the same
+// prefix share a probe sequence, so inserting one finds and flags the others.  Erasing shifts the rest of the probe
+// sequence back rather than leaving a tombstone.
+class LiveTable
+{
+public:
+	LiveTable(void)
+	{
+		clear();
+	}
+
+	// Empties the table and releases its memory
+	void clear(void)
+	{
+		std::vector< LiveTransaction > empty(LIVE_TABLE_MIN_SIZE);
+		mSlots.swap(empty);
+		mMask = mSlots.size()-1;
+		mCount = 0;
+	}
+
+	uint64_t size(void) const
+	{
+		return mCount;
+	}
+
+	// The next slot holding this prefix in its probe sequence, after 'slot' or from the start if it is LIVE_TABLE_NO_SLOT
+	uint64_t find(uint64_t prefix,uint64_t slot) const
+	{
+		slot = slot == LIVE_TABLE_NO_SLOT ? getHome(prefix) : ((slot+1) & mMask);
+		while ( mSlots[size_t(slot)].mUnspentCount )
+		{
+			if ( mSlots[size_t(slot)].mTxidPrefix == prefix )
+			{
+				return slot;
+			}
+			slot = (slot+1) & mMask;
+		}
+		return LIVE_TABLE_NO_SLOT;
+	}
+
+	LiveTransaction &operator[](uint64_t slot)
+	{
+		return mSlots[size_t(slot)];
+	}
+
+	void insert(LiveTransaction t)
+	{
+		if ( (mCount+1)*4 > mSlots.size()*3 )
+		{
+			grow();
+		}
+		uint64_t slot = getHome(t.mTxidPrefix);
+		while ( mSlots[size_t(slot)].mUnspentCount )
+		{
+			if ( mSlots[size_t(slot)].mTxidPrefix == t.mTxidPrefix )
+			{
+				mSlots[size_t(slot)].mSharedPrefix = 1;
+				t.mSharedPrefix = 1;
+			}
+			slot = (slot+1) & mMask;
+		}
+		mSlots[size_t(slot)] = t;
+		mCount++;
+	}
+
+	void erase(uint64_t slot)
+	{
+		uint64_t hole = slot;
+		uint64_t next = (hole+1) & mMask;
+		while ( mSlots[size_t(next)].mUnspentCount )
+		{
+			// An entry may fill the hole unless its home lies between the hole and itself
+			uint64_t home = getHome(mSlots[size_t(next)].mTxidPrefix);
+			if ( ((next - home) & mMask) >= ((next - hole) & mMask) )
+			{
+				mSlots[size_t(hole)] = mSlots[size_t(next)];
+				hole = next;
+			}
+			next = (next+1) & mMask;
+		}
+		mSlots[size_t(hole)] = LiveTransaction();
+		mCount--;
+	}
+
+private:
+	uint64_t getHome(uint64_t prefix) const
+	{
+		uint64_t h = prefix * 0x9E3779B97F4A7C15ULL;
+		return (h ^ (h >> 32)) & mMask;
+	}
+
+	void grow(void)
+	{
+		std::vector< LiveTransaction > old(mSlots.size()*2);
+		old.swap(mSlots);
+		mMask = mSlots.size()-1;
+		for (auto &t:old)
+		{
+			if ( t.mUnspentCount )
+			{
+				uint64_t slot = getHome(t.mTxidPrefix);
+				while ( mSlots[size_t(slot)].mUnspentCount )
+				{
+					slot = (slot+1) & mMask;
+				}
+				mSlots[size_t(slot)] = t;
+			}
+		}
+	}
+
+	std::vector< LiveTransaction >	mSlots;
+	uint64_t						mMask{0};
+	uint64_t						mCount{0};
+};
+
+// One transaction of the txid index while it is sorted
+class TxidEntry
+{
+public:
+	bool operator<(const TxidEntry &other) const
+	{
+		int c = memcmp(mTxid,other.mTxid,32);
+		return c < 0 || (c == 0 && mTransaction < other.mTransaction);
+	}
+
+	uint8_t		mTxid[32];
+	uint32_t	mTransaction;
+};
+
+// A sorted run of the txid index, read sequentially through a small buffer while the runs are merged
+class TxidRun
+{
+public:
+	const TxidEntry &getHead(void) const
+	{
+		return mBuffer[mNext];
+	}
+
+	// Move to the next entry; false at the end of the run
+	bool advance(void)
+	{
+		mNext++;
+		return mNext < mBuffer.size() || fill();
+	}
+
+	bool fill(void)
+	{
+		mBuffer.resize(TXID_MERGE_BUFFER_SIZE);
+		mBuffer.resize(size_t(fi_fread(&mBuffer[0],sizeof(TxidEntry),mBuffer.size(),mFile)));
+		mNext = 0;
+		return !mBuffer.empty();
+	}
+
+	FILE_INTERFACE				*mFile{nullptr};
+	std::vector< TxidEntry >	mBuffer;
+	size_t						mNext{0};
+};
+
+class UtxoWriterImpl : public UtxoWriter
+{
+public:
+	UtxoWriterImpl(const blocks::Blocks *blocks,const char *dataDir) : mBlocks(blocks), mDataDir(dataDir)
+	{
+	}
+
+	virtual ~UtxoWriterImpl(void)
+	{
+		closeColumns();
+	}
+
+	virtual void setVerifyMerkle(bool state) final
+	{
+		mVerifyMerkle = state;
+	}
+
+	virtual bool write(const char *utxoDir,uint32_t blockCount,UtxoWriterStats &stats) final
+	{
+		stats = UtxoWriterStats();
+		for (uint32_t i=0; i<CF_LAST; i++)
+		{
+			std::string fileName = getUtxoFileName(utxoDir,gColumnFileNames[i]);
+			mColumns[i] = fi_fopen(fileName.c_str(),i == CF_TRANSACTIONS ? "w+b" : "wb",nullptr,0,false); // the transactions are read back when txid prefixes collide
+			if ( mColumns[i] == nullptr )
+			{
+				printf("Failed to open '%s' for write access.\n", fileName.c_str());
+				closeColumns();
+				return false;
+			}
+		}
+		mReader.setVerifyMerkle(mVerifyMerkle);
+		mLive.clear();
+		mSpent.clear();
+		mWrittenTransactions = 0;
+		UtxoFileHeader header;
+		memcpy(header.mId,UTXO_SET_ID,8);
+		std::vector< HeightRecord > heights;
+		Timer t;
+		bool ok = true;
+		for (uint32_t i=0; i<blockCount && ok; i++)
+		{
+			const BlockChain::Block *b = mReader.read(mBlocks,mDataDir.c_str(),i);
+			if ( b == nullptr )
+			{
+				printf("Unable to read block %d; the set stops before it.\n", i);
+				ok = false;
+				break;
+			}
+			HeightRecord r;
+			r.mFirstTransaction = header.mTransactionCount;
+			r.mFirstOutput = header.mOutputCount;
+			r.mFirstInput = header.mInputCount;
+			heights.push_back(r);
+			addBlock(*b,header,stats);
+			ok = writeColumns();
+			stats.mRawBytes += mReader.getData().size();
+			if ( mLive.size() > stats.mPeakLiveTransactions )
+			{
+				stats.mPeakLiveTransactions = mLive.size();
+			}
+			if ( (i % 10000) == 0 && i )
+			{
+				printf("Added %s of %s blocks; %s transactions with unspent outputs.\n", formatNumber(int32_t(i)), formatNumber(int32_t(blockCount)), formatNumber(int32_t(mLive.size())));
+			}
+		}
+		ok = closeColumns() && ok;
+		mLive.clear();
+		if ( ok )
+		{
+			header.mBlockCount = uint32_t(heights.size());
+			HeightRecord end;
+			end.mFirstTransaction = header.mTransactionCount;
+			end.mFirstOutput = header.mOutputCount;
+			end.mFirstInput = header.mInputCount;
+			heights.push_back(end);
+			std::vector< uint8_t > index(sizeof(header) + heights.size()*sizeof(HeightRecord));
+			memcpy(&index[0],&header,sizeof(header));
+			memcpy(&index[sizeof(header)],&heights[0],heights.size()*sizeof(HeightRecord));
+			ok = writeTxidIndex(utxoDir,header.mTransactionCount) &&
+				 writeFile(utxoDir,"UtxoSpent.dat",mSpent.empty() ? nullptr : &mSpent[0],mSpent.size()*sizeof(uint64_t)) &&
+				 writeFile(utxoDir,"Utxo.idx",&index[0],index.size());
+		}
+		if ( ok )
+		{
+			uint64_t spentCount = 0;
+			for (auto &w:mSpent)
+			{
+				spentCount += popCount(w);
+			}
+			stats.mBlockCount = header.mBlockCount;
+			stats.mTransactionCount = header.mTransactionCount;
+			stats.mOutputCount = header.mOutputCount;
+			stats.mInputCount = header.mInputCount;
+			stats.mUnspentCount = header.mOutputCount - spentCount;
+			stats.mLargeValueCount = header.mLargeValueCount;
+		}
+		mSpent.clear();
+		printf("Wrote the outputs of %s blocks in %0.3f seconds.\n", formatNumber(int32_t(heights.size() ? heights.size()-1 : 0)), t.getElapsedSeconds());
+		return ok;
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	static uint32_t popCount(uint64_t v)
+	{
+		uint32_t ret = 0;
+		while ( v )
+		{
+			v &= v-1;
+			ret++;
+		}
+		return ret;
+	}
+
+	// Numbers the outputs of the block and resolves its inputs, transaction by transaction, so an output spent
+	// later in the same block is found
+	void addBlock(const BlockChain::Block &b,UtxoFileHeader &header,UtxoWriterStats &stats)
+	{
+		static const uint8_t emptyScript = 0;
+		mScripts.clear();
+		mScriptLengths.clear();
+		for (uint32_t i=0; i<b.totalOutputCount; i++)
+		{
+			const uint8_t *script = b.outputs.getScript(i);
+			mScripts.push_back(script ? script : &emptyScript);
+			mScriptLengths.push_back(b.outputs.scriptLengths[i]);
+		}
+		mScriptHashes.resize(size_t(b.totalOutputCount)*32);
+		if ( b.totalOutputCount )
+		{
+			computeSHA256Batch(b.totalOutputCount,&mScripts[0],&mScriptLengths[0],reinterpret_cast< uint8_t (*)[32]>(&mScriptHashes[0]));
+		}
+		mSpent.resize(size_t((header.mOutputCount + b.totalOutputCount + 63) / 64),0);
+
+		for (uint32_t i=0; i<b.transactionCount; i++)
+		{
+			const BlockChain::BlockTransaction &t = b.transactions[i];
+			uint32_t inputCount = i ? t.inputCount : 0; // the coinbase spends nothing
+			for (uint32_t j=0; j<inputCount; j++)
+			{
+				const BlockChain::BlockInput &input = t.inputs[j];
+				uint64_t found = findLive(input.transactionHash,false);
+				uint64_t spent = UTXO_NO_OUTPUT;
+				if ( found != LIVE_TABLE_NO_SLOT && input.transactionIndex < mLive[found].mOutputCount )
+				{
+					spent = mLive[found].mFirstOutput + input.transactionIndex;
+					uint64_t &word = mSpent[size_t(spent >> 6)];
+					uint64_t bit = uint64_t(1) << (spent & 63);
+					if ( word & bit )
+					{
+						spent = UTXO_NO_OUTPUT; // already spent; a block this parser accepted spends it twice
+					}
+					else
+					{
+						word |= bit;
+						if ( --mLive[found].mUnspentCount == 0 )
+						{
+							mLive.erase(found);
+						}
+					}
+				}
+				if ( spent == UTXO_NO_OUTPUT )
+				{
+					stats.mUnresolvedInputs++;
+				}
+				mInputs.push_back(spent);
+			}
+			header.mInputCount += inputCount;
+
+			TransactionRecord tr;
+			memcpy(tr.mTxid,t.transactionHash,32);
+			tr.mFirstOutput = header.mOutputCount;
+			mTransactions.push_back(tr);
+			header.mTransactionCount++;
+
+			LiveTransaction live = LiveTransaction();
+			memcpy(&live.mTxidPrefix,t.transactionHash,sizeof(live.mTxidPrefix));
+			live.mFirstOutput = header.mOutputCount;
+			live.mOutputCount = t.outputCount;
+			live.mTransaction = uint32_t(header.mTransactionCount-1);
+			for (uint32_t j=0; j<t.outputCount; j++)
+			{
+				uint64_t value = t.outputs.values[j];
+				if ( value < LARGE_VALUE_FLAG )
+				{
+					mValues.push_back(uint32_t(value));
+				}
+				else
+				{
+					mValues.push_back(LARGE_VALUE_FLAG | uint32_t(header.mLargeValueCount));
+					mLargeValues.push_back(value);
+					header.mLargeValueCount++;
+				}
+				uint64_t outputNumber = header.mOutputCount + j;
+				const uint8_t *script = t.outputs.getScript(j);
+				if ( script && script[0] == OP_RETURN )
+				{
+					mSpent[size_t(outputNumber >> 6)] |= uint64_t(1) << (outputNumber & 63); // unspendable
+				}
+				else
+				{
+					live.mUnspentCount++;
+				}
+			}
+			header.mOutputCount += t.outputCount;
+			uint64_t found = findLive(t.transactionHash,true);
+			if ( found != LIVE_TABLE_NO_SLOT )
+			{
+				// The txid is reused (BIP30), so the outputs of the earlier transaction can no longer be spent
+				stats.mDuplicateTransactions++;
+				spendOverwritten(mLive[found],header);
+				mLive.erase(found);
+			}
+			if ( live.mUnspentCount )
+			{
+				mLive.insert(live);
+			}
+		}
+		for (uint32_t i=0; i<b.totalOutputCount; i++)
+		{
+			uint64_t scriptId;
+			memcpy(&scriptId,&mScriptHashes[size_t(i)*32],sizeof(scriptId));
+			mScriptIds.push_back(scriptId);
+		}
+	}
+
+	// The live table slot of this txid; LIVE_TABLE_NO_SLOT if it has no unspent outputs.  Only the prefixes are
+	// compared unless two live transactions shared one, or 'verify' is set, when the full txids are read back from
+	// the transaction column.  An input spending a live transaction is always resolved exactly; 'verify' is needed
+	// where the txid may not be live at all.
+	uint64_t findLive(const uint8_t *txid,bool verify)
+	{
+		uint64_t prefix;
+		memcpy(&prefix,txid,sizeof(prefix));
+		for (uint64_t slot=mLive.find(prefix,LIVE_TABLE_NO_SLOT); slot!=LIVE_TABLE_NO_SLOT; slot=mLive.find(prefix,slot))
+		{
+			const LiveTransaction &t = mLive[slot];
+			if ( (!verify && !t.mSharedPrefix) || isTxid(t.mTransaction,txid) )
+			{
+				return slot;
+			}
+		}
+		return LIVE_TABLE_NO_SLOT;
+	}
+
+	// True if this transaction number has this txid; the block being added is still in memory
+	bool isTxid(uint32_t transaction,const uint8_t *txid)
+	{
+		TransactionRecord r;
+		if ( transaction >= mWrittenTransactions )
+		{
+			r = mTransactions[size_t(transaction - mWrittenTransactions)];
+		}
+		else
+		{
+			FILE_INTERFACE *f = mColumns[CF_TRANSACTIONS];
+			fi_fseek(f,uint64_t(transaction)*sizeof(TransactionRecord),SEEK_SET);
+			bool ok = fi_fread(&r,sizeof(r),1,f) == 1;
+			fi_fseek(f,0,SEEK_END);
+			if ( !ok )
+			{
+				return false;
+			}
+		}
+		return memcmp(r.mTxid,txid,32) == 0;
+	}
+
+	// Spend the outputs of a transaction whose txid has been reused, in the block being added.  They are written to
+	// the inputs column as if spent by an input, so moving the set across this height sets and clears them as well.
+	void spendOverwritten(const LiveTransaction &overwritten,UtxoFileHeader &header)
+	{
+		for (uint32_t i=0; i<overwritten.mOutputCount; i++)
+		{
+			uint64_t outputNumber = overwritten.mFirstOutput + i;
+			uint64_t &word = mSpent[size_t(outputNumber >> 6)];
+			uint64_t bit = uint64_t(1) << (outputNumber & 63);
+			if ( (word & bit) == 0 )
+			{
+				word |= bit;
+				mInputs.push_back(outputNumber);
+				header.mInputCount++;
+			}
+		}
+	}
+
+	template < typename T > bool writeColumn(ColumnFile c,std::vector< T > &column)
+	{
+		bool ok = column.empty() || fi_fwrite(&column[0],sizeof(T)*column.size(),1,mColumns[c]) == 1;
+		column.clear();
+		return ok;
+	}
+
+	bool writeColumns(void)
+	{
+		mWrittenTransactions += mTransactions.size();
+		bool ok = writeColumn(CF_TRANSACTIONS,mTransactions);
+		ok = writeColumn(CF_VALUES,mValues) && ok;
+		ok = writeColumn(CF_LARGE_VALUES,mLargeValues) && ok;
+		ok = writeColumn(CF_SCRIPT_IDS,mScriptIds) && ok;
+		ok = writeColumn(CF_INPUTS,mInputs) && ok;
+		if ( !ok )
+		{
+			printf("Failed to write the output columns.\n");
+		}
+		return ok;
+	}
+
+	bool closeColumns(void)
+	{
+		bool ok = true;
+		for (uint32_t i=0; i<CF_LAST; i++)
+		{
+			if ( mColumns[i] )
+			{
+				ok = fi_fclose(mColumns[i]) == 0 && ok;
+				mColumns[i] = nullptr;
+			}
+		}
+		return ok;
+	}
+
+	// Sorts the transaction numbers by txid.  The transaction column is read sequentially in runs which are sorted
+	// in memory; when there is more than one, the runs are written beside the set and merged.  Reused txids are
+	// ordered by transaction number so a lookup can take the latest.
+	bool writeTxidIndex(const char *utxoDir,uint64_t transactionCount)
+	{
+		if ( transactionCount > 0xFFFFFFFF )
+		{
+			printf("Too many transactions for the txid index.\n");
+			return false;
+		}
+		std::string fileName = getUtxoFileName(utxoDir,gColumnFileNames[CF_TRANSACTIONS]);
+		FILE_INTERFACE *input = fi_fopen(fileName.c_str(),"rb",nullptr,0,false);
+		if ( input == nullptr )
+		{
+			printf("Failed to open '%s' for read access.\n", fileName.c_str());
+			return false;
+		}
+		std::vector< TransactionRecord > records;
+		std::vector< TxidEntry > entries;
+		std::vector< std::string > runNames;
+		bool ok = true;
+		for (uint64_t first=0; first<transactionCount && ok; first+=TXID_RUN_SIZE)
+		{
+			uint32_t count = uint32_t(std::min< uint64_t >(TXID_RUN_SIZE,transactionCount-first));
+			records.resize(count);
+			entries.resize(count);
+			ok = fi_fread(&records[0],sizeof(TransactionRecord)*count,1,input) == 1;
+			for (uint32_t i=0; i<count; i++)
+			{
+				memcpy(entries[i].mTxid,records[i].mTxid,32);
+				entries[i].mTransaction = uint32_t(first+i);
+			}
+			std::sort(entries.begin(),entries.end());
+			if ( ok && count < transactionCount )
+			{
+				char name[64];
+				snprintf(name,sizeof(name),"UtxoTxids.run%u",uint32_t(runNames.size()));
+				runNames.push_back(name);
+				ok = writeFile(utxoDir,name,&entries[0],count*sizeof(TxidEntry));
+			}
+		}
+		fi_fclose(input);
+		if ( !ok )
+		{
+			printf("Failed to sort the txid index.\n");
+		}
+		else if ( runNames.empty() )
+		{
+			std::vector< uint32_t > order(entries.size());
+			for (size_t i=0; i<entries.size(); i++)
+			{
+				order[i] = entries[i].mTransaction;
+			}
+			ok = writeFile(utxoDir,"UtxoTxids.dat",order.empty() ? nullptr : &order[0],order.size()*sizeof(uint32_t));
+		}
+		else
+		{
+			std::vector< TxidEntry >().swap(entries);
+			std::vector< TransactionRecord >().swap(records);
+			ok = mergeTxidRuns(utxoDir,runNames);
+		}
+		for (auto &i:runNames)
+		{
+			fi_deleteFile(getUtxoFileName(utxoDir,i.c_str()).c_str());
+		}
+		return ok;
+	}
+
+	// Merges the sorted runs of the txid index into UtxoTxids.dat
+	bool mergeTxidRuns(const char *utxoDir,const std::vector< std::string > &runNames)
+	{
+		std::vector< TxidRun > runs(runNames.size());
+		auto later = [&runs](uint32_t a,uint32_t b)
+		{
+			return runs[b].getHead() < runs[a].getHead();
+		};
+		std::priority_queue< uint32_t, std::vector< uint32_t >, decltype(later) > heads(later);
+		bool ok = true;
+		for (uint32_t i=0; i<uint32_t(runs.size()) && ok; i++)
+		{
+			std::string fileName = getUtxoFileName(utxoDir,runNames[i].c_str());
+			runs[i].mFile = fi_fopen(fileName.c_str(),"rb",nullptr,0,false);
+			ok = runs[i].mFile != nullptr && runs[i].fill();
+			if ( ok )
+			{
+				heads.push(i);
+			}
+		}
+		std::string fileName = getUtxoFileName(utxoDir,"UtxoTxids.dat");
+		FILE_INTERFACE *output = ok ? fi_fopen(fileName.c_str(),"wb",nullptr,0,false) : nullptr;
+		if ( output )
+		{
+			std::vector< uint32_t > order;
+			order.reserve(TXID_MERGE_BUFFER_SIZE);
+			while ( !heads.empty() && ok )
+			{
+				uint32_t r = heads.top();
+				heads.pop();
+				order.push_back(runs[r].getHead().mTransaction);
+				if ( runs[r].advance() )
+				{
+					heads.push(r);
+				}
+				if ( order.size() == TXID_MERGE_BUFFER_SIZE || heads.empty() )
+				{
+					ok = fi_fwrite(&order[0],sizeof(uint32_t)*order.size(),1,output) == 1;
+					order.clear();
+				}
+			}
+			ok = fi_fclose(output) == 0 && ok;
+		}
+		else
+		{
+			ok = false;
+		}
+		for (auto &r:runs)
+		{
+			if ( r.mFile )
+			{
+				fi_fclose(r.mFile);
+			}
+		}
+		if ( !ok )
+		{
+			printf("Failed to merge the txid index into '%s'.\n", fileName.c_str());
+		}
+		return ok;
+	}
+
+	const blocks::Blocks				*mBlocks{nullptr};
+	std::string							mDataDir;
+	bool								mVerifyMerkle{false};
+	blockfile::BlockReader				mReader;
+	FILE_INTERFACE						*mColumns[CF_LAST]{};
+	LiveTable							mLive;
+	uint64_t							mWrittenTransactions{0};	// Transactions in the column file; the rest are in mTransactions
+	std::vector< uint64_t >				mSpent;				// One bit per output numbered so far
+	// The columns of the block being added
+	std::vector< TransactionRecord >	mTransactions;
+	std::vector< uint32_t >				mValues;
+	std::vector< uint64_t >				mLargeValues;
+	std::vector< uint64_t >				mScriptIds;
+	std::vector< uint64_t >				mInputs;
+	std::vector< const uint8_t *>		mScripts;			// The output scripts of the block, hashed together
+	std::vector< uint32_t >				mScriptLengths;
+	std::vector< uint8_t >				mScriptHashes;		// 32 bytes per output script
+};
+
+class UtxoSetImpl : public UtxoSet
+{
+public:
+	virtual ~UtxoSetImpl(void)
+	{
+	}
+
+	bool open(const char *utxoDir)
+	{
+		if ( !mIndex.open(utxoDir,"Utxo.idx",sizeof(UtxoFileHeader)) )
+		{
+			return false;
+		}
+		memcpy(&mHeader,mIndex.mData,sizeof(mHeader));
+		if ( memcmp(mHeader.mId,UTXO_SET_ID,8) != 0 || mHeader.mVersion != UTXO_SET_VERSION ||
+			 fi_getFileLength(mIndex.mFile) < sizeof(UtxoFileHeader) + (uint64_t(mHeader.mBlockCount)+1)*sizeof(HeightRecord) )
+		{
+			printf("'%s' does not hold a valid UTXO set.\n", utxoDir);
+			return false;
+		}
+		mHeights = reinterpret_cast< const HeightRecord *>(mIndex.mData + sizeof(UtxoFileHeader));
+		uint64_t spentLength = ((mHeader.mOutputCount+63)/64)*sizeof(uint64_t);
+		if ( !mColumns[CF_TRANSACTIONS].open(utxoDir,gColumnFileNames[CF_TRANSACTIONS],mHeader.mTransactionCount*sizeof(TransactionRecord)) ||
+			 !mColumns[CF_VALUES].open(utxoDir,gColumnFileNames[CF_VALUES],mHeader.mOutputCount*sizeof(uint32_t)) ||
+			 !mColumns[CF_LARGE_VALUES].open(utxoDir,gColumnFileNames[CF_LARGE_VALUES],mHeader.mLargeValueCount*sizeof(uint64_t)) ||
+			 !mColumns[CF_SCRIPT_IDS].open(utxoDir,gColumnFileNames[CF_SCRIPT_IDS],mHeader.mOutputCount*sizeof(uint64_t)) ||
+			 !mColumns[CF_INPUTS].open(utxoDir,gColumnFileNames[CF_INPUTS],mHeader.mInputCount*sizeof(uint64_t)) ||
+			 !mTxidFile.open(utxoDir,"UtxoTxids.dat",mHeader.mTransactionCount*sizeof(uint32_t)) ||
+			 !mSpentFile.open(utxoDir,"UtxoSpent.dat",spentLength) )
+		{
+			return false;
+		}
+		mTransactions = reinterpret_cast< const TransactionRecord *>(mColumns[CF_TRANSACTIONS].mData);
+		mValues = reinterpret_cast< const uint32_t *>(mColumns[CF_VALUES].mData);
+		mLargeValues = reinterpret_cast< const uint64_t *>(mColumns[CF_LARGE_VALUES].mData);
+		mScriptIds = reinterpret_cast< const uint64_t *>(mColumns[CF_SCRIPT_IDS].mData);
+		mInputs = reinterpret_cast< const uint64_t *>(mColumns[CF_INPUTS].mData);
+		mTxids = reinterpret_cast< const uint32_t *>(mTxidFile.mData);
+		mSpent.resize(size_t(spentLength/sizeof(uint64_t)));
+		if ( spentLength )
+		{
+			memcpy(&mSpent[0],mSpentFile.mData,size_t(spentLength));
+		}
+		mHeight = mHeader.mBlockCount;
+		return true;
+	}
+
+	virtual uint32_t getBlockCount(void) const final
+	{
+		return mHeader.mBlockCount;
+	}
+
+	virtual uint64_t getTransactionCount(void) const final
+	{
+		return mHeader.mTransactionCount;
+	}
+
+	virtual uint64_t getOutputCount(void) const final
+	{
+		return mHeader.mOutputCount;
+	}
+
+	virtual uint32_t getHeight(void) const final
+	{
+		return mHeight;
+	}
+
+	virtual bool setHeight(uint32_t height) final
+	{
+		if ( height > mHeader.mBlockCount )
+		{
+			return false;
+		}
+		uint64_t target = mHeights[height].mFirstInput;
+		uint64_t current = mHeights[mHeight].mFirstInput;
+		uint64_t fromCurrent = target > current ? target - current : current - target;
+		if ( mHeader.mInputCount - target < fromCurrent )
+		{
+			if ( !mSpent.empty() )
+			{
+				memcpy(&mSpent[0],mSpentFile.mData,mSpent.size()*sizeof(uint64_t));
+			}
+			current = mHeader.mInputCount;
+		}
+		// Each output is spent by one input at most, so replaying an input sets or clears its bit alone
+		if ( target > current )
+		{
+			for (uint64_t i=current; i<target; i++)
+			{
+				uint64_t n = mInputs[i];
+				if ( n != UTXO_NO_OUTPUT )
+				{
+					mSpent[size_t(n >> 6)] |= uint64_t(1) << (n & 63);
+				}
+			}
+		}
+		else
+		{
+			for (uint64_t i=target; i<current; i++)
+			{
+				uint64_t n = mInputs[i];
+				if ( n != UTXO_NO_OUTPUT )
+				{
+					mSpent[size_t(n >> 6)] &= ~(uint64_t(1) << (n & 63));
+				}
+			}
+		}
+		mHeight = height;
+		return true;
+	}
+
+	virtual uint64_t findOutput(const uint8_t txid[32],uint32_t outputIndex) const final
+	{
+		uint64_t firstOutput;
+		uint32_t blockHeight;
+		uint32_t outputCount = findTransaction(txid,firstOutput,blockHeight);
+		return outputIndex < outputCount ? firstOutput + outputIndex : UTXO_NO_OUTPUT;
+	}
+
+	virtual uint32_t findTransaction(const uint8_t txid[32],uint64_t &firstOutput,uint32_t &blockHeight) const final
+	{
+		// The last entry with this txid; the latest transaction to use it
+		uint64_t lo = 0;
+		uint64_t hi = mHeader.mTransactionCount;
+		while ( lo < hi )
+		{
+			uint64_t mid = (lo + hi) / 2;
+			if ( memcmp(mTransactions[mTxids[mid]].mTxid,txid,32) <= 0 )
+			{
+				lo = mid+1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		if ( lo == 0 || memcmp(mTransactions[mTxids[lo-1]].mTxid,txid,32) != 0 )
+		{
+			return 0;
+		}
+		uint64_t t = mTxids[lo-1];
+		firstOutput = mTransactions[t].mFirstOutput;
+		blockHeight = getTransactionHeight(t);
+		return getTransactionOutputCount(t);
+	}
+
+	virtual bool getOutPoint(uint64_t outputNumber,uint8_t txid[32],uint32_t &outputIndex,uint32_t &blockHeight) const final
+	{
+		if ( outputNumber >= mHeader.mOutputCount )
+		{
+			return false;
+		}
+		// The last transaction whose first output is at or before this one
+		uint64_t lo = 0;
+		uint64_t hi = mHeader.mTransactionCount;
+		while ( lo < hi )
+		{
+			uint64_t mid = (lo + hi) / 2;
+			if ( mTransactions[mid].mFirstOutput <= outputNumber )
+			{
+				lo = mid+1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		const TransactionRecord &r = mTransactions[lo-1];
+		memcpy(txid,r.mTxid,32);
+		outputIndex = uint32_t(outputNumber - r.mFirstOutput);
+		blockHeight = getTransactionHeight(lo-1);
+		return true;
+	}
+
+	virtual bool isUnspent(uint64_t outputNumber) const final
+	{
+		return outputNumber < mHeights[mHeight].mFirstOutput && (mSpent[size_t(outputNumber >> 6)] & (uint64_t(1) << (outputNumber & 63))) == 0;
+	}
+
+	virtual uint64_t getValue(uint64_t outputNumber) const final
+	{
+		uint32_t v = mValues[outputNumber];
+		return (v & LARGE_VALUE_FLAG) ? mLargeValues[v & ~LARGE_VALUE_FLAG] : v;
+	}
+
+	virtual uint64_t getScriptId(uint64_t outputNumber) const final
+	{
+		return mScriptIds[outputNumber];
+	}
+
+	virtual void getBalances(uint32_t threadCount,uint32_t count,const uint64_t *scriptIds,UtxoBalance *balances,std::vector< uint64_t > *unspentOutputs) const final
+	{
+		class ScanWorker
+		{
+		public:
+			std::vector< UtxoBalance >				mBalances;
+			std::vector< std::vector< uint64_t > >	mUnspent;
+		};
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		std::vector< ScanWorker > workers(pool->getThreadCount()+1);
+		for (auto &w:workers)
+		{
+			w.mBalances.resize(count);
+			w.mUnspent.resize(unspentOutputs ? count : 0);
+		}
+		uint64_t outputCount = mHeights[mHeight].mFirstOutput;
+		pool->parallelFor(uint32_t((outputCount + SCAN_GRAIN_SIZE-1) / SCAN_GRAIN_SIZE),1,[this,outputCount,count,scriptIds,unspentOutputs,&workers](uint32_t begin,uint32_t end,uint32_t workerIndex)
+		{
+			ScanWorker &w = workers[workerIndex];
+			uint64_t last = uint64_t(end)*SCAN_GRAIN_SIZE;
+			if ( last > outputCount )
+			{
+				last = outputCount;
+			}
+			for (uint64_t n=uint64_t(begin)*SCAN_GRAIN_SIZE; n<last; n++)
+			{
+				uint64_t id = mScriptIds[n];
+				for (uint32_t i=0; i<count; i++)
+				{
+					if ( id == scriptIds[i] )
+					{
+						UtxoBalance &b = w.mBalances[i];
+						uint64_t value = getValue(n);
+						b.mReceivedCount++;
+						b.mReceivedValue += value;
+						if ( isUnspent(n) )
+						{
+							b.mUnspentCount++;
+							b.mUnspentValue += value;
+							if ( unspentOutputs )
+							{
+								w.mUnspent[i].push_back(n);
+							}
+						}
+					}
+				}
+			}
+		});
+		pool->release();
+		for (uint32_t i=0; i<count; i++)
+		{
+			balances[i] = UtxoBalance();
+			if ( unspentOutputs )
+			{
+				unspentOutputs[i].clear();
+			}
+			for (auto &w:workers)
+			{
+				addBalance(balances[i],w.mBalances[i]);
+				if ( unspentOutputs )
+				{
+					unspentOutputs[i].insert(unspentOutputs[i].end(),w.mUnspent[i].begin(),w.mUnspent[i].end());
+				}
+			}
+			if ( unspentOutputs )
+			{
+				std::sort(unspentOutputs[i].begin(),unspentOutputs[i].end());
+			}
+		}
+	}
+
+	virtual void getTotals(uint32_t threadCount,UtxoBalance &totals) const final
+	{
+		threadpool::ThreadPool *pool = threadpool::ThreadPool::createForCaller(threadCount);
+		std::vector< UtxoBalance > workers(pool->getThreadCount()+1);
+		uint64_t outputCount = mHeights[mHeight].mFirstOutput;
+		pool->parallelFor(uint32_t((outputCount + SCAN_GRAIN_SIZE-1) / SCAN_GRAIN_SIZE),1,[this,outputCount,&workers](uint32_t begin,uint32_t end,uint32_t workerIndex)
+		{
+			UtxoBalance &b = workers[workerIndex];
+			uint64_t last = uint64_t(end)*SCAN_GRAIN_SIZE;
+			if ( last > outputCount )
+			{
+				last = outputCount;
+			}
+			for (uint64_t n=uint64_t(begin)*SCAN_GRAIN_SIZE; n<last; n++)
+			{
+				uint64_t value = getValue(n);
+				b.mReceivedCount++;
+				b.mReceivedValue += value;
+				if ( (mSpent[size_t(n >> 6)] & (uint64_t(1) << (n & 63))) == 0 )
+				{
+					b.mUnspentCount++;
+					b.mUnspentValue += value;
+				}
+			}
+		});
+		pool->release();
+		totals = UtxoBalance();
+		for (auto &w:workers)
+		{
+			addBalance(totals,w);
+		}
+	}
+
+	virtual void release(void) final
+	{
+		delete this;
+	}
+
+private:
+	static void addBalance(UtxoBalance &dest,const UtxoBalance &b)
+	{
+		dest.mReceivedCount += b.mReceivedCount;
+		dest.mReceivedValue += b.mReceivedValue;
+		dest.mUnspentCount += b.mUnspentCount;
+		dest.mUnspentValue += b.mUnspentValue;
+	}
+
+	uint32_t getTransactionOutputCount(uint64_t t) const
+	{
+		uint64_t end = t+1 < mHeader.mTransactionCount ? mTransactions[t+1].mFirstOutput : mHeader.mOutputCount;
+		return uint32_t(end - mTransactions[t].mFirstOutput);
+	}
+
+	// The last height whose first transaction is at or before this one
+	uint32_t getTransactionHeight(uint64_t t) const
+	{
+		uint32_t lo = 0;
+		uint32_t hi = mHeader.mBlockCount;
+		while ( lo < hi )
+		{
+			uint32_t mid = (lo + hi) / 2;
+			if ( mHeights[mid].mFirstTransaction <= t )
+			{
+				lo = mid+1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		return lo ? lo-1 : 0;
+	}
+
+	UtxoFileHeader				mHeader;
+	MappedFile					mIndex;
+	MappedFile					mColumns[CF_LAST];
+	MappedFile					mTxidFile;
+	MappedFile					mSpentFile;			// The spent bits at the last height
+	const HeightRecord			*mHeights{nullptr};
+	const TransactionRecord		*mTransactions{nullptr};
+	const uint32_t				*mValues{nullptr};
+	const uint64_t				*mLargeValues{nullptr};
+	const uint64_t				*mScriptIds{nullptr};
+	const uint64_t				*mInputs{nullptr};
+	const uint32_t				*mTxids{nullptr};		// Transaction numbers sorted by txid
+	uint32_t					mHeight{0};
+	std::vector< uint64_t >		mSpent;				// The spent bits at mHeight
+};
+
+UtxoWriter *UtxoWriter::create(const blocks::Blocks *blocks,const char *dataDir)
+{
+	auto ret = new UtxoWriterImpl(blocks,dataDir);
+	return static_cast< UtxoWriter *>(ret);
+}
+
+UtxoSet *UtxoSet::create(const char *utxoDir)
+{
+	auto ret = new UtxoSetImpl;
+	if ( !ret->open(utxoDir) )
+	{
+		delete ret;
+		ret = nullptr;
+	}
+	return static_cast< UtxoSet *>(ret);
+}
+
+}
@@ -4,6 +4,7 @@
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/document.h"
 #include "CBlockIndex.h"
+#include "HexCodec.h"
 #include "ScopedTime.h"
 
 #include <assert.h>
@@ -153,48 +154,20 @@ public:
 		delete this;
 	}
 
-	char getHex(uint8_t c)
-	{
-		char ret;
-		if ( c < 10 )
-		{
-			ret = '0'+c;
-		}
-		else
-		{
-			ret = 'A'+(c-10);
-		}
-		return ret;
-	}
-
+	// Both are sized once and filled in place by the hex codec
 	std::string getHex(const std::string &str)
 	{
-		std::string ret;
-		for (auto &i:str)
-		{
-			uint8_t c = uint8_t(i);
-			char h1 = getHex(c>>4);
-			char h2 = getHex(c&15);
-			ret.push_back(h1);
-			ret.push_back(h2);
-		}
+		std::string ret(str.size()*2+1,0);
+		encodeHex(reinterpret_cast< const uint8_t *>(str.data()),uint32_t(str.size()),&ret[0],true);
+		ret.resize(str.size()*2);
 		return ret;
 	}
 
 	std::string getHexReverse(const std::string &str)
 	{
-		std::string ret;
-		size_t count = str.size();
-		size_t index = count-1;
-		for (size_t i=0; i<(count-1); i++)
-		{
-			uint8_t c = uint8_t(str[index]);
-			char h1 = getHex(c>>4);
-			char h2 = getHex(c&15);
-			ret.push_back(h1);
-			ret.push_back(h2);
-			index--;
-		}
+		std::string ret(str.size()*2+1,0);
+		encodeHexReverse(reinterpret_cast< const uint8_t *>(str.data()),uint32_t(str.size()),&ret[0],true);
+		ret.resize(str.size()*2);
 		return ret;
 	}
 
@@ -1,10 +1,13 @@
 #include "logging.h"
 #include "BitcoinAddress.h"
+#include "HexCodec.h"
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <mutex>
+#include <atomic>
 
 #ifdef _MSC_VER
 #include <conio.h>
@@ -14,8 +17,9 @@
 #define MAXNUMERIC 32  // JWR  support up to 16 32 character long numeric formated strings
 #define MAXFNUM    16
 
-static	char  gFormat[MAXNUMERIC*MAXFNUM];
-static int32_t    gIndex = 0;
+// The ring of result buffers is per thread; so blocks decoded on worker threads can format numbers safely
+static thread_local char  gFormat[MAXNUMERIC*MAXFNUM];
+static thread_local int32_t    gIndex = 0;
 
 // This is a helper method for getting a formatted numeric output (basically having the commas which makes them easier to read)
 const char * formatNumber(int32_t number) // JWR  format this integer into a fancy comma delimited string
@@ -53,13 +57,24 @@ const char * formatNumber(int32_t number) // JWR  format this integer into a fan
 }
 
 
+// gmtime returns a pointer to shared storage; so use the reentrant version of it
+static void getUTC(uint32_t timeStamp, struct tm &gtm)
+{
+	time_t t(timeStamp);
+#ifdef _MSC_VER
+	gmtime_s(&gtm, &t);
+#else
+	gmtime_r(&t, &gtm);
+#endif
+}
+
 const char *getDateString(uint32_t _t)
 {
-	time_t t(_t);
-	static char scratch[1024];
-	struct tm *gtm = gmtime(&t);
+	static thread_local char scratch[1024];
+	struct tm gtm;
+	getUTC(_t, gtm);
 	//	strftime(scratch, 1024, "%m, %d, %Y", gtm);
-	sprintf(scratch, "%4d-%02d-%02d", gtm->tm_year + 1900, gtm->tm_mon + 1, gtm->tm_mday);
+	snprintf(scratch, sizeof(scratch), "%4d-%02d-%02d", gtm.tm_year + 1900, gtm.tm_mon + 1, gtm.tm_mday);
 	return scratch;
 }
 
@@ -69,24 +84,37 @@ const char *getTimeString(uint32_t timeStamp)
 	{
 		return "NEVER";
 	}
-	static char scratch[1024];
-	time_t t(timeStamp);
-	struct tm *gtm = gmtime(&t);
-	strftime(scratch, 1024, "%m/%d/%Y %H:%M:%S", gtm);
+	static thread_local char scratch[1024];
+	struct tm gtm;
+	getUTC(timeStamp, gtm);
+	strftime(scratch, 1024, "%m/%d/%Y %H:%M:%S", &gtm);
 	return scratch;
 }
 
 
 
 // This is a helper method to handle logging the output from scanning the blockchain
+static std::atomic< bool > gLogEnabled(true);
+
+void setLogEnabled(bool state)
+{
+	gLogEnabled = state;
+}
+
 void logMessage(const char *fmt, ...)
 {
+	if (!gLogEnabled)
+	{
+		return;
+	}
 	static FILE		*gLogFile = NULL;
+	static std::mutex	gLogMutex;	// blocks may be parsed on more than one thread; each message is written out whole
 	char wbuff[2048];
 	va_list arg;
 	va_start(arg, fmt);
-	vsprintf(wbuff, fmt, arg);
+	vsnprintf(wbuff, sizeof(wbuff), fmt, arg);
 	va_end(arg);
+	std::lock_guard<std::mutex> lock(gLogMutex);
 	printf("%s", wbuff);
 	if (gLogFile == NULL)
 	{
@@ -104,10 +132,9 @@ void printReverseHash(const uint8_t hash[32])
 {
 	if (hash)
 	{
-		for (uint32_t i = 0; i < 32; i++)
-		{
-			logMessage("%02x", hash[31 - i]);
-		}
+		// Format the whole hash first so it can't be interleaved with output from another thread
+		char scratch[HEX_HASH_SIZE];
+		logMessage("%s", encodeHexReverse(hash, 32, scratch));
 	}
 	else
 	{
@@ -124,7 +151,7 @@ void logBitcoinAddress(const uint8_t address[25])
 
 const char *getBitcoinAddressAscii(const uint8_t address[25])
 {
-	static char temp[512];
+	static thread_local char temp[512];
 	bitcoinAddressToAscii(address, temp, 512);
 	return temp;
 }